@@ -0,0 +1,396 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="AudioOutput.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "AudioOutput.h"
+#include "DrumTrace.h"
+#include <string.h>
+
+#ifdef _WIN32
+#pragma comment(lib, "winmm.lib")
+#endif
+
+/// <summary>
+/// Accumulates the cost of one mixed block
+/// </summary>
+static void RecordRender(std::atomic<uint64_t>& blocks, std::atomic<int64_t>& sumUs, std::atomic<int64_t>& maxUs, int64_t durationUs)
+{
+    blocks.fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(durationUs, std::memory_order_relaxed);
+    if (durationUs > maxUs.load(std::memory_order_relaxed))
+    {
+        maxUs.store(durationUs, std::memory_order_relaxed);
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="realTime">pace blocks at the sample rate instead of as fast as possible</param>
+CNullAudioOutput::CNullAudioOutput(bool realTime) :
+    m_pMixer(NULL),
+    m_bRealTime(realTime),
+    m_running(false),
+    m_blocks(0),
+    m_renderSumUs(0),
+    m_renderMaxUs(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CNullAudioOutput::~CNullAudioOutput()
+{
+    Stop();
+}
+
+/// <summary>
+/// Starts pulling audio from the mixer
+/// </summary>
+/// <param name="pMixer">initialized mixer with its samples loaded</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CNullAudioOutput::Start(CDrumMixer* pMixer)
+{
+    if (NULL == pMixer)
+    {
+        return E_POINTER;
+    }
+
+    CNullAudioOutput::Stop();
+
+    m_pMixer = pMixer;
+    m_running = true;
+    m_thread = std::thread(&CNullAudioOutput::ThreadProc, this);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stops the output thread
+/// </summary>
+void CNullAudioOutput::Stop()
+{
+    m_running = false;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+/// <summary>
+/// Reads the block timing counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void CNullAudioOutput::GetRenderStats(AudioRenderStats* pStats) const
+{
+    if (NULL == pStats)
+    {
+        return;
+    }
+
+    pStats->blocks = m_blocks.load(std::memory_order_relaxed);
+    pStats->renderSumUs = m_renderSumUs.load(std::memory_order_relaxed);
+    pStats->renderMaxUs = m_renderMaxUs.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Receives each mixed block on the output thread
+/// </summary>
+/// <param name="pFrames">interleaved 16 bit stereo frames</param>
+/// <param name="frameCount">number of frames</param>
+void CNullAudioOutput::OnBlock(const short* pFrames, int frameCount)
+{
+    (void)pFrames;
+    (void)frameCount;
+}
+
+/// <summary>
+/// Output thread body
+/// </summary>
+void CNullAudioOutput::ThreadProc()
+{
+    CDrumTraceThreadScope trace;
+    int blockFrames = m_pMixer->BlockFrames();
+    int sampleRate = m_pMixer->SampleRate();
+    std::vector<short> buffer(blockFrames * 2);
+
+    int64_t startUs = DrumGetTimeMicroseconds();
+    uint64_t framesOut = 0;
+
+    while (m_running)
+    {
+        // The block is "heard" at its deadline when paced, or right away otherwise
+        int64_t blockTimeUs = startUs + static_cast<int64_t>(framesOut * 1000000 / sampleRate);
+        int64_t nowUs = DrumGetTimeMicroseconds();
+        if (m_bRealTime)
+        {
+            DrumSleepMicroseconds(blockTimeUs - nowUs);
+        }
+        else
+        {
+            blockTimeUs = nowUs;
+        }
+
+        int64_t renderStartUs = DrumGetTimeMicroseconds();
+        m_pMixer->Render(&buffer[0], blockFrames, blockTimeUs);
+        RecordRender(m_blocks, m_renderSumUs, m_renderMaxUs, DrumGetTimeMicroseconds() - renderStartUs);
+
+        OnBlock(&buffer[0], blockFrames);
+        framesOut += blockFrames;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="szPath">wave file to create</param>
+/// <param name="realTime">pace blocks at the sample rate instead of as fast as possible</param>
+CWaveFileAudioOutput::CWaveFileAudioOutput(const char* szPath, bool realTime) :
+    CNullAudioOutput(realTime),
+    m_path(szPath, szPath + strlen(szPath) + 1)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CWaveFileAudioOutput::~CWaveFileAudioOutput()
+{
+    // Stop here, the base destructor can no longer reach OnBlock or the writer
+    Stop();
+}
+
+/// <summary>
+/// Creates the file and starts pulling audio from the mixer
+/// </summary>
+/// <param name="pMixer">initialized mixer with its samples loaded</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CWaveFileAudioOutput::Start(CDrumMixer* pMixer)
+{
+    if (NULL == pMixer)
+    {
+        return E_POINTER;
+    }
+
+    CNullAudioOutput::Stop();
+
+    HRESULT hr = m_writer.Open(&m_path[0], pMixer->SampleRate());
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    return CNullAudioOutput::Start(pMixer);
+}
+
+/// <summary>
+/// Stops the output thread and finalizes the file
+/// </summary>
+void CWaveFileAudioOutput::Stop()
+{
+    CNullAudioOutput::Stop();
+    m_writer.Close();
+}
+
+/// <summary>
+/// Appends each mixed block to the file
+/// </summary>
+/// <param name="pFrames">interleaved 16 bit stereo frames</param>
+/// <param name="frameCount">number of frames</param>
+void CWaveFileAudioOutput::OnBlock(const short* pFrames, int frameCount)
+{
+    m_writer.Write(pFrames, frameCount);
+}
+
+#ifdef _WIN32
+
+/// <summary>
+/// Constructor
+/// </summary>
+CWaveOutAudioOutput::CWaveOutAudioOutput() :
+    m_pMixer(NULL),
+    m_hWaveOut(NULL),
+    m_hBufferDoneEvent(NULL),
+    m_running(false),
+    m_blocks(0),
+    m_renderSumUs(0),
+    m_renderMaxUs(0)
+{
+    ZeroMemory(m_headers, sizeof(m_headers));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CWaveOutAudioOutput::~CWaveOutAudioOutput()
+{
+    Stop();
+}
+
+/// <summary>
+/// Opens the default device and starts pulling audio from the mixer
+/// </summary>
+/// <param name="pMixer">initialized mixer with its samples loaded</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CWaveOutAudioOutput::Start(CDrumMixer* pMixer)
+{
+    if (NULL == pMixer)
+    {
+        return E_POINTER;
+    }
+
+    Stop();
+
+    m_pMixer = pMixer;
+
+    WAVEFORMATEX format = {0};
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = 2;
+    format.nSamplesPerSec = pMixer->SampleRate();
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = format.nChannels * format.wBitsPerSample / 8;
+    format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+
+    // Auto-reset event signalled by the driver each time a buffer finishes
+    m_hBufferDoneEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (NULL == m_hBufferDoneEvent)
+    {
+        return E_FAIL;
+    }
+
+    MMRESULT result = waveOutOpen(&m_hWaveOut, WAVE_MAPPER, &format,
+        reinterpret_cast<DWORD_PTR>(m_hBufferDoneEvent), 0, CALLBACK_EVENT);
+    if (MMSYSERR_NOERROR != result)
+    {
+        m_hWaveOut = NULL;
+        CloseHandle(m_hBufferDoneEvent);
+        m_hBufferDoneEvent = NULL;
+        return E_FAIL;
+    }
+
+    int blockFrames = pMixer->BlockFrames();
+    for (int i = 0; i < cBufferCount; ++i)
+    {
+        m_buffers[i].assign(blockFrames * 2, 0);
+        ZeroMemory(&m_headers[i], sizeof(WAVEHDR));
+        m_headers[i].lpData = reinterpret_cast<LPSTR>(&m_buffers[i][0]);
+        m_headers[i].dwBufferLength = blockFrames * 2 * sizeof(short);
+        waveOutPrepareHeader(m_hWaveOut, &m_headers[i], sizeof(WAVEHDR));
+    }
+
+    m_running = true;
+    m_thread = std::thread(&CWaveOutAudioOutput::ThreadProc, this);
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stops the output thread and closes the device
+/// </summary>
+void CWaveOutAudioOutput::Stop()
+{
+    m_running = false;
+    if (m_hBufferDoneEvent)
+    {
+        SetEvent(m_hBufferDoneEvent);
+    }
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    if (m_hWaveOut)
+    {
+        waveOutReset(m_hWaveOut);
+        for (int i = 0; i < cBufferCount; ++i)
+        {
+            waveOutUnprepareHeader(m_hWaveOut, &m_headers[i], sizeof(WAVEHDR));
+        }
+
+        waveOutClose(m_hWaveOut);
+        m_hWaveOut = NULL;
+    }
+
+    if (m_hBufferDoneEvent)
+    {
+        CloseHandle(m_hBufferDoneEvent);
+        m_hBufferDoneEvent = NULL;
+    }
+}
+
+/// <summary>
+/// Reads the block timing counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void CWaveOutAudioOutput::GetRenderStats(AudioRenderStats* pStats) const
+{
+    if (NULL == pStats)
+    {
+        return;
+    }
+
+    pStats->blocks = m_blocks.load(std::memory_order_relaxed);
+    pStats->renderSumUs = m_renderSumUs.load(std::memory_order_relaxed);
+    pStats->renderMaxUs = m_renderMaxUs.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Mixes into a buffer and hands it to the device
+/// </summary>
+/// <param name="index">buffer to fill</param>
+/// <param name="queuedBuffers">buffers already queued ahead of this one</param>
+void CWaveOutAudioOutput::SubmitBuffer(int index, int queuedBuffers)
+{
+    int blockFrames = m_pMixer->BlockFrames();
+    int64_t startUs = DrumGetTimeMicroseconds();
+
+    // This block plays once everything already queued has drained
+    int64_t blockTimeUs = startUs + static_cast<int64_t>(queuedBuffers) * blockFrames * 1000000 / m_pMixer->SampleRate();
+    m_pMixer->Render(&m_buffers[index][0], blockFrames, blockTimeUs);
+    RecordRender(m_blocks, m_renderSumUs, m_renderMaxUs, DrumGetTimeMicroseconds() - startUs);
+
+    waveOutWrite(m_hWaveOut, &m_headers[index], sizeof(WAVEHDR));
+}
+
+/// <summary>
+/// Output thread body
+/// </summary>
+void CWaveOutAudioOutput::ThreadProc()
+{
+    CDrumTraceThreadScope trace;
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+    for (int i = 0; i < cBufferCount; ++i)
+    {
+        SubmitBuffer(i, i);
+    }
+
+    while (m_running)
+    {
+        WaitForSingleObject(m_hBufferDoneEvent, INFINITE);
+
+        // Refill every buffer the device has finished with
+        int queued = 0;
+        for (int i = 0; i < cBufferCount; ++i)
+        {
+            if (0 == (m_headers[i].dwFlags & WHDR_DONE))
+            {
+                ++queued;
+            }
+        }
+
+        for (int i = 0; i < cBufferCount && m_running; ++i)
+        {
+            if (m_headers[i].dwFlags & WHDR_DONE)
+            {
+                SubmitBuffer(i, queued++);
+            }
+        }
+    }
+}
+
+#endif
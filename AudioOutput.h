@@ -0,0 +1,179 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="AudioOutput.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumMixer.h"
+#include "WaveFile.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Timing of the blocks pulled from the mixer by an output
+/// </summary>
+struct AudioRenderStats
+{
+    uint64_t                blocks;
+    int64_t                 renderSumUs;
+    int64_t                 renderMaxUs;
+};
+
+/// <summary>
+/// Destination for mixed audio. An output owns the thread that pulls blocks from the mixer.
+/// </summary>
+class IAudioOutput
+{
+public:
+    virtual ~IAudioOutput() {}
+
+    /// <summary>
+    /// Starts pulling audio from the mixer
+    /// </summary>
+    /// <param name="pMixer">initialized mixer with its samples loaded</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT         Start(CDrumMixer* pMixer) = 0;
+
+    /// <summary>
+    /// Stops the output thread and releases the device
+    /// </summary>
+    virtual void            Stop() = 0;
+
+    /// <summary>
+    /// Reads the block timing counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    virtual void            GetRenderStats(AudioRenderStats* pStats) const = 0;
+};
+
+/// <summary>
+/// Output that discards the mixed audio. Used to measure mixing cost and
+/// trigger-to-output latency on machines without a sound card.
+/// </summary>
+class CNullAudioOutput : public IAudioOutput
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="realTime">pace blocks at the sample rate instead of as fast as possible</param>
+    explicit CNullAudioOutput(bool realTime);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~CNullAudioOutput();
+
+    virtual HRESULT         Start(CDrumMixer* pMixer);
+    virtual void            Stop();
+    virtual void            GetRenderStats(AudioRenderStats* pStats) const;
+
+protected:
+    /// <summary>
+    /// Receives each mixed block on the output thread
+    /// </summary>
+    /// <param name="pFrames">interleaved 16 bit stereo frames</param>
+    /// <param name="frameCount">number of frames</param>
+    virtual void            OnBlock(const short* pFrames, int frameCount);
+
+private:
+    CDrumMixer*             m_pMixer;
+    bool                    m_bRealTime;
+    std::thread             m_thread;
+    std::atomic<bool>       m_running;
+
+    std::atomic<uint64_t>   m_blocks;
+    std::atomic<int64_t>    m_renderSumUs;
+    std::atomic<int64_t>    m_renderMaxUs;
+
+    /// <summary>
+    /// Output thread body
+    /// </summary>
+    void                    ThreadProc();
+};
+
+/// <summary>
+/// Output that writes the mixed audio to a wave file
+/// </summary>
+class CWaveFileAudioOutput : public CNullAudioOutput
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="szPath">wave file to create</param>
+    /// <param name="realTime">pace blocks at the sample rate instead of as fast as possible</param>
+    CWaveFileAudioOutput(const char* szPath, bool realTime);
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~CWaveFileAudioOutput();
+
+    virtual HRESULT         Start(CDrumMixer* pMixer);
+    virtual void            Stop();
+
+protected:
+    virtual void            OnBlock(const short* pFrames, int frameCount);
+
+private:
+    std::vector<char>       m_path;
+    CWaveFileWriter         m_writer;
+};
+
+#ifdef _WIN32
+
+#include <mmsystem.h>
+
+/// <summary>
+/// Output to the default waveOut device using a short queue of small buffers
+/// </summary>
+class CWaveOutAudioOutput : public IAudioOutput
+{
+    static const int        cBufferCount = 3;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CWaveOutAudioOutput();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~CWaveOutAudioOutput();
+
+    virtual HRESULT         Start(CDrumMixer* pMixer);
+    virtual void            Stop();
+    virtual void            GetRenderStats(AudioRenderStats* pStats) const;
+
+private:
+    CDrumMixer*             m_pMixer;
+    HWAVEOUT                m_hWaveOut;
+    HANDLE                  m_hBufferDoneEvent;
+    WAVEHDR                 m_headers[cBufferCount];
+    std::vector<short>      m_buffers[cBufferCount];
+    std::thread             m_thread;
+    std::atomic<bool>       m_running;
+
+    std::atomic<uint64_t>   m_blocks;
+    std::atomic<int64_t>    m_renderSumUs;
+    std::atomic<int64_t>    m_renderMaxUs;
+
+    /// <summary>
+    /// Output thread body
+    /// </summary>
+    void                    ThreadProc();
+
+    /// <summary>
+    /// Mixes into a buffer and hands it to the device
+    /// </summary>
+    /// <param name="index">buffer to fill</param>
+    /// <param name="queuedBuffers">buffers already queued ahead of this one</param>
+    void                    SubmitBuffer(int index, int queuedBuffers);
+};
+
+#endif
@@ -0,0 +1,127 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="BoundedQueue.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/// <summary>
+/// Fixed capacity lock-free queue. Any number of threads may push and pop; every
+/// slot carries a sequence number so neither side ever takes a lock or allocates.
+/// </summary>
+/// <typeparam name="T">copyable element type</typeparam>
+/// <typeparam name="Capacity">number of slots, must be a power of two</typeparam>
+template <typename T, uint32_t Capacity>
+class CBoundedQueue
+{
+    static_assert(Capacity >= 2 && 0 == (Capacity & (Capacity - 1)), "Capacity must be a power of two");
+
+    static const uint32_t   cMask = Capacity - 1;
+    static const int        cCacheLine = 64;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CBoundedQueue()
+    {
+        for (uint32_t i = 0; i < Capacity; ++i)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        m_enqueuePos.store(0, std::memory_order_relaxed);
+        m_dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// Adds an element to the tail of the queue
+    /// </summary>
+    /// <param name="item">element to add</param>
+    /// <returns>false if the queue was full</returns>
+    bool Push(const T& item)
+    {
+        uint32_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = m_slots[pos & cMask];
+            uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(sequence - pos);
+
+            if (0 == diff)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.item = item;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Removes the element at the head of the queue
+    /// </summary>
+    /// <param name="item">receives the element</param>
+    /// <returns>false if the queue was empty</returns>
+    bool Pop(T& item)
+    {
+        uint32_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = m_slots[pos & cMask];
+            uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(sequence - (pos + 1));
+
+            if (0 == diff)
+            {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    item = slot.item;
+                    slot.sequence.store(pos + Capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint32_t>   sequence;
+        T                       item;
+    };
+
+    // Producers and consumers work on separate cache lines
+    Slot                    m_slots[Capacity];
+    char                    m_pad0[cCacheLine];
+    std::atomic<uint32_t>   m_enqueuePos;
+    char                    m_pad1[cCacheLine];
+    std::atomic<uint32_t>   m_dequeuePos;
+    char                    m_pad2[cCacheLine];
+
+    // Not copyable
+    CBoundedQueue(const CBoundedQueue&);
+    CBoundedQueue& operator=(const CBoundedQueue&);
+};
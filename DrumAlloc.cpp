@@ -0,0 +1,104 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumAlloc.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumAlloc.h"
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+// Constant initialized, so it counts allocations made before main as well
+static std::atomic<uint64_t> g_AllocationCount(0);
+
+/// <summary>
+/// Gets the number of times operator new has been called since the program started
+/// </summary>
+uint64_t DrumAllocationCount()
+{
+    return g_AllocationCount.load(std::memory_order_relaxed);
+}
+
+#if DRUM_ALLOC_COUNT_ENABLED
+
+/// <summary>
+/// Counts an allocation and makes it, with the retries the standard asks of operator new
+/// </summary>
+/// <param name="size">bytes to allocate</param>
+/// <returns>the memory, or NULL if there is none and no new handler to make some</returns>
+static void* CountedAllocate(size_t size)
+{
+    g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    size = (0 == size) ? 1 : size;
+    for (;;)
+    {
+        void* p = malloc(size);
+        if (NULL != p)
+        {
+            return p;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (NULL == handler)
+        {
+            return NULL;
+        }
+        handler();
+    }
+}
+
+void* operator new(size_t size)
+{
+    void* p = CountedAllocate(size);
+    if (NULL == p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+    try
+    {
+        return CountedAllocate(size);
+    }
+    catch (...)
+    {
+        return NULL;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t& nothrow) throw()
+{
+    return operator new(size, nothrow);
+}
+
+void operator delete(void* p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+    free(p);
+}
+
+#endif
@@ -0,0 +1,56 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumAlloc.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Counts heap allocations, so a bench can check that the frame path makes none once
+// it has warmed up. DrumAlloc.cpp replaces the global operator new and delete of the
+// whole program it is built into, whether or not anything asks for the count: every
+// new, on any thread, adds one to a relaxed atomic counter before it calls malloc.
+// It is therefore built into DrumBench alone and kept out of the engine library.
+// Built with DRUM_ALLOC_COUNT_ENABLED defined to 0, the operators are left alone and
+// the count stays at zero.
+
+#pragma once
+
+#include "DrumPlatform.h"
+
+#ifndef DRUM_ALLOC_COUNT_ENABLED
+#define DRUM_ALLOC_COUNT_ENABLED 1
+#endif
+
+/// <summary>
+/// Gets the number of times operator new has been called since the program started
+/// </summary>
+uint64_t DrumAllocationCount();
+
+/// <summary>
+/// Counts the allocations made from its construction on, by every thread
+/// </summary>
+class CDrumAllocationGuard
+{
+public:
+    /// <summary>
+    /// Constructor, starts counting
+    /// </summary>
+    CDrumAllocationGuard() : m_start(DrumAllocationCount()) { }
+
+    /// <summary>
+    /// Starts counting again from now
+    /// </summary>
+    void                    Reset() { m_start = DrumAllocationCount(); }
+
+    /// <summary>
+    /// Gets the number of allocations since the guard was constructed or reset
+    /// </summary>
+    uint64_t                Allocations() const { return DrumAllocationCount() - m_start; }
+
+    /// <summary>
+    /// Tells whether allocations are counted at all in this build
+    /// </summary>
+    static bool             IsCounting() { return 0 != DRUM_ALLOC_COUNT_ENABLED; }
+
+private:
+    uint64_t                m_start;
+};
@@ -0,0 +1,4235 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumBench.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Microbenchmarks for the drum engine. Runs without a sensor or a window.
+// Usage: DrumBench [benchmark...]   (no arguments runs everything)
+
+#include "DrumPlatform.h"
+#include "AudioOutput.h"
+#include "DrumAlloc.h"
+#include "DrumBounce.h"
+#include "DrumDrawList.h"
+#include "DrumEngine.h"
+#include "DrumMixer.h"
+#include "DrumPlayer.h"
+#include "DrumRasterizer.h"
+#include "DrumReactor.h"
+#include "DrumSnapshot.h"
+#include "DrumTrace.h"
+#include "DrumTriggerSinks.h"
+#include "DrumZones.h"
+#include "HitPredictor.h"
+#include "LatencyTracer.h"
+#include "MidiFile.h"
+#include "MidiOutput.h"
+#include "OnsetGate.h"
+#include "PedalDetector.h"
+#include "SkeletonFilter.h"
+#include "SkeletonFusion.h"
+#include "SkeletonGenerator.h"
+#include "SkeletonProjection.h"
+#include "SkeletonSources.h"
+#include "SkeletonStream.h"
+#include "StrikeDetector.h"
+#include "TripleBuffer.h"
+#include "WaveFile.h"
+#include "WorkerGroup.h"
+#include "ZoneCalibrator.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+static uint32_t g_RandomState = 0x12345678;
+
+/// <summary>
+/// Small deterministic generator so runs are comparable
+/// </summary>
+static float RandomFloat(float lo, float hi)
+{
+    g_RandomState ^= g_RandomState << 13;
+    g_RandomState ^= g_RandomState >> 17;
+    g_RandomState ^= g_RandomState << 5;
+    return lo + (hi - lo) * ((g_RandomState & 0xFFFFFF) / 16777216.0f);
+}
+
+/// <summary>
+/// Counts the set bits of a zone mask
+/// </summary>
+static int CountHits(const DrumZoneMask& mask)
+{
+    int count = 0;
+    for (int i = 0; i < cDrumZoneMaskWords; ++i)
+    {
+        uint64_t bits = mask.bits[i];
+        while (bits)
+        {
+            bits &= bits - 1;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Fills a table with random zones around the shoulder
+/// </summary>
+static void CreateRandomZones(CDrumZoneTable& table, int count)
+{
+    table.Clear();
+    for (int i = 0; i < count; ++i)
+    {
+        DrumZone zone;
+        zone.xMin = RandomFloat(-0.9f, 0.9f);
+        zone.xMax = zone.xMin + RandomFloat(0.07f, 0.4f);
+        zone.yMin = RandomFloat(-0.2f, 0.7f);
+        zone.yMax = zone.yMin + RandomFloat(0.07f, 0.3f);
+        zone.depthMin = RandomFloat(-0.2f, 0.35f);
+        zone.depthMax = zone.depthMin + RandomFloat(0.06f, 0.4f);
+        zone.hands = 1 + (i % 3);
+        zone.motion = i % 3;
+        zone.sampleId = i;
+        table.AddZone(zone);
+    }
+}
+
+/// <summary>
+/// Per-frame cost of testing both hands against kits of growing size, scanning
+/// every zone against looking up the spatial index
+/// </summary>
+/// <returns>0 on success, 1 if the indexed, SIMD and scalar results differ</returns>
+static int BenchZoneHitTest()
+{
+    static const int zoneCounts[] = { 6, 12, 24, 48, 64, 96, 192, 384, 512 };
+    static const int inputCount = 1024;
+
+    std::vector<DrumHandInput> inputs(inputCount * 2);
+    for (int i = 0; i < inputCount * 2; ++i)
+    {
+        inputs[i].x = RandomFloat(-1.1f, 1.25f);
+        inputs[i].y = RandomFloat(-0.3f, 1.1f);
+        inputs[i].depth = RandomFloat(-0.2f, 0.65f);
+        inputs[i].motion = i % 4;
+    }
+
+    printf("zone hit test (both hands, per frame)\n");
+    printf("%8s %12s %12s %12s %12s %10s\n", "zones", "indexed ns", "simd ns", "scalar ns", "candidates", "hits/frame");
+
+    int failures = 0;
+    CDrumZoneTable table;
+    CDrumZoneTable linear;
+    for (size_t c = 0; c < sizeof(zoneCounts) / sizeof(zoneCounts[0]); ++c)
+    {
+        CreateRandomZones(table, zoneCounts[c]);
+        linear = table;
+        table.BuildIndex();
+        if (table.IsIndexed() != (zoneCounts[c] >= cDrumZoneIndexMinCount))
+        {
+            ++failures;
+        }
+
+        // Every path must agree before their timings mean anything, the
+        // margins of the occupancy test included
+        DrumZoneHits indexed, simd, scalar;
+        int64_t candidates = 0;
+        for (int i = 0; i < inputCount; ++i)
+        {
+            const DrumHandInput& left = inputs[i * 2];
+            const DrumHandInput& right = inputs[i * 2 + 1];
+            table.HitTest(left, right, &indexed);
+            table.HitTestLinear(left, right, &simd);
+            table.HitTestScalar(left, right, &scalar);
+            if (0 != memcmp(&indexed, &simd, sizeof(simd)) || 0 != memcmp(&simd, &scalar, sizeof(simd)))
+            {
+                ++failures;
+            }
+
+            table.OccupancyTest(left, right, 0.035f, 0.0125f, &indexed);
+            linear.OccupancyTest(left, right, 0.035f, 0.0125f, &simd);
+            if (0 != memcmp(&indexed, &simd, sizeof(simd)))
+            {
+                ++failures;
+            }
+
+            // Kits too small to index scan every zone
+            const uint16_t* pZones;
+            candidates += table.IsIndexed() ?
+                table.Candidates(left.x, left.y, &pZones) + table.Candidates(right.x, right.y, &pZones) :
+                2 * zoneCounts[c];
+        }
+
+        int frames = 4000000 / (zoneCounts[c] + 16);
+        int hits = 0;
+
+        int64_t startUs = DrumGetTimeMicroseconds();
+        for (int i = 0; i < frames; ++i)
+        {
+            int input = (i & (inputCount - 1)) * 2;
+            table.HitTest(inputs[input], inputs[input + 1], &indexed);
+            hits += CountHits(indexed.left) + CountHits(indexed.right);
+        }
+        int64_t indexedUs = DrumGetTimeMicroseconds() - startUs;
+
+        startUs = DrumGetTimeMicroseconds();
+        for (int i = 0; i < frames; ++i)
+        {
+            int input = (i & (inputCount - 1)) * 2;
+            table.HitTestLinear(inputs[input], inputs[input + 1], &simd);
+            hits += CountHits(simd.left) + CountHits(simd.right);
+        }
+        int64_t simdUs = DrumGetTimeMicroseconds() - startUs;
+
+        startUs = DrumGetTimeMicroseconds();
+        for (int i = 0; i < frames; ++i)
+        {
+            int input = (i & (inputCount - 1)) * 2;
+            table.HitTestScalar(inputs[input], inputs[input + 1], &scalar);
+            hits += CountHits(scalar.left) + CountHits(scalar.right);
+        }
+        int64_t scalarUs = DrumGetTimeMicroseconds() - startUs;
+
+        printf("%8d %12.1f %12.1f %12.1f %12.2f %10.2f\n", zoneCounts[c],
+            indexedUs * 1000.0 / frames, simdUs * 1000.0 / frames, scalarUs * 1000.0 / frames,
+            candidates / (2.0 * inputCount), hits / (6.0 * frames));
+    }
+
+    if (failures)
+    {
+        printf("FAILED: %d frames where indexed, SIMD and scalar hit tests differ\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Builds a hand input for the onset scenarios
+/// </summary>
+static DrumHandInput MakeHand(float x, float y, float depth, uint32_t motion)
+{
+    DrumHandInput hand;
+    hand.x = x;
+    hand.y = y;
+    hand.depth = depth;
+    hand.motion = motion;
+    return hand;
+}
+
+/// <summary>
+/// Checks the retrigger state machine on scripted strokes, then times a frame of it
+/// </summary>
+/// <returns>0 on success, 1 if a scenario produced the wrong onsets</returns>
+static int BenchOnsetGate()
+{
+    static const int64_t frameUs = 33333;
+
+    CDrumZoneTable table;
+    CreateDefaultDrumZones(table);
+
+    COnsetGate gate;
+    DrumOnset onsets[cDrumZoneMaxCount];
+    const DrumHandInput idle = MakeHand(-1.1f, -0.3f, 0.0f, DRUM_MOTION_NONE);
+    int failures = 0;
+    int64_t timeUs = 0;
+
+    // A hand that lands on the snare and keeps drifting down plays once
+    int played = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        DrumHandInput left = MakeHand(0.0f, 0.54f + i * 0.004f, 0.125f, DRUM_MOTION_DOWN);
+        played += gate.Process(table, left, idle, 0.5f, 0.0f, timeUs, onsets, cDrumZoneMaxCount);
+        timeUs += frameUs;
+    }
+    failures += (1 != played);
+
+    // Rising above the strike point re-arms without leaving the zone
+    DrumHandInput left = MakeHand(0.0f, 0.47f, 0.125f, DRUM_MOTION_NONE);
+    played = gate.Process(table, left, idle, 0.0f, 0.0f, timeUs, onsets, cDrumZoneMaxCount);
+    timeUs += frameUs;
+    left = MakeHand(0.0f, 0.54f, 0.125f, DRUM_MOTION_DOWN);
+    played += gate.Process(table, left, idle, 0.5f, 0.0f, timeUs, onsets, cDrumZoneMaxCount);
+    failures += (1 != played);
+
+    // Leaving re-arms, but not sooner than the minimum re-strike interval
+    timeUs += 20000;
+    left = MakeHand(0.71f, 0.54f, 0.125f, DRUM_MOTION_NONE);
+    played = gate.Process(table, left, idle, 0.0f, 0.0f, timeUs, onsets, cDrumZoneMaxCount);
+    timeUs += 20000;
+    left = MakeHand(0.0f, 0.54f, 0.125f, DRUM_MOTION_DOWN);
+    played += gate.Process(table, left, idle, 0.5f, 0.0f, timeUs, onsets, cDrumZoneMaxCount);
+    failures += (0 != played);
+
+    // Both hands on the high tom together make one flammed onset at the louder velocity
+    timeUs += frameUs;
+    left = MakeHand(0.36f, 0.46f, 0.4f, DRUM_MOTION_DOWN);
+    DrumHandInput right = MakeHand(0.39f, 0.46f, 0.4f, DRUM_MOTION_DOWN);
+    played = gate.Process(table, left, right, 0.3f, 0.8f, timeUs, onsets, cDrumZoneMaxCount);
+    failures += (1 != played || !onsets[0].flam || DRUM_HAND_BOTH != onsets[0].hands || 0.8f != onsets[0].hitVelocity);
+
+    // A second hand arriving inside the flam window joins the first hand's onset
+    gate.Reset();
+    played = gate.Process(table, left, idle, 0.3f, 0.0f, timeUs, onsets, cDrumZoneMaxCount);
+    played += gate.Process(table, idle, right, 0.0f, 0.8f, timeUs + 5000, onsets, cDrumZoneMaxCount);
+    failures += (1 != played);
+
+    // Cost of a frame that repeats a latched hit
+    static const int frames = 2000000;
+    left = MakeHand(0.0f, 0.54f, 0.125f, DRUM_MOTION_DOWN);
+    played = 0;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < frames; ++i)
+    {
+        played += gate.Process(table, left, idle, 0.5f, 0.0f, timeUs + i * frameUs, onsets, cDrumZoneMaxCount);
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+
+    printf("onset gate (default kit)\n");
+    printf("%12s %10s %12s\n", "ns/frame", "onsets", "suppressed");
+    printf("%12.1f %10d %12llu\n", elapsedUs * 1000.0 / frames, played, static_cast<unsigned long long>(gate.Suppressed()));
+
+    if (failures)
+    {
+        printf("FAILED: %d onset scenarios produced the wrong onsets\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Checks that scheduled triggers start on their own frame and that cancels withdraw them
+/// </summary>
+/// <returns>number of failed checks</returns>
+static int CheckScheduledTriggers()
+{
+    static const int blockFrames = 128;
+    static const int sampleRate = 48000;
+
+    CDrumMixer mixer;
+    mixer.Initialize(sampleRate, blockFrames, 4);
+    const float click[2] = { 0.5f, 0.5f };
+    mixer.SetSample(0, click, 1);
+
+    // Frame 300 is in the third block, at offset 44
+    const int64_t startUs = 300LL * 1000000 / sampleRate + 1;
+    mixer.Schedule(0, 1.0f, startUs, 1);
+    mixer.Schedule(0, 1.0f, startUs + 1000, 2);
+    mixer.Cancel(2);
+
+    short output[blockFrames * 2 * 4];
+    for (int b = 0; b < 4; ++b)
+    {
+        mixer.Render(output + b * blockFrames * 2, blockFrames, static_cast<int64_t>(b) * blockFrames * 1000000 / sampleRate);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < blockFrames * 4; ++i)
+    {
+        bool expected = (300 == i);
+        failures += (expected != (0 != output[i * 2]));
+    }
+
+    DrumMixerStats stats;
+    mixer.GetStats(&stats);
+    failures += (1 != stats.cancelled || 0 != stats.lateCancels);
+
+    // With the queue full, cancels and chokes are lost and counted like lost hits
+    int queued = 0;
+    while (mixer.Cancel(3))
+    {
+        ++queued;
+    }
+    failures += !(!mixer.Choke(0) && !mixer.Trigger(0, 1.0f, 0));
+    mixer.GetStats(&stats);
+    failures += (0 == queued || 2 != stats.droppedControls || 1 != stats.dropped);
+
+    return failures;
+}
+
+/// <summary>
+/// Compares two frames field by field
+/// </summary>
+static bool SameSkeletonFrame(const SkeletonFrame& a, const SkeletonFrame& b)
+{
+    bool same = (a.timestampMs == b.timestampMs && a.frameNumber == b.frameNumber && a.flags == b.flags);
+    for (int i = 0; i < 4; ++i)
+    {
+        same = same && (a.floorClipPlane[i] == b.floorClipPlane[i]);
+    }
+
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        const SkeletonData& sa = a.skeletons[s];
+        const SkeletonData& sb = b.skeletons[s];
+        same = same && (sa.trackingState == sb.trackingState && sa.trackingId == sb.trackingId);
+        same = same && (sa.position.x == sb.position.x && sa.position.y == sb.position.y && sa.position.z == sb.position.z);
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            same = same && (sa.joints[j].x == sb.joints[j].x && sa.joints[j].y == sb.joints[j].y && sa.joints[j].z == sb.joints[j].z);
+            same = same && (sa.jointStates[j] == sb.jointStates[j]);
+        }
+    }
+
+    return same;
+}
+
+/// <summary>
+/// Writes bytes to a file, for recordings damaged on purpose
+/// </summary>
+static bool WriteBytes(const char* szPath, const std::vector<char>& bytes, size_t count)
+{
+    FILE* pFile = fopen(szPath, "wb");
+    if (NULL == pFile)
+    {
+        return false;
+    }
+
+    bool written = (0 == count || fwrite(&bytes[0], 1, count, pFile) == count);
+    fclose(pFile);
+    return written;
+}
+
+/// <summary>
+/// Recordings: frames recorded and mapped back in come out as they went in, paced or not,
+/// and a recording with a wrong header, never closed or cut short is refused
+/// </summary>
+static int BenchSkeletonStream()
+{
+    static const char szPath[] = "DrumBench.skel";
+    static const int frameCount = 300;
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = 2;
+    params.noise = 0.005f;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+    CSkeletonGenerator generator;
+    generator.Initialize(params, zones);
+
+    // Every field of the frame set to something, so a field lost on the way shows
+    std::vector<SkeletonFrame> frames(frameCount);
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SyntheticHit hits[2 * cSkeletonCount];
+        generator.NextFrame(&frames[f], hits, 2 * cSkeletonCount);
+        frames[f].flags = static_cast<uint32_t>(f & 3);
+        frames[f].floorClipPlane[0] = 0.01f * f;
+        frames[f].floorClipPlane[2] = -0.5f;
+    }
+
+    int failures = 0;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    CSkeletonRecorder recorder;
+    failures += FAILED(recorder.Open(szPath, cSkeletonStreamFlagSmoothed));
+    for (int f = 0; f < frameCount; ++f)
+    {
+        failures += FAILED(recorder.Write(frames[f]));
+    }
+    recorder.Close();
+    int64_t recordUs = DrumGetTimeMicroseconds() - startUs;
+
+    // The file is the header and the frames, nothing else
+    std::vector<char> bytes;
+    FILE* pFile = fopen(szPath, "rb");
+    if (NULL != pFile)
+    {
+        char buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+        {
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        }
+        fclose(pFile);
+    }
+    const size_t expectedBytes = sizeof(SkeletonStreamHeader) + frameCount * sizeof(SkeletonFrame);
+    failures += (bytes.size() != expectedBytes);
+    if (bytes.size() != expectedBytes)
+    {
+        printf("FAILED: recording is %llu bytes, expected %llu\n", static_cast<unsigned long long>(bytes.size()),
+            static_cast<unsigned long long>(expectedBytes));
+        remove(szPath);
+        return 1;
+    }
+
+    // As fast as asked for, every frame as it was recorded
+    CSkeletonReplayer replayer;
+    int replayed = 0;
+    int different = 0;
+    startUs = DrumGetTimeMicroseconds();
+    if (SUCCEEDED(replayer.Open(szPath)))
+    {
+        failures += (static_cast<uint64_t>(frameCount) != replayer.FrameCount() || cSkeletonStreamFlagSmoothed != replayer.Flags());
+        replayer.Start(0, false);
+        const SkeletonFrame* pFrame;
+        while (NULL != (pFrame = replayer.Next(0)))
+        {
+            different += (replayed >= frameCount || !SameSkeletonFrame(*pFrame, frames[replayed]));
+            ++replayed;
+        }
+        failures += (replayer.TimeUntilNextUs(0) >= 0);
+
+        // Paced, the second frame waits as long after the first as it was recorded
+        replayer.Start(0, true);
+        failures += (NULL == replayer.Next(0) || NULL != replayer.Next(0));
+        failures += (replayer.TimeUntilNextUs(0) != (frames[1].timestampMs - frames[0].timestampMs) * 1000);
+        replayer.Close();
+    }
+    int64_t replayUs = DrumGetTimeMicroseconds() - startUs;
+    failures += (frameCount != replayed || 0 != different);
+
+    // Damaged copies of the recording
+    SkeletonStreamHeader header;
+    memcpy(&header, &bytes[0], sizeof(header));
+    struct DamagedRecording
+    {
+        const char*         name;
+        size_t              bytes;
+        size_t              patchOffset;
+        uint64_t            patchValue;
+        int                 patchBytes;
+    };
+    const DamagedRecording damaged[] =
+    {
+        { "empty",              0,                                  0, 0, 0 },
+        { "header cut short",   sizeof(header) / 2,                 0, 0, 0 },
+        { "last frame cut",     bytes.size() - sizeof(SkeletonFrame) / 2, 0, 0, 0 },
+        { "frames missing",     bytes.size() - 10 * sizeof(SkeletonFrame), 0, 0, 0 },
+        { "bad magic",          bytes.size(),                       0, 'X', 1 },
+        { "bad version",        bytes.size(),                       offsetof(SkeletonStreamHeader, version), cSkeletonStreamVersion + 1, 4 },
+        { "bad frame size",     bytes.size(),                       offsetof(SkeletonStreamHeader, frameBytes), sizeof(SkeletonFrame) - 8, 4 },
+        { "never closed",       bytes.size(),                       offsetof(SkeletonStreamHeader, frameCount), 0, 8 },
+    };
+    int refused = 0;
+    const int damagedCount = static_cast<int>(sizeof(damaged) / sizeof(damaged[0]));
+    for (int d = 0; d < damagedCount; ++d)
+    {
+        std::vector<char> copy(bytes);
+        memcpy(&copy[0] + damaged[d].patchOffset, &damaged[d].patchValue, damaged[d].patchBytes);
+        if (WriteBytes(szPath, copy, damaged[d].bytes))
+        {
+            CSkeletonReplayer broken;
+            bool opened = SUCCEEDED(broken.Open(szPath));
+            refused += !opened;
+            if (opened)
+            {
+                printf("FAILED: damaged recording replayed: %s\n", damaged[d].name);
+            }
+        }
+    }
+    failures += (damagedCount != refused);
+
+    // A recording closed without frames is empty, not damaged
+    CSkeletonRecorder emptyRecorder;
+    failures += FAILED(emptyRecorder.Open(szPath, 0));
+    emptyRecorder.Close();
+    CSkeletonReplayer empty;
+    failures += (FAILED(empty.Open(szPath)) || 0 != empty.FrameCount() || NULL != empty.Next(0));
+    empty.Close();
+    remove(szPath);
+
+    printf("\nskeleton recordings (%d frames of %u bytes, %u byte header)\n", frameCount,
+        static_cast<unsigned>(sizeof(SkeletonFrame)), static_cast<unsigned>(sizeof(SkeletonStreamHeader)));
+    printf("%14s %14s %14s %14s %14s\n", "replayed", "different", "refused", "record us", "replay us");
+    printf("%14d %14d %11d/%-2d %14lld %14lld\n", replayed, different, refused, damagedCount,
+        static_cast<long long>(recordUs), static_cast<long long>(replayUs));
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, frames changed on the way or a damaged recording was replayed\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Fills sample slots with a steady level each, slot i at (i + 1) / 64, so the level
+/// of a mixed frame tells which slots are sounding
+/// </summary>
+static void SetLevelSamples(CDrumMixer& mixer, int count, int seconds)
+{
+    int frameCount = mixer.SampleRate() * seconds;
+    std::vector<float> level(static_cast<size_t>(frameCount) * 2);
+    for (int i = 0; i < count; ++i)
+    {
+        std::fill(level.begin(), level.end(), (i + 1) / 64.0f);
+        mixer.SetSample(i, &level[0], frameCount);
+    }
+}
+
+/// <summary>
+/// Mixer through its outputs: the voice limit and the order voices are stolen in, read back
+/// from a wave file; the cost of mixing a block with every voice busy; and the latency from
+/// a trigger to the block it is heard in, paced at the sample rate
+/// </summary>
+static int BenchMixer()
+{
+    static const char szPath[] = "DrumBench.wav";
+    static const int voiceCount = 4;
+    static const int latencyHits = 200;
+    static const int64_t latencyPeriodUs = 5000;
+
+    int failures = 0;
+    const int sampleRate = CDrumMixer::cDefaultSampleRate;
+    const int blockFrames = CDrumMixer::cDefaultBlockFrames;
+    const int64_t blockUs = static_cast<int64_t>(blockFrames) * 1000000 / sampleRate;
+
+    // Six hits on four voices in the first block: the two oldest are stolen, leaving slots 2 to 5
+    float firstLevel = 0.0f;
+    float laterLevel = 0.0f;
+    DrumMixerStats voiceStats;
+    {
+        CDrumMixer mixer;
+        mixer.Initialize(sampleRate, blockFrames, voiceCount);
+        SetLevelSamples(mixer, voiceCount + 2, 1);
+        for (int i = 0; i < voiceCount + 2; ++i)
+        {
+            mixer.Trigger(i, 1.0f, DrumGetTimeMicroseconds());
+        }
+
+        CWaveFileAudioOutput output(szPath, false);
+        if (SUCCEEDED(output.Start(&mixer)))
+        {
+            DrumSleepMicroseconds(20000);
+            output.Stop();
+
+            std::vector<float> stereo;
+            if (SUCCEEDED(LoadWaveFile(szPath, sampleRate, stereo)) && stereo.size() > 2000)
+            {
+                firstLevel = stereo[0];
+                laterLevel = stereo[2000];
+            }
+        }
+        remove(szPath);
+        mixer.GetStats(&voiceStats);
+    }
+    const float expectedLevel = (3 + 4 + 5 + 6) / 64.0f;
+    failures += (fabsf(firstLevel - expectedLevel) > 2.0f / 32768.0f || fabsf(laterLevel - expectedLevel) > 2.0f / 32768.0f);
+    failures += (static_cast<uint64_t>(voiceCount + 2) != voiceStats.triggers || 2 != voiceStats.stolen || 0 != voiceStats.dropped);
+
+    // Every voice busy, mixed as fast as the output can pull; stopped well before the sample ends
+    AudioRenderStats costStats;
+    {
+        static const int costSeconds = 60;
+        static const uint64_t costBlocks = 5000;
+
+        CDrumMixer mixer;
+        mixer.Initialize(sampleRate, blockFrames, CDrumMixer::cDefaultVoiceCount);
+        SetLevelSamples(mixer, 1, costSeconds);
+        for (int i = 0; i < CDrumMixer::cDefaultVoiceCount; ++i)
+        {
+            mixer.Trigger(0, 0.05f, DrumGetTimeMicroseconds());
+        }
+
+        CNullAudioOutput output(false);
+        output.Start(&mixer);
+        do
+        {
+            DrumSleepMicroseconds(1000);
+            output.GetRenderStats(&costStats);
+        } while (costStats.blocks < costBlocks);
+        output.Stop();
+        output.GetRenderStats(&costStats);
+        failures += (costStats.blocks * blockFrames >= static_cast<uint64_t>(costSeconds) * sampleRate);
+    }
+    double meanRenderUs = costStats.blocks ? static_cast<double>(costStats.renderSumUs) / costStats.blocks : 0.0;
+    failures += (0 == costStats.blocks || meanRenderUs >= blockUs);
+
+    // Hits from another thread, heard in the next paced block
+    DrumMixerStats latencyStats;
+    {
+        CDrumMixer mixer;
+        mixer.Initialize(sampleRate, blockFrames, CDrumMixer::cDefaultVoiceCount);
+        SetLevelSamples(mixer, 1, 1);
+
+        CNullAudioOutput output(true);
+        output.Start(&mixer);
+        for (int i = 0; i < latencyHits; ++i)
+        {
+            DrumSleepMicroseconds(latencyPeriodUs);
+            mixer.Trigger(0, 0.05f, DrumGetTimeMicroseconds());
+        }
+        DrumSleepMicroseconds(4 * blockUs);
+        output.Stop();
+        mixer.GetStats(&latencyStats);
+    }
+    double meanLatencyUs = latencyStats.latencyCount ? static_cast<double>(latencyStats.latencySumUs) / latencyStats.latencyCount : 0.0;
+    failures += (static_cast<uint64_t>(latencyHits) != latencyStats.latencyCount || 0 != latencyStats.dropped || 0 != latencyStats.droppedControls);
+    failures += (meanLatencyUs > 2.0 * blockUs || latencyStats.latencyMaxUs > 50000);
+
+    printf("\nmixer outputs (%d Hz, %d frame blocks of %lld us)\n", sampleRate, blockFrames, static_cast<long long>(blockUs));
+    printf("%14s %14s %14s %14s %14s\n", "voices", "hits", "stolen", "level", "expected");
+    printf("%14d %14llu %14llu %14.4f %14.4f\n", voiceCount, static_cast<unsigned long long>(voiceStats.triggers),
+        static_cast<unsigned long long>(voiceStats.stolen), firstLevel, expectedLevel);
+    printf("%14s %14s %14s %14s\n", "busy voices", "blocks", "mean us", "max us");
+    printf("%14d %14llu %14.1f %14lld\n", CDrumMixer::cDefaultVoiceCount, static_cast<unsigned long long>(costStats.blocks),
+        meanRenderUs, static_cast<long long>(costStats.renderMaxUs));
+    printf("%14s %14s %14s %14s %14s\n", "paced hits", "dropped", "cancels lost", "mean us", "max us");
+    printf("%14llu %14llu %14llu %14.0f %14lld\n", static_cast<unsigned long long>(latencyStats.latencyCount),
+        static_cast<unsigned long long>(latencyStats.dropped), static_cast<unsigned long long>(latencyStats.droppedControls),
+        meanLatencyUs, static_cast<long long>(latencyStats.latencyMaxUs));
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, wrong voices or steal order, mixing too slow or hits late\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Runs the predictor on synthetic 30 Hz drumming and compares it with the true strike times
+/// </summary>
+/// <returns>0 on success, 1 if predictions are missing or off by more than a frame</returns>
+static int BenchHitPredictor()
+{
+    static const int strokeCount = 400;
+    static const int64_t frameUs = 33333;
+    static const float shoulderY = 0.4f;
+    static const float shoulderZ = 2.0f;
+    static const float handDepth = 0.2f;
+    static const float topY = 0.2f;
+    static const float bottomY = 0.65f;
+
+    CDrumZoneTable table;
+    CreateDefaultDrumZones(table);
+
+    // Snare strike plane and the part of each stroke that reaches it
+    const DrumZone snare = table.GetZone(0);
+    const float planeY = snare.yMin + CHitPredictor::DefaultParams().strikePlane * (snare.yMax - snare.yMin);
+    const float crossPhase = acosf(1.0f - (planeY - topY) / (bottomY - topY)) / 3.14159265f;
+
+    // Stroke lengths vary so crossings fall everywhere between frames
+    std::vector<int64_t> strokeStartUs(strokeCount + 1);
+    std::vector<int64_t> crossUs(strokeCount);
+    strokeStartUs[0] = 0;
+    for (int i = 0; i < strokeCount; ++i)
+    {
+        int64_t periodUs = static_cast<int64_t>(RandomFloat(350000.0f, 600000.0f));
+        strokeStartUs[i + 1] = strokeStartUs[i] + periodUs;
+        crossUs[i] = strokeStartUs[i] + static_cast<int64_t>(crossPhase * periodUs);
+    }
+
+    CStrikeDetector detector;
+    COnsetGate gate;
+    CHitPredictor predictor;
+    DrumOnset onsets[cDrumZoneMaxCount];
+    HitAction actions[4];
+    const DrumHandInput idle = MakeHand(-1.1f, -0.3f, 0.0f, DRUM_MOTION_NONE);
+
+    int stroke = 0;
+    int64_t errorAbsSumUs = 0;
+    int scheduled = 0;
+    int heard = 0;
+    int64_t elapsedUs = 0;
+
+    for (int64_t timeUs = frameUs; timeUs < strokeStartUs[strokeCount]; timeUs += frameUs)
+    {
+        while (stroke < strokeCount - 1 && timeUs >= strokeStartUs[stroke + 1])
+        {
+            ++stroke;
+        }
+
+        // Sharp bounce at the bottom like a stick on a head, plus tracking noise
+        float phase = static_cast<float>(timeUs - strokeStartUs[stroke]) / (strokeStartUs[stroke + 1] - strokeStartUs[stroke]);
+        float y = topY + (bottomY - topY) * (1.0f - fabsf(cosf(3.14159265f * phase))) + RandomFloat(-0.005f, 0.005f);
+
+        SkeletonPoint hand;
+        hand.x = 0.05f;
+        hand.y = shoulderY - y;
+        hand.z = shoulderZ - handDepth;
+
+        int64_t startUs = DrumGetTimeMicroseconds();
+
+        const HandMotion& motion = detector.Update(hand, timeUs);
+        DrumHandInput left = MakeHand(hand.x, y, handDepth, motion.struck ? DRUM_MOTION_DOWN : DRUM_MOTION_NONE);
+
+        int onsetCount = gate.Process(table, left, idle, motion.hitVelocity, 0.0f, timeUs, onsets, cDrumZoneMaxCount);
+        int actionCount = predictor.Process(table, gate, left, idle, motion.downSpeed, 0.0f, motion.hitVelocity, 0.0f,
+                                            timeUs, onsets, &onsetCount, actions, 4);
+
+        elapsedUs += DrumGetTimeMicroseconds() - startUs;
+
+        // Compare every scheduled sample with the true crossing of the stroke it belongs to
+        for (int i = 0; i < actionCount; ++i)
+        {
+            if (HIT_ACTION_SCHEDULE == actions[i].type)
+            {
+                int64_t errorUs = actions[i].timeUs - crossUs[stroke];
+                errorAbsSumUs += (errorUs < 0) ? -errorUs : errorUs;
+                ++scheduled;
+            }
+        }
+
+        heard += onsetCount;
+    }
+
+    const HitPredictorStats& stats = predictor.Stats();
+    int frames = static_cast<int>(strokeStartUs[strokeCount] / frameUs);
+    double meanErrorUs = scheduled ? static_cast<double>(errorAbsSumUs) / scheduled : 0.0;
+
+    printf("hit predictor (%d synthetic strokes at 30 Hz)\n", strokeCount);
+    printf("%10s %10s %10s %10s %10s %10s\n", "predicted", "confirmed", "cancelled", "unconfirm", "missed", "ns/frame");
+    printf("%10llu %10llu %10llu %10llu %10llu %10.1f\n",
+        static_cast<unsigned long long>(stats.predicted), static_cast<unsigned long long>(stats.confirmed),
+        static_cast<unsigned long long>(stats.cancelled), static_cast<unsigned long long>(stats.unconfirmed),
+        static_cast<unsigned long long>(stats.missed), elapsedUs * 1000.0 / frames);
+    printf("error vs true crossing %.1f us, vs measured crossing %.1f us (max %lld), scheduled %.1f us before detection\n",
+        meanErrorUs,
+        stats.errorCount ? static_cast<double>(stats.errorAbsSumUs) / stats.errorCount : 0.0,
+        static_cast<long long>(stats.errorAbsMaxUs),
+        stats.confirmed ? static_cast<double>(stats.gainSumUs) / stats.confirmed : 0.0);
+
+    int failures = CheckScheduledTriggers();
+    if (failures)
+    {
+        printf("FAILED: scheduled triggers did not start on their frame\n");
+    }
+
+    if (stats.confirmed + stats.missed < strokeCount * 95 / 100 || stats.confirmed < strokeCount * 8 / 10 ||
+        meanErrorUs > frameUs || heard > strokeCount / 10)
+    {
+        printf("FAILED: predictions missing or more than a frame off\n");
+        ++failures;
+    }
+
+    return failures ? 1 : 0;
+}
+
+/// <summary>
+/// Runs both hands of a generated drummer through strike detectors and compares the frame each
+/// stroke was detected on, and the landing time fitted between frames, with when it really landed
+/// </summary>
+/// <returns>0 on success, 1 if the fitted times are not ten times finer than the frame period</returns>
+static int RunStrikeTiming(float tempoBpm, float noise, bool check)
+{
+    static const int64_t matchUs = 100000;
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.tempoBpm = tempoBpm;
+    params.noise = noise;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+
+    CSkeletonGenerator generator;
+    if (FAILED(generator.Initialize(params, zones)))
+    {
+        printf("FAILED: generator rejected %.0f bpm\n", tempoBpm);
+        return 1;
+    }
+
+    static const SkeletonJoint joints[2] = { SKELETON_JOINT_HAND_LEFT, SKELETON_JOINT_HAND_RIGHT };
+    CStrikeDetector detectors[2];
+    std::vector<int64_t> truth[2];
+
+    int strokes = 0;
+    double frameErrorSumUs = 0.0;
+    double fitErrorSumUs = 0.0;
+    double fitSquareSumUs = 0.0;
+    double fitErrorMaxUs = 0.0;
+    for (int f = 0; f < 30 * 120; ++f)
+    {
+        SkeletonFrame frame;
+        SyntheticHit hits[2 * cSkeletonCount * 4];
+        int hitCount = generator.NextFrame(&frame, hits, 2 * cSkeletonCount * 4);
+        for (int i = 0; i < hitCount; ++i)
+        {
+            truth[(DRUM_HAND_LEFT == hits[i].hand) ? 0 : 1].push_back(hits[i].timeUs);
+        }
+
+        int64_t timeUs = generator.TimeUs();
+        for (int h = 0; h < 2; ++h)
+        {
+            const HandMotion& motion = detectors[h].Update(frame.skeletons[0].joints[joints[h]], timeUs);
+            if (!motion.struck || truth[h].empty())
+            {
+                continue;
+            }
+
+            // The stroke is the latest one of the hand that landed near the fitted time
+            int64_t landedUs = truth[h][0];
+            for (size_t i = 0; i < truth[h].size(); ++i)
+            {
+                if (llabs(truth[h][i] - motion.strikeUs) < llabs(landedUs - motion.strikeUs))
+                {
+                    landedUs = truth[h][i];
+                }
+            }
+
+            if (llabs(timeUs - landedUs) > matchUs)
+            {
+                continue;
+            }
+
+            double fitErrorUs = static_cast<double>(motion.strikeUs - landedUs);
+            frameErrorSumUs += static_cast<double>(timeUs - landedUs);
+            fitErrorSumUs += fabs(fitErrorUs);
+            fitSquareSumUs += fitErrorUs * fitErrorUs;
+            fitErrorMaxUs = (fabs(fitErrorUs) > fitErrorMaxUs) ? fabs(fitErrorUs) : fitErrorMaxUs;
+            ++strokes;
+        }
+    }
+
+    double frameErrorMs = strokes ? frameErrorSumUs / strokes / 1000.0 : 0.0;
+    double fitErrorMs = strokes ? fitErrorSumUs / strokes / 1000.0 : 0.0;
+    double fitRmsMs = strokes ? sqrt(fitSquareSumUs / strokes) / 1000.0 : 0.0;
+    printf("%10.0f %10.3f %8d %14.2f %14.2f %12.2f %12.2f\n", tempoBpm, noise, strokes, frameErrorMs, fitErrorMs, fitRmsMs, fitErrorMaxUs / 1000.0);
+
+    int expected = static_cast<int>(tempoBpm * 2.0f * 0.95f);
+    if (check && (strokes < expected || fitRmsMs * 10.0 > params.frameUs / 1000.0))
+    {
+        printf("FAILED: %d of about %d strokes timed, fitted landing times should be ten times finer than a frame\n",
+            strokes, static_cast<int>(tempoBpm * 2.0f));
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Times strokes between frames: generated drummers at tempos that put the landings everywhere
+/// between frames, and the cost of one fit
+/// </summary>
+/// <returns>0 on success, 1 if the fitted landing times are too coarse</returns>
+static int BenchStrikeTiming()
+{
+    printf("strike timing (120 s of one generated drummer per row, both hands)\n");
+    printf("%10s %10s %8s %14s %14s %12s %12s\n",
+        "bpm", "noise m", "strokes", "detected ms", "fit |err| ms", "fit rms ms", "fit max ms");
+
+    // Clean and lightly jittered tracking must time strokes to a tenth of a frame; heavier jitter is reported only
+    int result = 0;
+    result |= RunStrikeTiming(113.0f, 0.0f, true);
+    result |= RunStrikeTiming(217.0f, 0.0f, true);
+    result |= RunStrikeTiming(480.0f, 0.0f, true);
+    result |= RunStrikeTiming(113.0f, 0.002f, true);
+    result |= RunStrikeTiming(480.0f, 0.002f, true);
+    result |= RunStrikeTiming(113.0f, 0.005f, false);
+
+    // One fit, on a stroke that bounced between the last two frames
+    CStrikeDetector detector;
+    static const float heights[] = { 0.40f, 0.30f, 0.20f, 0.10f, 0.04f, 0.12f };
+    for (int i = 0; i < 6; ++i)
+    {
+        SkeletonPoint hand = { 0.0f, heights[i], 1.8f };
+        detector.Update(hand, i * 33333);
+    }
+
+    static const int iterations = 100000;
+    int64_t checksum = 0;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < iterations; ++i)
+    {
+        checksum += detector.EstimateStrikeTime();
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+    printf("%10s %14s\n", "ns/fit", "landed us");
+    printf("%10.1f %14lld\n", elapsedUs * 1000.0 / iterations, static_cast<long long>(checksum / iterations));
+
+    return result;
+}
+
+/// <summary>
+/// One frame of a synthetic drummer playing the snare with the left hand and the hi-hat with the right
+/// </summary>
+static DrumPlayerInput MakeDrummerInput(int64_t timeUs, int64_t periodUs, int64_t offsetUs)
+{
+    static const float shoulderY = 0.4f;
+    static const float shoulderZ = 2.0f;
+    static const float handDepth = 0.2f;
+
+    float leftPhase = static_cast<float>((timeUs + offsetUs) % periodUs) / periodUs;
+    float rightPhase = static_cast<float>((timeUs + offsetUs + periodUs / 2) % periodUs) / periodUs;
+    float leftY = 0.2f + 0.45f * (1.0f - fabsf(cosf(3.14159265f * leftPhase)));
+    float rightY = 0.02f + 0.34f * (1.0f - fabsf(cosf(3.14159265f * rightPhase)));
+
+    DrumPlayerInput input;
+    input.leftHand.x = 0.04f;
+    input.leftHand.y = shoulderY - leftY;
+    input.leftHand.z = shoulderZ - handDepth;
+    input.rightHand.x = 0.07f;
+    input.rightHand.y = shoulderY - rightY;
+    input.rightHand.z = shoulderZ - handDepth;
+    input.leftTracked = true;
+    input.rightTracked = true;
+    input.left = MakeHand(input.leftHand.x, leftY, handDepth, DRUM_MOTION_NONE);
+    input.right = MakeHand(input.rightHand.x, rightY, handDepth, DRUM_MOTION_NONE);
+    memset(&input.leftFoot, 0, sizeof(input.leftFoot));
+    memset(&input.rightFoot, 0, sizeof(input.rightFoot));
+    input.timeUs = timeUs;
+    return input;
+}
+
+/// <summary>
+/// Calls made for each index of one worker group run
+/// </summary>
+struct WorkerRunCalls
+{
+    static const int        cMaxItems = 16;
+
+    int                     count;
+    std::atomic<int>        calls[cMaxItems];
+};
+
+/// <summary>
+/// Counts a call for an index, after a little work that differs between indices
+/// </summary>
+static void CountWorkerCall(void* pContext, int index)
+{
+    volatile int spin = 0;
+    for (int i = 0; i < (index * 37) % 200; ++i)
+    {
+        spin = spin + i;
+    }
+
+    static_cast<WorkerRunCalls*>(pContext)->calls[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Checks that every index of a run was called exactly once and no index past it at all
+/// </summary>
+static bool WorkerRunExact(const WorkerRunCalls& run)
+{
+    bool exact = true;
+    for (int i = 0; i < WorkerRunCalls::cMaxItems; ++i)
+    {
+        exact = exact && (run.calls[i].load(std::memory_order_relaxed) == ((i < run.count) ? 1 : 0));
+    }
+
+    return exact;
+}
+
+/// <summary>
+/// Runs two drummers through one roster in parallel and checks that neither disturbs the other
+/// </summary>
+/// <returns>0 on success, 1 if the players' outputs differ from running them alone</returns>
+static int BenchPlayers()
+{
+    static const int frameCount = 30 * 60;
+    static const int64_t frameUs = 33333;
+    static const int64_t periods[2] = { 420000, 530000 };
+    static const int64_t offsets[2] = { 0, 170000 };
+
+    CDrumPlayerRoster roster;
+    roster.Start(1);
+
+    // Reference: each drummer on its own player, one after the other
+    CDrumPlayer alone[2];
+    alone[0].Attach(100, 0);
+    alone[1].Attach(200, 1);
+
+    CDrumPlayer* players[2] = { roster.Acquire(100), roster.Acquire(200) };
+    int failures = (NULL == players[0] || NULL == players[1] || players[0] == players[1]);
+    if (failures)
+    {
+        printf("FAILED: roster could not attach two players\n");
+        return 1;
+    }
+
+    int notes = 0;
+    int64_t parallelUs = 0;
+    for (int f = 0; f < frameCount; ++f)
+    {
+        int64_t timeUs = (f + 1) * frameUs;
+        DrumPlayerInput inputs[2];
+        DrumPlayerOutput outputs[2], expected[2];
+        for (int p = 0; p < 2; ++p)
+        {
+            inputs[p] = MakeDrummerInput(timeUs, periods[p], offsets[p]);
+            alone[p].Process(inputs[p], &expected[p]);
+        }
+
+        int64_t startUs = DrumGetTimeMicroseconds();
+        roster.Process(players, inputs, outputs, 2);
+        parallelUs += DrumGetTimeMicroseconds() - startUs;
+
+        for (int p = 0; p < 2; ++p)
+        {
+            bool same = (outputs[p].onsetCount == expected[p].onsetCount && outputs[p].actionCount == expected[p].actionCount);
+            for (int i = 0; same && i < outputs[p].onsetCount; ++i)
+            {
+                same = (outputs[p].onsets[i].zone == expected[p].onsets[i].zone &&
+                        outputs[p].onsets[i].hitVelocity == expected[p].onsets[i].hitVelocity);
+            }
+
+            for (int i = 0; same && i < outputs[p].actionCount; ++i)
+            {
+                same = (outputs[p].actions[i].type == expected[p].actions[i].type &&
+                        outputs[p].actions[i].timeUs == expected[p].actions[i].timeUs);
+            }
+
+            failures += !same;
+            notes += outputs[p].onsetCount + outputs[p].actionCount;
+        }
+    }
+
+    // Small and large runs alternate, so a worker still claiming when a small run ends meets a bigger
+    // next one; each run must call every index once, and nothing of it may run after it returns
+    static const int groupRuns = 20000;
+    int groupMismatched = 0;
+    {
+        CWorkerGroup group;
+        group.Start(3);
+        WorkerRunCalls runs[2];
+        for (int r = 0; r < groupRuns; ++r)
+        {
+            WorkerRunCalls& run = runs[r % 2];
+            run.count = (r % 2) ? 8 : 2;
+            for (int i = 0; i < WorkerRunCalls::cMaxItems; ++i)
+            {
+                run.calls[i].store(0, std::memory_order_relaxed);
+            }
+
+            group.Run(CountWorkerCall, &run, run.count);
+            groupMismatched += !WorkerRunExact(run) || (r > 0 && !WorkerRunExact(runs[(r + 1) % 2]));
+        }
+
+        group.Stop();
+    }
+    failures += (groupMismatched > 0);
+
+    const HitPredictorStats first = players[0]->Predictor().Stats();
+    const HitPredictorStats second = players[1]->Predictor().Stats();
+
+    // The second drummer walks away; the next person gets a fresh player in the freed slot
+    uint32_t present = 100;
+    HitAction cancels[cDrumPlayerMaxActions * CDrumPlayerRoster::cMaxPlayers];
+    roster.Reclaim(&present, 1, cancels, cDrumPlayerMaxActions * CDrumPlayerRoster::cMaxPlayers);
+    CDrumPlayer* pNewcomer = roster.Acquire(300);
+    failures += (NULL != roster.Find(200) || pNewcomer != players[1] || 0 != pNewcomer->Predictor().Stats().predicted);
+
+    printf("players (2 drummers, %d frames, 1 worker thread)\n", frameCount);
+    printf("%12s %10s %12s %12s %12s\n", "ns/frame", "notes", "1 predicted", "2 predicted", "runs wrong");
+    printf("%12.1f %10d %12llu %12llu %12d\n", parallelUs * 1000.0 / frameCount, notes,
+        static_cast<unsigned long long>(first.predicted), static_cast<unsigned long long>(second.predicted), groupMismatched);
+
+    roster.Stop();
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, players disturbed each other, were not reclaimed or worker runs overlapped\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Checks histogram percentiles against exact ones and times a record
+/// </summary>
+/// <returns>0 on success, 1 if a percentile is outside the bucket precision</returns>
+static int BenchLatencyHistogram()
+{
+    static const int valueCount = 200000;
+
+    // Long tailed, like frame latencies: mostly a few ms, sometimes far more
+    std::vector<int64_t> values(valueCount);
+    for (int i = 0; i < valueCount; ++i)
+    {
+        float u = RandomFloat(0.0f, 1.0f);
+        values[i] = static_cast<int64_t>(2000.0f + 500.0f * RandomFloat(-1.0f, 1.0f) + ((u > 0.98f) ? 100000.0f * (u - 0.98f) * 50.0f : 0.0f));
+    }
+
+    CLatencyHistogram histogram;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < valueCount; ++i)
+    {
+        histogram.Record(values[i]);
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+
+    LatencySummary summary;
+    histogram.GetSummary(&summary);
+
+    std::sort(values.begin(), values.end());
+    int64_t exact50 = values[valueCount / 2 - 1];
+    int64_t exact99 = values[valueCount * 99 / 100 - 1];
+
+    printf("latency histogram (%d buckets, %d values)\n", CLatencyHistogram::cBucketCount, valueCount);
+    printf("%10s %10s %10s %10s %10s %10s\n", "ns/record", "p50", "exact", "p99", "exact", "max");
+    printf("%10.1f %10lld %10lld %10lld %10lld %10lld\n", elapsedUs * 1000.0 / valueCount,
+        static_cast<long long>(summary.p50Us), static_cast<long long>(exact50),
+        static_cast<long long>(summary.p99Us), static_cast<long long>(exact99), static_cast<long long>(summary.maxUs));
+
+    // Bucket upper bounds are at most 1/16 above the values they hold
+    int failures = 0;
+    failures += (summary.p50Us < exact50 || summary.p50Us > exact50 + exact50 / CLatencyHistogram::cSubBucketCount);
+    failures += (summary.p99Us < exact99 || summary.p99Us > exact99 + exact99 / CLatencyHistogram::cSubBucketCount);
+    failures += (summary.maxUs != values[valueCount - 1] || summary.count != static_cast<uint64_t>(valueCount));
+
+    // Every value lands in a bucket whose bounds hold it
+    for (int64_t v = 0; v < (1 << 20); v += 1 + v / 64)
+    {
+        int index = CLatencyHistogram::BucketIndex(static_cast<uint64_t>(v));
+        failures += (v > CLatencyHistogram::BucketUpperBound(index) || (index > 0 && v <= CLatencyHistogram::BucketUpperBound(index - 1)));
+    }
+
+    if (failures)
+    {
+        printf("FAILED: %d histogram checks\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Checks the records of one tracing thread: the newest ones, in order, none torn
+/// </summary>
+/// <param name="records">collected records</param>
+/// <param name="serial">serial number of the thread</param>
+/// <param name="written">records the thread wrote, 0 if it may still be writing</param>
+/// <param name="pCount">receives the number of the thread's records</param>
+/// <returns>number of problems found</returns>
+static int CheckTraceRecords(const std::vector<DrumTraceRecord>& records, uint16_t serial, int written, int* pCount)
+{
+    int failures = 0;
+    int count = 0;
+    int32_t last = -1;
+    for (size_t r = 0; r < records.size(); ++r)
+    {
+        const DrumTraceRecord& record = records[r];
+        if (record.thread != serial)
+        {
+            continue;
+        }
+
+        // Every field of a record comes from the same write, and one thread's records keep their order
+        int32_t sequence = record.values[0];
+        failures += (record.values[1] != (sequence ^ 0x5A5A) || record.reals[0] != static_cast<float>(sequence) || sequence <= last);
+        failures += (last >= 0 && written > 0 && sequence != last + 1);
+        last = sequence;
+        ++count;
+    }
+
+    // Once the thread is done the ring gives up exactly its newest records
+    if (written > 0)
+    {
+        int capacity = static_cast<int>(cDrumTraceRingRecords) - 1;
+        int expected = (written < capacity) ? written : capacity;
+        failures += (count != expected || last != written - 1);
+    }
+
+    *pCount = count;
+    return failures;
+}
+
+/// <summary>
+/// Times a trace point against formatting the same numbers into a string stream, the way
+/// DBOUT did; checks that rings collected while threads trace hold no torn records, that
+/// a dump reads back the same, and that rings of finished threads are taken up again
+/// </summary>
+/// <returns>0 on success, 1 if a record is lost, torn, out of order or misread</returns>
+static int BenchTrace()
+{
+    static const int iterations = 1000000;
+    static const int threadCount = 4;
+    static const int threadRecords = 200000;
+    static const char szPath[] = "DrumBench.trace";
+
+    printf("trace (%d records per thread, %u per ring)\n", threadRecords, cDrumTraceRingRecords);
+
+    // One thread, warm ring
+    DrumTraceWrite(DRUM_TRACE_FRAME, 0, 0, 0, 0.0f, 0.0f);
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < iterations; ++i)
+    {
+        DrumTraceWrite(DRUM_TRACE_TRIGGER, static_cast<uint32_t>(i), i & 3, i & 7, 0.5f, 1.0f);
+    }
+    double traceNs = (DrumGetTimeMicroseconds() - startUs) * 1000.0 / iterations;
+
+    // Most of a trace point is reading the tick counter, which is slow under some hypervisors. The sum
+    // only keeps the reads from being optimized away; unsigned, it wraps instead of overflowing
+    uint64_t tickSum = 0;
+    startUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < iterations; ++i)
+    {
+        tickSum += static_cast<uint64_t>(DrumTraceTicks());
+    }
+    double ticksNs = (DrumGetTimeMicroseconds() - startUs) * 1000.0 / iterations;
+
+    static const int streamIterations = iterations / 10;
+    size_t streamLength = 0;
+    startUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < streamIterations; ++i)
+    {
+        std::wostringstream os;
+        os << L"Snare played " << i << L" velocity " << 0.5f << L"\n";
+        streamLength += os.str().size();
+    }
+    double streamNs = (DrumGetTimeMicroseconds() - startUs) * 1000.0 / streamIterations;
+
+    // Several threads trace while the rings are collected again and again
+    std::atomic<int> started(0);
+    std::atomic<bool> go(false);
+    uint16_t serials[threadCount] = {};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            CDrumTraceThreadScope scope;
+            serials[t] = DrumTraceThreadSerial();
+            started.fetch_add(1);
+            while (!go.load())
+            {
+            }
+
+            for (int i = 0; i < threadRecords; ++i)
+            {
+                DrumTraceWrite(DRUM_TRACE_VOICE_START, static_cast<uint32_t>(t), i, i ^ 0x5A5A, static_cast<float>(i), 0.0f);
+            }
+        }));
+    }
+
+    while (started.load() < threadCount)
+    {
+    }
+    go.store(true);
+
+    int failures = 0;
+    int collections = 0;
+    DrumTraceFileHeader header;
+    std::vector<DrumTraceRecord> records;
+    records.reserve(cDrumTraceMaxThreads * cDrumTraceRingRecords);
+    for (int c = 0; c < 20; ++c)
+    {
+        DrumTraceCollect(&header, records);
+        for (int t = 0; t < threadCount; ++t)
+        {
+            int count;
+            failures += CheckTraceRecords(records, serials[t], 0, &count);
+        }
+        ++collections;
+    }
+
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads[t].join();
+        failures += (0 == serials[t]);
+    }
+
+    // Finished threads: the newest records of each, and the same again from a dump
+    DrumTraceCollect(&header, records);
+    int held = 0;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        int count;
+        failures += CheckTraceRecords(records, serials[t], threadRecords, &count);
+        held += count;
+    }
+
+    DrumTraceFileHeader readHeader;
+    std::vector<DrumTraceRecord> readRecords;
+    bool dumped = SUCCEEDED(DrumTraceDump(szPath)) && SUCCEEDED(DrumTraceRead(szPath, &readHeader, readRecords));
+    remove(szPath);
+    int readHeld = 0;
+    for (int t = 0; dumped && t < threadCount; ++t)
+    {
+        int count;
+        failures += CheckTraceRecords(readRecords, serials[t], threadRecords, &count);
+        readHeld += count;
+    }
+    failures += (!dumped || readHeld != held || readHeader.recordCount != readRecords.size());
+
+    // Ticks map onto the microsecond clock
+    int64_t beforeUs = DrumGetTimeMicroseconds();
+    DrumTraceWrite(DRUM_TRACE_FRAME, 0xC10C, 0, 0, 0.0f, 0.0f);
+    int64_t afterUs = DrumGetTimeMicroseconds();
+    DrumTraceCollect(&header, records);
+    double clockErrorUs = 1e9;
+    for (size_t r = 0; r < records.size(); ++r)
+    {
+        if (DRUM_TRACE_FRAME == records[r].event && 0xC10C == records[r].id)
+        {
+            double timeUs = DrumTraceTimeUs(header, records[r].ticks);
+            clockErrorUs = (timeUs < beforeUs) ? beforeUs - timeUs : ((timeUs > afterUs) ? timeUs - afterUs : 0.0);
+        }
+    }
+    failures += (clockErrorUs > 1000.0);
+
+    // Rings of finished threads go to the next ones, however many come and go
+    int attached = 0;
+    for (int t = 0; t < 4 * cDrumTraceMaxThreads; ++t)
+    {
+        std::thread thread([&attached]()
+        {
+            CDrumTraceThreadScope scope;
+            attached += (0 != DrumTraceThreadSerial()) ? 1 : 0;
+        });
+        thread.join();
+    }
+    failures += (attached != 4 * cDrumTraceMaxThreads);
+
+    printf("%12s %12s %12s %12s %12s %12s %12s\n", "trace ns", "ticks ns", "stream ns", "collections", "held", "clock us", "reattached");
+    printf("%12.1f %12.1f %12.1f %12d %12d %12.1f %12d\n", traceNs, ticksNs, streamNs, collections, held, clockErrorUs, attached);
+
+    if (failures || 0 == streamLength || 0 == tickSum)
+    {
+        printf("FAILED: %d trace records lost, torn, out of order or misread\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Projection worked out by hand from the SDK formula, for a 640x480 screen
+/// </summary>
+struct ProjectionReference
+{
+    SkeletonPoint           point;
+    int32_t                 imageX;
+    int32_t                 imageY;
+    uint16_t                depth;
+};
+
+static const ProjectionReference g_ProjectionReferences[] =
+{
+    { {  0.0f,  0.0f,  2.0f }, 160,  120, 16000 },
+    { {  0.5f,  0.25f, 2.0f }, 231,   84, 16000 },
+    { { -0.3f, -0.2f,  1.5f }, 103,  158, 12000 },
+    { {  1.0f, -0.8f,  3.0f }, 255,  196, 24000 },
+    { { -2.0f,  1.5f,  0.8f }, -553, -415, 6400 },    // off the image, truncated towards zero
+    { {  0.0f,  0.0f,  0.0f }, 0,      0,     0 },    // at the sensor
+    { {  0.2f,  0.3f, -1.0f }, 0,      0,     0 },    // behind the sensor
+};
+
+/// <summary>
+/// Projects every joint of every skeleton one at a time, the way the application did before batching
+/// </summary>
+static void ProjectSkeletonsScalar(const SkeletonFrame& frame, int width, int height, ProjectedSkeleton* pProjected)
+{
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            DepthImagePoint point;
+            SkeletonToDepthImage(frame.skeletons[s].joints[j], &point);
+            pProjected[s].x[j] = static_cast<float>(point.x * width) / cDepthImageWidth;
+            pProjected[s].y[j] = static_cast<float>(point.y * height) / cDepthImageHeight;
+            pProjected[s].depth[j] = point.depth;
+        }
+    }
+}
+
+/// <summary>
+/// Checks the batched projection against hand worked values and the one joint at a
+/// time reference, and times both
+/// </summary>
+/// <returns>0 on success, 1 if any projected joint differs</returns>
+static int BenchProjection()
+{
+    static const int frameCount = 20000;
+    static const int cachedFrames = 16;
+    static const int width = 640;
+    static const int height = 480;
+
+    int failures = 0;
+
+    // Hand worked values, through the scalar reference and the batched projection
+    static const int referenceCount = sizeof(g_ProjectionReferences) / sizeof(g_ProjectionReferences[0]);
+    SkeletonData reference;
+    memset(&reference, 0, sizeof(reference));
+    for (int i = 0; i < cSkeletonJointCount; ++i)
+    {
+        reference.joints[i] = g_ProjectionReferences[i % referenceCount].point;
+    }
+
+    ProjectedSkeleton referenceProjection;
+    ProjectSkeleton(reference, width, height, &referenceProjection);
+    for (int i = 0; i < cSkeletonJointCount; ++i)
+    {
+        const ProjectionReference& expected = g_ProjectionReferences[i % referenceCount];
+        DepthImagePoint point;
+        SkeletonToDepthImage(expected.point, &point);
+        failures += (point.x != expected.imageX || point.y != expected.imageY || point.depth != expected.depth);
+        failures += (referenceProjection.x[i] != expected.imageX * 2.0f || referenceProjection.y[i] != expected.imageY * 2.0f ||
+                     referenceProjection.depth[i] != expected.depth);
+    }
+
+    // Random frames of six skeletons, a few joints at or behind the sensor
+    std::vector<SkeletonFrame> frames(frameCount);
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SkeletonFrame& frame = frames[f];
+        memset(&frame, 0, sizeof(frame));
+        for (int s = 0; s < cSkeletonCount; ++s)
+        {
+            frame.skeletons[s].trackingState = SKELETON_TRACKED;
+            for (int j = 0; j < cSkeletonJointCount; ++j)
+            {
+                SkeletonPoint& joint = frame.skeletons[s].joints[j];
+                joint.x = RandomFloat(-2.0f, 2.0f);
+                joint.y = RandomFloat(-1.5f, 1.5f);
+                joint.z = (RandomFloat(0.0f, 1.0f) < 0.01f) ? RandomFloat(-0.1f, 0.0f) : RandomFloat(0.5f, 4.0f);
+            }
+        }
+    }
+
+    // Timed on a few frames that stay in cache, so the projection is measured rather than memory
+    ProjectedSkeleton scalar[cSkeletonCount];
+    ProjectedSkeleton batched[cSkeletonCount];
+    DrumPlayerInput inputs[cSkeletonCount];
+
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int f = 0; f < frameCount; ++f)
+    {
+        ProjectSkeletonsScalar(frames[f % cachedFrames], width, height, scalar);
+    }
+    int64_t scalarUs = DrumGetTimeMicroseconds() - startUs;
+
+    startUs = DrumGetTimeMicroseconds();
+    for (int f = 0; f < frameCount; ++f)
+    {
+        ProjectSkeletons(frames[f % cachedFrames], width, height, batched);
+    }
+    int64_t batchedUs = DrumGetTimeMicroseconds() - startUs;
+
+    // What detection does instead, since zones are in skeleton space
+    startUs = DrumGetTimeMicroseconds();
+    for (int f = 0; f < frameCount; ++f)
+    {
+        const SkeletonFrame& frame = frames[f % cachedFrames];
+        for (int s = 0; s < cSkeletonCount; ++s)
+        {
+            BuildDrumPlayerInput(frame.skeletons[s], f, &inputs[s]);
+        }
+    }
+    int64_t zoneSpaceUs = DrumGetTimeMicroseconds() - startUs;
+
+    int mismatches = 0;
+    for (int f = 0; f < frameCount; ++f)
+    {
+        ProjectSkeletonsScalar(frames[f], width, height, scalar);
+        ProjectSkeletons(frames[f], width, height, batched);
+
+        for (int s = 0; s < cSkeletonCount; ++s)
+        {
+            for (int j = 0; j < cSkeletonJointCount; ++j)
+            {
+                mismatches += (scalar[s].x[j] != batched[s].x[j] || scalar[s].y[j] != batched[s].y[j] || scalar[s].depth[j] != batched[s].depth[j]);
+            }
+        }
+    }
+
+    printf("projection (6 skeletons, %d frames)\n", frameCount);
+    printf("%12s %12s %12s %12s\n", "scalar ns", "batched ns", "zone ns", "mismatches");
+    printf("%12.1f %12.1f %12.1f %12d\n", scalarUs * 1000.0 / frameCount, batchedUs * 1000.0 / frameCount,
+        zoneSpaceUs * 1000.0 / frameCount, mismatches);
+
+    if (failures || mismatches)
+    {
+        printf("FAILED: %d reference values and %d joints differ from the SDK projection\n", failures, mismatches);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Note the pipeline played, scored against the generator's strokes
+/// </summary>
+struct PipelineNote
+{
+    int64_t                 timeUs;
+    uint32_t                trackingId;
+    int                     zone;
+    uint32_t                ticket;             // 0 for onsets, which cannot be cancelled
+    bool                    cancelled;
+};
+
+/// <summary>
+/// Keeps every note the engine would have sounded, crossing out the cancelled ones
+/// </summary>
+class CPipelineNoteSink : public IDrumTriggerSink
+{
+public:
+    std::vector<PipelineNote> notes;
+
+    virtual void Trigger(const DrumHitTrigger& trigger)
+    {
+        if (DRUM_TRIGGER_CHOKE == trigger.type)
+        {
+            return;
+        }
+
+        if (DRUM_TRIGGER_CANCEL != trigger.type)
+        {
+            PipelineNote note = { trigger.timeUs, trigger.trackingId, trigger.zone, trigger.ticket, false };
+            notes.push_back(note);
+            return;
+        }
+
+        for (size_t n = notes.size(); n-- > 0;)
+        {
+            if (notes[n].ticket == trigger.ticket)
+            {
+                notes[n].cancelled = true;
+                break;
+            }
+        }
+    }
+};
+
+/// <summary>
+/// Accuracy of the notes a pipeline played
+/// </summary>
+struct PipelineScore
+{
+    int                     strokes;
+    int                     notes;
+    float                   precision;
+    float                   recall;
+    double                  errorMs;            // mean distance of a matched note from its stroke
+};
+
+/// <summary>
+/// Scores the notes a pipeline played against the strokes the generator played
+/// </summary>
+/// <param name="truth">strokes in time order</param>
+/// <param name="notes">what the engine sent, cancels crossed out</param>
+/// <param name="fromUs">strokes and notes before this are left out</param>
+/// <param name="untilUs">capture time of the last frame; later predictions are for strokes not reported yet</param>
+/// <param name="pScore">receives the score</param>
+static void ScorePipelineNotes(const std::vector<SyntheticHit>& truth, const std::vector<PipelineNote>& notes,
+                               int64_t fromUs, int64_t untilUs, PipelineScore* pScore)
+{
+    static const int64_t windowUs = 100000;
+
+    std::vector<PipelineNote> played;
+    for (size_t n = 0; n < notes.size(); ++n)
+    {
+        if (!notes[n].cancelled && notes[n].timeUs >= fromUs && notes[n].timeUs <= untilUs)
+        {
+            played.push_back(notes[n]);
+        }
+    }
+
+    std::sort(played.begin(), played.end(), [](const PipelineNote& a, const PipelineNote& b) { return a.timeUs < b.timeUs; });
+
+    // Each stroke takes the closest unclaimed note of its drummer and zone within the window
+    std::vector<bool> claimed(played.size(), false);
+    int strokes = 0;
+    int matched = 0;
+    int64_t errorSumUs = 0;
+    size_t first = 0;
+    for (size_t h = 0; h < truth.size(); ++h)
+    {
+        const SyntheticHit& hit = truth[h];
+        if (hit.timeUs < fromUs)
+        {
+            continue;
+        }
+        ++strokes;
+
+        while (first < played.size() && played[first].timeUs < hit.timeUs - windowUs)
+        {
+            ++first;
+        }
+
+        size_t best = played.size();
+        int64_t bestErrorUs = windowUs + 1;
+        for (size_t n = first; n < played.size() && played[n].timeUs <= hit.timeUs + windowUs; ++n)
+        {
+            int64_t errorUs = played[n].timeUs - hit.timeUs;
+            errorUs = (errorUs < 0) ? -errorUs : errorUs;
+            if (!claimed[n] && played[n].trackingId == hit.trackingId && played[n].zone == hit.zone && errorUs < bestErrorUs)
+            {
+                best = n;
+                bestErrorUs = errorUs;
+            }
+        }
+
+        if (best < played.size())
+        {
+            claimed[best] = true;
+            errorSumUs += bestErrorUs;
+            ++matched;
+        }
+    }
+
+    pScore->strokes = strokes;
+    pScore->notes = static_cast<int>(played.size());
+    pScore->precision = played.empty() ? 0.0f : static_cast<float>(matched) / played.size();
+    pScore->recall = (0 == strokes) ? 0.0f : static_cast<float>(matched) / strokes;
+    pScore->errorMs = matched ? errorSumUs / 1000.0 / matched : 0.0;
+}
+
+/// <summary>
+/// Generates a performance, times the pipeline on it and scores what it played
+/// </summary>
+/// <returns>0 on success, 1 if precision or recall is below minScore</returns>
+static int RunPipeline(int skeletonCount, float tempoBpm, float noise, float minScore)
+{
+    static const int frameCount = 30 * 120;
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = skeletonCount;
+    params.tempoBpm = tempoBpm;
+    params.noise = noise;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+
+    CSkeletonGenerator generator;
+    if (FAILED(generator.Initialize(params, zones)))
+    {
+        printf("FAILED: generator rejected %d skeletons at %.0f bpm\n", skeletonCount, tempoBpm);
+        return 1;
+    }
+
+    std::vector<SkeletonFrame> frames(frameCount);
+    std::vector<int64_t> frameTimes(frameCount);
+    std::vector<SyntheticHit> truth;
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SyntheticHit hits[2 * cSkeletonCount * 4];
+        int hitCount = generator.NextFrame(&frames[f], hits, 2 * cSkeletonCount * 4);
+        truth.insert(truth.end(), hits, hits + hitCount);
+        frameTimes[f] = generator.TimeUs();
+    }
+
+    // Timed pass: nothing but the pipeline
+    CDrumEngine timed;
+    CNullTriggerSink dropped;
+    timed.Start(0);
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int f = 0; f < frameCount; ++f)
+    {
+        timed.ProcessFrame(frames[f], frameTimes[f], &dropped);
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+    timed.Stop();
+
+    // Scored pass: the same frames again on a fresh engine, keeping what would have sounded
+    CDrumEngine scored;
+    CPipelineNoteSink sink;
+    scored.Start(0);
+    for (int f = 0; f < frameCount; ++f)
+    {
+        scored.ProcessFrame(frames[f], frameTimes[f], &sink);
+    }
+    scored.Stop();
+
+    PipelineScore score;
+    ScorePipelineNotes(truth, sink.notes, 0, frameTimes[frameCount - 1], &score);
+
+    double nsPerFrame = elapsedUs * 1000.0 / frameCount;
+    printf("%10d %10.0f %10.3f %12.0f %10.1f %8d %8d %10.3f %10.3f %10.1f\n", skeletonCount, tempoBpm, noise,
+        (elapsedUs > 0) ? frameCount * 1000000.0 / elapsedUs : 0.0, nsPerFrame,
+        score.strokes, score.notes, score.precision, score.recall, score.errorMs);
+
+    if (score.precision < minScore || score.recall < minScore)
+    {
+        printf("FAILED: precision and recall should be at least %.2f\n", minScore);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Runs generated drummers through the whole detection pipeline and scores the notes
+/// against the strokes they played
+/// </summary>
+/// <returns>0 on success, 1 if detection accuracy regressed</returns>
+static int BenchPipeline()
+{
+    printf("pipeline (%d s of generated frames per row, serial)\n", 120);
+    printf("%10s %10s %10s %12s %10s %8s %8s %10s %10s %10s\n",
+        "skeletons", "bpm", "noise m", "frames/s", "ns/frame", "strokes", "notes", "precision", "recall", "error ms");
+
+    // Clean and lightly jittered tracking must stay accurate; heavy jitter is reported only
+    int result = 0;
+    result |= RunPipeline(1, 120.0f, 0.0f, 0.95f);
+    result |= RunPipeline(1, 120.0f, 0.005f, 0.95f);
+    result |= RunPipeline(1, 120.0f, 0.015f, 0.0f);
+    result |= RunPipeline(1, 240.0f, 0.0f, 0.95f);
+    result |= RunPipeline(2, 120.0f, 0.005f, 0.95f);
+    result |= RunPipeline(6, 120.0f, 0.005f, 0.95f);
+    return result;
+}
+
+/// <summary>
+/// Plays a generated drummer of some reach through an engine and scores the notes after the warm-up
+/// </summary>
+/// <param name="reach">drummer's reach against the default layout's</param>
+/// <param name="calibrate">whether the engine calibrates the zones</param>
+/// <param name="pScore">receives the score</param>
+/// <param name="pFit">receives the fit, if calibrating</param>
+/// <returns>false if the generator rejected the drummer</returns>
+static bool RunCalibratedDrummer(float reach, bool calibrate, PipelineScore* pScore, DrumZoneFit* pFit)
+{
+    static const int frameCount = 30 * 120;
+    static const int64_t warmupUs = 20000000;
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.noise = 0.005f;
+    params.reach = reach;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+    CSkeletonGenerator generator;
+    if (FAILED(generator.Initialize(params, zones)))
+    {
+        return false;
+    }
+
+    CDrumEngine engine;
+    CPipelineNoteSink sink;
+    std::vector<SyntheticHit> truth;
+    engine.SetCalibration(calibrate);
+    engine.Start(0);
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SkeletonFrame frame;
+        SyntheticHit hits[8];
+        int hitCount = generator.NextFrame(&frame, hits, 8);
+        truth.insert(truth.end(), hits, hits + hitCount);
+        engine.ProcessFrame(frame, generator.TimeUs(), &sink);
+    }
+    engine.Stop();
+
+    ScorePipelineNotes(truth, sink.notes, warmupUs, generator.TimeUs(), pScore);
+
+    CDrumPlayer* pPlayer = engine.Players().Find(1);
+    if (NULL != pPlayer)
+    {
+        *pFit = pPlayer->Calibrator().Fit();
+    }
+    return true;
+}
+
+/// <summary>
+/// Per-frame cost of the calibrator on a kit, strokes landing on every fifteenth frame
+/// as they do at 120 strokes per minute and 30 frames per second
+/// </summary>
+/// <param name="zones">layout to fit</param>
+/// <param name="reach">scale of the strike points</param>
+/// <param name="pLayouts">receives how often the zones were laid out again</param>
+/// <returns>ns per frame</returns>
+static double TimeCalibrator(const CDrumZoneTable& zones, float reach, int* pLayouts)
+{
+    static const int frameCount = 300000;
+    static const int strokeFrames = 15;
+    static const int pointCount = 1024;
+
+    // Strike points of the downward zones, scaled and jittered, with their hand's motion
+    std::vector<DrumHandInput> points;
+    for (int i = 0; i < zones.Count(); ++i)
+    {
+        DrumZone zone = zones.GetZone(i);
+        if (0 != (zone.motion & DRUM_MOTION_DOWN) && zone.hands)
+        {
+            points.push_back(MakeHand((zone.xMin + zone.xMax) * 0.5f * reach, (zone.yMin + zone.yMax) * 0.5f * reach,
+                                      DrumZoneStrikeDepth(zone) * reach, DRUM_MOTION_DOWN));
+        }
+    }
+
+    std::vector<DrumHandInput> inputs(pointCount);
+    for (int i = 0; i < pointCount; ++i)
+    {
+        inputs[i] = points[static_cast<size_t>(RandomFloat(0.0f, static_cast<float>(points.size()) - 0.01f))];
+        inputs[i].x += RandomFloat(-0.02f, 0.02f);
+        inputs[i].y += RandomFloat(-0.02f, 0.02f);
+        inputs[i].depth += RandomFloat(-0.02f, 0.02f);
+    }
+
+    const DrumHandInput idle = MakeHand(0.0f, 0.3f, 0.1f, DRUM_MOTION_NONE);
+    CDrumZoneTable fitted = zones;
+    CZoneCalibrator calibrator;
+    calibrator.Start(zones);
+
+    int layouts = 0;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int f = 0; f < frameCount; ++f)
+    {
+        const DrumHandInput& stroke = (0 == f % strokeFrames) ? inputs[(f / strokeFrames) & (pointCount - 1)] : idle;
+        layouts += calibrator.Update((f / strokeFrames) & 1 ? idle : stroke, (f / strokeFrames) & 1 ? stroke : idle, &fitted) ? 1 : 0;
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+
+    *pLayouts = layouts;
+    return elapsedUs * 1000.0 / frameCount;
+}
+
+/// <summary>
+/// Drummers with shorter and longer arms than the default layout was made for, played
+/// with and without calibration, and the cost of calibrating on every frame
+/// </summary>
+/// <returns>0 on success, 1 if a calibrated drummer is not played accurately or the fit is off</returns>
+static int BenchCalibration()
+{
+    static const float reaches[] = { 0.7f, 0.85f, 1.0f, 1.15f, 1.3f };
+
+    printf("calibration (120 s of one generated drummer per row, scored after a 20 s warm-up)\n");
+    printf("%8s %10s %10s %14s %12s %10s\n", "reach", "precision", "recall", "cal precision", "cal recall", "cal scale");
+
+    int failures = 0;
+    for (size_t r = 0; r < sizeof(reaches) / sizeof(reaches[0]); ++r)
+    {
+        PipelineScore plain, calibrated;
+        DrumZoneFit fit = { 0.0f, 0.0f, 0.0f, 0.0f };
+        if (!RunCalibratedDrummer(reaches[r], false, &plain, &fit) || !RunCalibratedDrummer(reaches[r], true, &calibrated, &fit))
+        {
+            printf("FAILED: generator rejected reach %.2f\n", reaches[r]);
+            return 1;
+        }
+
+        printf("%8.2f %10.3f %10.3f %14.3f %12.3f %10.3f\n", reaches[r],
+            plain.precision, plain.recall, calibrated.precision, calibrated.recall, fit.scale);
+
+        failures += (calibrated.precision < 0.95f || calibrated.recall < 0.95f);
+        failures += (fabsf(fit.scale - reaches[r]) > 0.1f * reaches[r]);
+    }
+
+    CDrumZoneTable defaults, large;
+    CreateDefaultDrumZones(defaults);
+    CreateRandomZones(large, 512);
+    large.BuildIndex();
+
+    int defaultLayouts, largeLayouts;
+    double defaultNs = TimeCalibrator(defaults, 0.8f, &defaultLayouts);
+    double largeNs = TimeCalibrator(large, 0.8f, &largeLayouts);
+    printf("%8s %10s %10s\n", "zones", "ns/frame", "layouts");
+    printf("%8d %10.1f %10d\n", defaults.Count(), defaultNs, defaultLayouts);
+    printf("%8d %10.1f %10d\n", large.Count(), largeNs, largeLayouts);
+
+    if (failures)
+    {
+        printf("FAILED: %d calibrated drummers below 0.95 precision or recall, or fitted more than 10%% off their reach\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// One foot of the synthetic pedal performance
+/// </summary>
+/// <param name="height">foot height above the floor</param>
+/// <param name="footTracked">whether the sensor tracks the foot</param>
+/// <param name="ankleTracked">whether the sensor tracks the ankle</param>
+static DrumFootInput MakeFoot(float height, bool footTracked, bool ankleTracked)
+{
+    static const float floorY = -0.9f;
+    static const float noise = 0.002f;
+
+    DrumFootInput input;
+    input.foot.x = 0.0f;
+    input.foot.y = floorY + height + RandomFloat(-noise, noise);
+    input.foot.z = 2.0f;
+    input.ankle = input.foot;
+    input.ankle.y += 0.05f + RandomFloat(-noise, noise);
+    input.footTracked = footTracked;
+    input.ankleTracked = ankleTracked;
+    return input;
+}
+
+/// <summary>
+/// Time span of a synthetic pedal performance
+/// </summary>
+struct PedalSpan
+{
+    int64_t                 startUs;
+    int64_t                 endUs;
+};
+
+// Legs lost for longer than the reset, for a single late frame, and feet lost with the ankles still tracked
+static const PedalSpan g_PedalGaps[] = { { 20200000, 25200000 }, { 30090000, 30200000 } };
+static const PedalSpan g_PedalAnkleOnly = { 40000000, 45000000 };
+
+/// <summary>
+/// Gets whether a span of the performance overlaps a tracking gap
+/// </summary>
+static bool InPedalGap(int64_t startUs, int64_t endUs)
+{
+    for (size_t g = 0; g < sizeof(g_PedalGaps) / sizeof(g_PedalGaps[0]); ++g)
+    {
+        if (startUs < g_PedalGaps[g].endUs && endUs > g_PedalGaps[g].startUs)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Height of a foot that lifts to peak over riseUs, holds for holdUs and comes down over fallUs
+/// </summary>
+static float PedalHeight(int64_t sinceUs, float peak, int64_t riseUs, int64_t holdUs, int64_t fallUs)
+{
+    if (sinceUs < 0 || sinceUs >= riseUs + holdUs + fallUs)
+    {
+        return 0.0f;
+    }
+
+    if (sinceUs < riseUs)
+    {
+        return peak * sinceUs / riseUs;
+    }
+
+    if (sinceUs < riseUs + holdUs)
+    {
+        return peak;
+    }
+
+    return peak * (riseUs + holdUs + fallUs - sinceUs) / fallUs;
+}
+
+/// <summary>
+/// Keeps every trigger the engine makes
+/// </summary>
+class CPedalTriggerSink : public IDrumTriggerSink
+{
+public:
+    std::vector<DrumHitTrigger> triggers;
+
+    virtual void Trigger(const DrumHitTrigger& trigger) { triggers.push_back(trigger); }
+};
+
+/// <summary>
+/// Kicks on every beat and a hi-hat opened for a second out of every two, through
+/// long and short tracking gaps and a stretch where only the ankles are tracked;
+/// then the open hi-hat on a player, the triggers of the engine and the mixer's choke
+/// </summary>
+/// <returns>0 on success, 1 if a stroke was missed, doubled, sounded across a gap or a choke failed</returns>
+static int BenchPedals()
+{
+    static const int64_t frameUs = 33333;
+    static const int64_t durationUs = 60000000;
+    static const int64_t kickPeriodUs = 500000;
+    static const int64_t kickRiseUs = 100000;
+    static const int64_t kickFallUs = 50000;
+    static const int64_t hihatPeriodUs = 2000000;
+    static const int64_t hihatOffsetUs = 250000;
+    static const int64_t hihatRiseUs = 100000;
+    static const int64_t hihatHoldUs = 900000;
+    static const PedalSpan slowCloses = { 50000000, 56000000 };
+
+    printf("pedals (60 s of kicks on every beat and a hi-hat opened every 2 s, with tracking gaps)\n");
+
+    int failures = 0;
+    int kicks = 0, expectedKicks = 0, chicks = 0, expectedChicks = 0, chokes = 0, expectedChokes = 0, strays = 0;
+    bool openInGap = false;
+
+    CPedalDetector detector;
+    for (int64_t timeUs = 0; timeUs < durationUs; timeUs += frameUs)
+    {
+        int64_t kickStartUs = timeUs - timeUs % kickPeriodUs;
+        int64_t hihatStartUs = (timeUs < hihatOffsetUs) ? -hihatPeriodUs : timeUs - (timeUs - hihatOffsetUs) % hihatPeriodUs;
+        bool slow = (hihatStartUs >= slowCloses.startUs && hihatStartUs < slowCloses.endUs);
+        int64_t hihatFallUs = slow ? 1000000 : 60000;
+
+        bool gap = InPedalGap(timeUs, timeUs + 1);
+        bool ankleOnly = (timeUs >= g_PedalAnkleOnly.startUs && timeUs < g_PedalAnkleOnly.endUs);
+        DrumFootInput left = MakeFoot(PedalHeight(timeUs - hihatStartUs, 0.1f, hihatRiseUs, hihatHoldUs, hihatFallUs), !gap && !ankleOnly, !gap);
+        DrumFootInput right = MakeFoot(PedalHeight(timeUs - kickStartUs, 0.08f, kickRiseUs, 0, kickFallUs), !gap && !ankleOnly, !gap);
+
+        DrumPedalEvent events[cPedalMaxEvents];
+        int count = detector.Update(left, right, timeUs, events);
+        for (int e = 0; e < count; ++e)
+        {
+            const DrumPedalEvent& event = events[e];
+            if (DRUM_PIECE_KICK == event.piece)
+            {
+                // A kick lands within two frames of the foot reaching the floor
+                int64_t landUs = kickStartUs + kickRiseUs + kickFallUs;
+                bool expected = (timeUs >= landUs - kickFallUs && timeUs < landUs + 2 * frameUs && !InPedalGap(kickStartUs, landUs));
+                kicks += (event.sounds && !event.chokes) ? 1 : 0;
+                strays += expected ? 0 : 1;
+            }
+            else
+            {
+                int64_t closedUs = hihatStartUs + hihatRiseUs + hihatHoldUs + hihatFallUs;
+                bool expected = (timeUs < closedUs + 2 * frameUs && !InPedalGap(hihatStartUs, closedUs));
+                chokes += event.chokes ? 1 : 0;
+                chicks += event.sounds ? 1 : 0;
+                strays += (expected && event.sounds != slow) ? 0 : 1;
+            }
+        }
+
+        // The legs have been gone for longer than the reset, so the hi-hat must have closed
+        openInGap = openInGap || (timeUs > g_PedalGaps[0].startUs + 2 * CPedalDetector::DefaultParams().resetUs &&
+                                  timeUs < g_PedalGaps[0].endUs && detector.IsHihatOpen());
+    }
+
+    for (int64_t startUs = 0; startUs < durationUs; startUs += kickPeriodUs)
+    {
+        expectedKicks += InPedalGap(startUs, startUs + kickRiseUs + kickFallUs) ? 0 : 1;
+    }
+
+    for (int64_t startUs = hihatOffsetUs; startUs < durationUs; startUs += hihatPeriodUs)
+    {
+        bool slow = (startUs >= slowCloses.startUs && startUs < slowCloses.endUs);
+        int64_t closedUs = startUs + hihatRiseUs + hihatHoldUs + (slow ? 1000000 : 60000);
+        if (closedUs >= durationUs)
+        {
+            continue;
+        }
+
+        expectedChokes += InPedalGap(startUs, closedUs) ? 0 : 1;
+        expectedChicks += (InPedalGap(startUs, closedUs) || slow) ? 0 : 1;
+    }
+
+    printf("%10s %10s %10s %10s %10s %10s %10s\n", "kicks", "expected", "chicks", "expected", "chokes", "expected", "strays");
+    printf("%10d %10d %10d %10d %10d %10d %10d\n", kicks, expectedKicks, chicks, expectedChicks, chokes, expectedChokes, strays);
+    failures += (kicks != expectedKicks || chicks != expectedChicks || chokes != expectedChokes || strays != 0 || openInGap);
+
+    // The hi-hat zone rings open while the pedal is up, and the engine chokes it when the pedal closes
+    CDrumEngine engine;
+    engine.Start(0);
+    CPedalTriggerSink sink;
+    SkeletonFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    SkeletonData& skel = frame.skeletons[0];
+    skel.trackingState = SKELETON_TRACKED;
+    skel.trackingId = 1;
+    for (int j = 0; j < cSkeletonJointCount; ++j)
+    {
+        skel.joints[j].z = 2.0f;
+        skel.jointStates[j] = SKELETON_JOINT_TRACKED;
+    }
+    skel.joints[SKELETON_JOINT_SHOULDER_CENTER].y = 0.4f;
+
+    int hihatZone = -1;
+    bool openWhileUp = false, closedWhileDown = true;
+    for (int f = 0; f < 60; ++f)
+    {
+        // Lifted from frame 10 to 30, back down by frame 33
+        float height = (f < 10) ? 0.0f : ((f < 30) ? 0.1f : ((f < 33) ? 0.1f - 0.033f * (f - 29) : 0.0f));
+        skel.joints[SKELETON_JOINT_FOOT_LEFT].y = -0.9f + ((height > 0.0f) ? height : 0.0f);
+        skel.joints[SKELETON_JOINT_ANKLE_LEFT].y = skel.joints[SKELETON_JOINT_FOOT_LEFT].y + 0.05f;
+        skel.joints[SKELETON_JOINT_FOOT_RIGHT].y = -0.9f;
+        skel.joints[SKELETON_JOINT_ANKLE_RIGHT].y = -0.85f;
+        engine.ProcessFrame(frame, f * frameUs, &sink);
+
+        CDrumPlayer* pPlayer = engine.Players().Find(1);
+        for (int z = 0; NULL != pPlayer && z < pPlayer->Zones().Count() && hihatZone < 0; ++z)
+        {
+            hihatZone = (DRUM_PIECE_HIHAT == pPlayer->Zones().SampleId(z)) ? z : hihatZone;
+        }
+
+        if (NULL != pPlayer && hihatZone >= 0)
+        {
+            int piece = pPlayer->ZonePiece(hihatZone);
+            openWhileUp = openWhileUp || (f > 12 && f < 30 && DRUM_PIECE_OPEN_HIHAT == piece);
+            closedWhileDown = closedWhileDown && ((f >= 10 && f <= 35) || DRUM_PIECE_HIHAT == piece);
+        }
+    }
+
+    int engineChokes = 0, enginePedals = 0;
+    for (size_t t = 0; t < sink.triggers.size(); ++t)
+    {
+        const DrumHitTrigger& trigger = sink.triggers[t];
+        engineChokes += (DRUM_TRIGGER_CHOKE == trigger.type && DRUM_PIECE_OPEN_HIHAT == trigger.piece && DRUM_PIECE_OPEN_HIHAT == trigger.sampleId) ? 1 : 0;
+        enginePedals += (DRUM_TRIGGER_PLAY == trigger.type && DRUM_PIECE_HIHAT_PEDAL == trigger.piece && trigger.zone < 0) ? 1 : 0;
+    }
+    printf("%10s %10s %10s %10s\n", "open", "closed", "chokes", "pedals");
+    printf("%10s %10s %10d %10d\n", openWhileUp ? "yes" : "no", closedWhileDown ? "yes" : "no", engineChokes, enginePedals);
+    failures += (!openWhileUp || !closedWhileDown || engineChokes != 1 || enginePedals != 1);
+
+    // A choked voice fades out within the choke time without jumping, other samples play on
+    CDrumMixer mixer;
+    mixer.Initialize(CDrumMixer::cDefaultSampleRate, CDrumMixer::cDefaultBlockFrames, 4);
+    std::vector<float> tone(CDrumMixer::cDefaultSampleRate * 2, 0.5f);
+    mixer.SetSample(DRUM_PIECE_OPEN_HIHAT, &tone[0], CDrumMixer::cDefaultSampleRate);
+    mixer.SetSample(DRUM_PIECE_KICK, &tone[0], CDrumMixer::cDefaultSampleRate);
+    std::vector<short> out(CDrumMixer::cDefaultBlockFrames * 2);
+    mixer.Trigger(DRUM_PIECE_OPEN_HIHAT, 1.0f, 0);
+    mixer.Render(&out[0], CDrumMixer::cDefaultBlockFrames, 0);
+    short ringing = out[0];
+    mixer.Choke(DRUM_PIECE_OPEN_HIHAT);
+
+    int fadeFrames = static_cast<int>(cDrumMixerChokeUs * CDrumMixer::cDefaultSampleRate / 1000000);
+    int blocks = (fadeFrames + CDrumMixer::cDefaultBlockFrames - 1) / CDrumMixer::cDefaultBlockFrames;
+    bool monotonic = true;
+    short previous = ringing;
+    for (int b = 0; b < blocks; ++b)
+    {
+        mixer.Render(&out[0], CDrumMixer::cDefaultBlockFrames, 0);
+        for (int i = 0; i < CDrumMixer::cDefaultBlockFrames; ++i)
+        {
+            monotonic = monotonic && out[i * 2] <= previous;
+            previous = out[i * 2];
+        }
+    }
+
+    mixer.Render(&out[0], CDrumMixer::cDefaultBlockFrames, 0);
+    bool silent = (0 == out[0]);
+    mixer.Trigger(DRUM_PIECE_KICK, 1.0f, 0);
+    mixer.Choke(DRUM_PIECE_OPEN_HIHAT);
+    mixer.Render(&out[0], CDrumMixer::cDefaultBlockFrames, 0);
+    mixer.Render(&out[0], CDrumMixer::cDefaultBlockFrames, 0);
+    bool othersPlay = (out[CDrumMixer::cDefaultBlockFrames * 2 - 1] == ringing);
+
+    DrumMixerStats mixerStats;
+    mixer.GetStats(&mixerStats);
+    printf("%10s %10s %10s %10s\n", "fade", "silent", "others", "choked");
+    printf("%10s %10s %10s %10llu\n", monotonic ? "smooth" : "jumps", silent ? "yes" : "no", othersPlay ? "play" : "cut",
+        static_cast<unsigned long long>(mixerStats.choked));
+    failures += (!monotonic || !silent || !othersPlay || 1 != mixerStats.choked || 0 == ringing);
+
+    // What the feet cost per frame
+    static const int iterations = 1000000;
+    DrumFootInput feet[2][64];
+    for (int i = 0; i < 64; ++i)
+    {
+        feet[0][i] = MakeFoot(PedalHeight(i * frameUs, 0.1f, hihatRiseUs, 0, hihatRiseUs), true, true);
+        feet[1][i] = MakeFoot(PedalHeight(i * frameUs, 0.08f, kickRiseUs, 0, kickFallUs), true, true);
+    }
+
+    detector.Reset();
+    int strokes = 0;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < iterations; ++i)
+    {
+        DrumPedalEvent events[cPedalMaxEvents];
+        strokes += detector.Update(feet[0][i & 63], feet[1][i & 63], i * frameUs, events);
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+    printf("%10s %10s\n", "ns/frame", "strokes");
+    printf("%10.1f %10d\n", elapsedUs * 1000.0 / iterations, strokes);
+
+    if (failures)
+    {
+        printf("FAILED: %d pedal checks\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// NuiTransformSmooth with its default parameters, rebuilt from the SDK's description:
+/// Holt double exponential smoothing with a jitter radius and a cap on how far a
+/// prediction may stray from the raw joint. Only here to compare against.
+/// </summary>
+class CHoltSkeletonFilter
+{
+public:
+    CHoltSkeletonFilter()
+    {
+        memset(m_seen, 0, sizeof(m_seen));
+    }
+
+    void Filter(SkeletonFrame* pFrame)
+    {
+        static const float smoothing = 0.5f;
+        static const float correction = 0.5f;
+        static const float prediction = 0.5f;
+        static const float jitterRadius = 0.05f;
+        static const float maxDeviation = 0.04f;
+
+        for (int s = 0; s < cSkeletonCount; ++s)
+        {
+            SkeletonData& skel = pFrame->skeletons[s];
+            if (SKELETON_TRACKED != skel.trackingState)
+            {
+                m_seen[s] = 0;
+                continue;
+            }
+
+            for (int j = 0; j < cSkeletonJointCount; ++j)
+            {
+                float* pRaw = &skel.joints[j].x;
+                float* pFiltered = m_filtered[s][j];
+                float* pTrend = m_trend[s][j];
+                float filtered[3];
+                float trend[3];
+
+                if (0 == m_seen[s])
+                {
+                    for (int a = 0; a < 3; ++a)
+                    {
+                        filtered[a] = pRaw[a];
+                        trend[a] = 0.0f;
+                    }
+                }
+                else if (1 == m_seen[s])
+                {
+                    for (int a = 0; a < 3; ++a)
+                    {
+                        filtered[a] = (pRaw[a] + m_raw[s][j][a]) * 0.5f;
+                        trend[a] = (filtered[a] - pFiltered[a]) * correction + pTrend[a] * (1.0f - correction);
+                    }
+                }
+                else
+                {
+                    // Moves within the jitter radius are damped in proportion to their size
+                    float length = Length(pRaw, pFiltered);
+                    float damp = (length <= jitterRadius) ? length / jitterRadius : 1.0f;
+                    for (int a = 0; a < 3; ++a)
+                    {
+                        float raw = pRaw[a] * damp + pFiltered[a] * (1.0f - damp);
+                        filtered[a] = raw * (1.0f - smoothing) + (pFiltered[a] + pTrend[a]) * smoothing;
+                        trend[a] = (filtered[a] - pFiltered[a]) * correction + pTrend[a] * (1.0f - correction);
+                    }
+                }
+
+                float predicted[3];
+                for (int a = 0; a < 3; ++a)
+                {
+                    predicted[a] = filtered[a] + trend[a] * prediction;
+                }
+
+                float deviation = Length(predicted, pRaw);
+                float keep = (deviation > maxDeviation) ? maxDeviation / deviation : 1.0f;
+                for (int a = 0; a < 3; ++a)
+                {
+                    m_raw[s][j][a] = pRaw[a];
+                    pFiltered[a] = filtered[a];
+                    pTrend[a] = trend[a];
+                    pRaw[a] = predicted[a] * keep + pRaw[a] * (1.0f - keep);
+                }
+            }
+
+            m_seen[s] = (m_seen[s] < 2) ? m_seen[s] + 1 : 2;
+        }
+    }
+
+private:
+    int                     m_seen[cSkeletonCount];
+    float                   m_raw[cSkeletonCount][cSkeletonJointCount][3];
+    float                   m_filtered[cSkeletonCount][cSkeletonJointCount][3];
+    float                   m_trend[cSkeletonCount][cSkeletonJointCount][3];
+
+    static float Length(const float* a, const float* b)
+    {
+        float dx = a[0] - b[0];
+        float dy = a[1] - b[1];
+        float dz = a[2] - b[2];
+        return sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+};
+
+// How a stream of frames is smoothed before detection
+enum BenchSmoothing
+{
+    BENCH_SMOOTHING_NONE = 0,
+    BENCH_SMOOTHING_HOLT,
+    BENCH_SMOOTHING_ONE_EURO
+};
+
+/// <summary>
+/// What a smoothing did to a jittered stream, against the stream without jitter
+/// </summary>
+struct FilterScore
+{
+    double                  bodyJitterMm;       // RMS error of the shoulder center, which never moves
+    double                  handErrorMm;        // RMS error of the hands
+    double                  handLagMs;          // how far the hands trail the clean ones, from their velocity
+    PipelineScore           pipeline;
+};
+
+/// <summary>
+/// Smooths a jittered stream, measures lag and jitter against the clean stream and plays the result
+/// </summary>
+/// <param name="clean">frames without jitter</param>
+/// <param name="noisy">the same frames with jitter</param>
+/// <param name="frameTimes">capture times of the frames</param>
+/// <param name="truth">strokes of the performance</param>
+/// <param name="smoothing">BenchSmoothing</param>
+/// <param name="params">One-Euro settings</param>
+/// <param name="pScore">receives the score</param>
+static void ScoreSmoothing(const std::vector<SkeletonFrame>& clean, const std::vector<SkeletonFrame>& noisy,
+                           const std::vector<int64_t>& frameTimes, const std::vector<SyntheticHit>& truth,
+                           int smoothing, const SkeletonFilterParams& params, FilterScore* pScore)
+{
+    static const int hands[2] = { SKELETON_JOINT_HAND_LEFT, SKELETON_JOINT_HAND_RIGHT };
+
+    CSkeletonFilter filter;
+    filter.SetParams(params);
+    CHoltSkeletonFilter* pHolt = new CHoltSkeletonFilter();
+
+    CDrumEngine engine;
+    CPipelineNoteSink sink;
+    engine.Start(0);
+
+    double bodySum = 0.0;
+    double handSum = 0.0;
+    double lagSum = 0.0;
+    double speedSum = 0.0;
+    int bodyCount = 0;
+    int handCount = 0;
+    for (size_t f = 0; f < noisy.size(); ++f)
+    {
+        SkeletonFrame frame = noisy[f];
+        if (BENCH_SMOOTHING_HOLT == smoothing)
+        {
+            pHolt->Filter(&frame);
+        }
+        else if (BENCH_SMOOTHING_ONE_EURO == smoothing)
+        {
+            filter.Filter(&frame, frameTimes[f]);
+        }
+
+        engine.ProcessFrame(frame, frameTimes[f], &sink);
+
+        // The first second lets every smoothing settle
+        if (frameTimes[f] - frameTimes[0] < 1000000)
+        {
+            continue;
+        }
+
+        const SkeletonData& skel = frame.skeletons[0];
+        const SkeletonData& real = clean[f].skeletons[0];
+        const SkeletonData& before = clean[f - 1].skeletons[0];
+        double frameS = (frameTimes[f] - frameTimes[f - 1]) / 1000000.0;
+
+        const float* pShoulder = &skel.joints[SKELETON_JOINT_SHOULDER_CENTER].x;
+        const float* pRealShoulder = &real.joints[SKELETON_JOINT_SHOULDER_CENTER].x;
+        for (int a = 0; a < 3; ++a)
+        {
+            bodySum += (pShoulder[a] - pRealShoulder[a]) * (pShoulder[a] - pRealShoulder[a]);
+        }
+        ++bodyCount;
+
+        // A joint lagging by t sits t times its velocity behind; the least squares t over the run is the lag
+        for (int h = 0; h < 2; ++h)
+        {
+            const float* pHand = &skel.joints[hands[h]].x;
+            const float* pRealHand = &real.joints[hands[h]].x;
+            const float* pRealBefore = &before.joints[hands[h]].x;
+            for (int a = 0; a < 3; ++a)
+            {
+                double error = pRealHand[a] - pHand[a];
+                double velocity = (pRealHand[a] - pRealBefore[a]) / frameS;
+                handSum += error * error;
+                lagSum += error * velocity;
+                speedSum += velocity * velocity;
+            }
+            ++handCount;
+        }
+    }
+
+    engine.Stop();
+    delete pHolt;
+
+    pScore->bodyJitterMm = 1000.0 * sqrt(bodySum / (bodyCount ? bodyCount : 1));
+    pScore->handErrorMm = 1000.0 * sqrt(handSum / (handCount ? handCount : 1));
+    pScore->handLagMs = (speedSum > 0.0) ? 1000.0 * lagSum / speedSum : 0.0;
+    ScorePipelineNotes(truth, sink.notes, frameTimes[0] + 1000000, frameTimes.back(), &pScore->pipeline);
+}
+
+/// <summary>
+/// Generates a performance without jitter and a copy of it with uniform jitter on every coordinate
+/// </summary>
+static bool GenerateFilterStreams(int skeletonCount, float noise, int frameCount, std::vector<SkeletonFrame>& clean,
+                                  std::vector<SkeletonFrame>& noisy, std::vector<int64_t>& frameTimes, std::vector<SyntheticHit>& truth)
+{
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = skeletonCount;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+
+    CSkeletonGenerator generator;
+    if (FAILED(generator.Initialize(params, zones)))
+    {
+        return false;
+    }
+
+    clean.resize(frameCount);
+    frameTimes.resize(frameCount);
+    truth.clear();
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SyntheticHit hits[2 * cSkeletonCount * 4];
+        int hitCount = generator.NextFrame(&clean[f], hits, 2 * cSkeletonCount * 4);
+        truth.insert(truth.end(), hits, hits + hitCount);
+        frameTimes[f] = generator.TimeUs();
+    }
+
+    noisy = clean;
+    for (int f = 0; f < frameCount; ++f)
+    {
+        for (int s = 0; s < skeletonCount; ++s)
+        {
+            float* pCoordinates = &noisy[f].skeletons[s].joints[0].x;
+            for (int l = 0; l < cSkeletonFilterLanes; ++l)
+            {
+                pCoordinates[l] += RandomFloat(-noise, noise);
+            }
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Measures the lag and jitter the SDK's default smoothing and the One-Euro filter leave
+/// on a jittered stream, what detection makes of each, and what the filter costs
+/// </summary>
+/// <returns>0 on success, 1 if the filter smooths or detects worse than it should</returns>
+static int BenchSkeletonFilter()
+{
+    static const int frameCount = 30 * 120;
+    static const float noise = 0.01f;
+
+    std::vector<SkeletonFrame> clean;
+    std::vector<SkeletonFrame> noisy;
+    std::vector<int64_t> frameTimes;
+    std::vector<SyntheticHit> truth;
+    if (!GenerateFilterStreams(1, noise, frameCount, clean, noisy, frameTimes, truth))
+    {
+        printf("FAILED: generator rejected the drummer\n");
+        return 1;
+    }
+
+    int failures = 0;
+
+    // A filter must leave a still joint where it is and follow a step exactly in the end
+    {
+        CSkeletonFilter filter;
+        SkeletonFrame frame = clean[0];
+        SkeletonFrame still = frame;
+        bool steady = true;
+        for (int f = 0; f < 10; ++f)
+        {
+            frame = still;
+            filter.Filter(&frame, f * 33333);
+            steady = steady && (0 == memcmp(&frame, &still, sizeof(frame)));
+        }
+
+        float target = still.skeletons[0].joints[SKELETON_JOINT_HAND_RIGHT].x + 0.3f;
+        float last = 0.0f;
+        for (int f = 10; f < 300; ++f)
+        {
+            frame = still;
+            frame.skeletons[0].joints[SKELETON_JOINT_HAND_RIGHT].x = target;
+            filter.Filter(&frame, f * 33333);
+            last = frame.skeletons[0].joints[SKELETON_JOINT_HAND_RIGHT].x;
+        }
+
+        // A new drummer in the slot starts unfiltered
+        still.skeletons[0].trackingId += 1;
+        frame = still;
+        filter.Filter(&frame, 300 * 33333);
+        bool restarted = (0 == memcmp(&frame, &still, sizeof(frame)));
+
+        SkeletonFilterParams bad = CSkeletonFilter::DefaultParams();
+        bad.handMinCutoff = 0.0f;
+        if (!steady || fabsf(last - target) > 0.0005f || !restarted || SUCCEEDED(filter.SetParams(bad)))
+        {
+            printf("FAILED: filter moved a still joint (%d), missed a step by %.4f m, kept a new drummer's past (%d) or took a zero cutoff\n",
+                steady ? 0 : 1, fabsf(last - target), restarted ? 0 : 1);
+            ++failures;
+        }
+    }
+
+    printf("filter (%d s of one generated drummer, %.0f mm uniform jitter on every coordinate)\n", frameCount / 30, noise * 1000.0f);
+    printf("%-22s %12s %12s %10s %8s %10s %10s %10s\n",
+        "smoothing", "body mm", "hand mm", "lag ms", "notes", "precision", "recall", "error ms");
+
+    struct SmoothingRow
+    {
+        const char*             name;
+        int                     smoothing;
+        float                   handMinCutoff;
+        float                   handBeta;
+    };
+
+    const SkeletonFilterParams defaults = CSkeletonFilter::DefaultParams();
+    const SmoothingRow rows[] =
+    {
+        { "none", BENCH_SMOOTHING_NONE, 0.0f, 0.0f },
+        { "sdk default (holt)", BENCH_SMOOTHING_HOLT, 0.0f, 0.0f },
+        { "one-euro", BENCH_SMOOTHING_ONE_EURO, defaults.handMinCutoff, defaults.handBeta },
+        { "one-euro, no beta", BENCH_SMOOTHING_ONE_EURO, defaults.handMinCutoff, 0.0f },
+        { "one-euro, beta x4", BENCH_SMOOTHING_ONE_EURO, defaults.handMinCutoff, 4.0f * defaults.handBeta },
+    };
+
+    FilterScore scores[sizeof(rows) / sizeof(rows[0])];
+    for (size_t r = 0; r < sizeof(rows) / sizeof(rows[0]); ++r)
+    {
+        SkeletonFilterParams params = defaults;
+        if (BENCH_SMOOTHING_ONE_EURO == rows[r].smoothing)
+        {
+            params.handMinCutoff = rows[r].handMinCutoff;
+            params.handBeta = rows[r].handBeta;
+        }
+
+        FilterScore& score = scores[r];
+        ScoreSmoothing(clean, noisy, frameTimes, truth, rows[r].smoothing, params, &score);
+        printf("%-22s %12.2f %12.2f %10.1f %8d %10.3f %10.3f %10.1f\n", rows[r].name, score.bodyJitterMm, score.handErrorMm,
+            score.handLagMs, score.pipeline.notes, score.pipeline.precision, score.pipeline.recall, score.pipeline.errorMs);
+    }
+
+    // The SDK's trend prediction all but cancels the lag by overshooting, so the filter is held to
+    // the error it leaves: it must calm the body and keep the hands closer than the SDK smoothing
+    // does, and place notes at least as well
+    const FilterScore& none = scores[0];
+    const FilterScore& holt = scores[1];
+    const FilterScore& euro = scores[2];
+    if (euro.bodyJitterMm > 0.5 * none.bodyJitterMm || euro.bodyJitterMm > holt.bodyJitterMm || euro.handErrorMm > holt.handErrorMm ||
+        euro.pipeline.precision < 0.95f || euro.pipeline.recall < 0.95f || euro.pipeline.errorMs > holt.pipeline.errorMs)
+    {
+        printf("FAILED: one-euro should halve the body jitter, leave less error than the SDK smoothing and detect at 0.95\n");
+        ++failures;
+    }
+
+    // Cost of a frame with every slot tracked
+    std::vector<SkeletonFrame> six;
+    std::vector<SkeletonFrame> sixNoisy;
+    std::vector<SyntheticHit> sixTruth;
+    if (!GenerateFilterStreams(cSkeletonCount, noise, 300, six, sixNoisy, frameTimes, sixTruth))
+    {
+        printf("FAILED: generator rejected %d drummers\n", cSkeletonCount);
+        return 1;
+    }
+
+    static const int passes = 100;
+    CSkeletonFilter filter;
+    float checksum = 0.0f;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int p = 0; p < passes; ++p)
+    {
+        filter.Reset();
+        for (size_t f = 0; f < sixNoisy.size(); ++f)
+        {
+            SkeletonFrame frame = sixNoisy[f];
+            filter.Filter(&frame, frameTimes[f]);
+            checksum += frame.skeletons[cSkeletonCount - 1].joints[SKELETON_JOINT_HAND_RIGHT].y;
+        }
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+    printf("%10s %16s %10s\n", "skeletons", "ns/frame+copy", "checksum");
+    printf("%10d %16.1f %10.1f\n", cSkeletonCount, elapsedUs * 1000.0 / (passes * sixNoisy.size()), checksum);
+
+    if (failures)
+    {
+        printf("FAILED: %d filter checks\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Two simulated sensors: sensor 1 stands to the drummer's left, turned towards him,
+// and takes its frames 13 ms after sensor 0 does
+static const int64_t g_FusionFineUs = 3333;
+static const int     g_FusionFinePerFrame = 10;
+static const int     g_FusionSensorPhase = 4;
+static const int64_t g_FusionStartUs = 10000000;
+static const float   g_FusionYawDegrees = 35.0f;
+
+/// <summary>
+/// One frame of a simulated sensor, in the order frames reach the host
+/// </summary>
+struct FusionArrival
+{
+    int                     sensor;
+    size_t                  frame;
+    int64_t                 arrivalUs;
+};
+
+/// <summary>
+/// What two sensors made of one drummer
+/// </summary>
+struct FusionStreams
+{
+    std::vector<SkeletonFrame> frames[2];
+    std::vector<FusionArrival> arrivals;        // in arrival order
+    std::vector<SyntheticHit> truth;            // on sensor 0's clock
+    SkeletonSensorPose      pose;               // where sensor 1 stands
+};
+
+/// <summary>
+/// Hides a hand and its wrist the way the sensor does behind a cymbal: inferred, and stuck where it was last seen
+/// </summary>
+static void HideHand(SkeletonData& skel, int hand, bool hidden, SkeletonPoint* pLastSeen)
+{
+    int wrist = hand - 1;
+    if (!hidden)
+    {
+        pLastSeen[0] = skel.joints[wrist];
+        pLastSeen[1] = skel.joints[hand];
+        return;
+    }
+
+    skel.joints[wrist] = pLastSeen[0];
+    skel.joints[hand] = pLastSeen[1];
+    skel.jointStates[wrist] = SKELETON_JOINT_INFERRED;
+    skel.jointStates[hand] = SKELETON_JOINT_INFERRED;
+}
+
+/// <summary>
+/// Generates a drummer as two sensors see him. Every 4 s sensor 0 loses the right hand for 2 s
+/// and sensor 1 the left hand for 2 s, a second later. Frames reach the host 8 to 20 ms after capture.
+/// </summary>
+/// <param name="clockOffsetUs">how far sensor 1's clock is ahead of sensor 0's</param>
+/// <param name="silentAfterUs">sensor 1 sends nothing captured after this long</param>
+/// <param name="pStreams">receives the frames</param>
+/// <returns>false if the generator rejected the drummer</returns>
+static bool GenerateFusionStreams(int64_t clockOffsetUs, int64_t silentAfterUs, FusionStreams* pStreams)
+{
+    static const int seconds = 120;
+    static const float noise = 0.002f;
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.frameUs = g_FusionFineUs;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+
+    CSkeletonGenerator generator;
+    if (FAILED(generator.Initialize(params, zones)))
+    {
+        return false;
+    }
+
+    float angle = g_FusionYawDegrees * 3.14159265f / 180.0f;
+    SkeletonSensorPose pose = { { cosf(angle), 0.0f, sinf(angle), 0.0f, 1.0f, 0.0f, -sinf(angle), 0.0f, cosf(angle) }, { -1.2f, 0.05f, 0.7f } };
+    pStreams->pose = pose;
+    pStreams->truth.clear();
+    pStreams->arrivals.clear();
+
+    SkeletonPoint lastSeen[2][2][2];        // sensor, hand, wrist and hand
+    memset(lastSeen, 0, sizeof(lastSeen));
+    int fineCount = seconds * 1000000 / static_cast<int>(g_FusionFineUs);
+    for (int f = 0; f < fineCount; ++f)
+    {
+        SkeletonFrame frame;
+        SyntheticHit hits[2 * cSkeletonCount * 4];
+        int hitCount = generator.NextFrame(&frame, hits, 2 * cSkeletonCount * 4);
+        for (int h = 0; h < hitCount; ++h)
+        {
+            hits[h].timeUs += g_FusionStartUs;
+            pStreams->truth.push_back(hits[h]);
+        }
+
+        int phase = f % g_FusionFinePerFrame;
+        if (0 != phase && g_FusionSensorPhase != phase)
+        {
+            continue;
+        }
+
+        int sensor = (0 == phase) ? 0 : 1;
+        int64_t captureUs = generator.TimeUs() + g_FusionStartUs;
+        if (1 == sensor && generator.TimeUs() >= silentAfterUs)
+        {
+            continue;
+        }
+
+        SkeletonData& skel = frame.skeletons[0];
+        int64_t cycleUs = generator.TimeUs() % 4000000;
+        HideHand(skel, SKELETON_JOINT_HAND_RIGHT, 0 == sensor && cycleUs < 2000000, lastSeen[sensor][0]);
+        HideHand(skel, SKELETON_JOINT_HAND_LEFT, 1 == sensor && cycleUs >= 1000000 && cycleUs < 3000000, lastSeen[sensor][1]);
+
+        float* pCoordinates = &skel.joints[0].x;
+        for (int l = 0; l < cSkeletonFilterLanes; ++l)
+        {
+            pCoordinates[l] += RandomFloat(-noise, noise);
+        }
+
+        // Sensor 1 sees everything from where it stands: p = R^T (q - t)
+        if (1 == sensor)
+        {
+            SkeletonPoint* pPoints[cSkeletonJointCount + 1];
+            for (int j = 0; j < cSkeletonJointCount; ++j)
+            {
+                pPoints[j] = &skel.joints[j];
+            }
+            pPoints[cSkeletonJointCount] = &skel.position;
+
+            const float* r = pose.rotation;
+            for (int j = 0; j <= cSkeletonJointCount; ++j)
+            {
+                SkeletonPoint d = { pPoints[j]->x - pose.translation[0], pPoints[j]->y - pose.translation[1], pPoints[j]->z - pose.translation[2] };
+                pPoints[j]->x = r[0] * d.x + r[3] * d.y + r[6] * d.z;
+                pPoints[j]->y = r[1] * d.x + r[4] * d.y + r[7] * d.z;
+                pPoints[j]->z = r[2] * d.x + r[5] * d.y + r[8] * d.z;
+            }
+        }
+
+        frame.timestampMs = (captureUs + ((1 == sensor) ? clockOffsetUs : 0)) / 1000;
+        frame.frameNumber = static_cast<uint32_t>(pStreams->frames[sensor].size());
+
+        FusionArrival arrival = { sensor, pStreams->frames[sensor].size(), captureUs + 8000 + static_cast<int64_t>(RandomFloat(0.0f, 12000.0f)) };
+        pStreams->frames[sensor].push_back(frame);
+        pStreams->arrivals.push_back(arrival);
+    }
+
+    std::stable_sort(pStreams->arrivals.begin(), pStreams->arrivals.end(),
+        [](const FusionArrival& a, const FusionArrival& b) { return a.arrivalUs < b.arrivalUs; });
+    return true;
+}
+
+/// <summary>
+/// How the fusion did on one pair of streams
+/// </summary>
+struct FusionRun
+{
+    PipelineScore           score;
+    SkeletonFusionStats     stats;
+    LatencySummary          wait;
+    double                  offsetErrorMs;      // learned clock offset against the real one
+    double                  translationErrorMm; // learned pose against the real one
+    double                  rotationErrorDegrees;
+    bool                    registered;
+    uint64_t                referenceFrames;    // frames sensor 0 sent
+    double                  nsPerFrame;         // pushing and popping, per fused frame
+};
+
+/// <summary>
+/// Plays the streams of two sensors through the fusion into the engine, frame by frame in
+/// arrival order on a simulated clock, or only sensor 0's straight into the engine
+/// </summary>
+static void RunFusion(const FusionStreams& streams, int64_t clockOffsetUs, bool fuse, FusionRun* pRun)
+{
+    CDrumEngine engine;
+    CPipelineNoteSink sink;
+    engine.Start(0);
+
+    CLatencyTracer tracer;
+    CSkeletonFusion fusion;
+    fusion.Initialize(fuse ? 2 : 1);
+    fusion.SetLatencyTracer(&tracer);
+
+    SkeletonFrame fused;
+    int64_t fusedUs = 0;
+    int64_t arrivalUs = 0;
+    int64_t nowUs = 0;
+    int64_t fusionUs = 0;
+    for (size_t a = 0; a <= streams.arrivals.size(); ++a)
+    {
+        // Frames that wait out their time go before the next frame arrives; after the last one, all of them
+        bool last = (a == streams.arrivals.size());
+        int64_t nextUs = last ? INT64_MAX : streams.arrivals[a].arrivalUs;
+        if (!fuse)
+        {
+            if (!last)
+            {
+                const SkeletonFrame& frame = streams.frames[0][streams.arrivals[a].frame];
+                if (0 == streams.arrivals[a].sensor)
+                {
+                    engine.ProcessFrame(frame, frame.timestampMs * 1000, &sink);
+                }
+            }
+            continue;
+        }
+
+        for (;;)
+        {
+            int64_t dueUs = fusion.TimeUntilDueUs(nowUs);
+            if (dueUs < 0 || nowUs + dueUs > nextUs)
+            {
+                break;
+            }
+
+            nowUs += dueUs;
+            int64_t startUs = DrumGetTimeMicroseconds();
+            HRESULT hr = fusion.Pop(nowUs, &fused, &fusedUs, &arrivalUs);
+            fusionUs += DrumGetTimeMicroseconds() - startUs;
+            if (S_OK != hr)
+            {
+                break;
+            }
+            engine.ProcessFrame(fused, fusedUs, &sink);
+        }
+
+        if (last)
+        {
+            break;
+        }
+
+        const FusionArrival& arrival = streams.arrivals[a];
+        const SkeletonFrame& frame = streams.frames[arrival.sensor][arrival.frame];
+        nowUs = arrival.arrivalUs;
+        int64_t startUs = DrumGetTimeMicroseconds();
+        fusion.Push(arrival.sensor, frame, frame.timestampMs * 1000, nowUs);
+        HRESULT hr = fusion.Pop(nowUs, &fused, &fusedUs, &arrivalUs);
+        fusionUs += DrumGetTimeMicroseconds() - startUs;
+        while (S_OK == hr)
+        {
+            engine.ProcessFrame(fused, fusedUs, &sink);
+            startUs = DrumGetTimeMicroseconds();
+            hr = fusion.Pop(nowUs, &fused, &fusedUs, &arrivalUs);
+            fusionUs += DrumGetTimeMicroseconds() - startUs;
+        }
+    }
+    engine.Stop();
+
+    // The fused clock runs the quickest transport delay ahead of sensor 0's
+    int64_t shiftUs = fuse ? fusion.ClockOffsetUs(0) : 0;
+    std::vector<SyntheticHit> truth = streams.truth;
+    for (size_t h = 0; h < truth.size(); ++h)
+    {
+        truth[h].timeUs += shiftUs;
+    }
+
+    // Learning where sensor 1 stands takes the first seconds
+    const std::vector<SkeletonFrame>& reference = streams.frames[0];
+    ScorePipelineNotes(truth, sink.notes, g_FusionStartUs + 3000000 + shiftUs, reference.back().timestampMs * 1000 + shiftUs, &pRun->score);
+
+    fusion.GetStats(&pRun->stats);
+    tracer.GetSummary(LATENCY_STAGE_FUSION, &pRun->wait);
+    pRun->referenceFrames = reference.size();
+    pRun->nsPerFrame = pRun->stats.fused ? fusionUs * 1000.0 / pRun->stats.fused : 0.0;
+    pRun->registered = fuse && fusion.IsRegistered(1);
+    pRun->offsetErrorMs = fuse ? fabs((fusion.ClockOffsetUs(0) - fusion.ClockOffsetUs(1)) - clockOffsetUs) / 1000.0 : 0.0;
+
+    // Angle of the rotation between the learned pose and the real one, and the distance between the sensor positions
+    const SkeletonSensorPose& learned = fusion.SensorPose(fuse ? 1 : 0);
+    double trace = 0.0;
+    double distance = 0.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            trace += learned.rotation[3 * k + i] * streams.pose.rotation[3 * k + i];
+        }
+        double d = learned.translation[i] - streams.pose.translation[i];
+        distance += d * d;
+    }
+    double cosine = (trace - 1.0) * 0.5;
+    pRun->rotationErrorDegrees = acos((cosine > 1.0) ? 1.0 : ((cosine < -1.0) ? -1.0 : cosine)) * 180.0 / 3.14159265;
+    pRun->translationErrorMm = 1000.0 * sqrt(distance);
+}
+
+/// <summary>
+/// Fuses two simulated sensors that each lose a hand part of the time, with their clocks set
+/// apart, and scores the notes against one sensor alone
+/// </summary>
+/// <returns>0 on success, 1 if the fusion missed alignment, pose or notes</returns>
+static int BenchFusion()
+{
+    int failures = 0;
+
+    // Bad counts, sensors and settings are turned away
+    {
+        CSkeletonFusion fusion;
+        SkeletonFusionParams bad = CSkeletonFusion::DefaultParams();
+        bad.trackedWeight = 0.0f;
+        SkeletonFrame frame;
+        memset(&frame, 0, sizeof(frame));
+        bool rejected = FAILED(fusion.Initialize(0)) && FAILED(fusion.Initialize(cSkeletonFusionMaxSensors + 1)) &&
+                        SUCCEEDED(fusion.Initialize(2)) && FAILED(fusion.SetSensorPose(0, fusion.SensorPose(0))) &&
+                        FAILED(fusion.Push(2, frame, 0, 0)) && FAILED(fusion.SetParams(bad));
+        if (!rejected)
+        {
+            printf("FAILED: fusion took a bad sensor count, sensor or setting\n");
+            ++failures;
+        }
+    }
+
+    struct FusionRow
+    {
+        const char*             name;
+        bool                    fuse;
+        int64_t                 clockOffsetUs;
+        int64_t                 silentAfterUs;
+    };
+
+    static const FusionRow rows[] =
+    {
+        { "sensor 0 only", false, 0, INT64_MAX },
+        { "fused, clock +7.3 s", true, 7300000, INT64_MAX },
+        { "fused, clock -2.5 s", true, -2500000, INT64_MAX },
+        { "fused, 1 quits at 60 s", true, 7300000, 60000000 },
+    };
+
+    const SkeletonFusionParams defaults = CSkeletonFusion::DefaultParams();
+    printf("fusion (120 s of one drummer seen by 2 sensors 13 ms apart, each losing a hand 2 s in every 4)\n");
+    printf("%-24s %9s %8s %8s %8s %6s %9s %8s %8s %8s %6s %9s %8s %8s\n", "run", "clock ms", "pose mm", "pose deg",
+        "fused", "short", "recovered", "wait p50", "wait p99", "wait max", "notes", "precision", "recall", "error ms");
+
+    float aloneRecall = 0.0f;
+    double nsPerFrame = 0.0;
+    for (size_t r = 0; r < sizeof(rows) / sizeof(rows[0]); ++r)
+    {
+        FusionStreams streams;
+        if (!GenerateFusionStreams(rows[r].clockOffsetUs, rows[r].silentAfterUs, &streams))
+        {
+            printf("FAILED: generator rejected the drummer\n");
+            return 1;
+        }
+
+        FusionRun run;
+        RunFusion(streams, rows[r].clockOffsetUs, rows[r].fuse, &run);
+        if (!rows[r].fuse)
+        {
+            printf("%-24s %9s %8s %8s %8llu %6s %9s %8s %8s %8s %6d %9.3f %8.3f %8.1f\n", rows[r].name, "-", "-", "-",
+                static_cast<unsigned long long>(run.referenceFrames), "-", "-", "-", "-", "-",
+                run.score.notes, run.score.precision, run.score.recall, run.score.errorMs);
+            aloneRecall = run.score.recall;
+            continue;
+        }
+
+        printf("%-24s %9.2f %8.1f %8.2f %8llu %6llu %9llu %8.1f %8.1f %8.1f %6d %9.3f %8.3f %8.1f\n", rows[r].name,
+            run.offsetErrorMs, run.translationErrorMm, run.rotationErrorDegrees, static_cast<unsigned long long>(run.stats.fused),
+            static_cast<unsigned long long>(run.stats.incomplete), static_cast<unsigned long long>(run.stats.recoveredJoints),
+            run.wait.p50Us / 1000.0, run.wait.p99Us / 1000.0, run.wait.maxUs / 1000.0,
+            run.score.notes, run.score.precision, run.score.recall, run.score.errorMs);
+
+        // Every frame of sensor 0 goes out once, none waits past its deadline (give or take a histogram bucket),
+        // and the clock and the pose are learned closely
+        int64_t waitLimitUs = defaults.maxWaitUs + defaults.maxWaitUs / 16;
+        if (run.stats.fused != run.referenceFrames || run.stats.late || run.wait.maxUs > waitLimitUs ||
+            !run.registered || run.offsetErrorMs > 2.0 || run.translationErrorMm > 20.0 || run.rotationErrorDegrees > 1.0)
+        {
+            printf("FAILED: every frame should go out within %.0f ms, and the clock within 2 ms and the pose within 20 mm and 1 degree\n",
+                defaults.maxWaitUs / 1000.0);
+            ++failures;
+        }
+
+        // With both sensors there all along, the hands one sensor loses must come from the other
+        if (INT64_MAX == rows[r].silentAfterUs &&
+            (run.score.precision < 0.95f || run.score.recall < 0.95f || run.score.recall < aloneRecall + 0.1f))
+        {
+            printf("FAILED: fused notes should reach 0.95 and recall well above one sensor's %.3f\n", aloneRecall);
+            ++failures;
+        }
+
+        nsPerFrame = (nsPerFrame > 0.0) ? nsPerFrame : run.nsPerFrame;
+    }
+    printf("%16s\n%16.0f\n", "ns/fused frame", nsPerFrame);
+
+    if (failures)
+    {
+        printf("FAILED: %d fusion checks\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+static const int     g_ReactorFrames = 400;
+static const int64_t g_ReactorFrameUs = 2000;
+static const int64_t g_ReactorUiCostUs = 100;
+static const int     g_ReactorUiPerFrame = 14;         // 1.4 ms of UI work every 2 ms frame
+static const int64_t g_ReactorFrameDelayUs = 300;      // frame after the UI burst, while it is being worked off
+
+/// <summary>
+/// Loop under load and what its handlers saw
+/// </summary>
+struct ReactorLoad
+{
+    CDrumReactor            reactor;
+    CDrumReactorEvent       frame;
+    std::atomic<int64_t>    signalledUs;
+    CLatencyHistogram       frameLatency;       // frame signalled to its handler running
+    int64_t                 uiCostUs;
+    uint64_t                frames;
+    uint64_t                uiDone;
+    uint64_t                configDone;
+    std::atomic<bool>       drained;
+};
+
+/// <summary>
+/// What one reactor run did
+/// </summary>
+struct ReactorRun
+{
+    LatencySummary          latency;
+    uint64_t                frames;
+    uint64_t                uiPosted;
+    uint64_t                uiDone;
+    uint64_t                configPosted;
+    uint64_t                configDone;
+    int                     early;              // timers run before they were due
+    DrumReactorStats        stats;
+};
+
+static void OnReactorFrame(void* pContext)
+{
+    ReactorLoad* pLoad = static_cast<ReactorLoad*>(pContext);
+    pLoad->frameLatency.Record(DrumGetTimeMicroseconds() - pLoad->signalledUs.load(std::memory_order_acquire));
+    ++pLoad->frames;
+}
+
+static void OnReactorUi(void* pContext)
+{
+    ReactorLoad* pLoad = static_cast<ReactorLoad*>(pContext);
+    int64_t startUs = DrumGetTimeMicroseconds();
+    while (DrumGetTimeMicroseconds() - startUs < pLoad->uiCostUs)
+    {
+    }
+    ++pLoad->uiDone;
+}
+
+static void OnReactorConfig(void* pContext)
+{
+    ++static_cast<ReactorLoad*>(pContext)->configDone;
+}
+
+static void OnReactorDrained(void* pContext)
+{
+    static_cast<ReactorLoad*>(pContext)->drained.store(true, std::memory_order_release);
+}
+
+/// <summary>
+/// Signals a frame every g_ReactorFrameUs to a loop on its own thread, after a burst of
+/// UI work and a config change. With oneQueue the frames are posted behind the UI work
+/// instead, the way a loop with a single queue would see them.
+/// </summary>
+static void RunReactorLoad(bool flood, bool oneQueue, ReactorRun* pRun)
+{
+    ReactorLoad* pLoad = new ReactorLoad();
+    pLoad->signalledUs = 0;
+    pLoad->uiCostUs = g_ReactorUiCostUs;
+    pLoad->frames = 0;
+    pLoad->uiDone = 0;
+    pLoad->configDone = 0;
+    pLoad->drained = false;
+    memset(pRun, 0, sizeof(*pRun));
+
+    pLoad->reactor.Initialize();
+    pLoad->frame.Create();
+    pLoad->reactor.AddEvent(&pLoad->frame, DRUM_REACTOR_SENSOR, OnReactorFrame, pLoad);
+    std::thread loop(&CDrumReactor::Run, &pLoad->reactor);
+
+    int64_t startUs = DrumGetTimeMicroseconds() + g_ReactorFrameUs;
+    for (int f = 0; f < g_ReactorFrames; ++f)
+    {
+        int64_t dueUs = startUs + f * g_ReactorFrameUs;
+        if (flood)
+        {
+            DrumSleepMicroseconds(dueUs - g_ReactorFrameDelayUs - DrumGetTimeMicroseconds());
+            for (int u = 0; u < g_ReactorUiPerFrame; ++u)
+            {
+                pRun->uiPosted += pLoad->reactor.Post(DRUM_REACTOR_UI, OnReactorUi, pLoad) ? 1 : 0;
+            }
+            pRun->configPosted += pLoad->reactor.Post(DRUM_REACTOR_CONFIG, OnReactorConfig, pLoad) ? 1 : 0;
+        }
+
+        DrumSleepMicroseconds(dueUs - DrumGetTimeMicroseconds());
+        pLoad->signalledUs.store(DrumGetTimeMicroseconds(), std::memory_order_release);
+        if (oneQueue)
+        {
+            pLoad->reactor.Post(DRUM_REACTOR_UI, OnReactorFrame, pLoad);
+        }
+        else
+        {
+            pLoad->frame.Signal();
+        }
+
+        // The next frame overwrites the signal time, so this one must have been taken first
+        while (pLoad->frames < static_cast<uint64_t>(f + 1) && DrumGetTimeMicroseconds() - dueUs < 100000)
+        {
+            DrumSleepMicroseconds(50);
+        }
+    }
+
+    // Whatever UI work is left goes before the marker
+    pLoad->reactor.Post(DRUM_REACTOR_UI, OnReactorDrained, pLoad);
+    while (!pLoad->drained.load(std::memory_order_acquire))
+    {
+        DrumSleepMicroseconds(1000);
+    }
+
+    pLoad->reactor.Stop();
+    loop.join();
+
+    pLoad->frameLatency.GetSummary(&pRun->latency);
+    pLoad->reactor.GetStats(&pRun->stats);
+    pRun->frames = pLoad->frames;
+    pRun->uiDone = pLoad->uiDone;
+    pRun->configDone = pLoad->configDone;
+    delete pLoad;
+}
+
+/// <summary>
+/// Arms a 1 ms timer over and over on this thread and records how late it runs
+/// </summary>
+static void RunReactorTimer(ReactorRun* pRun)
+{
+    struct TimerState
+    {
+        CLatencyHistogram   lateness;
+        int64_t             dueUs;
+        int                 fired;
+        int                 early;
+
+        static void OnTimer(void* pContext)
+        {
+            TimerState* pState = static_cast<TimerState*>(pContext);
+            int64_t lateUs = DrumGetTimeMicroseconds() - pState->dueUs;
+            pState->early += (lateUs < 0) ? 1 : 0;
+            pState->lateness.Record((lateUs < 0) ? 0 : lateUs);
+            ++pState->fired;
+        }
+    };
+
+    memset(pRun, 0, sizeof(*pRun));
+    TimerState* pState = new TimerState();
+    pState->fired = 0;
+    pState->early = 0;
+
+    CDrumReactor reactor;
+    reactor.Initialize();
+    int timer = -1;
+    reactor.AddTimer(DRUM_REACTOR_SENSOR, TimerState::OnTimer, pState, &timer);
+    for (int f = 0; f < g_ReactorFrames; ++f)
+    {
+        pState->dueUs = DrumGetTimeMicroseconds() + 1000 + (f % 7) * 37;
+        reactor.SetTimer(timer, pState->dueUs);
+        while (pState->fired <= f)
+        {
+            reactor.RunOnce(cDrumReactorInfinite);
+        }
+    }
+
+    pState->lateness.GetSummary(&pRun->latency);
+    reactor.GetStats(&pRun->stats);
+    pRun->frames = pState->fired;
+    pRun->early = pState->early;
+    delete pState;
+}
+
+/// <summary>
+/// Measures how long the detection loop takes to run a frame handler once the frame is
+/// signalled: idle, against timers, and under a flood of UI work with and without priorities
+/// </summary>
+/// <returns>0 on success, 1 if frames waited behind UI work, work was lost or timers ran early</returns>
+static int BenchReactor()
+{
+#ifdef _WIN32
+    const char* szBackend = "WaitForMultipleObjects";
+#else
+    const char* szBackend = "epoll + eventfd";
+#endif
+    printf("reactor (%s; %d frames every %lld us, %d UI items of %lld us %lld us before each under load)\n", szBackend,
+        g_ReactorFrames, static_cast<long long>(g_ReactorFrameUs), g_ReactorUiPerFrame,
+        static_cast<long long>(g_ReactorUiCostUs), static_cast<long long>(g_ReactorFrameDelayUs));
+    printf("%-24s %8s %8s %8s %8s %8s %8s %10s %9s\n", "run", "frames", "p50 us", "p99 us", "max us",
+        "ui done", "config", "preempted", "ui batch");
+
+    int failures = 0;
+
+    // Rejects what it cannot wait on
+    CDrumReactor rejecting;
+    int timer = -1;
+    failures += (S_OK != rejecting.Initialize());
+    failures += (E_INVALIDARG != rejecting.AddTimer(DRUM_REACTOR_PRIORITY_COUNT, OnReactorConfig, NULL, &timer));
+    failures += (E_POINTER != rejecting.AddEvent(NULL, DRUM_REACTOR_SENSOR, OnReactorConfig, NULL));
+    failures += rejecting.Post(DRUM_REACTOR_UI, NULL, NULL);
+
+    static const char* names[] = { "idle", "timer 1 ms", "UI flood, one queue", "UI flood, priorities" };
+    ReactorRun runs[4];
+    RunReactorLoad(false, false, &runs[0]);
+    RunReactorTimer(&runs[1]);
+    RunReactorLoad(true, true, &runs[2]);
+    RunReactorLoad(true, false, &runs[3]);
+
+    for (int r = 0; r < 4; ++r)
+    {
+        const ReactorRun& run = runs[r];
+        printf("%-24s %8llu %8lld %8lld %8lld %8llu %8llu %10llu %9d\n", names[r],
+            static_cast<unsigned long long>(run.frames), static_cast<long long>(run.latency.p50Us),
+            static_cast<long long>(run.latency.p99Us), static_cast<long long>(run.latency.maxUs),
+            static_cast<unsigned long long>(run.uiDone), static_cast<unsigned long long>(run.configDone),
+            static_cast<unsigned long long>(run.stats.preempted), run.stats.maxUiBatch);
+
+        failures += (run.frames != static_cast<uint64_t>(g_ReactorFrames));
+        failures += (run.uiDone != run.uiPosted || run.configDone != run.configPosted || run.stats.dropped > 0);
+        failures += (run.early > 0);
+    }
+
+    // Waking up takes far less than a frame, and timers are kept to the microsecond where the platform can
+    failures += (runs[0].latency.p50Us > g_ReactorFrameUs / 2);
+    failures += (runs[1].latency.p50Us > g_ReactorFrameUs / 2);
+
+    // Behind one queue a frame waits for the UI work ahead of it; with priorities, for the one item running at most.
+    // The tail holds whatever else the machine was doing, so medians are compared.
+    failures += (runs[2].uiPosted != static_cast<uint64_t>(g_ReactorFrames * g_ReactorUiPerFrame));
+    failures += (runs[3].latency.p50Us * 4 > runs[2].latency.p50Us);
+    failures += (runs[3].stats.preempted == 0 || runs[3].stats.maxUiBatch > cDrumReactorDefaultUiBatch + 1);
+
+    if (failures)
+    {
+        printf("FAILED: %d reactor checks\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// What the detection and render threads saw in one run
+/// </summary>
+struct RenderRun
+{
+    LatencySummary          detection;          // frame due to snapshot published
+    int                     published;
+    int                     drawn;
+    int                     torn;               // snapshots that changed while being drawn
+    int                     outOfOrder;
+};
+
+/// <summary>
+/// Remembers the played notes for the snapshots, the way the application does
+/// </summary>
+class CRenderHitSink : public IDrumTriggerSink
+{
+public:
+    CDrumHitHistory         history;
+
+    virtual void Trigger(const DrumHitTrigger& trigger)
+    {
+        if (DRUM_TRIGGER_PLAY == trigger.type)
+        {
+            DrumSnapshotHit hit = { trigger.timeUs, trigger.trackingId, trigger.zone, trigger.hitVelocity };
+            history.Add(hit);
+        }
+    }
+};
+
+/// <summary>
+/// Detects generated frames on this thread at a fixed rate and draws the snapshots on another
+/// thread that stalls for renderDelayUs per frame, five times as long on every tenth
+/// </summary>
+static void RunRenderThreads(const std::vector<SkeletonFrame>& frames, const std::vector<int64_t>& frameTimes,
+                             int64_t frameUs, int64_t renderDelayUs, RenderRun* pRun)
+{
+    CTripleBuffer<DrumSnapshot>* pSnapshots = new CTripleBuffer<DrumSnapshot>();
+    std::atomic<bool> done(false);
+    int drawn = 0;
+    int torn = 0;
+    int outOfOrder = 0;
+
+    std::thread render([&]()
+    {
+        uint32_t lastFrame = 0;
+        while (!done.load(std::memory_order_acquire))
+        {
+            if (!pSnapshots->Acquire())
+            {
+                DrumSleepMicroseconds(500);
+                continue;
+            }
+
+            const DrumSnapshot& snapshot = pSnapshots->ReadBuffer();
+            uint32_t frameNumber = snapshot.frameNumber;
+            int64_t frameTimeUs = snapshot.frameTimeUs;
+            outOfOrder += (frameNumber <= lastFrame);
+            lastFrame = frameNumber;
+
+            // Drawing starts by projecting the snapshot for the window
+            DrumSnapshotView view;
+            for (int s = 0; s < cSkeletonCount; ++s)
+            {
+                ProjectDrumSnapshotSkeleton(snapshot.skeletons[s], 640, 480, &view);
+            }
+
+            // Slow present, or a device lost
+            if (renderDelayUs > 0)
+            {
+                DrumSleepMicroseconds((0 == drawn % 10) ? renderDelayUs * 5 : renderDelayUs);
+            }
+
+            torn += (snapshot.frameNumber != frameNumber || snapshot.frameTimeUs != frameTimeUs ||
+                     frameTimeUs != frameTimes[frameNumber - 1]);
+            ++drawn;
+        }
+    });
+
+    CDrumEngine engine;
+    engine.Start(0);
+    CRenderHitSink sink;
+    CLatencyHistogram latency;
+
+    int64_t startUs = DrumGetTimeMicroseconds() + frameUs;
+    for (size_t f = 0; f < frames.size(); ++f)
+    {
+        int64_t dueUs = startUs + static_cast<int64_t>(f) * frameUs;
+        int64_t nowUs = DrumGetTimeMicroseconds();
+        if (dueUs > nowUs)
+        {
+            DrumSleepMicroseconds(dueUs - nowUs);
+        }
+
+        engine.ProcessFrame(frames[f], frameTimes[f], &sink);
+
+        FillDrumSnapshot(frames[f], engine.Players(), sink.history, frameTimes[f], &pSnapshots->WriteBuffer());
+        pSnapshots->Publish();
+        latency.Record(DrumGetTimeMicroseconds() - dueUs);
+    }
+
+    done.store(true, std::memory_order_release);
+    render.join();
+    engine.Stop();
+    delete pSnapshots;
+
+    latency.GetSummary(&pRun->detection);
+    pRun->published = static_cast<int>(frames.size());
+    pRun->drawn = drawn;
+    pRun->torn = torn;
+    pRun->outOfOrder = outOfOrder;
+}
+
+/// <summary>
+/// Shows that a stalled render thread neither delays detection nor sees half written snapshots
+/// </summary>
+/// <returns>0 on success, 1 if render stalls reached detection</returns>
+static int BenchRenderDecoupling()
+{
+    static const int frameCount = 300;
+    static const int64_t frameUs = 4000;
+    static const int64_t delays[] = { 0, 10000, 40000 };
+    static const int delayCount = sizeof(delays) / sizeof(delays[0]);
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = 2;
+    params.noise = 0.003f;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+    CSkeletonGenerator generator;
+    generator.Initialize(params, zones);
+
+    std::vector<SkeletonFrame> frames(frameCount);
+    std::vector<int64_t> frameTimes(frameCount);
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SyntheticHit hits[2 * cSkeletonCount];
+        generator.NextFrame(&frames[f], hits, 2 * cSkeletonCount);
+        frameTimes[f] = generator.TimeUs();
+    }
+
+    printf("render decoupling (%d frames every %lld us, detection latency from frame due to snapshot published)\n",
+        frameCount, static_cast<long long>(frameUs));
+    printf("%12s %10s %10s %10s %10s %8s %8s\n", "stall us", "p50 us", "p99 us", "max us", "drawn", "torn", "order");
+
+    int failures = 0;
+    RenderRun runs[delayCount];
+    for (int d = 0; d < delayCount; ++d)
+    {
+        RunRenderThreads(frames, frameTimes, frameUs, delays[d], &runs[d]);
+        printf("%12lld %10lld %10lld %10lld %10d %8d %8d\n", static_cast<long long>(delays[d]),
+            static_cast<long long>(runs[d].detection.p50Us), static_cast<long long>(runs[d].detection.p99Us),
+            static_cast<long long>(runs[d].detection.maxUs), runs[d].drawn, runs[d].torn, runs[d].outOfOrder);
+
+        failures += (runs[d].torn > 0 || runs[d].outOfOrder > 0 || runs[d].drawn < 1);
+        failures += (static_cast<int>(runs[d].detection.count) != runs[d].published);
+
+        // A render stall that leaked into detection would delay most frames by a frame or more.
+        // The median is compared because the tail also holds whatever else the machine was doing.
+        if (delays[d] > 0)
+        {
+            failures += (runs[d].detection.p50Us > runs[0].detection.p50Us + frameUs / 2);
+            failures += (runs[d].drawn >= runs[0].drawn);
+        }
+    }
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, render stalls reached detection or snapshots were torn\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Remembers the notes for the snapshots the way the application does, predicted ones included
+/// </summary>
+class CDrawHitSink : public IDrumTriggerSink
+{
+public:
+    CDrumHitHistory         history;
+    int64_t                 frameTimeUs;
+
+    CDrawHitSink() : frameTimeUs(0) {}
+
+    virtual void Trigger(const DrumHitTrigger& trigger)
+    {
+        if ((DRUM_TRIGGER_PLAY == trigger.type && trigger.zone >= 0) || DRUM_TRIGGER_SCHEDULE == trigger.type)
+        {
+            DrumSnapshotHit hit = { (DRUM_TRIGGER_PLAY == trigger.type) ? trigger.timeUs : frameTimeUs,
+                                    trigger.trackingId, trigger.zone, trigger.hitVelocity };
+            history.Add(hit);
+        }
+    }
+};
+
+/// <summary>
+/// Draws one shape on a cleared image and gets the area it covers, in pixels, from how
+/// much of its brush's strongest channel ended up in the image
+/// </summary>
+static float DrawnArea(CDrumRasterizer& image, CDrumDrawList* pList, const DrumDrawCommand& command)
+{
+    pList->Reset(image.Width(), image.Height());
+    switch (command.op)
+    {
+    case DRUM_DRAW_LINE:
+        pList->AddLine(DRUM_LAYER_BONES, static_cast<DrumBrush>(command.brush), command.x0, command.y0, command.x1, command.y1, command.width);
+        break;
+    case DRUM_DRAW_ELLIPSE:
+        pList->AddEllipse(DRUM_LAYER_JOINTS, static_cast<DrumBrush>(command.brush), command.x0, command.y0, command.x1, command.y1, command.width);
+        break;
+    case DRUM_DRAW_RECT:
+        pList->AddRect(DRUM_LAYER_ZONES, static_cast<DrumBrush>(command.brush), command.x0, command.y0, command.x1, command.y1, command.width);
+        break;
+    default:
+        pList->FillRect(DRUM_LAYER_ZONES, static_cast<DrumBrush>(command.brush), command.x0, command.y0, command.x1, command.y1);
+        break;
+    }
+    pList->Close();
+
+    image.Clear();
+    image.Draw(*pList);
+
+    // Every brush has a channel at full strength, red or green
+    int channel = (cDrumBrushColors[command.brush].r > cDrumBrushColors[command.brush].g) ? 0 : 1;
+    float full = ((0 == channel) ? cDrumBrushColors[command.brush].r : cDrumBrushColors[command.brush].g) * 255.0f;
+    double sum = 0.0;
+    const uint8_t* pPixels = image.Pixels();
+    for (int i = 0; i < image.Width() * image.Height(); ++i)
+    {
+        sum += pPixels[4 * i + channel];
+    }
+
+    return static_cast<float>(sum / full);
+}
+
+/// <summary>
+/// Checks the software rasterizer against the areas of reference shapes, checks that its SSE2
+/// and scalar paths draw the same pixels, writes a frame as a PNG, and times recording and
+/// drawing the overlay of generated drummers
+/// </summary>
+/// <returns>0 on success, 1 if a shape was drawn wrong or the paths disagree</returns>
+static int BenchDrawList()
+{
+    static const char szPath[] = "DrumBench.png";
+    static const int width = 640;
+    static const int height = 480;
+    static const int frameCount = 600;
+
+    // Shapes whose areas are known: a bone, a joint, a zone outline, a lit zone, and a bone across the image edge
+    struct ReferenceShape
+    {
+        const char*         name;
+        DrumDrawCommand     command;
+        float               area;
+    };
+    static const ReferenceShape shapes[] =
+    {
+        { "bone",        { DRUM_DRAW_LINE, DRUM_BRUSH_BONE_TRACKED, 0, 0, 10.0f, 20.0f, 50.0f, 50.0f, 6.0f }, 50.0f * 6.0f },
+        { "thin bone",   { DRUM_DRAW_LINE, DRUM_BRUSH_BONE_INFERRED, 0, 0, 5.0f, 5.0f, 5.0f, 45.0f, 1.0f }, 40.0f },
+        { "joint",       { DRUM_DRAW_ELLIPSE, DRUM_BRUSH_JOINT_TRACKED, 0, 0, 32.0f, 32.0f, 3.0f, 3.0f, 1.0f }, 6.0f * 3.14159265f },
+        { "zone",        { DRUM_DRAW_RECT, DRUM_BRUSH_ZONE, 0, 0, 12.0f, 40.0f, 4.0f, 8.0f, 1.0f }, 2.0f * (8.0f + 32.0f) },
+        { "lit zone",    { DRUM_DRAW_FILL_RECT, DRUM_BRUSH_JOINT_INFERRED, 0, 0, 8.25f, 8.5f, 24.75f, 16.5f, 0.0f }, 16.5f * 8.0f },
+        { "clipped",     { DRUM_DRAW_LINE, DRUM_BRUSH_BONE_TRACKED, 0, 0, -20.0f, 60.0f, 20.0f, 60.0f, 6.0f }, 20.0f * 6.0f },
+    };
+    static const int shapeCount = sizeof(shapes) / sizeof(shapes[0]);
+
+    int failures = 0;
+    CDrumDrawList* pList = new CDrumDrawList();
+    CDrumRasterizer reference;
+    reference.Initialize(64, 64);
+
+    printf("draw list reference shapes (area drawn against area of the shape, pixels)\n");
+    printf("%12s %10s %10s %8s\n", "shape", "expected", "drawn", "error %");
+    for (int s = 0; s < shapeCount; ++s)
+    {
+        float area = DrawnArea(reference, pList, shapes[s].command);
+        float error = 100.0f * (area - shapes[s].area) / shapes[s].area;
+        printf("%12s %10.1f %10.1f %8.2f\n", shapes[s].name, shapes[s].area, area, error);
+        failures += (fabsf(error) > 3.0f);
+    }
+
+    // The inside of a filled box is its brush exactly, and nothing is drawn a pixel past its edge
+    DrawnArea(reference, pList, shapes[4].command);
+    const uint8_t* pPixels = reference.Pixels();
+    failures += (pPixels[4 * (12 * 64 + 16)] != 255 || pPixels[4 * (12 * 64 + 16) + 1] != 255 || pPixels[4 * (12 * 64 + 16) + 2] != 0);
+    failures += (pPixels[4 * (12 * 64 + 26)] != 0 || pPixels[4 * (18 * 64 + 16)] != 0 || pPixels[4 * (12 * 64 + 6)] != 0);
+
+    // Overlays of generated drummers with their zones, hits lighting them
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = 2;
+    params.noise = 0.003f;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+    CSkeletonGenerator generator;
+    generator.Initialize(params, zones);
+
+    CDrumEngine engine;
+    engine.Start(0);
+    CDrawHitSink sink;
+    std::vector<DrumSnapshot> snapshots(frameCount);
+    SkeletonFrame frame;
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SyntheticHit hits[2 * cSkeletonCount];
+        generator.NextFrame(&frame, hits, 2 * cSkeletonCount);
+        sink.frameTimeUs = generator.TimeUs();
+        engine.ProcessFrame(frame, generator.TimeUs(), &sink);
+        FillDrumSnapshot(frame, engine.Players(), sink.history, generator.TimeUs(), &snapshots[f]);
+    }
+    engine.Stop();
+
+    // A kit too big for the snapshot: the zones past the limit are drawn as the box they lie in,
+    // lit when one of them is played
+    static const int bigKitZones = cDrumSnapshotMaxZones + 24;
+    int overflowOutlines = 0;
+    int overflowFlashes = 0;
+    int overflowOutside = 0;
+    {
+        DrumSnapshot* pBig = new DrumSnapshot();
+        const SkeletonData& drummer = frame.skeletons[0];
+        CDrumPlayer* pPlayer = NULL;
+        for (int i = 0; i < CDrumPlayerRoster::cMaxPlayers && NULL == pPlayer; ++i)
+        {
+            CDrumPlayer& player = engine.Players().Player(i);
+            pPlayer = (player.IsActive() && player.TrackingId() == drummer.trackingId) ? &player : NULL;
+        }
+
+        if (NULL != pPlayer)
+        {
+            CDrumZoneTable& kit = pPlayer->Zones();
+            for (int z = kit.Count(); z < bigKitZones; ++z)
+            {
+                DrumZone zone = kit.GetZone(z % kit.Count());
+                zone.xMin -= 0.01f * z;
+                zone.yMax += 0.005f * z;
+                kit.AddZone(zone);
+            }
+
+            CDrumHitHistory history;
+            DrumSnapshotHit hit = { generator.TimeUs(), drummer.trackingId, bigKitZones - 1, 1.0f };
+            history.Add(hit);
+            history.Add(hit);
+            FillDrumSnapshot(frame, engine.Players(), history, generator.TimeUs(), pBig);
+
+            const DrumSnapshotSkeleton& skel = pBig->skeletons[0];
+            failures += (bigKitZones != skel.zoneTotal || cDrumSnapshotMaxZones != skel.zoneCount);
+            for (int z = cDrumSnapshotMaxZones; z < bigKitZones; ++z)
+            {
+                DrumZone zone = kit.GetZone(z);
+                overflowOutside += (zone.xMin < skel.overflow.xMin || zone.xMax > skel.overflow.xMax ||
+                                    zone.yMin < skel.overflow.yMin || zone.yMax > skel.overflow.yMax ||
+                                    zone.depthMin < skel.overflow.depthMin || zone.depthMax > skel.overflow.depthMax);
+            }
+
+            RecordDrumSnapshot(*pBig, width, height, pList);
+            for (int i = 0; i < pList->CommandCount(); ++i)
+            {
+                const DrumDrawCommand& command = pList->Commands()[i];
+                bool overflowBrush = (DRUM_LAYER_ZONES == command.layer && DRUM_BRUSH_BONE_INFERRED == command.brush);
+                overflowOutlines += (overflowBrush && DRUM_DRAW_RECT == command.op);
+                overflowFlashes += (overflowBrush && DRUM_DRAW_FILL_RECT == command.op);
+            }
+            failures += (pList->Dropped() > 0);
+        }
+
+        failures += (NULL == pPlayer || 1 != overflowOutlines || 1 != overflowFlashes || 0 != overflowOutside);
+        delete pBig;
+    }
+
+    // Recording, and the brush changes drawing in recorded order would take against drawing in batches
+    int64_t commands = 0;
+    int64_t recordedChanges = 0;
+    int64_t batchedChanges = 0;
+    int litFrames = 0;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    for (int f = 0; f < frameCount; ++f)
+    {
+        RecordDrumSnapshot(snapshots[f], width, height, pList);
+        commands += pList->CommandCount();
+        recordedChanges += pList->RecordedBrushChanges();
+        batchedChanges += pList->BatchCount();
+        failures += (pList->Dropped() > 0);
+
+        int batched = 0;
+        for (int b = 0; b < pList->BatchCount(); ++b)
+        {
+            batched += pList->Batch(b).count;
+        }
+        failures += (batched != pList->CommandCount());
+
+        bool lit = false;
+        for (int i = 0; i < pList->CommandCount(); ++i)
+        {
+            lit = lit || (DRUM_DRAW_FILL_RECT == pList->Commands()[i].op);
+        }
+        litFrames += lit;
+    }
+    double recordNs = 1000.0 * (DrumGetTimeMicroseconds() - startUs) / frameCount;
+    failures += (0 == commands || batchedChanges >= recordedChanges || 0 == litFrames);
+
+    // Every frame drawn both ways must match to the pixel
+    CDrumRasterizer vectorized;
+    CDrumRasterizer scalar;
+    vectorized.Initialize(width, height);
+    scalar.Initialize(width, height);
+    scalar.SetVectorized(false);
+
+    int mismatched = 0;
+    for (int f = 0; f < frameCount; f += 10)
+    {
+        RecordDrumSnapshot(snapshots[f], width, height, pList);
+        vectorized.Clear();
+        vectorized.Draw(*pList);
+        scalar.Clear();
+        scalar.Draw(*pList);
+        mismatched += (0 != vectorized.CountDifferentPixels(scalar, 0));
+    }
+    failures += (mismatched > 0);
+
+    double drawNs[2];
+    CDrumRasterizer* images[2] = { &vectorized, &scalar };
+    for (int path = 0; path < 2; ++path)
+    {
+        startUs = DrumGetTimeMicroseconds();
+        for (int f = 0; f < frameCount; ++f)
+        {
+            RecordDrumSnapshot(snapshots[f], width, height, pList);
+            images[path]->Clear();
+            images[path]->Draw(*pList);
+        }
+        drawNs[path] = 1000.0 * (DrumGetTimeMicroseconds() - startUs) / frameCount - recordNs;
+    }
+
+    // The last frame as a PNG: stored deflate blocks make its size exact
+    size_t raw = static_cast<size_t>(width * 4 + 1) * height;
+    size_t expectedBytes = 8 + (12 + 13) + (12 + 2 + (raw + 65534) / 65535 * 5 + raw + 4) + 12;
+    size_t pngBytes = 0;
+    if (SUCCEEDED(vectorized.WritePng(szPath)))
+    {
+        FILE* pFile = fopen(szPath, "rb");
+        if (NULL != pFile)
+        {
+            unsigned char signature[8] = { 0 };
+            fseek(pFile, 0, SEEK_END);
+            pngBytes = static_cast<size_t>(ftell(pFile));
+            fseek(pFile, 0, SEEK_SET);
+            failures += (fread(signature, 1, sizeof(signature), pFile) != sizeof(signature) || 0 != memcmp(signature, "\x89PNG\r\n\x1a\n", 8));
+            fclose(pFile);
+        }
+        remove(szPath);
+    }
+    failures += (pngBytes != expectedBytes);
+
+    printf("\ndraw list overlay (%d frames of 2 drummers at %dx%d)\n", frameCount, width, height);
+    printf("%14s %14s %14s %14s %14s %14s\n", "commands", "brush sets", "batched", "record ns", "SSE2 ns", "scalar ns");
+    printf("%14.1f %14.1f %14.1f %14.0f %14.0f %14.0f\n", static_cast<double>(commands) / frameCount,
+        static_cast<double>(recordedChanges) / frameCount, static_cast<double>(batchedChanges) / frameCount,
+        recordNs, drawNs[0], drawNs[1]);
+    printf("%14s %14s %14s %14s\n", "mismatched", "png bytes", "big kit zones", "overflow box");
+    printf("%14d %14llu %14d %14s\n", mismatched, static_cast<unsigned long long>(pngBytes), bigKitZones,
+        (1 == overflowOutlines && 1 == overflowFlashes && 0 == overflowOutside) ? "drawn, lit" : "wrong");
+
+    delete pList;
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, shapes drawn wrong, paths disagree, a big kit lost zones or the PNG is wrong\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Bounces a generated session through the engine
+/// </summary>
+/// <param name="frameCount">frames to generate</param>
+/// <param name="pBounce">initialized bounce with its kit loaded and opened</param>
+/// <returns>microseconds the session took, or -1 if it failed</returns>
+static int64_t RunBounce(int frameCount, CDrumBounce* pBounce)
+{
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = 2;
+    params.noise = 0.005f;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+    CSkeletonGeneratorSource source;
+    if (FAILED(source.Initialize(params, zones, frameCount)))
+    {
+        return -1;
+    }
+
+    CDrumEngine engine;
+    engine.Start(0);
+    const SkeletonFrame* pFrame;
+    int64_t timeUs;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    HRESULT hr = S_OK;
+    while (SUCCEEDED(hr) && S_OK == source.Read(&pFrame, &timeUs))
+    {
+        hr = pBounce->AdvanceTo(timeUs);
+        engine.ProcessFrame(*pFrame, timeUs, pBounce);
+    }
+    hr = SUCCEEDED(hr) ? pBounce->Finish() : hr;
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+    engine.Stop();
+
+    return SUCCEEDED(hr) ? elapsedUs : -1;
+}
+
+/// <summary>
+/// Offline bounce: a session mixed on the virtual clock comes out the same every time,
+/// far faster than it was played, with a hit landing on the sample it was due
+/// </summary>
+static int BenchBounce()
+{
+    static const char szPath[] = "DrumBench.wav";
+    static const int frameCount = 30 * 60;
+
+    int failures = 0;
+    DrumBounceParams params = CDrumBounce::DefaultParams();
+
+    // The same session twice, hashed instead of written
+    uint64_t hashes[2] = { 0, 0 };
+    int64_t elapsedUs[2] = { 0, 0 };
+    DrumBounceStats stats;
+    for (int run = 0; run < 2; ++run)
+    {
+        CDrumBounce bounce;
+        failures += FAILED(bounce.Initialize(params));
+        bounce.SynthesizeKit();
+        failures += FAILED(bounce.Open(NULL));
+        elapsedUs[run] = RunBounce(frameCount, &bounce);
+        failures += (elapsedUs[run] < 0);
+        hashes[run] = bounce.Hash();
+        bounce.GetStats(&stats);
+    }
+    failures += (hashes[0] != hashes[1]);
+
+    uint64_t triggers = 0;
+    for (int type = 0; type < DRUM_TRIGGER_TYPE_COUNT; ++type)
+    {
+        triggers += stats.triggers[type];
+    }
+    double audioSeconds = static_cast<double>(stats.audioFrames) / params.sampleRate;
+    double bestSeconds = ((elapsedUs[0] < elapsedUs[1]) ? elapsedUs[0] : elapsedUs[1]) / 1000000.0;
+    double speed = (bestSeconds > 0.0) ? audioSeconds / bestSeconds : 0.0;
+    failures += (stats.frames != static_cast<uint64_t>(frameCount) || 0 == triggers);
+    failures += (audioSeconds < (frameCount - 1) / 30.0 + params.tailUs / 1000000.0 - 0.01);
+    failures += (speed < 10.0);
+
+    // A one sample click played by a frame arriving a second in lands on its sample in the file
+    int64_t expectedFrame = ((1000000 + params.sensorLatencyUs) * params.sampleRate + 500000) / 1000000;
+    int64_t clickFrame = -1;
+    {
+        static const float click[2] = { 0.5f, 0.5f };
+        CDrumBounce bounce;
+        failures += FAILED(bounce.Initialize(params));
+        bounce.Mixer().SetSample(0, click, 1);
+        if (SUCCEEDED(bounce.Open(szPath)))
+        {
+            DrumHitTrigger trigger;
+            memset(&trigger, 0, sizeof(trigger));
+            trigger.type = DRUM_TRIGGER_PLAY;
+            trigger.sampleId = 0;
+            trigger.hitVelocity = 1.0f;
+
+            bounce.AdvanceTo(0);
+            bounce.AdvanceTo(1000000);
+            bounce.Trigger(trigger);
+            failures += FAILED(bounce.Finish());
+
+            std::vector<float> stereo;
+            if (SUCCEEDED(LoadWaveFile(szPath, params.sampleRate, stereo)))
+            {
+                for (size_t f = 0; f < stereo.size() / 2 && clickFrame < 0; ++f)
+                {
+                    clickFrame = (0.0f != stereo[2 * f]) ? static_cast<int64_t>(f) : -1;
+                }
+            }
+            remove(szPath);
+        }
+    }
+    // Block starts and the delay into a block are both whole microseconds, which may cost a sample
+    failures += (clickFrame < expectedFrame - 1 || clickFrame > expectedFrame + 1);
+
+    printf("\noffline bounce (%d frames of 2 drummers, %d Hz, %d frame blocks)\n", frameCount, params.sampleRate, params.blockFrames);
+    printf("%14s %14s %14s %14s %14s\n", "audio s", "triggers", "bounce ms", "x real time", "identical");
+    printf("%14.1f %14llu %14.1f %14.0f %14s\n", audioSeconds, static_cast<unsigned long long>(triggers),
+        bestSeconds * 1000.0, speed, (hashes[0] == hashes[1]) ? "yes" : "no");
+    printf("%14s %14s\n", "click frame", "expected");
+    printf("%14lld %14lld\n", static_cast<long long>(clickFrame), static_cast<long long>(expectedFrame));
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, bounces differ, run slow or land off their sample\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// Allocations of the frame path: every skeleton the sensor can track, from the joint filter
+/// through detection and the mixer to the overlay's draw list, must allocate nothing once
+/// warmed up, whether the players are detected inline or on worker threads
+/// </summary>
+static int BenchAllocations()
+{
+    static const int frameCount = 30 * 60;
+    static const int warmupFrames = 30 * 10;
+    static const int width = 640;
+    static const int height = 480;
+
+    if (!CDrumAllocationGuard::IsCounting())
+    {
+        printf("\nframe path allocations: not counted in this build\n");
+        return 0;
+    }
+
+    // The hook has to see an allocation to be believed when it sees none; the probe escapes
+    // through a volatile pointer so the compiler cannot leave the allocation out
+    int failures = 0;
+    {
+        static int* volatile s_pProbe = NULL;
+        CDrumAllocationGuard guard;
+        s_pProbe = new int[16];
+        failures += (1 != guard.Allocations());
+        delete[] s_pProbe;
+    }
+
+    // Six drummers, generated before anything is counted
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = cSkeletonCount;
+    params.noise = 0.005f;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+    CSkeletonGenerator generator;
+    generator.Initialize(params, zones);
+
+    std::vector<SkeletonFrame> frames(frameCount);
+    std::vector<int64_t> frameTimes(frameCount);
+    for (int f = 0; f < frameCount; ++f)
+    {
+        SyntheticHit hits[2 * cSkeletonCount];
+        generator.NextFrame(&frames[f], hits, 2 * cSkeletonCount);
+        frameTimes[f] = generator.TimeUs();
+    }
+
+    static const int threadCounts[] = { 0, 2 };
+    uint64_t warmupAllocations[2] = { 0, 0 };
+    uint64_t steadyAllocations[2] = { 0, 0 };
+    int firstAllocatingFrame[2] = { -1, -1 };
+    uint64_t triggers[2] = { 0, 0 };
+    for (int run = 0; run < 2; ++run)
+    {
+        CSkeletonFilter filter;
+        CDrumBounce bounce;
+        failures += FAILED(bounce.Initialize(CDrumBounce::DefaultParams()));
+        bounce.SynthesizeKit();
+        failures += FAILED(bounce.Open(NULL));
+        CDrawHitSink hits;
+        CTeeTriggerSink sinks;
+        sinks.Add(&bounce);
+        sinks.Add(&hits);
+        DrumSnapshot* pSnapshot = new DrumSnapshot();
+        CDrumDrawList* pList = new CDrumDrawList();
+
+        CDrumEngine engine;
+        failures += FAILED(engine.Start(threadCounts[run]));
+
+        CDrumAllocationGuard guard;
+        SkeletonFrame filtered;
+        for (int f = 0; f < frameCount; ++f)
+        {
+            if (warmupFrames == f)
+            {
+                warmupAllocations[run] = guard.Allocations();
+                guard.Reset();
+            }
+            uint64_t before = guard.Allocations();
+
+            filtered = frames[f];
+            filter.Filter(&filtered, frameTimes[f]);
+            failures += FAILED(bounce.AdvanceTo(frameTimes[f]));
+            hits.frameTimeUs = frameTimes[f];
+            engine.ProcessFrame(filtered, frameTimes[f], &sinks);
+            FillDrumSnapshot(filtered, engine.Players(), hits.history, frameTimes[f], pSnapshot);
+            RecordDrumSnapshot(*pSnapshot, width, height, pList);
+
+            if (f >= warmupFrames && firstAllocatingFrame[run] < 0 && guard.Allocations() != before)
+            {
+                firstAllocatingFrame[run] = f;
+            }
+        }
+        steadyAllocations[run] = guard.Allocations();
+        engine.Stop();
+
+        DrumBounceStats stats;
+        bounce.GetStats(&stats);
+        for (int type = 0; type < DRUM_TRIGGER_TYPE_COUNT; ++type)
+        {
+            triggers[run] += stats.triggers[type];
+        }
+        failures += (0 == triggers[run] || 0 != steadyAllocations[run]);
+
+        delete pList;
+        delete pSnapshot;
+    }
+
+    printf("\nframe path allocations (%d frames of %d drummers, %d to warm up)\n", frameCount, cSkeletonCount, warmupFrames);
+    printf("%14s %14s %14s %14s %14s\n", "threads", "triggers", "warming up", "after", "first frame");
+    for (int run = 0; run < 2; ++run)
+    {
+        printf("%14d %14llu %14llu %14llu %14d\n", threadCounts[run], static_cast<unsigned long long>(triggers[run]),
+            static_cast<unsigned long long>(warmupAllocations[run]), static_cast<unsigned long long>(steadyAllocations[run]),
+            firstAllocatingFrame[run]);
+    }
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, the frame path allocated after warming up\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+/// <summary>
+/// MIDI output that only keeps count, for timing the sink itself
+/// </summary>
+class CCountingMidiOutput : public IMidiOutput
+{
+public:
+    std::atomic<uint64_t>   events;
+
+    CCountingMidiOutput() : events(0) {}
+    virtual bool IsPaced() const { return false; }
+    virtual HRESULT Write(const MidiEvent*, int count) { events += count; return S_OK; }
+};
+
+/// <summary>
+/// Plays a generated performance into a Standard MIDI File, reads it back and checks every
+/// note against what the engine played; then times Trigger, the only part on the detection thread
+/// </summary>
+/// <returns>0 on success, 1 if a note was lost, wrong or out of order</returns>
+static int BenchMidi()
+{
+    static const char szPath[] = "DrumBench.mid";
+    static const int frameCount = 30 * 120;
+    static const uint8_t expectedNotes[DRUM_PIECE_COUNT] = { 38, 42, 49, 51, 48, 45, 36, 44, 46 };
+
+    int failures = 0;
+    for (int piece = 0; piece < DRUM_PIECE_COUNT; ++piece)
+    {
+        failures += (DrumPieceMidiNote(static_cast<DrumPiece>(piece)) != expectedNotes[piece]);
+    }
+    failures += (DrumMidiVelocity(0.0f) != 1 || DrumMidiVelocity(1.0f) != 127 || DrumMidiVelocity(2.0f) != 127);
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+    params.skeletonCount = 2;
+    params.noise = 0.005f;
+
+    CDrumZoneTable zones;
+    CreateDefaultDrumZones(zones);
+    CSkeletonGeneratorSource source;
+    if (FAILED(source.Initialize(params, zones, frameCount)))
+    {
+        printf("FAILED: generator rejected the performance\n");
+        return 1;
+    }
+
+    // The engine's notes and the MIDI file side by side
+    CMidiFileOutput file;
+    if (FAILED(file.Open(szPath)))
+    {
+        printf("FAILED: cannot create %s\n", szPath);
+        return 1;
+    }
+
+    CMidiTriggerSink midi;
+    CPipelineNoteSink notes;
+    CTeeTriggerSink sinks;
+    sinks.Add(&notes);
+    sinks.Add(&midi);
+    midi.Start(&file, 0);
+
+    CDrumEngine engine;
+    engine.Start(0);
+    const SkeletonFrame* pFrame;
+    int64_t timeUs;
+    while (S_OK == source.Read(&pFrame, &timeUs))
+    {
+        engine.ProcessFrame(*pFrame, timeUs, &sinks);
+        while (midi.Backlog() > CMidiTriggerSink::cQueueCapacity / 2)
+        {
+            DrumSleepMicroseconds(CMidiTriggerSink::cBatchPeriodUs);
+        }
+    }
+    engine.Stop();
+    midi.Stop();
+    file.Close();
+
+    MidiSinkStats stats;
+    midi.GetStats(&stats);
+
+    std::vector<PipelineNote> played;
+    for (size_t n = 0; n < notes.notes.size(); ++n)
+    {
+        if (!notes.notes[n].cancelled)
+        {
+            played.push_back(notes.notes[n]);
+        }
+    }
+    std::stable_sort(played.begin(), played.end(), [](const PipelineNote& a, const PipelineNote& b) { return a.timeUs < b.timeUs; });
+
+    std::vector<MidiEvent> events;
+    HRESULT hr = LoadMidiFile(szPath, events);
+    remove(szPath);
+    if (FAILED(hr))
+    {
+        printf("FAILED: %s does not read back as a Standard MIDI File\n", szPath);
+        return 1;
+    }
+
+    // Note ons in file order against the engine's notes in time order, times from the first note
+    static const int64_t tickUs = cMidiFileTempoUs / cMidiFileDivision;
+    size_t ons = 0;
+    size_t offs = 0;
+    int64_t lastUs = 0;
+    int wrong = 0;
+    for (size_t e = 0; e < events.size(); ++e)
+    {
+        const MidiEvent& event = events[e];
+        wrong += (event.timeUs < lastUs);
+        lastUs = event.timeUs;
+
+        if ((cMidiNoteOff | cMidiDrumChannel) == event.status)
+        {
+            ++offs;
+            continue;
+        }
+
+        if ((cMidiNoteOn | cMidiDrumChannel) != event.status || ons >= played.size())
+        {
+            ++wrong;
+            continue;
+        }
+
+        const PipelineNote& note = played[ons];
+        const CDrumPlayer* pPlayer = NULL;
+        for (int i = 0; i < CDrumPlayerRoster::cMaxPlayers; ++i)
+        {
+            pPlayer = (engine.Players().Player(i).TrackingId() == note.trackingId) ? &engine.Players().Player(i) : pPlayer;
+        }
+
+        int64_t expectedUs = note.timeUs - played[0].timeUs;
+        int64_t errorUs = event.timeUs - expectedUs;
+        uint8_t expectedNote = (NULL != pPlayer) ? DrumPieceMidiNote(static_cast<DrumPiece>(pPlayer->Zones().SampleId(note.zone))) : 0;
+        wrong += (event.data1 != expectedNote || event.data2 < 1 || errorUs < -tickUs || errorUs > tickUs);
+        ++ons;
+    }
+
+    failures += wrong;
+    failures += (ons != played.size() || offs != ons || stats.notes != ons || stats.dropped != 0);
+
+    // Trigger cost alone: the sink's thread is the one that does the work
+    CCountingMidiOutput counter;
+    CMidiTriggerSink timed;
+    timed.Start(&counter, 0);
+    DrumHitTrigger trigger = { DRUM_TRIGGER_PLAY, 1, 0, DRUM_PIECE_SNARE, 0, 0.5f, 0, 0, 0, false };
+    std::vector<int64_t> costs;
+    costs.reserve(100000);
+    for (int i = 0; i < 100000; ++i)
+    {
+        trigger.timeUs = i * 1000;
+        int64_t startUs = DrumGetTimeMicroseconds();
+        timed.Trigger(trigger);
+        costs.push_back(DrumGetTimeMicroseconds() - startUs);
+        if (0 == i % 256)
+        {
+            while (timed.Backlog() > 0)
+            {
+                DrumSleepMicroseconds(CMidiTriggerSink::cBatchPeriodUs);
+            }
+        }
+    }
+    int64_t bulkStartUs = DrumGetTimeMicroseconds();
+    for (int i = 0; i < 256; ++i)
+    {
+        timed.Trigger(trigger);
+    }
+    double nsPerTrigger = (DrumGetTimeMicroseconds() - bulkStartUs) * 1000.0 / 256;
+    timed.Stop();
+    std::sort(costs.begin(), costs.end());
+
+    printf("midi (%d s, %d drummers, General MIDI notes to a Standard MIDI File and back)\n", frameCount / 30, params.skeletonCount);
+    printf("%10s %10s %10s %10s %10s %10s %12s %12s\n", "notes", "in file", "note offs", "wrong", "dropped", "batches", "ns/trigger", "p99 us");
+    printf("%10d %10d %10d %10d %10llu %10llu %12.1f %12lld\n", static_cast<int>(played.size()), static_cast<int>(ons),
+        static_cast<int>(offs), wrong, static_cast<unsigned long long>(stats.dropped), static_cast<unsigned long long>(stats.batches),
+        nsPerTrigger, static_cast<long long>(costs[costs.size() * 99 / 100]));
+
+    if (failures)
+    {
+        printf("FAILED: %d checks, MIDI notes were lost, wrong or out of order\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
+
+struct Benchmark
+{
+    const char*             name;
+    int                     (*run)();
+};
+
+static const Benchmark g_Benchmarks[] =
+{
+    { "zones", BenchZoneHitTest },
+    { "mixer", BenchMixer },
+    { "stream", BenchSkeletonStream },
+    { "onsets", BenchOnsetGate },
+    { "predict", BenchHitPredictor },
+    { "strikes", BenchStrikeTiming },
+    { "players", BenchPlayers },
+    { "latency", BenchLatencyHistogram },
+    { "trace", BenchTrace },
+    { "projection", BenchProjection },
+    { "pipeline", BenchPipeline },
+    { "calibration", BenchCalibration },
+    { "pedals", BenchPedals },
+    { "filter", BenchSkeletonFilter },
+    { "fusion", BenchFusion },
+    { "reactor", BenchReactor },
+    { "render", BenchRenderDecoupling },
+    { "draw", BenchDrawList },
+    { "bounce", BenchBounce },
+    { "allocs", BenchAllocations },
+    { "midi", BenchMidi },
+};
+
+/// <summary>
+/// Entry point for the benchmark tool
+/// </summary>
+/// <param name="argc">argument count</param>
+/// <param name="argv">names of the benchmarks to run, all if none</param>
+/// <returns>0 if every benchmark ran and validated</returns>
+int main(int argc, char** argv)
+{
+    int result = 0;
+    for (size_t i = 0; i < sizeof(g_Benchmarks) / sizeof(g_Benchmarks[0]); ++i)
+    {
+        bool selected = (argc < 2);
+        for (int a = 1; a < argc; ++a)
+        {
+            selected = selected || (0 == strcmp(argv[a], g_Benchmarks[i].name));
+        }
+
+        if (selected)
+        {
+            result |= g_Benchmarks[i].run();
+            printf("\n");
+        }
+    }
+
+    return result;
+}
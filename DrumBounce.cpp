@@ -0,0 +1,262 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumBounce.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumBounce.h"
+#include "DrumKit.h"
+#include "StrikeDetector.h"
+#include <math.h>
+#include <string.h>
+#include <string>
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumBounce::CDrumBounce() :
+    m_params(DefaultParams()),
+    m_bWriting(false),
+    m_bStarted(false),
+    m_firstTimeUs(0),
+    m_arrivalUs(0),
+    m_hash(14695981039346656037ULL)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CDrumBounce::~CDrumBounce()
+{
+    m_writer.Close();
+}
+
+/// <summary>
+/// Gets the settings the application plays with
+/// </summary>
+DrumBounceParams CDrumBounce::DefaultParams()
+{
+    DrumBounceParams params;
+    params.sampleRate = CDrumMixer::cDefaultSampleRate;
+    params.blockFrames = CDrumMixer::cDefaultBlockFrames;
+    params.voiceCount = CDrumMixer::cDefaultVoiceCount;
+    params.sensorLatencyUs = 33333;
+    params.tailUs = 2000000;
+    return params;
+}
+
+/// <summary>
+/// Sets up the mixer and forgets any earlier bounce
+/// </summary>
+/// <param name="params">settings</param>
+/// <returns>S_OK on success, E_INVALIDARG for bad settings, otherwise failure code</returns>
+HRESULT CDrumBounce::Initialize(const DrumBounceParams& params)
+{
+    if (params.sampleRate <= 0 || params.blockFrames <= 0 || params.sensorLatencyUs < 0 || params.tailUs < 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = m_mixer.Initialize(params.sampleRate, params.blockFrames, params.voiceCount);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_writer.Close();
+    m_params = params;
+    m_bWriting = false;
+    m_block.assign(static_cast<size_t>(params.blockFrames) * 2, 0);
+    m_bStarted = false;
+    m_firstTimeUs = 0;
+    m_arrivalUs = 0;
+    m_hash = 14695981039346656037ULL;
+    memset(&m_stats, 0, sizeof(m_stats));
+    return S_OK;
+}
+
+/// <summary>
+/// Loads the kit's samples from the files the application plays
+/// </summary>
+/// <param name="szDirectory">folder holding the samples, with its trailing separator</param>
+/// <returns>S_OK on success, otherwise the failure of the first sample that did not load</returns>
+HRESULT CDrumBounce::LoadKit(const char* szDirectory)
+{
+    for (int i = 0; i < DRUM_PIECE_COUNT; ++i)
+    {
+        std::string path(szDirectory);
+        path += DrumPieceSampleFile(static_cast<DrumPiece>(i));
+
+        HRESULT hr = m_mixer.LoadSample(i, path.c_str());
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Fills every piece of the kit with a made up sample, for bouncing without the sample files
+/// </summary>
+void CDrumBounce::SynthesizeKit()
+{
+    // Drums are decaying tones, cymbals decaying noise; a fixed seed keeps bounces repeatable
+    static const float pitches[DRUM_PIECE_COUNT] = { 220.0f, 0.0f, 0.0f, 0.0f, 180.0f, 110.0f, 60.0f, 0.0f, 0.0f };
+    static const float decays[DRUM_PIECE_COUNT]  = { 0.08f, 0.05f, 0.6f, 0.4f, 0.2f, 0.25f, 0.15f, 0.03f, 0.3f };
+
+    uint32_t seed = 12345;
+    std::vector<float> stereo;
+    for (int piece = 0; piece < DRUM_PIECE_COUNT; ++piece)
+    {
+        int frameCount = static_cast<int>(decays[piece] * 5.0f * m_params.sampleRate);
+        stereo.resize(static_cast<size_t>(frameCount) * 2);
+        for (int f = 0; f < frameCount; ++f)
+        {
+            float t = static_cast<float>(f) / m_params.sampleRate;
+            float envelope = 0.5f * expf(-t / decays[piece]);
+            float value;
+            if (pitches[piece] > 0.0f)
+            {
+                value = sinf(6.28318531f * pitches[piece] * t);
+            }
+            else
+            {
+                seed = seed * 1664525u + 1013904223u;
+                value = static_cast<float>(seed >> 8) / 8388608.0f - 1.0f;
+            }
+
+            stereo[2 * f] = envelope * value;
+            stereo[2 * f + 1] = envelope * value;
+        }
+
+        m_mixer.SetSample(piece, &stereo[0], frameCount);
+    }
+}
+
+/// <summary>
+/// Starts writing the mix
+/// </summary>
+/// <param name="szPath">wave file to create, NULL to only hash the mix</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CDrumBounce::Open(const char* szPath)
+{
+    m_bWriting = false;
+    if (NULL == szPath)
+    {
+        return S_OK;
+    }
+
+    HRESULT hr = m_writer.Open(szPath, m_params.sampleRate);
+    m_bWriting = SUCCEEDED(hr);
+    return hr;
+}
+
+/// <summary>
+/// Mixes whole blocks until the next one would start after a time
+/// </summary>
+/// <param name="timeUs">virtual time to mix up to</param>
+/// <param name="inclusive">also mix the block that starts at or before timeUs and ends after it</param>
+HRESULT CDrumBounce::MixUntil(int64_t timeUs, bool inclusive)
+{
+    const uint64_t blockFrames = static_cast<uint64_t>(m_params.blockFrames);
+    for (;;)
+    {
+        int64_t blockUs = FrameTimeUs(m_stats.audioFrames);
+        int64_t endUs = FrameTimeUs(m_stats.audioFrames + blockFrames);
+        if (inclusive ? (blockUs >= timeUs) : (endUs > timeUs))
+        {
+            return S_OK;
+        }
+
+        m_mixer.Render(&m_block[0], m_params.blockFrames, blockUs);
+        m_stats.audioFrames += blockFrames;
+
+        // Hashed as the little endian bytes that go into the file
+        for (size_t i = 0; i < m_block.size(); ++i)
+        {
+            uint16_t sample = static_cast<uint16_t>(m_block[i]);
+            m_hash = (m_hash ^ (sample & 0xFF)) * 1099511628211ULL;
+            m_hash = (m_hash ^ (sample >> 8)) * 1099511628211ULL;
+        }
+
+        if (m_bWriting)
+        {
+            HRESULT hr = m_writer.Write(&m_block[0], m_params.blockFrames);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Mixes up to the moment a frame would have arrived, so its triggers land after it
+/// </summary>
+/// <param name="timeUs">capture time of the next frame</param>
+/// <returns>S_OK on success, otherwise the failure writing the file</returns>
+HRESULT CDrumBounce::AdvanceTo(int64_t timeUs)
+{
+    if (!m_bStarted)
+    {
+        m_firstTimeUs = timeUs;
+        m_bStarted = true;
+    }
+
+    // The mix starts with the first frame's capture; every frame arrives a sensor latency after its own.
+    // Blocks that end by then are mixed, the one it falls in waits for the frame's triggers.
+    int64_t arrivalUs = timeUs - m_firstTimeUs + m_params.sensorLatencyUs;
+    m_arrivalUs = (arrivalUs > m_arrivalUs) ? arrivalUs : m_arrivalUs;
+    ++m_stats.frames;
+    return MixUntil(m_arrivalUs, false);
+}
+
+/// <summary>
+/// Places one trigger of the current frame on the virtual clock
+/// </summary>
+/// <param name="trigger">trigger from the engine</param>
+void CDrumBounce::Trigger(const DrumHitTrigger& trigger)
+{
+    ++m_stats.triggers[trigger.type];
+
+    switch (trigger.type)
+    {
+    case DRUM_TRIGGER_PLAY:
+        // Heard the moment the frame arrives, to the sample rather than at the next block
+        m_mixer.Schedule(trigger.sampleId, CStrikeDetector::HitGain(trigger.hitVelocity), m_arrivalUs, 0);
+        break;
+
+    case DRUM_TRIGGER_SCHEDULE:
+        // The predicted crossing moved onto the output clock, as the application does
+        m_mixer.Schedule(trigger.sampleId, CStrikeDetector::HitGain(trigger.hitVelocity),
+            m_arrivalUs + trigger.leadUs - m_params.sensorLatencyUs, trigger.ticket);
+        break;
+
+    case DRUM_TRIGGER_CANCEL:
+        m_mixer.Cancel(trigger.ticket);
+        break;
+
+    case DRUM_TRIGGER_CHOKE:
+        m_mixer.Choke(trigger.sampleId);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/// <summary>
+/// Mixes the tail and closes the file
+/// </summary>
+/// <returns>S_OK on success, otherwise the failure writing the file</returns>
+HRESULT CDrumBounce::Finish()
+{
+    HRESULT hr = MixUntil(m_arrivalUs + m_params.tailUs, true);
+    m_writer.Close();
+    m_bWriting = false;
+    return hr;
+}
@@ -0,0 +1,156 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumBounce.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Offline bounce of a session to a wave file. Instead of an output thread pulling
+// blocks on the wall clock, the mixer is run on a virtual clock that follows the
+// frames: before each frame is detected, audio is mixed up to the moment the frame
+// would have arrived, and the frame's triggers are then placed on that clock to the
+// sample, the way the application places them on the output clock. Nothing depends
+// on when the code runs, so a session bounces as fast as it can be mixed and two
+// bounces of one session are the same to the bit.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumEngine.h"
+#include "DrumMixer.h"
+#include "WaveFile.h"
+#include <vector>
+
+/// <summary>
+/// Settings of a bounce
+/// </summary>
+struct DrumBounceParams
+{
+    int                     sampleRate;
+    int                     blockFrames;        // frames mixed per block
+    int                     voiceCount;
+    int64_t                 sensorLatencyUs;    // from a hand moving to its frame arriving, as the application assumes
+    int64_t                 tailUs;             // mixed after the last frame so its notes ring out
+};
+
+/// <summary>
+/// What a bounce has done so far
+/// </summary>
+struct DrumBounceStats
+{
+    uint64_t                frames;             // skeleton frames
+    uint64_t                audioFrames;        // stereo frames mixed
+    uint64_t                triggers[DRUM_TRIGGER_TYPE_COUNT];
+};
+
+/// <summary>
+/// Mixes the triggers of a session into a wave file on a virtual clock. Call AdvanceTo
+/// with each frame's capture time before the engine detects it, pass the engine's
+/// triggers to Trigger, and Finish after the last frame. Not thread safe.
+/// </summary>
+class CDrumBounce : public IDrumTriggerSink
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumBounce();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~CDrumBounce();
+
+    /// <summary>
+    /// Gets the settings the application plays with
+    /// </summary>
+    static DrumBounceParams DefaultParams();
+
+    /// <summary>
+    /// Sets up the mixer and forgets any earlier bounce
+    /// </summary>
+    /// <param name="params">settings</param>
+    /// <returns>S_OK on success, E_INVALIDARG for bad settings, otherwise failure code</returns>
+    HRESULT                 Initialize(const DrumBounceParams& params);
+
+    /// <summary>
+    /// Loads the kit's samples from the files the application plays
+    /// </summary>
+    /// <param name="szDirectory">folder holding the samples, with its trailing separator</param>
+    /// <returns>S_OK on success, otherwise the failure of the first sample that did not load</returns>
+    HRESULT                 LoadKit(const char* szDirectory);
+
+    /// <summary>
+    /// Fills every piece of the kit with a made up sample, for bouncing without the sample files
+    /// </summary>
+    void                    SynthesizeKit();
+
+    /// <summary>
+    /// Starts writing the mix
+    /// </summary>
+    /// <param name="szPath">wave file to create, NULL to only hash the mix</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// <summary>
+    /// Mixes up to the moment a frame would have arrived, so its triggers land after it
+    /// </summary>
+    /// <param name="timeUs">capture time of the next frame</param>
+    /// <returns>S_OK on success, otherwise the failure writing the file</returns>
+    HRESULT                 AdvanceTo(int64_t timeUs);
+
+    /// <summary>
+    /// Places one trigger of the current frame on the virtual clock
+    /// </summary>
+    /// <param name="trigger">trigger from the engine</param>
+    virtual void            Trigger(const DrumHitTrigger& trigger);
+
+    /// <summary>
+    /// Mixes the tail and closes the file
+    /// </summary>
+    /// <returns>S_OK on success, otherwise the failure writing the file</returns>
+    HRESULT                 Finish();
+
+    /// <summary>
+    /// Gets the FNV-1a hash of every sample mixed so far, to compare bounces without their files
+    /// </summary>
+    uint64_t                Hash() const { return m_hash; }
+
+    /// <summary>
+    /// Reads what the bounce has done so far
+    /// </summary>
+    /// <param name="pStats">receives the counts</param>
+    void                    GetStats(DrumBounceStats* pStats) const { *pStats = m_stats; }
+
+    /// <summary>
+    /// Gets the mixer, for its counters or to load samples of one's own
+    /// </summary>
+    CDrumMixer&             Mixer() { return m_mixer; }
+
+private:
+    DrumBounceParams        m_params;
+    CDrumMixer              m_mixer;
+    CWaveFileWriter         m_writer;
+    bool                    m_bWriting;
+    std::vector<short>      m_block;
+
+    bool                    m_bStarted;
+    int64_t                 m_firstTimeUs;      // capture time of the first frame, heard at the start of the mix
+    int64_t                 m_arrivalUs;        // virtual time the current frame arrived
+    uint64_t                m_hash;
+    DrumBounceStats         m_stats;
+
+    /// <summary>
+    /// Mixes whole blocks until the next one would start after a time
+    /// </summary>
+    /// <param name="timeUs">virtual time to mix up to</param>
+    /// <param name="inclusive">also mix the block that starts at or before timeUs and ends after it</param>
+    HRESULT                 MixUntil(int64_t timeUs, bool inclusive);
+
+    /// <summary>
+    /// Gets the virtual time a stereo frame of the mix is heard at
+    /// </summary>
+    int64_t                 FrameTimeUs(uint64_t frame) const
+    {
+        return static_cast<int64_t>(frame * 1000000 / static_cast<uint64_t>(m_params.sampleRate));
+    }
+};
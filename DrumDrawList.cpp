@@ -0,0 +1,278 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumDrawList.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumDrawList.h"
+
+/// <summary>
+/// Joints a bone runs between
+/// </summary>
+struct DrumBone
+{
+    SkeletonJoint           joint0;
+    SkeletonJoint           joint1;
+};
+
+// Torso, left arm, right arm, left leg, right leg
+static const DrumBone cDrumBones[] =
+{
+    { SKELETON_JOINT_HEAD, SKELETON_JOINT_SHOULDER_CENTER },
+    { SKELETON_JOINT_SHOULDER_CENTER, SKELETON_JOINT_SHOULDER_LEFT },
+    { SKELETON_JOINT_SHOULDER_CENTER, SKELETON_JOINT_SHOULDER_RIGHT },
+    { SKELETON_JOINT_SHOULDER_CENTER, SKELETON_JOINT_SPINE },
+    { SKELETON_JOINT_SPINE, SKELETON_JOINT_HIP_CENTER },
+    { SKELETON_JOINT_HIP_CENTER, SKELETON_JOINT_HIP_LEFT },
+    { SKELETON_JOINT_HIP_CENTER, SKELETON_JOINT_HIP_RIGHT },
+
+    { SKELETON_JOINT_SHOULDER_LEFT, SKELETON_JOINT_ELBOW_LEFT },
+    { SKELETON_JOINT_ELBOW_LEFT, SKELETON_JOINT_WRIST_LEFT },
+    { SKELETON_JOINT_WRIST_LEFT, SKELETON_JOINT_HAND_LEFT },
+
+    { SKELETON_JOINT_SHOULDER_RIGHT, SKELETON_JOINT_ELBOW_RIGHT },
+    { SKELETON_JOINT_ELBOW_RIGHT, SKELETON_JOINT_WRIST_RIGHT },
+    { SKELETON_JOINT_WRIST_RIGHT, SKELETON_JOINT_HAND_RIGHT },
+
+    { SKELETON_JOINT_HIP_LEFT, SKELETON_JOINT_KNEE_LEFT },
+    { SKELETON_JOINT_KNEE_LEFT, SKELETON_JOINT_ANKLE_LEFT },
+    { SKELETON_JOINT_ANKLE_LEFT, SKELETON_JOINT_FOOT_LEFT },
+
+    { SKELETON_JOINT_HIP_RIGHT, SKELETON_JOINT_KNEE_RIGHT },
+    { SKELETON_JOINT_KNEE_RIGHT, SKELETON_JOINT_ANKLE_RIGHT },
+    { SKELETON_JOINT_ANKLE_RIGHT, SKELETON_JOINT_FOOT_RIGHT }
+};
+
+static const int cDrumBoneCount = sizeof(cDrumBones) / sizeof(cDrumBones[0]);
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumDrawList::CDrumDrawList()
+{
+    Reset(0, 0);
+    Close();
+}
+
+/// <summary>
+/// Forgets every command, to record a new frame
+/// </summary>
+/// <param name="width">width (in pixels) of the screen the frame is drawn on</param>
+/// <param name="height">height (in pixels) of the screen the frame is drawn on</param>
+void CDrumDrawList::Reset(int width, int height)
+{
+    m_count = 0;
+    m_batchCount = 0;
+    m_dropped = 0;
+    m_width = width;
+    m_height = height;
+}
+
+/// <summary>
+/// Appends a command unless the list is full
+/// </summary>
+void CDrumDrawList::Add(const DrumDrawCommand& command)
+{
+    if (m_count >= cDrumDrawListMaxCommands)
+    {
+        ++m_dropped;
+        return;
+    }
+
+    m_commands[m_count++] = command;
+}
+
+/// <summary>
+/// Records a line
+/// </summary>
+void CDrumDrawList::AddLine(DrumDrawLayer layer, DrumBrush brush, float x0, float y0, float x1, float y1, float width)
+{
+    DrumDrawCommand command = { DRUM_DRAW_LINE, static_cast<uint8_t>(brush), static_cast<uint8_t>(layer), 0, x0, y0, x1, y1, width };
+    Add(command);
+}
+
+/// <summary>
+/// Records the outline of an ellipse
+/// </summary>
+void CDrumDrawList::AddEllipse(DrumDrawLayer layer, DrumBrush brush, float x, float y, float radiusX, float radiusY, float width)
+{
+    DrumDrawCommand command = { DRUM_DRAW_ELLIPSE, static_cast<uint8_t>(brush), static_cast<uint8_t>(layer), 0, x, y, radiusX, radiusY, width };
+    Add(command);
+}
+
+/// <summary>
+/// Records the outline of a rectangle
+/// </summary>
+void CDrumDrawList::AddRect(DrumDrawLayer layer, DrumBrush brush, float left, float top, float right, float bottom, float width)
+{
+    DrumDrawCommand command = { DRUM_DRAW_RECT, static_cast<uint8_t>(brush), static_cast<uint8_t>(layer), 0, left, top, right, bottom, width };
+    Add(command);
+}
+
+/// <summary>
+/// Records a filled rectangle
+/// </summary>
+void CDrumDrawList::FillRect(DrumDrawLayer layer, DrumBrush brush, float left, float top, float right, float bottom)
+{
+    DrumDrawCommand command = { DRUM_DRAW_FILL_RECT, static_cast<uint8_t>(brush), static_cast<uint8_t>(layer), 0, left, top, right, bottom, 0.0f };
+    Add(command);
+}
+
+/// <summary>
+/// Sorts the recorded commands into batches, keeping their order within each batch
+/// </summary>
+void CDrumDrawList::Close()
+{
+    // Counting sort on layer and brush, which keeps the recorded order within a batch
+    static const int keyCount = DRUM_LAYER_COUNT * DRUM_BRUSH_COUNT;
+    int counts[keyCount] = { 0 };
+    for (int i = 0; i < m_count; ++i)
+    {
+        ++counts[m_commands[i].layer * DRUM_BRUSH_COUNT + m_commands[i].brush];
+    }
+
+    int starts[keyCount];
+    int next = 0;
+    m_batchCount = 0;
+    for (int key = 0; key < keyCount; ++key)
+    {
+        starts[key] = next;
+        if (counts[key] > 0)
+        {
+            DrumDrawBatch& batch = m_batches[m_batchCount++];
+            batch.brush = key % DRUM_BRUSH_COUNT;
+            batch.first = next;
+            batch.count = counts[key];
+        }
+        next += counts[key];
+    }
+
+    for (int i = 0; i < m_count; ++i)
+    {
+        const DrumDrawCommand& command = m_commands[i];
+        m_sorted[starts[command.layer * DRUM_BRUSH_COUNT + command.brush]++] = command;
+    }
+}
+
+/// <summary>
+/// Gets how many times the brush would change drawing the commands in the order they were recorded
+/// </summary>
+int CDrumDrawList::RecordedBrushChanges() const
+{
+    int changes = 0;
+    for (int i = 0; i < m_count; ++i)
+    {
+        changes += (0 == i || m_commands[i].brush != m_commands[i - 1].brush);
+    }
+
+    return changes;
+}
+
+/// <summary>
+/// Records a tracked skeleton with its zones, already projected
+/// </summary>
+static void RecordSkeleton(const DrumSnapshot& snapshot, const DrumSnapshotSkeleton& skel, const DrumSnapshotView& view, CDrumDrawList* pList)
+{
+    // The zones around the shoulder, the ones played further forward in a different color
+    for (int z = 0; z < skel.zoneCount; ++z)
+    {
+        const DrumSnapshotRect& rect = view.zones[z];
+        DrumBrush brush = (skel.zones[z].depthMin > 0.0f) ? DRUM_BRUSH_JOINT_INFERRED : DRUM_BRUSH_ZONE;
+        pList->AddRect(DRUM_LAYER_ZONES, brush, rect.left, rect.top, rect.right, rect.bottom, cDrumZoneThickness);
+    }
+
+    // The zones of a kit too big to draw one by one, as the gray box they lie in
+    if (skel.zoneTotal > skel.zoneCount)
+    {
+        pList->AddRect(DRUM_LAYER_ZONES, DRUM_BRUSH_BONE_INFERRED, view.overflow.left, view.overflow.top,
+            view.overflow.right, view.overflow.bottom, cDrumZoneThickness);
+    }
+
+    // Light up the zones this skeleton just played; any of the zones that did not fit lights their box, once
+    bool overflowLit = false;
+    for (int i = 0; i < snapshot.hitCount; ++i)
+    {
+        const DrumSnapshotHit& hit = snapshot.hits[i];
+        if (hit.trackingId != skel.trackingId || hit.zone < 0 || snapshot.frameTimeUs - hit.timeUs >= cDrumHitFlashUs)
+        {
+            continue;
+        }
+
+        if (hit.zone < skel.zoneCount)
+        {
+            const DrumSnapshotRect& rect = view.zones[hit.zone];
+            DrumBrush brush = (skel.zones[hit.zone].depthMin > 0.0f) ? DRUM_BRUSH_JOINT_INFERRED : DRUM_BRUSH_ZONE;
+            pList->FillRect(DRUM_LAYER_ZONES, brush, rect.left, rect.top, rect.right, rect.bottom);
+        }
+        else if (hit.zone < skel.zoneTotal && !overflowLit)
+        {
+            pList->FillRect(DRUM_LAYER_ZONES, DRUM_BRUSH_BONE_INFERRED, view.overflow.left, view.overflow.top,
+                view.overflow.right, view.overflow.bottom);
+            overflowLit = true;
+        }
+    }
+
+    for (int b = 0; b < cDrumBoneCount; ++b)
+    {
+        int joint0 = cDrumBones[b].joint0;
+        int joint1 = cDrumBones[b].joint1;
+        uint8_t joint0State = skel.jointStates[joint0];
+        uint8_t joint1State = skel.jointStates[joint1];
+
+        // Bones to a joint that was lost, or between two inferred joints, are not drawn
+        if (SKELETON_JOINT_NOT_TRACKED == joint0State || SKELETON_JOINT_NOT_TRACKED == joint1State ||
+            (SKELETON_JOINT_INFERRED == joint0State && SKELETON_JOINT_INFERRED == joint1State))
+        {
+            continue;
+        }
+
+        // A bone is inferred unless both of its joints are tracked
+        bool tracked = (SKELETON_JOINT_TRACKED == joint0State && SKELETON_JOINT_TRACKED == joint1State);
+        pList->AddLine(DRUM_LAYER_BONES, tracked ? DRUM_BRUSH_BONE_TRACKED : DRUM_BRUSH_BONE_INFERRED,
+            view.joints.x[joint0], view.joints.y[joint0], view.joints.x[joint1], view.joints.y[joint1],
+            tracked ? cDrumTrackedBoneThickness : cDrumInferredBoneThickness);
+    }
+
+    // The joints in a different color
+    for (int j = 0; j < cSkeletonJointCount; ++j)
+    {
+        if (SKELETON_JOINT_INFERRED == skel.jointStates[j] || SKELETON_JOINT_TRACKED == skel.jointStates[j])
+        {
+            DrumBrush brush = (SKELETON_JOINT_INFERRED == skel.jointStates[j]) ? DRUM_BRUSH_JOINT_INFERRED : DRUM_BRUSH_JOINT_TRACKED;
+            pList->AddEllipse(DRUM_LAYER_JOINTS, brush, view.joints.x[j], view.joints.y[j], cDrumJointThickness, cDrumJointThickness, 1.0f);
+        }
+    }
+}
+
+/// <summary>
+/// Records the overlay of a snapshot: each tracked skeleton with its zones, the zones it just
+/// played lit, and a dot for each skeleton tracked by position only. Closes the list.
+/// </summary>
+/// <param name="snapshot">snapshot to draw</param>
+/// <param name="width">width (in pixels) of the screen</param>
+/// <param name="height">height (in pixels) of the screen</param>
+/// <param name="pList">receives the frame's commands</param>
+void RecordDrumSnapshot(const DrumSnapshot& snapshot, int width, int height, CDrumDrawList* pList)
+{
+    pList->Reset(width, height);
+
+    DrumSnapshotView view;
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        const DrumSnapshotSkeleton& skel = snapshot.skeletons[s];
+        ProjectDrumSnapshotSkeleton(skel, width, height, &view);
+
+        if (SKELETON_TRACKED == skel.trackingState)
+        {
+            RecordSkeleton(snapshot, skel, view, pList);
+        }
+        else if (SKELETON_POSITION_ONLY == skel.trackingState)
+        {
+            // Only the center point of the skeleton is known
+            pList->AddEllipse(DRUM_LAYER_JOINTS, DRUM_BRUSH_JOINT_TRACKED, view.positionX, view.positionY,
+                cDrumJointThickness, cDrumJointThickness, 1.0f);
+        }
+    }
+
+    pList->Close();
+}
@@ -0,0 +1,215 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumDrawList.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// What the overlay draws for one frame, kept apart from whoever draws it. A frame
+// is recorded as lines, ellipses and rectangles, each naming a brush, and then
+// sorted into batches that share a layer and a brush. Layers keep the zones under
+// the bones and the bones under the joints, as they were drawn one at a time;
+// within a layer every command of one brush is drawn together, so a backend sets
+// each brush once per layer instead of once per shape. Direct2D draws the list in
+// the application and CDrumRasterizer draws it into memory anywhere.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumSnapshot.h"
+
+// Pens of the overlay
+static const float   cDrumJointThickness = 3.0f;           // radius of a joint
+static const float   cDrumTrackedBoneThickness = 6.0f;
+static const float   cDrumInferredBoneThickness = 1.0f;
+static const float   cDrumZoneThickness = 1.0f;
+
+// How long a zone stays lit after it is played
+static const int64_t cDrumHitFlashUs = 150000;
+
+// Every shape of a frame with every skeleton tracked: zones and their flashes, the box around
+// the zones that did not fit and its flash, 19 bones and 20 joints each
+static const int     cDrumDrawListMaxCommands = cSkeletonCount * (2 * cDrumSnapshotMaxZones + 2 + 19 + cSkeletonJointCount);
+
+/// <summary>
+/// Brushes the overlay draws with
+/// </summary>
+enum DrumBrush
+{
+    DRUM_BRUSH_JOINT_TRACKED = 0,
+    DRUM_BRUSH_JOINT_INFERRED,              // also zones played further forward
+    DRUM_BRUSH_BONE_TRACKED,
+    DRUM_BRUSH_BONE_INFERRED,
+    DRUM_BRUSH_ZONE,
+    DRUM_BRUSH_COUNT
+};
+
+/// <summary>
+/// Layers of the overlay, drawn bottom first
+/// </summary>
+enum DrumDrawLayer
+{
+    DRUM_LAYER_ZONES = 0,
+    DRUM_LAYER_BONES,
+    DRUM_LAYER_JOINTS,
+    DRUM_LAYER_COUNT
+};
+
+/// <summary>
+/// Kinds of shape
+/// </summary>
+enum DrumDrawOp
+{
+    DRUM_DRAW_LINE = 0,                     // from (x0, y0) to (x1, y1)
+    DRUM_DRAW_ELLIPSE,                      // outline around (x0, y0) with radii x1 and y1
+    DRUM_DRAW_RECT,                         // outline of the box (x0, y0) to (x1, y1)
+    DRUM_DRAW_FILL_RECT                     // the box (x0, y0) to (x1, y1), filled
+};
+
+/// <summary>
+/// Color of a brush, each channel 0 to 1
+/// </summary>
+struct DrumBrushColor
+{
+    float                   r;
+    float                   g;
+    float                   b;
+};
+
+// Colors of the brushes, as the application has always drawn them
+static const DrumBrushColor cDrumBrushColors[DRUM_BRUSH_COUNT] =
+{
+    { 0.27f, 0.75f, 0.27f },                // joint tracked
+    { 1.0f, 1.0f, 0.0f },                   // joint inferred, D2D1::ColorF::Yellow
+    { 0.0f, 128.0f / 255.0f, 0.0f },        // bone tracked, D2D1::ColorF::Green
+    { 128.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f },      // bone inferred, D2D1::ColorF::Gray
+    { 1.0f, 0.0f, 0.0f }                    // zone, D2D1::ColorF::Red
+};
+
+/// <summary>
+/// One shape, in screen pixels
+/// </summary>
+struct DrumDrawCommand
+{
+    uint8_t                 op;             // DrumDrawOp
+    uint8_t                 brush;          // DrumBrush
+    uint8_t                 layer;          // DrumDrawLayer
+    uint8_t                 reserved;
+    float                   x0;
+    float                   y0;
+    float                   x1;
+    float                   y1;
+    float                   width;          // of the stroke, unused by fills
+};
+
+/// <summary>
+/// Commands of one layer drawn with one brush
+/// </summary>
+struct DrumDrawBatch
+{
+    int                     brush;          // DrumBrush
+    int                     first;          // index of the first command
+    int                     count;
+};
+
+/// <summary>
+/// Shapes of one frame, recorded in the order they are produced and drawn in batches.
+/// Fixed size, so recording a frame allocates nothing.
+/// </summary>
+class CDrumDrawList
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumDrawList();
+
+    /// <summary>
+    /// Forgets every command, to record a new frame
+    /// </summary>
+    /// <param name="width">width (in pixels) of the screen the frame is drawn on</param>
+    /// <param name="height">height (in pixels) of the screen the frame is drawn on</param>
+    void                    Reset(int width, int height);
+
+    /// <summary>
+    /// Records a line
+    /// </summary>
+    void                    AddLine(DrumDrawLayer layer, DrumBrush brush, float x0, float y0, float x1, float y1, float width);
+
+    /// <summary>
+    /// Records the outline of an ellipse
+    /// </summary>
+    void                    AddEllipse(DrumDrawLayer layer, DrumBrush brush, float x, float y, float radiusX, float radiusY, float width);
+
+    /// <summary>
+    /// Records the outline of a rectangle
+    /// </summary>
+    void                    AddRect(DrumDrawLayer layer, DrumBrush brush, float left, float top, float right, float bottom, float width);
+
+    /// <summary>
+    /// Records a filled rectangle
+    /// </summary>
+    void                    FillRect(DrumDrawLayer layer, DrumBrush brush, float left, float top, float right, float bottom);
+
+    /// <summary>
+    /// Sorts the recorded commands into batches, keeping their order within each batch
+    /// </summary>
+    void                    Close();
+
+    /// <summary>
+    /// Gets the number of batches, after Close
+    /// </summary>
+    int                     BatchCount() const { return m_batchCount; }
+
+    /// <summary>
+    /// Gets a batch, after Close
+    /// </summary>
+    const DrumDrawBatch&    Batch(int i) const { return m_batches[i]; }
+
+    /// <summary>
+    /// Gets the commands sorted into batches, after Close
+    /// </summary>
+    const DrumDrawCommand*  Commands() const { return m_sorted; }
+
+    /// <summary>
+    /// Gets the number of commands recorded
+    /// </summary>
+    int                     CommandCount() const { return m_count; }
+
+    /// <summary>
+    /// Gets the number of commands that did not fit
+    /// </summary>
+    int                     Dropped() const { return m_dropped; }
+
+    /// <summary>
+    /// Gets how many times the brush would change drawing the commands in the order they were recorded
+    /// </summary>
+    int                     RecordedBrushChanges() const;
+
+    int                     Width() const { return m_width; }
+    int                     Height() const { return m_height; }
+
+private:
+    DrumDrawCommand         m_commands[cDrumDrawListMaxCommands];   // as recorded
+    DrumDrawCommand         m_sorted[cDrumDrawListMaxCommands];     // by layer, then brush
+    DrumDrawBatch           m_batches[DRUM_LAYER_COUNT * DRUM_BRUSH_COUNT];
+    int                     m_count;
+    int                     m_batchCount;
+    int                     m_dropped;
+    int                     m_width;
+    int                     m_height;
+
+    /// <summary>
+    /// Appends a command unless the list is full
+    /// </summary>
+    void                    Add(const DrumDrawCommand& command);
+};
+
+/// <summary>
+/// Records the overlay of a snapshot: each tracked skeleton with its zones, the zones it just
+/// played lit, and a dot for each skeleton tracked by position only. Closes the list.
+/// </summary>
+/// <param name="snapshot">snapshot to draw</param>
+/// <param name="width">width (in pixels) of the screen</param>
+/// <param name="height">height (in pixels) of the screen</param>
+/// <param name="pList">receives the frame's commands</param>
+void RecordDrumSnapshot(const DrumSnapshot& snapshot, int width, int height, CDrumDrawList* pList);
@@ -0,0 +1,243 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumEngine.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumEngine.h"
+#include "DrumTrace.h"
+#include <string.h>
+
+/// <summary>
+/// Traces a trigger and passes it to the sink
+/// </summary>
+/// <param name="pSink">receives the trigger</param>
+/// <param name="trigger">trigger to pass on</param>
+static void EmitTrigger(IDrumTriggerSink* pSink, const DrumHitTrigger& trigger)
+{
+    DRUM_TRACE(DRUM_TRACE_TRIGGER, trigger.trackingId, trigger.type, trigger.piece, trigger.hitVelocity, trigger.leadUs / 1000.0f);
+    pSink->Trigger(trigger);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumEngine::CDrumEngine() :
+    m_pLatency(NULL)
+{
+}
+
+/// <summary>
+/// Detects hits on one frame and hands the resulting triggers to a sink
+/// </summary>
+/// <param name="frame">frame to process</param>
+/// <param name="timeUs">capture time of the frame</param>
+/// <param name="pSink">receives the triggers</param>
+/// <returns>number of triggers passed to the sink</returns>
+int CDrumEngine::ProcessFrame(const SkeletonFrame& frame, int64_t timeUs, IDrumTriggerSink* pSink)
+{
+    int triggerCount = 0;
+
+    // Players whose skeleton has gone are freed for the next person to step in
+    uint32_t trackingIds[cSkeletonCount];
+    int trackedCount = 0;
+    for (int i = 0; i < cSkeletonCount; ++i)
+    {
+        if (SKELETON_TRACKED == frame.skeletons[i].trackingState)
+        {
+            trackingIds[trackedCount++] = frame.skeletons[i].trackingId;
+        }
+    }
+
+    HitAction reclaimed[cDrumPlayerMaxActions * CDrumPlayerRoster::cMaxPlayers];
+    int reclaimedCount = m_players.Reclaim(trackingIds, trackedCount, reclaimed, cDrumPlayerMaxActions * CDrumPlayerRoster::cMaxPlayers);
+    for (int i = 0; i < reclaimedCount; ++i)
+    {
+        DrumHitTrigger trigger = { DRUM_TRIGGER_CANCEL, 0, -1, -1, -1, reclaimed[i].hitVelocity, timeUs, 0, reclaimed[i].ticket, false };
+        EmitTrigger(pSink, trigger);
+        ++triggerCount;
+    }
+
+    // Every tracked skeleton is its own drummer, detected in parallel
+    CDrumPlayer* players[cSkeletonCount];
+    DrumPlayerInput inputs[cSkeletonCount];
+    DrumPlayerOutput outputs[cSkeletonCount];
+    int playerCount = 0;
+    int64_t stageUs = (NULL != m_pLatency) ? DrumGetTimeMicroseconds() : 0;
+
+    // Zones are in skeleton space, so the hands are measured without projecting anything
+    for (int i = 0; i < cSkeletonCount; ++i)
+    {
+        const SkeletonData& skel = frame.skeletons[i];
+        CDrumPlayer* pPlayer = (SKELETON_TRACKED == skel.trackingState) ? m_players.Acquire(skel.trackingId) : NULL;
+        if (NULL != pPlayer)
+        {
+            BuildDrumPlayerInput(skel, timeUs, &inputs[playerCount]);
+            players[playerCount++] = pPlayer;
+        }
+    }
+
+    RecordStage(LATENCY_STAGE_ZONE_SPACE, &stageUs);
+
+    m_players.Process(players, inputs, outputs, playerCount);
+
+    RecordStage(LATENCY_STAGE_DETECTION, &stageUs);
+
+    int playedCount = 0;
+    for (int p = 0; p < playerCount; ++p)
+    {
+        playedCount += EmitPlayerOutput(*players[p], outputs[p], timeUs, pSink);
+    }
+
+    // Only frames that played something say anything about the trigger path
+    if (playedCount > 0)
+    {
+        RecordStage(LATENCY_STAGE_TRIGGER, &stageUs);
+    }
+
+    DRUM_TRACE(DRUM_TRACE_FRAME, frame.frameNumber, playerCount, triggerCount + playedCount, 0.0f, 0.0f);
+    return triggerCount + playedCount;
+}
+
+/// <summary>
+/// Records the time since the previous stage ended, if stages are timed at all
+/// </summary>
+/// <param name="stage">stage that just ended</param>
+/// <param name="pStageUs">end of the previous stage, receives the end of this one</param>
+void CDrumEngine::RecordStage(LatencyStage stage, int64_t* pStageUs)
+{
+    if (NULL == m_pLatency)
+    {
+        return;
+    }
+
+    int64_t nowUs = DrumGetTimeMicroseconds();
+    m_pLatency->Record(stage, nowUs - *pStageUs);
+    *pStageUs = nowUs;
+}
+
+/// <summary>
+/// Passes one player's output to the sink: the pedals first, so a closing hi-hat chokes
+/// before anything is played on it, then the predictor's requests, then the detected strokes
+/// </summary>
+/// <param name="player">player the output came from</param>
+/// <param name="output">what the player played on the frame</param>
+/// <param name="timeUs">capture time of the frame</param>
+/// <param name="pSink">receives the triggers</param>
+/// <returns>number of triggers passed to the sink</returns>
+int CDrumEngine::EmitPlayerOutput(const CDrumPlayer& player, const DrumPlayerOutput& output, int64_t timeUs, IDrumTriggerSink* pSink)
+{
+    int triggerCount = 0;
+
+    for (int i = 0; i < output.pedalCount; ++i)
+    {
+        const DrumPedalEvent& pedal = output.pedals[i];
+
+        DrumHitTrigger trigger;
+        trigger.trackingId = player.TrackingId();
+        trigger.zone = -1;
+        trigger.hitVelocity = pedal.hitVelocity;
+        trigger.timeUs = timeUs;
+        trigger.leadUs = 0;
+        trigger.ticket = 0;
+        trigger.flam = false;
+
+        if (pedal.chokes)
+        {
+            trigger.type = DRUM_TRIGGER_CHOKE;
+            trigger.piece = DRUM_PIECE_OPEN_HIHAT;
+            trigger.sampleId = player.PieceSample(DRUM_PIECE_OPEN_HIHAT);
+            EmitTrigger(pSink, trigger);
+            ++triggerCount;
+        }
+
+        if (pedal.sounds)
+        {
+            trigger.type = DRUM_TRIGGER_PLAY;
+            trigger.piece = pedal.piece;
+            trigger.sampleId = player.PieceSample(pedal.piece);
+            EmitTrigger(pSink, trigger);
+            ++triggerCount;
+        }
+    }
+
+    for (int i = 0; i < output.actionCount; ++i)
+    {
+        const HitAction& action = output.actions[i];
+
+        DrumHitTrigger trigger;
+        trigger.trackingId = player.TrackingId();
+        trigger.zone = action.zone;
+        trigger.piece = player.ZonePiece(action.zone);
+        trigger.sampleId = player.ZoneSample(action.zone);
+        trigger.hitVelocity = action.hitVelocity;
+        trigger.ticket = action.ticket;
+        trigger.flam = false;
+
+        if (HIT_ACTION_SCHEDULE == action.type)
+        {
+            trigger.type = DRUM_TRIGGER_SCHEDULE;
+            trigger.timeUs = action.timeUs;
+            trigger.leadUs = action.leadUs;
+        }
+        else
+        {
+            trigger.type = DRUM_TRIGGER_CANCEL;
+            trigger.timeUs = timeUs;
+            trigger.leadUs = 0;
+        }
+
+        EmitTrigger(pSink, trigger);
+    }
+
+    for (int i = 0; i < output.onsetCount; ++i)
+    {
+        const DrumOnset& onset = output.onsets[i];
+
+        DrumHitTrigger trigger;
+        trigger.type = DRUM_TRIGGER_PLAY;
+        trigger.trackingId = player.TrackingId();
+        trigger.zone = onset.zone;
+        trigger.piece = player.ZonePiece(onset.zone);
+        trigger.sampleId = player.ZoneSample(onset.zone);
+        trigger.hitVelocity = onset.hitVelocity;
+        trigger.timeUs = onset.timeUs;
+        trigger.leadUs = onset.timeUs - timeUs;
+        trigger.ticket = 0;
+        trigger.flam = onset.flam;
+
+        EmitTrigger(pSink, trigger);
+    }
+
+    return triggerCount + output.actionCount + output.onsetCount;
+}
+
+/// <summary>
+/// Adds up the prediction accuracy of every player slot
+/// </summary>
+/// <param name="pStats">receives the totals</param>
+void CDrumEngine::GetPredictorStats(HitPredictorStats* pStats)
+{
+    // Every player slot; a slot keeps its numbers until another skeleton takes it
+    HitPredictorStats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < CDrumPlayerRoster::cMaxPlayers; ++i)
+    {
+        const HitPredictorStats& player = m_players.Player(i).Predictor().Stats();
+        stats.predicted += player.predicted;
+        stats.confirmed += player.confirmed;
+        stats.cancelled += player.cancelled;
+        stats.unconfirmed += player.unconfirmed;
+        stats.missed += player.missed;
+        stats.errorCount += player.errorCount;
+        stats.errorSumUs += player.errorSumUs;
+        stats.errorAbsSumUs += player.errorAbsSumUs;
+        stats.gainSumUs += player.gainSumUs;
+        if (player.errorAbsMaxUs > stats.errorAbsMaxUs)
+        {
+            stats.errorAbsMaxUs = player.errorAbsMaxUs;
+        }
+    }
+
+    *pStats = stats;
+}
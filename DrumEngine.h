@@ -0,0 +1,148 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumEngine.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Sensor and window independent drum engine: skeleton frames come in through a
+// frame source, triggers go out through a trigger sink. The Kinect application
+// and the headless driver are both front ends of it.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumKit.h"
+#include "DrumPlayer.h"
+#include "LatencyTracer.h"
+#include "SkeletonFrame.h"
+
+// What a trigger asks of the output
+enum DrumHitTriggerType
+{
+    DRUM_TRIGGER_PLAY = 0,          // a stroke was detected on this frame, sound it now
+    DRUM_TRIGGER_SCHEDULE,          // a stroke is predicted, sound it at timeUs
+    DRUM_TRIGGER_CANCEL,            // a scheduled stroke did not happen after all
+    DRUM_TRIGGER_CHOKE,             // silence what the piece's sample is still sounding, such as an open hi-hat closed by the pedal
+    DRUM_TRIGGER_TYPE_COUNT
+};
+
+/// <summary>
+/// One request to the output, in the order the engine made them
+/// </summary>
+struct DrumHitTrigger
+{
+    DrumHitTriggerType         type;
+    uint32_t                trackingId;         // skeleton that played, 0 for cancels of a skeleton that has gone
+    int32_t                 zone;               // -1 for pedals, chokes and cancels of a skeleton that has gone
+    int32_t                 piece;              // DrumPiece played or choked, -1 for cancels of a skeleton that has gone
+    int32_t                 sampleId;           // mixer sample the player's kit uses for the piece, -1 with the zone
+    float                   hitVelocity;        // 0..1
+    int64_t                 timeUs;             // landing time for strokes, between frames; frame time for pedals and cancels, predicted crossing for schedules
+    int64_t                 leadUs;             // schedules: how far the crossing is past the frame; strokes: how far the landing is before it, negative
+    uint32_t                ticket;             // schedules and cancels: names the scheduled stroke
+    bool                    flam;               // plays: both hands struck together
+};
+
+/// <summary>
+/// Where skeleton frames come from: a sensor, a recording or a generator
+/// </summary>
+class ISkeletonFrameSource
+{
+public:
+    virtual ~ISkeletonFrameSource() {}
+
+    /// <summary>
+    /// Gets the next frame. Sources do not pace themselves; frames come as fast as they are asked for.
+    /// </summary>
+    /// <param name="ppFrame">receives the frame, valid until the next call</param>
+    /// <param name="pTimeUs">receives the capture time of the frame</param>
+    /// <returns>S_OK with a frame, S_FALSE once the source has ended, otherwise failure code</returns>
+    virtual HRESULT         Read(const SkeletonFrame** ppFrame, int64_t* pTimeUs) = 0;
+};
+
+/// <summary>
+/// Where triggers go: an audio mixer, a file, or nowhere
+/// </summary>
+class IDrumTriggerSink
+{
+public:
+    virtual ~IDrumTriggerSink() {}
+
+    /// <summary>
+    /// Takes one trigger. Called on the thread that processes frames.
+    /// </summary>
+    /// <param name="trigger">what to play or cancel</param>
+    virtual void            Trigger(const DrumHitTrigger& trigger) = 0;
+};
+
+/// <summary>
+/// Turns skeleton frames into triggers: strike detection, zone tests, onset gating
+/// and prediction for every tracked skeleton, all in skeleton space. Has no idea
+/// where frames come from, where triggers go or what screen anything is drawn on.
+/// </summary>
+class CDrumEngine
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumEngine();
+
+    /// <summary>
+    /// Starts the threads skeletons are processed on
+    /// </summary>
+    /// <param name="threadCount">threads besides the caller, 0 to process skeletons one after another</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Start(int threadCount) { return m_players.Start(threadCount); }
+
+    /// <summary>
+    /// Joins the threads
+    /// </summary>
+    void                    Stop() { m_players.Stop(); }
+
+    /// <summary>
+    /// Times the zone space, detection and trigger stages of every frame
+    /// </summary>
+    /// <param name="pLatency">tracer to record into, NULL for none</param>
+    void                    SetLatencyTracer(CLatencyTracer* pLatency) { m_pLatency = pLatency; }
+
+    /// <summary>
+    /// Chooses whether skeletons tracked from now on get zones calibrated to their reach
+    /// </summary>
+    /// <param name="enable">true to calibrate</param>
+    void                    SetCalibration(bool enable) { m_players.SetCalibration(enable); }
+
+    /// <summary>
+    /// Detects hits on one frame and hands the resulting triggers to a sink
+    /// </summary>
+    /// <param name="frame">frame to process</param>
+    /// <param name="timeUs">capture time of the frame</param>
+    /// <param name="pSink">receives the triggers</param>
+    /// <returns>number of triggers passed to the sink</returns>
+    int                     ProcessFrame(const SkeletonFrame& frame, int64_t timeUs, IDrumTriggerSink* pSink);
+
+    /// <summary>
+    /// Gets the players, one per tracked skeleton
+    /// </summary>
+    CDrumPlayerRoster&      Players() { return m_players; }
+
+    /// <summary>
+    /// Adds up the prediction accuracy of every player slot
+    /// </summary>
+    /// <param name="pStats">receives the totals</param>
+    void                    GetPredictorStats(HitPredictorStats* pStats);
+
+private:
+    CDrumPlayerRoster       m_players;
+    CLatencyTracer*         m_pLatency;
+
+    /// <summary>
+    /// Records the time since the previous stage ended, if stages are timed at all
+    /// </summary>
+    void                    RecordStage(LatencyStage stage, int64_t* pStageUs);
+
+    /// <summary>
+    /// Passes one player's output to the sink: pedals, predictor requests, then detected strokes
+    /// </summary>
+    int                     EmitPlayerOutput(const CDrumPlayer& player, const DrumPlayerOutput& output, int64_t timeUs, IDrumTriggerSink* pSink);
+};
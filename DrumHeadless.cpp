@@ -0,0 +1,524 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumHeadless.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Runs the drum engine without a sensor, a window or an audio device. Frames
+// come from a recording or a generated performance, triggers are counted or
+// written to a file. Unless -realtime is given frames are processed as fast as
+// the engine can take them. Several recordings, one per sensor, are fused into
+// one stream as if the sensors had run together.
+//
+//   DrumHeadless -replay <recording> [-offset <ms>] [-replay <recording> [-offset <ms>]]... [options]
+//   DrumHeadless -generate <seconds> [-skeletons n] [-bpm b] [-noise m] [-reach r] [-seed s] [options]
+//
+// -offset moves the recording before it onto the first one's clock.
+// -wav mixes the kit on a virtual clock that follows the frames, so it runs as fast
+// as it can and the same session always gives the same file.
+//
+// options: -out <file>|-      write every trigger, "-" for standard output
+//          -midi <file>       write the notes to a Standard MIDI File
+//          -midiport <name>   play the notes on a local MIDI port (device name or number, or a raw MIDI device path)
+//          -realtime          pace frames by their capture times
+//          -threads <n>       threads besides the main one to detect skeletons on
+//          -latency           print the stage latencies at the end
+//          -calibrate         fit the zones to each drummer's reach
+//          -trace <file>      dump the trace rings at the end, for DrumTraceDecode
+//          -filter            smooth the joints with the One-Euro filter first, for raw recordings and generated frames
+//          -snapshot <file>   draw the overlay of the last frame into a 640x480 PNG
+//          -wav <file>        bounce what the session sounded like to a wave file
+//          -samples <dir>     folder of the kit's samples for -wav, made up samples without it
+
+#include "DrumBounce.h"
+#include "DrumDrawList.h"
+#include "DrumEngine.h"
+#include "DrumRasterizer.h"
+#include "DrumTrace.h"
+#include "DrumTriggerSinks.h"
+#include "DrumZones.h"
+#include "MidiOutput.h"
+#include "SkeletonFilter.h"
+#include "SkeletonSources.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// <summary>
+/// Prints how the driver is used
+/// </summary>
+static void PrintUsage()
+{
+    printf("usage: DrumHeadless -replay <recording> [-offset ms]... | -generate <seconds> [-skeletons n] [-bpm b] [-noise m] [-reach r] [-seed s]\n"
+           "                    [-out <file>|-] [-midi <file>] [-midiport <name>] [-realtime] [-threads n] [-latency] [-calibrate]\n"
+           "                    [-trace <file>] [-filter] [-snapshot <file>] [-wav <file> [-samples <dir>]]\n");
+}
+
+/// <summary>
+/// Remembers the notes played, for the snapshot, the way the application does
+/// </summary>
+class CSnapshotHitSink : public IDrumTriggerSink
+{
+public:
+    CDrumHitHistory         history;
+    int64_t                 frameTimeUs;
+
+    CSnapshotHitSink() : frameTimeUs(0) {}
+
+    virtual void Trigger(const DrumHitTrigger& trigger)
+    {
+        if ((DRUM_TRIGGER_PLAY == trigger.type && trigger.zone >= 0) || DRUM_TRIGGER_SCHEDULE == trigger.type)
+        {
+            DrumSnapshotHit hit = { (DRUM_TRIGGER_PLAY == trigger.type) ? trigger.timeUs : frameTimeUs,
+                                    trigger.trackingId, trigger.zone, trigger.hitVelocity };
+            history.Add(hit);
+        }
+    }
+};
+
+/// <summary>
+/// Entry point of the headless driver
+/// </summary>
+/// <returns>0 on success, 1 on bad arguments or a source that fails</returns>
+int main(int argc, char** argv)
+{
+    const char* szReplays[cSkeletonFusionMaxSensors];
+    int64_t replayOffsetsUs[cSkeletonFusionMaxSensors] = { 0 };
+    int replayCount = 0;
+    const char* szOut = NULL;
+    const char* szMidi = NULL;
+    const char* szMidiPort = NULL;
+    const char* szTrace = NULL;
+    const char* szSnapshot = NULL;
+    const char* szWav = NULL;
+    const char* szSamples = NULL;
+    double generateSeconds = 0.0;
+    bool realTime = false;
+    bool printLatency = false;
+    bool calibrate = false;
+    bool filter = false;
+    int threadCount = 0;
+
+    SkeletonGeneratorParams params = CSkeletonGenerator::DefaultParams();
+
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = (i + 1 < argc);
+        if (0 == strcmp(argv[i], "-replay") && hasValue && replayCount < cSkeletonFusionMaxSensors)
+        {
+            szReplays[replayCount++] = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-offset") && hasValue && replayCount > 0)
+        {
+            replayOffsetsUs[replayCount - 1] = static_cast<int64_t>(atof(argv[++i]) * 1000.0);
+        }
+        else if (0 == strcmp(argv[i], "-generate") && hasValue)
+        {
+            generateSeconds = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-skeletons") && hasValue)
+        {
+            params.skeletonCount = atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-bpm") && hasValue)
+        {
+            params.tempoBpm = static_cast<float>(atof(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-noise") && hasValue)
+        {
+            params.noise = static_cast<float>(atof(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-reach") && hasValue)
+        {
+            params.reach = static_cast<float>(atof(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-seed") && hasValue)
+        {
+            params.seed = static_cast<uint32_t>(strtoul(argv[++i], NULL, 10));
+        }
+        else if (0 == strcmp(argv[i], "-out") && hasValue)
+        {
+            szOut = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-midi") && hasValue)
+        {
+            szMidi = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-midiport") && hasValue)
+        {
+            szMidiPort = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-trace") && hasValue)
+        {
+            szTrace = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-snapshot") && hasValue)
+        {
+            szSnapshot = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-wav") && hasValue)
+        {
+            szWav = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-samples") && hasValue)
+        {
+            szSamples = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-threads") && hasValue)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-realtime"))
+        {
+            realTime = true;
+        }
+        else if (0 == strcmp(argv[i], "-latency"))
+        {
+            printLatency = true;
+        }
+        else if (0 == strcmp(argv[i], "-calibrate"))
+        {
+            calibrate = true;
+        }
+        else if (0 == strcmp(argv[i], "-filter"))
+        {
+            filter = true;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if ((0 == replayCount) == (generateSeconds <= 0.0) || (NULL != szMidi && NULL != szMidiPort))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    // The source
+    CSkeletonReplaySource replays[cSkeletonFusionMaxSensors];
+    ISkeletonFrameSource* pReplays[cSkeletonFusionMaxSensors];
+    CSkeletonFusionSource fused;
+    CSkeletonGeneratorSource generated;
+    ISkeletonFrameSource* pSource = NULL;
+    if (replayCount > 0)
+    {
+        for (int i = 0; i < replayCount; ++i)
+        {
+            if (FAILED(replays[i].Open(szReplays[i])))
+            {
+                printf("cannot open recording %s\n", szReplays[i]);
+                return 1;
+            }
+            pReplays[i] = &replays[i];
+        }
+
+        pSource = &replays[0];
+        if (replayCount > 1)
+        {
+            fused.Initialize(pReplays, replayOffsetsUs, replayCount);
+            pSource = &fused;
+        }
+    }
+    else
+    {
+        CDrumZoneTable zones;
+        CreateDefaultDrumZones(zones);
+        uint64_t frameCount = static_cast<uint64_t>(generateSeconds * 1000000.0 / params.frameUs);
+        if (FAILED(generated.Initialize(params, zones, frameCount)))
+        {
+            printf("cannot generate %d skeletons at %.0f bpm\n", params.skeletonCount, params.tempoBpm);
+            return 1;
+        }
+        pSource = &generated;
+    }
+
+    // The sinks: the file sink always counts, even when it writes nothing
+    CFileTriggerSink sink;
+    CTeeTriggerSink sinks;
+    sinks.Add(&sink);
+    if (NULL != szOut && FAILED(sink.Open(szOut)))
+    {
+        printf("cannot create %s\n", szOut);
+        return 1;
+    }
+
+    CMidiFileOutput midiFile;
+    CMidiPortOutput midiPort;
+    CMidiTriggerSink midi;
+    IMidiOutput* pMidiOutput = NULL;
+    if (NULL != szMidi)
+    {
+        if (FAILED(midiFile.Open(szMidi)))
+        {
+            printf("cannot create %s\n", szMidi);
+            return 1;
+        }
+        pMidiOutput = &midiFile;
+    }
+    else if (NULL != szMidiPort)
+    {
+        if (FAILED(midiPort.Open(szMidiPort)))
+        {
+            printf("cannot open MIDI port %s\n", szMidiPort);
+            return 1;
+        }
+        pMidiOutput = &midiPort;
+    }
+
+    if (NULL != pMidiOutput)
+    {
+        // Without a sensor there is no sensor latency to take off
+        midi.Start(pMidiOutput, 0);
+        sinks.Add(&midi);
+    }
+
+    CDrumBounce bounce;
+    if (NULL != szWav)
+    {
+        HRESULT bounceHr = bounce.Initialize(CDrumBounce::DefaultParams());
+        if (SUCCEEDED(bounceHr))
+        {
+            if (NULL != szSamples)
+            {
+                bounceHr = bounce.LoadKit(szSamples);
+            }
+            else
+            {
+                bounce.SynthesizeKit();
+            }
+        }
+        if (FAILED(bounceHr))
+        {
+            printf("cannot load the kit from %s\n", (NULL != szSamples) ? szSamples : "made up samples");
+            return 1;
+        }
+        if (FAILED(bounce.Open(szWav)))
+        {
+            printf("cannot create %s\n", szWav);
+            return 1;
+        }
+        sinks.Add(&bounce);
+    }
+
+    CSnapshotHitSink snapshotHits;
+    SkeletonFrame lastFrame;
+    if (NULL != szSnapshot)
+    {
+        sinks.Add(&snapshotHits);
+    }
+
+    // The engine
+    CLatencyTracer latency;
+    CDrumEngine engine;
+    engine.SetLatencyTracer(&latency);
+    engine.SetCalibration(calibrate);
+    fused.Fusion().SetLatencyTracer(&latency);
+    if (FAILED(engine.Start(threadCount)))
+    {
+        printf("cannot start %d detection threads\n", threadCount);
+        return 1;
+    }
+
+    CSkeletonFilter skeletonFilter;
+    SkeletonFrame filtered;
+
+    uint64_t frameCount = 0;
+    int64_t firstTimeUs = 0;
+    int64_t lastTimeUs = 0;
+    int64_t startUs = DrumGetTimeMicroseconds();
+    HRESULT hr = S_OK;
+    for (;;)
+    {
+        const SkeletonFrame* pFrame = NULL;
+        int64_t timeUs = 0;
+        hr = pSource->Read(&pFrame, &timeUs);
+        if (S_OK != hr)
+        {
+            break;
+        }
+
+        if (0 == frameCount)
+        {
+            firstTimeUs = timeUs;
+        }
+
+        if (realTime)
+        {
+            int64_t waitUs = startUs + (timeUs - firstTimeUs) - DrumGetTimeMicroseconds();
+            if (waitUs > 0)
+            {
+                DrumSleepMicroseconds(waitUs);
+            }
+        }
+
+        if (filter)
+        {
+            filtered = *pFrame;
+            skeletonFilter.Filter(&filtered, timeUs);
+            pFrame = &filtered;
+        }
+
+        // The bounce mixes up to the frame's arrival before its triggers come in
+        if (NULL != szWav && FAILED(bounce.AdvanceTo(timeUs)))
+        {
+            hr = E_FAIL;
+            break;
+        }
+
+        snapshotHits.frameTimeUs = timeUs;
+        engine.ProcessFrame(*pFrame, timeUs, &sinks);
+        if (NULL != szSnapshot)
+        {
+            lastFrame = *pFrame;
+        }
+
+        // The MIDI sink never waits for its thread; running ahead of real time, the driver waits instead
+        while (!realTime && midi.Backlog() > CMidiTriggerSink::cQueueCapacity / 2)
+        {
+            DrumSleepMicroseconds(CMidiTriggerSink::cBatchPeriodUs);
+        }
+        lastTimeUs = timeUs;
+        ++frameCount;
+    }
+    int64_t elapsedUs = DrumGetTimeMicroseconds() - startUs;
+
+    // The last frame as the window would have drawn it, zones and lit zones included
+    HRESULT snapshotHr = S_OK;
+    if (NULL != szSnapshot && frameCount > 0)
+    {
+        static const int snapshotWidth = 640;
+        static const int snapshotHeight = 480;
+        DrumSnapshot* pSnapshot = new DrumSnapshot();
+        CDrumDrawList* pList = new CDrumDrawList();
+        CDrumRasterizer image;
+
+        FillDrumSnapshot(lastFrame, engine.Players(), snapshotHits.history, lastTimeUs, pSnapshot);
+        RecordDrumSnapshot(*pSnapshot, snapshotWidth, snapshotHeight, pList);
+        snapshotHr = image.Initialize(snapshotWidth, snapshotHeight);
+        if (SUCCEEDED(snapshotHr))
+        {
+            image.Draw(*pList);
+            snapshotHr = image.WritePng(szSnapshot);
+        }
+
+        delete pList;
+        delete pSnapshot;
+    }
+
+    HRESULT bounceHr = (NULL != szWav) ? bounce.Finish() : S_OK;
+
+    engine.Stop();
+    sink.Close();
+    midi.Stop();
+    midiFile.Close();
+    midiPort.Close();
+
+    if (FAILED(hr))
+    {
+        printf("source failed after %llu frames\n", static_cast<unsigned long long>(frameCount));
+        return 1;
+    }
+
+    if (FAILED(bounceHr))
+    {
+        printf("cannot write %s\n", szWav);
+        return 1;
+    }
+
+    if (FAILED(snapshotHr))
+    {
+        printf("cannot write snapshot %s\n", szSnapshot);
+        return 1;
+    }
+
+    double streamSeconds = (lastTimeUs - firstTimeUs) / 1000000.0;
+    double elapsedSeconds = elapsedUs / 1000000.0;
+    printf("frames          %llu (%.1f s of skeleton stream)\n", static_cast<unsigned long long>(frameCount), streamSeconds);
+    printf("elapsed         %.3f s, %.0f frames/s, %.1fx real time\n", elapsedSeconds,
+        (elapsedSeconds > 0.0) ? frameCount / elapsedSeconds : 0.0,
+        (elapsedSeconds > 0.0) ? streamSeconds / elapsedSeconds : 0.0);
+    printf("triggers        %llu played, %llu scheduled, %llu cancelled, %llu choked\n",
+        static_cast<unsigned long long>(sink.Count(DRUM_TRIGGER_PLAY)),
+        static_cast<unsigned long long>(sink.Count(DRUM_TRIGGER_SCHEDULE)),
+        static_cast<unsigned long long>(sink.Count(DRUM_TRIGGER_CANCEL)),
+        static_cast<unsigned long long>(sink.Count(DRUM_TRIGGER_CHOKE)));
+    if (pSource == &generated)
+    {
+        printf("strokes         %llu generated\n", static_cast<unsigned long long>(generated.StrokeCount()));
+    }
+
+    if (pSource == &fused)
+    {
+        SkeletonFusionStats fusionStats;
+        fused.Fusion().GetStats(&fusionStats);
+        printf("fusion          %llu frames, %llu short of a sensor, %llu late, %llu overflowed, %llu joints recovered, longest wait %.1f ms\n",
+            static_cast<unsigned long long>(fusionStats.fused), static_cast<unsigned long long>(fusionStats.incomplete),
+            static_cast<unsigned long long>(fusionStats.late), static_cast<unsigned long long>(fusionStats.overflowed),
+            static_cast<unsigned long long>(fusionStats.recoveredJoints), fused.MaxWaitUs() / 1000.0);
+        for (int i = 1; i < replayCount; ++i)
+        {
+            printf("fusion          sensor %d: %s, in %llu frames\n", i,
+                fused.Fusion().IsRegistered(i) ? "registered" : "not registered",
+                static_cast<unsigned long long>(fusionStats.contributed[i]));
+        }
+    }
+
+    HitPredictorStats stats;
+    engine.GetPredictorStats(&stats);
+    printf("prediction      %llu predicted, %llu confirmed, %llu cancelled, %llu missed, mean |error| %.1f ms\n",
+        static_cast<unsigned long long>(stats.predicted), static_cast<unsigned long long>(stats.confirmed),
+        static_cast<unsigned long long>(stats.cancelled), static_cast<unsigned long long>(stats.missed),
+        stats.errorCount ? stats.errorAbsSumUs / (1000.0 * stats.errorCount) : 0.0);
+
+    if (NULL != pMidiOutput)
+    {
+        MidiSinkStats midiStats;
+        midi.GetStats(&midiStats);
+        printf("midi            %llu notes in %llu batches, %llu cancelled, %llu dropped, %llu failed\n",
+            static_cast<unsigned long long>(midiStats.notes), static_cast<unsigned long long>(midiStats.batches),
+            static_cast<unsigned long long>(midiStats.cancelled), static_cast<unsigned long long>(midiStats.dropped),
+            static_cast<unsigned long long>(midiStats.failed));
+    }
+
+    if (NULL != szWav)
+    {
+        DrumBounceStats bounceStats;
+        bounce.GetStats(&bounceStats);
+        DrumMixerStats mixerStats;
+        bounce.Mixer().GetStats(&mixerStats);
+        double audioSeconds = bounceStats.audioFrames / static_cast<double>(bounce.Mixer().SampleRate());
+        printf("bounce          %.1f s of audio to %s, %.1fx real time, hash %016llx\n", audioSeconds, szWav,
+            (elapsedSeconds > 0.0) ? audioSeconds / elapsedSeconds : 0.0, static_cast<unsigned long long>(bounce.Hash()));
+        printf("mixer           %llu hits, %llu stolen, %llu dropped, %llu cancels and chokes dropped\n",
+            static_cast<unsigned long long>(mixerStats.triggers), static_cast<unsigned long long>(mixerStats.stolen),
+            static_cast<unsigned long long>(mixerStats.dropped), static_cast<unsigned long long>(mixerStats.droppedControls));
+    }
+
+    for (int i = 0; calibrate && i < CDrumPlayerRoster::cMaxPlayers; ++i)
+    {
+        CDrumPlayer& player = engine.Players().Player(i);
+        if (player.IsActive())
+        {
+            const DrumZoneFit& fit = player.Calibrator().Fit();
+            printf("calibration     skeleton %u: %s after %u strokes, scale %.3f, offset x %.3f y %.3f depth %.3f m\n",
+                player.TrackingId(), player.Calibrator().IsFitted() ? "fitted" : "warming up", player.Calibrator().Strokes(),
+                fit.scale, fit.x, fit.y, fit.depth);
+        }
+    }
+
+    if (printLatency)
+    {
+        latency.Print(stdout);
+    }
+
+    if (NULL != szTrace && FAILED(DrumTraceDump(szTrace)))
+    {
+        printf("cannot write trace dump %s\n", szTrace);
+        return 1;
+    }
+
+    return 0;
+}
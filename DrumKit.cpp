@@ -0,0 +1,63 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumKit.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumKit.h"
+
+static const char* const g_PieceNames[DRUM_PIECE_COUNT] =
+{
+    "Snare",
+    "Hi Hat",
+    "Crash",
+    "Ride",
+    "High Tom",
+    "Low Tom",
+    "Kick",
+    "Hi Hat Pedal",
+    "Open Hi Hat"
+};
+
+static const char* const g_PieceSampleFiles[DRUM_PIECE_COUNT] =
+{
+    "snareDrum.WAV",
+    "hihatDrum.WAV",
+    "leftCrashDrum-small.WAV",
+    "ride-small.WAV",
+    "highTom-small.WAV",
+    "lowTom-small.WAV",
+    "kickDrum.WAV",
+    "hihatPedal.WAV",
+    "hihatOpen.WAV"
+};
+
+/// <summary>
+/// Gets a printable name for a kit piece
+/// </summary>
+/// <param name="piece">kit piece</param>
+/// <returns>name of the piece</returns>
+const char* DrumPieceName(DrumPiece piece)
+{
+    if (piece < 0 || piece >= DRUM_PIECE_COUNT)
+    {
+        return "Unknown";
+    }
+
+    return g_PieceNames[piece];
+}
+
+/// <summary>
+/// Gets the file name of the sample played by a kit piece
+/// </summary>
+/// <param name="piece">kit piece</param>
+/// <returns>file name, relative to the sample directory</returns>
+const char* DrumPieceSampleFile(DrumPiece piece)
+{
+    if (piece < 0 || piece >= DRUM_PIECE_COUNT)
+    {
+        return "";
+    }
+
+    return g_PieceSampleFiles[piece];
+}
@@ -0,0 +1,38 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumKit.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+// Pieces of the kit. The value doubles as the sample slot in the mixer. The pedals
+// are played by the feet rather than through zones, and the hi-hat zone plays the
+// open hi-hat while the hi-hat pedal is up.
+enum DrumPiece
+{
+    DRUM_PIECE_SNARE = 0,
+    DRUM_PIECE_HIHAT,
+    DRUM_PIECE_CRASH,
+    DRUM_PIECE_RIDE,
+    DRUM_PIECE_HIGH_TOM,
+    DRUM_PIECE_LOW_TOM,
+    DRUM_PIECE_KICK,
+    DRUM_PIECE_HIHAT_PEDAL,
+    DRUM_PIECE_OPEN_HIHAT,
+    DRUM_PIECE_COUNT
+};
+
+/// <summary>
+/// Gets a printable name for a kit piece
+/// </summary>
+/// <param name="piece">kit piece</param>
+/// <returns>name of the piece</returns>
+const char* DrumPieceName(DrumPiece piece);
+
+/// <summary>
+/// Gets the file name of the sample played by a kit piece
+/// </summary>
+/// <param name="piece">kit piece</param>
+/// <returns>file name, relative to the sample directory</returns>
+const char* DrumPieceSampleFile(DrumPiece piece);
@@ -0,0 +1,493 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumMixer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumMixer.h"
+#include "DrumTrace.h"
+#include "WaveFile.h"
+#include <string.h>
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumMixer::CDrumMixer() :
+    m_sampleRate(cDefaultSampleRate),
+    m_blockFrames(cDefaultBlockFrames),
+    m_voiceCount(0),
+    m_nextOrder(0),
+    m_pTracer(NULL),
+    m_pendingCount(0),
+    m_triggerCount(0),
+    m_droppedCount(0),
+    m_droppedControlCount(0),
+    m_stolenCount(0),
+    m_latencyCount(0),
+    m_latencySumUs(0),
+    m_latencyMaxUs(0),
+    m_scheduledCount(0),
+    m_cancelledCount(0),
+    m_lateCancelCount(0),
+    m_chokedCount(0)
+{
+    memset(m_voices, 0, sizeof(m_voices));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CDrumMixer::~CDrumMixer()
+{
+}
+
+/// <summary>
+/// Sets up the output format and preallocates the voice pool and mix buffer
+/// </summary>
+/// <param name="sampleRate">output sample rate</param>
+/// <param name="blockFrames">frames mixed per block</param>
+/// <param name="voiceCount">maximum simultaneously playing samples</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CDrumMixer::Initialize(int sampleRate, int blockFrames, int voiceCount)
+{
+    if (sampleRate <= 0 || blockFrames <= 0 || voiceCount <= 0 || voiceCount > cDrumMixerMaxVoices)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_sampleRate = sampleRate;
+    m_blockFrames = blockFrames;
+    m_voiceCount = voiceCount;
+    m_mixBuffer.assign(blockFrames * 2, 0.0f);
+    memset(m_voices, 0, sizeof(m_voices));
+    m_pendingCount = 0;
+
+    return S_OK;
+}
+
+/// <summary>
+/// Decodes a wave file into a sample slot. Must be called before output starts.
+/// </summary>
+/// <param name="sampleId">slot to load into</param>
+/// <param name="szPath">wave file to load</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CDrumMixer::LoadSample(int sampleId, const char* szPath)
+{
+    if (sampleId < 0 || sampleId >= cDrumMixerMaxSamples || NULL == szPath)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::vector<float> stereo;
+    HRESULT hr = LoadWaveFile(szPath, m_sampleRate, stereo);
+    if (SUCCEEDED(hr))
+    {
+        m_samples[sampleId].swap(stereo);
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Copies interleaved stereo audio into a sample slot. Must be called before output starts.
+/// </summary>
+/// <param name="sampleId">slot to load into</param>
+/// <param name="pStereo">left/right sample pairs at the mixer rate</param>
+/// <param name="frameCount">number of frames</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CDrumMixer::SetSample(int sampleId, const float* pStereo, int frameCount)
+{
+    if (sampleId < 0 || sampleId >= cDrumMixerMaxSamples || NULL == pStereo || frameCount < 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_samples[sampleId].assign(pStereo, pStereo + frameCount * 2);
+    return S_OK;
+}
+
+/// <summary>
+/// Queues a sample to start on the next mixed block. Lock-free and allocation-free.
+/// </summary>
+/// <param name="sampleId">slot to play</param>
+/// <param name="gain">linear gain applied to the sample</param>
+/// <param name="timeUs">arrival time of the frame the hit was detected in, used for latency statistics</param>
+/// <returns>false if the trigger queue was full and the hit was dropped</returns>
+bool CDrumMixer::Trigger(int sampleId, float gain, int64_t timeUs)
+{
+    DrumTrigger trigger;
+    trigger.sampleId = sampleId;
+    trigger.gain = gain;
+    trigger.timeUs = timeUs;
+    trigger.queuedUs = DrumGetTimeMicroseconds();
+    trigger.startUs = 0;
+    trigger.ticket = 0;
+
+    m_triggerCount.fetch_add(1, std::memory_order_relaxed);
+    if (!m_triggers.Push(trigger))
+    {
+        m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+        DRUM_TRACE(DRUM_TRACE_TRIGGER_DROPPED, sampleId, 0, 0, 0.0f, 0.0f);
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Queues a sample to start at a given time, to the sample. Lock-free and allocation-free.
+/// </summary>
+/// <param name="sampleId">slot to play</param>
+/// <param name="gain">linear gain applied to the sample</param>
+/// <param name="startUs">time the sample should be heard, on the output clock</param>
+/// <param name="ticket">nonzero name used to cancel the trigger</param>
+/// <returns>false if the trigger queue was full and the hit was dropped</returns>
+bool CDrumMixer::Schedule(int sampleId, float gain, int64_t startUs, uint32_t ticket)
+{
+    DrumTrigger trigger;
+    trigger.sampleId = sampleId;
+    trigger.gain = gain;
+    trigger.timeUs = startUs;
+    trigger.queuedUs = DrumGetTimeMicroseconds();
+    trigger.startUs = startUs;
+    trigger.ticket = ticket;
+
+    m_triggerCount.fetch_add(1, std::memory_order_relaxed);
+    m_scheduledCount.fetch_add(1, std::memory_order_relaxed);
+    if (!m_triggers.Push(trigger))
+    {
+        m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+        DRUM_TRACE(DRUM_TRACE_TRIGGER_DROPPED, sampleId, 0, 0, 0.0f, 0.0f);
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Withdraws a scheduled trigger that has not started yet. Lock-free and allocation-free.
+/// </summary>
+/// <param name="ticket">name the trigger was scheduled with</param>
+/// <returns>false if the trigger queue was full and the cancel was dropped</returns>
+bool CDrumMixer::Cancel(uint32_t ticket)
+{
+    DrumTrigger trigger;
+    trigger.sampleId = cDrumTriggerCancel;
+    trigger.gain = 0.0f;
+    trigger.timeUs = 0;
+    trigger.queuedUs = 0;
+    trigger.startUs = 0;
+    trigger.ticket = ticket;
+
+    // A lost cancel lets a retracted hit sound, so it is counted like a lost hit
+    if (!m_triggers.Push(trigger))
+    {
+        m_droppedControlCount.fetch_add(1, std::memory_order_relaxed);
+        DRUM_TRACE(DRUM_TRACE_TRIGGER_DROPPED, cDrumTriggerCancel, static_cast<int32_t>(ticket), 0, 0.0f, 0.0f);
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Fades out every voice still playing a sample, such as an open hi-hat when the
+/// pedal closes. Lock-free and allocation-free.
+/// </summary>
+/// <param name="sampleId">slot to silence</param>
+/// <returns>false if the trigger queue was full and the choke was dropped</returns>
+bool CDrumMixer::Choke(int sampleId)
+{
+    DrumTrigger trigger;
+    trigger.sampleId = cDrumTriggerChoke;
+    trigger.gain = 0.0f;
+    trigger.timeUs = 0;
+    trigger.queuedUs = 0;
+    trigger.startUs = 0;
+    trigger.ticket = static_cast<uint32_t>(sampleId);
+
+    if (!m_triggers.Push(trigger))
+    {
+        m_droppedControlCount.fetch_add(1, std::memory_order_relaxed);
+        DRUM_TRACE(DRUM_TRACE_TRIGGER_DROPPED, cDrumTriggerChoke, sampleId, 0, 0.0f, 0.0f);
+        return false;
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Mixes the next frames of output. Called from the audio thread only.
+/// </summary>
+/// <param name="pOut">receives interleaved 16 bit stereo frames</param>
+/// <param name="frameCount">number of frames to produce</param>
+/// <param name="blockTimeUs">time the first frame will be heard</param>
+void CDrumMixer::Render(short* pOut, int frameCount, int64_t blockTimeUs)
+{
+    int64_t frameUs = 0;
+
+    while (frameCount > 0)
+    {
+        int frames = frameCount < m_blockFrames ? frameCount : m_blockFrames;
+        int64_t timeUs = blockTimeUs + frameUs;
+        int64_t endUs = timeUs + static_cast<int64_t>(frames) * 1000000 / m_sampleRate;
+
+        // New hits start at the top of the block so the trigger path stays short
+        DrumTrigger trigger;
+        while (m_triggers.Pop(trigger))
+        {
+            HandleTrigger(trigger, timeUs, endUs, frames);
+        }
+
+        // Scheduled hits that fall inside this block start at their own frame
+        for (int i = 0; i < m_pendingCount; )
+        {
+            if (m_pending[i].startUs < endUs)
+            {
+                StartVoice(m_pending[i], timeUs, frames);
+                m_pending[i] = m_pending[--m_pendingCount];
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        MixVoices(frames);
+
+        // Convert to 16 bit with hard clipping
+        const float* pMix = &m_mixBuffer[0];
+        for (int i = 0; i < frames * 2; ++i)
+        {
+            float value = pMix[i];
+            if (value > 1.0f)
+            {
+                value = 1.0f;
+            }
+            else if (value < -1.0f)
+            {
+                value = -1.0f;
+            }
+
+            pOut[i] = static_cast<short>(value * 32767.0f);
+        }
+
+        pOut += frames * 2;
+        frameCount -= frames;
+        frameUs += static_cast<int64_t>(frames) * 1000000 / m_sampleRate;
+    }
+}
+
+/// <summary>
+/// Reads the activity counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void CDrumMixer::GetStats(DrumMixerStats* pStats) const
+{
+    if (NULL == pStats)
+    {
+        return;
+    }
+
+    pStats->triggers = m_triggerCount.load(std::memory_order_relaxed);
+    pStats->dropped = m_droppedCount.load(std::memory_order_relaxed);
+    pStats->droppedControls = m_droppedControlCount.load(std::memory_order_relaxed);
+    pStats->stolen = m_stolenCount.load(std::memory_order_relaxed);
+    pStats->latencyCount = m_latencyCount.load(std::memory_order_relaxed);
+    pStats->latencySumUs = m_latencySumUs.load(std::memory_order_relaxed);
+    pStats->latencyMaxUs = m_latencyMaxUs.load(std::memory_order_relaxed);
+    pStats->scheduled = m_scheduledCount.load(std::memory_order_relaxed);
+    pStats->cancelled = m_cancelledCount.load(std::memory_order_relaxed);
+    pStats->lateCancels = m_lateCancelCount.load(std::memory_order_relaxed);
+    pStats->choked = m_chokedCount.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Sorts one dequeued trigger into a voice, the pending list, a cancel or a choke
+/// </summary>
+/// <param name="trigger">trigger to handle</param>
+/// <param name="blockTimeUs">time the current block will be heard</param>
+/// <param name="blockEndUs">time the next block will be heard</param>
+/// <param name="blockFrames">frames in the current block</param>
+void CDrumMixer::HandleTrigger(const DrumTrigger& trigger, int64_t blockTimeUs, int64_t blockEndUs, int blockFrames)
+{
+    if (cDrumTriggerCancel == trigger.sampleId)
+    {
+        for (int i = 0; i < m_pendingCount; ++i)
+        {
+            if (m_pending[i].ticket == trigger.ticket)
+            {
+                m_pending[i] = m_pending[--m_pendingCount];
+                m_cancelledCount.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        // Already sounding; cutting it off would only add a click
+        m_lateCancelCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (cDrumTriggerChoke == trigger.sampleId)
+    {
+        int fade = static_cast<int>(cDrumMixerChokeUs * m_sampleRate / 1000000);
+        fade = (fade > 0) ? fade : 1;
+        int choked = 0;
+        for (int i = 0; i < m_voiceCount; ++i)
+        {
+            Voice& voice = m_voices[i];
+            if (NULL != voice.pData && voice.sampleId == static_cast<int>(trigger.ticket) && 0 == voice.fade)
+            {
+                voice.fade = fade;
+                ++choked;
+            }
+        }
+
+        m_chokedCount.fetch_add(choked, std::memory_order_relaxed);
+        DRUM_TRACE(DRUM_TRACE_VOICE_CHOKE, trigger.ticket, choked, 0, 0.0f, 0.0f);
+        return;
+    }
+
+    // A full pending list degrades to starting early rather than losing the hit
+    if (trigger.startUs >= blockEndUs && m_pendingCount < cDrumMixerMaxPending)
+    {
+        m_pending[m_pendingCount++] = trigger;
+        return;
+    }
+
+    StartVoice(trigger, blockTimeUs, blockFrames);
+}
+
+/// <summary>
+/// Assigns a voice to a dequeued trigger, stealing the oldest voice if none are free
+/// </summary>
+/// <param name="trigger">trigger to start</param>
+/// <param name="blockTimeUs">time the current block will be heard</param>
+/// <param name="blockFrames">frames in the current block</param>
+void CDrumMixer::StartVoice(const DrumTrigger& trigger, int64_t blockTimeUs, int blockFrames)
+{
+    if (trigger.sampleId < 0 || trigger.sampleId >= cDrumMixerMaxSamples || m_samples[trigger.sampleId].empty())
+    {
+        return;
+    }
+
+    Voice* pVoice = NULL;
+    Voice* pOldest = NULL;
+    for (int i = 0; i < m_voiceCount; ++i)
+    {
+        Voice& voice = m_voices[i];
+        if (NULL == voice.pData)
+        {
+            pVoice = &voice;
+            break;
+        }
+
+        // Orders are compared relative to the next order so wrap-around is harmless
+        if (NULL == pOldest || (m_nextOrder - voice.order) > (m_nextOrder - pOldest->order))
+        {
+            pOldest = &voice;
+        }
+    }
+
+    bool stolen = (NULL == pVoice);
+    if (stolen)
+    {
+        pVoice = pOldest;
+        m_stolenCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const std::vector<float>& sample = m_samples[trigger.sampleId];
+    pVoice->pData = &sample[0];
+    pVoice->sampleId = trigger.sampleId;
+    pVoice->frameCount = static_cast<int>(sample.size() / 2);
+    pVoice->position = 0;
+    pVoice->gain = trigger.gain;
+    pVoice->order = m_nextOrder++;
+    pVoice->delay = 0;
+    pVoice->fade = 0;
+
+    // Scheduled hits start part way into the block
+    int64_t startUs = blockTimeUs;
+    if (trigger.startUs > blockTimeUs)
+    {
+        int64_t delay = (trigger.startUs - blockTimeUs) * m_sampleRate / 1000000;
+        pVoice->delay = static_cast<int>(delay < blockFrames ? delay : blockFrames - 1);
+        startUs = blockTimeUs + static_cast<int64_t>(pVoice->delay) * 1000000 / m_sampleRate;
+    }
+
+    // Scheduled hits are meant to start late, only how far they slip counts as delay
+    if (NULL != m_pTracer)
+    {
+        int64_t readyUs = (trigger.startUs > trigger.queuedUs) ? trigger.startUs : trigger.queuedUs;
+        m_pTracer->Record(LATENCY_STAGE_AUDIO_START, startUs - readyUs);
+        m_pTracer->Record(LATENCY_STAGE_END_TO_END, startUs - trigger.timeUs);
+    }
+
+    int64_t latencyUs = startUs - trigger.timeUs;
+    m_latencyCount.fetch_add(1, std::memory_order_relaxed);
+    m_latencySumUs.fetch_add(latencyUs, std::memory_order_relaxed);
+    if (latencyUs > m_latencyMaxUs.load(std::memory_order_relaxed))
+    {
+        m_latencyMaxUs.store(latencyUs, std::memory_order_relaxed);
+    }
+
+    DRUM_TRACE(DRUM_TRACE_VOICE_START, trigger.sampleId, static_cast<int32_t>(pVoice - m_voices), stolen ? 1 : 0,
+               trigger.gain, static_cast<float>(latencyUs));
+}
+
+/// <summary>
+/// Sums all active voices into the float mix buffer
+/// </summary>
+/// <param name="frameCount">frames to mix, at most one block</param>
+void CDrumMixer::MixVoices(int frameCount)
+{
+    float* pMix = &m_mixBuffer[0];
+    memset(pMix, 0, frameCount * 2 * sizeof(float));
+
+    for (int v = 0; v < m_voiceCount; ++v)
+    {
+        Voice& voice = m_voices[v];
+        if (NULL == voice.pData)
+        {
+            continue;
+        }
+
+        int remaining = voice.frameCount - voice.position;
+        int space = frameCount - voice.delay;
+        int frames = remaining < space ? remaining : space;
+        const float* pSrc = voice.pData + voice.position * 2;
+        float* pDst = pMix + voice.delay * 2;
+        float gain = voice.gain;
+        voice.delay = 0;
+
+        bool choked = (voice.fade > 0);
+        if (choked)
+        {
+            // A choked voice ramps down to silence and ends there
+            frames = frames < voice.fade ? frames : voice.fade;
+            float step = gain / voice.fade;
+            for (int i = 0; i < frames; ++i)
+            {
+                gain -= step;
+                pDst[i * 2] += pSrc[i * 2] * gain;
+                pDst[i * 2 + 1] += pSrc[i * 2 + 1] * gain;
+            }
+
+            voice.gain = gain;
+            voice.fade -= frames;
+        }
+        else
+        {
+            for (int i = 0; i < frames * 2; ++i)
+            {
+                pDst[i] += pSrc[i] * gain;
+            }
+        }
+
+        voice.position += frames;
+        if (voice.position >= voice.frameCount || (choked && 0 == voice.fade))
+        {
+            voice.pData = NULL;
+        }
+    }
+}
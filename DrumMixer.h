@@ -0,0 +1,234 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumMixer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "BoundedQueue.h"
+#include "LatencyTracer.h"
+#include <atomic>
+#include <vector>
+
+static const int cDrumMixerMaxSamples = 32;
+static const int cDrumMixerMaxVoices  = 64;
+static const int cDrumMixerMaxPending = 32;
+
+// Sample id of a trigger that withdraws an earlier scheduled one
+static const int32_t cDrumTriggerCancel = -1;
+
+// Sample id of a trigger that silences the voices of the sample slot in its ticket
+static const int32_t cDrumTriggerChoke = -2;
+
+// A choked voice fades out over this long instead of clicking off
+static const int64_t cDrumMixerChokeUs = 5000;
+
+/// <summary>
+/// Request to start a sample, queued from the detection thread to the audio thread
+/// </summary>
+struct DrumTrigger
+{
+    int32_t                 sampleId;
+    float                   gain;
+    int64_t                 timeUs;
+    int64_t                 queuedUs;           // time the trigger was queued
+    int64_t                 startUs;            // 0 to start on the next block, otherwise when to start
+    uint32_t                ticket;             // names a scheduled trigger so it can be cancelled, 0 if unnamed; chokes: the slot
+};
+
+/// <summary>
+/// Counters describing mixer activity since initialization
+/// </summary>
+struct DrumMixerStats
+{
+    uint64_t                triggers;
+    uint64_t                dropped;
+    uint64_t                droppedControls;    // cancels and chokes lost to a full queue
+    uint64_t                stolen;
+    uint64_t                latencyCount;
+    int64_t                 latencySumUs;
+    int64_t                 latencyMaxUs;
+    uint64_t                scheduled;
+    uint64_t                cancelled;
+    uint64_t                lateCancels;        // cancels that arrived after their sample started
+    uint64_t                choked;             // voices faded out by a choke
+};
+
+/// <summary>
+/// Plays preloaded drum samples from a fixed voice pool. Samples are loaded up
+/// front, triggers are queued lock-free from any thread, and the output backend
+/// pulls mixed audio in small blocks from its own thread.
+/// </summary>
+class CDrumMixer
+{
+public:
+    static const int        cDefaultSampleRate  = 44100;
+    static const int        cDefaultBlockFrames = 128;
+    static const int        cDefaultVoiceCount  = 16;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumMixer();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CDrumMixer();
+
+    /// <summary>
+    /// Sets up the output format and preallocates the voice pool and mix buffer
+    /// </summary>
+    /// <param name="sampleRate">output sample rate</param>
+    /// <param name="blockFrames">frames mixed per block</param>
+    /// <param name="voiceCount">maximum simultaneously playing samples</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Initialize(int sampleRate, int blockFrames, int voiceCount);
+
+    /// <summary>
+    /// Decodes a wave file into a sample slot. Must be called before output starts.
+    /// </summary>
+    /// <param name="sampleId">slot to load into</param>
+    /// <param name="szPath">wave file to load</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 LoadSample(int sampleId, const char* szPath);
+
+    /// <summary>
+    /// Copies interleaved stereo audio into a sample slot. Must be called before output starts.
+    /// </summary>
+    /// <param name="sampleId">slot to load into</param>
+    /// <param name="pStereo">left/right sample pairs at the mixer rate</param>
+    /// <param name="frameCount">number of frames</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 SetSample(int sampleId, const float* pStereo, int frameCount);
+
+    /// <summary>
+    /// Queues a sample to start on the next mixed block. Lock-free and allocation-free.
+    /// </summary>
+    /// <param name="sampleId">slot to play</param>
+    /// <param name="gain">linear gain applied to the sample</param>
+    /// <param name="timeUs">arrival time of the frame the hit was detected in, used for latency statistics</param>
+    /// <returns>false if the trigger queue was full and the hit was dropped</returns>
+    bool                    Trigger(int sampleId, float gain, int64_t timeUs);
+
+    /// <summary>
+    /// Queues a sample to start at a given time, to the sample. Lock-free and allocation-free.
+    /// </summary>
+    /// <param name="sampleId">slot to play</param>
+    /// <param name="gain">linear gain applied to the sample</param>
+    /// <param name="startUs">time the sample should be heard, on the output clock</param>
+    /// <param name="ticket">nonzero name used to cancel the trigger</param>
+    /// <returns>false if the trigger queue was full and the hit was dropped</returns>
+    bool                    Schedule(int sampleId, float gain, int64_t startUs, uint32_t ticket);
+
+    /// <summary>
+    /// Withdraws a scheduled trigger that has not started yet. Lock-free and allocation-free.
+    /// </summary>
+    /// <param name="ticket">name the trigger was scheduled with</param>
+    /// <returns>false if the trigger queue was full and the cancel was dropped</returns>
+    bool                    Cancel(uint32_t ticket);
+
+    /// <summary>
+    /// Fades out every voice still playing a sample, such as an open hi-hat when the
+    /// pedal closes. Lock-free and allocation-free.
+    /// </summary>
+    /// <param name="sampleId">slot to silence</param>
+    /// <returns>false if the trigger queue was full and the choke was dropped</returns>
+    bool                    Choke(int sampleId);
+
+    /// <summary>
+    /// Records audio start and end to end latency of every hit. Must be called before output starts.
+    /// </summary>
+    /// <param name="pTracer">tracer to record into, or NULL to stop recording</param>
+    void                    SetLatencyTracer(CLatencyTracer* pTracer) { m_pTracer = pTracer; }
+
+    /// <summary>
+    /// Mixes the next frames of output. Called from the audio thread only.
+    /// </summary>
+    /// <param name="pOut">receives interleaved 16 bit stereo frames</param>
+    /// <param name="frameCount">number of frames to produce</param>
+    /// <param name="blockTimeUs">time the first frame will be heard</param>
+    void                    Render(short* pOut, int frameCount, int64_t blockTimeUs);
+
+    /// <summary>
+    /// Gets the output sample rate
+    /// </summary>
+    int                     SampleRate() const { return m_sampleRate; }
+
+    /// <summary>
+    /// Gets the number of frames mixed per block
+    /// </summary>
+    int                     BlockFrames() const { return m_blockFrames; }
+
+    /// <summary>
+    /// Reads the activity counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void                    GetStats(DrumMixerStats* pStats) const;
+
+private:
+    struct Voice
+    {
+        const float*        pData;
+        int                 sampleId;
+        int                 frameCount;
+        int                 position;
+        float               gain;
+        uint32_t            order;
+        int                 delay;              // frames of the current block before the sample starts
+        int                 fade;               // frames left until a choked voice is silent, 0 if not choked
+    };
+
+    int                     m_sampleRate;
+    int                     m_blockFrames;
+    int                     m_voiceCount;
+    uint32_t                m_nextOrder;
+    CLatencyTracer*         m_pTracer;
+
+    std::vector<float>      m_samples[cDrumMixerMaxSamples];
+    Voice                   m_voices[cDrumMixerMaxVoices];
+    std::vector<float>      m_mixBuffer;
+
+    CBoundedQueue<DrumTrigger, 256> m_triggers;
+
+    // Scheduled triggers that start after the current block, audio thread only
+    DrumTrigger             m_pending[cDrumMixerMaxPending];
+    int                     m_pendingCount;
+
+    std::atomic<uint64_t>   m_triggerCount;
+    std::atomic<uint64_t>   m_droppedCount;
+    std::atomic<uint64_t>   m_droppedControlCount;
+    std::atomic<uint64_t>   m_stolenCount;
+    std::atomic<uint64_t>   m_latencyCount;
+    std::atomic<int64_t>    m_latencySumUs;
+    std::atomic<int64_t>    m_latencyMaxUs;
+    std::atomic<uint64_t>   m_scheduledCount;
+    std::atomic<uint64_t>   m_cancelledCount;
+    std::atomic<uint64_t>   m_lateCancelCount;
+    std::atomic<uint64_t>   m_chokedCount;
+
+    /// <summary>
+    /// Assigns a voice to a dequeued trigger, stealing the oldest voice if none are free
+    /// </summary>
+    /// <param name="trigger">trigger to start</param>
+    /// <param name="blockTimeUs">time the current block will be heard</param>
+    /// <param name="blockFrames">frames in the current block</param>
+    void                    StartVoice(const DrumTrigger& trigger, int64_t blockTimeUs, int blockFrames);
+
+    /// <summary>
+    /// Sorts one dequeued trigger into a voice, the pending list, a cancel or a choke
+    /// </summary>
+    /// <param name="trigger">trigger to handle</param>
+    /// <param name="blockTimeUs">time the current block will be heard</param>
+    /// <param name="blockEndUs">time the next block will be heard</param>
+    /// <param name="blockFrames">frames in the current block</param>
+    void                    HandleTrigger(const DrumTrigger& trigger, int64_t blockTimeUs, int64_t blockEndUs, int blockFrames);
+
+    /// <summary>
+    /// Sums all active voices into the float mix buffer
+    /// </summary>
+    /// <param name="frameCount">frames to mix, at most one block</param>
+    void                    MixVoices(int frameCount);
+};
@@ -0,0 +1,62 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumPlatform.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumPlatform.h"
+
+#ifndef _WIN32
+#include <time.h>
+#include <errno.h>
+#endif
+
+/// <summary>
+/// Reads the monotonic high resolution clock
+/// </summary>
+/// <returns>time in microseconds from an arbitrary epoch</returns>
+int64_t DrumGetTimeMicroseconds()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER s_frequency = {0};
+    if (0 == s_frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&s_frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    // Split the conversion so large counter values don't overflow
+    int64_t seconds = counter.QuadPart / s_frequency.QuadPart;
+    int64_t remainder = counter.QuadPart % s_frequency.QuadPart;
+    return seconds * 1000000 + (remainder * 1000000) / s_frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/// <summary>
+/// Blocks the calling thread for at least the given duration
+/// </summary>
+/// <param name="microseconds">time to sleep</param>
+void DrumSleepMicroseconds(int64_t microseconds)
+{
+    if (microseconds <= 0)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    Sleep(static_cast<DWORD>((microseconds + 999) / 1000));
+#else
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(microseconds / 1000000);
+    ts.tv_nsec = static_cast<long>((microseconds % 1000000) * 1000);
+    while (0 != nanosleep(&ts, &ts) && EINTR == errno)
+    {
+    }
+#endif
+}
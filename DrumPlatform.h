@@ -0,0 +1,113 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumPlatform.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Platform glue shared by the drum engine sources. The engine is plain C++ so it
+// can also be built and profiled away from the Kinect runtime.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <intrin.h>
+
+#else
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Minimal HRESULT definitions so engine code keeps the same error conventions
+typedef int32_t HRESULT;
+
+#define S_OK            ((HRESULT)0x00000000)
+#define S_FALSE         ((HRESULT)0x00000001)
+#define E_FAIL          ((HRESULT)0x80004005)
+#define E_POINTER       ((HRESULT)0x80004003)
+#define E_INVALIDARG    ((HRESULT)0x80070057)
+#define E_OUTOFMEMORY   ((HRESULT)0x8007000E)
+
+#define SUCCEEDED(hr)   (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)      (((HRESULT)(hr)) < 0)
+
+#endif
+
+// Plain data that every thread has its own copy of; the v110 compiler has no thread_local
+#if defined(_MSC_VER)
+#define DRUM_THREAD_LOCAL __declspec(thread)
+#else
+#define DRUM_THREAD_LOCAL __thread
+#endif
+
+// SSE2 is part of every x64 target and of the x86 targets we build for
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define DRUM_HAVE_SSE2 1
+#endif
+
+/// <summary>
+/// Finds the lowest set bit
+/// </summary>
+/// <param name="value">non-zero value</param>
+/// <returns>index of the lowest set bit</returns>
+inline int DrumLowestBit(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(value)))
+    {
+        return static_cast<int>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+/// <summary>
+/// Finds the highest set bit
+/// </summary>
+/// <param name="value">non-zero value</param>
+/// <returns>index of the highest set bit</returns>
+inline int DrumHighestBit(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32)))
+    {
+        return static_cast<int>(index) + 32;
+    }
+    _BitScanReverse(&index, static_cast<unsigned long>(value));
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+/// <summary>
+/// Reads the monotonic high resolution clock
+/// </summary>
+/// <returns>time in microseconds from an arbitrary epoch</returns>
+int64_t DrumGetTimeMicroseconds();
+
+/// <summary>
+/// Blocks the calling thread for at least the given duration
+/// </summary>
+/// <param name="microseconds">time to sleep</param>
+void DrumSleepMicroseconds(int64_t microseconds);
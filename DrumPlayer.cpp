@@ -0,0 +1,363 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumPlayer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumPlayer.h"
+
+/// <summary>
+/// Feeds a hand to its strike detector and converts the result to zone motion flags
+/// </summary>
+/// <param name="detector">detector of the hand</param>
+/// <param name="position">hand position in skeleton space</param>
+/// <param name="tracked">whether the sensor tracks the hand</param>
+/// <param name="timeUs">capture time of the frame</param>
+/// <returns>DRUM_MOTION flags of the hand</returns>
+static uint32_t UpdateHandMotion(CStrikeDetector& detector, const SkeletonPoint& position, bool tracked, int64_t timeUs)
+{
+    if (!tracked)
+    {
+        detector.Reset();
+        return DRUM_MOTION_NONE;
+    }
+
+    const HandMotion& motion = detector.Update(position, timeUs);
+
+    uint32_t flags = DRUM_MOTION_NONE;
+    if (motion.struck)
+    {
+        flags |= DRUM_MOTION_DOWN;
+    }
+
+    if (motion.velocity.x > detector.Params().motionDeadband)
+    {
+        flags |= DRUM_MOTION_RIGHT;
+    }
+
+    return flags;
+}
+
+/// <summary>
+/// Takes one foot and its ankle out of a skeleton
+/// </summary>
+/// <param name="skel">skeleton</param>
+/// <param name="foot">foot joint</param>
+/// <param name="ankle">ankle joint of the same leg</param>
+/// <param name="pInput">receives the foot</param>
+static void BuildFootInput(const SkeletonData& skel, SkeletonJoint foot, SkeletonJoint ankle, DrumFootInput* pInput)
+{
+    pInput->foot = skel.joints[foot];
+    pInput->ankle = skel.joints[ankle];
+    pInput->footTracked = (SKELETON_JOINT_NOT_TRACKED != skel.jointStates[foot]);
+    pInput->ankleTracked = (SKELETON_JOINT_NOT_TRACKED != skel.jointStates[ankle]);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumPlayer::CDrumPlayer() :
+    m_bActive(false),
+    m_trackingId(0),
+    m_slot(0)
+{
+    for (int i = 0; i < DRUM_PIECE_COUNT; ++i)
+    {
+        m_kit[i] = i;
+    }
+}
+
+/// <summary>
+/// Starts following a skeleton with fresh state, the default zones and the default kit
+/// </summary>
+/// <param name="trackingId">sensor tracking id of the skeleton</param>
+/// <param name="slot">index of the player in its roster, makes its tickets unique</param>
+void CDrumPlayer::Attach(uint32_t trackingId, int slot)
+{
+    m_bActive = true;
+    m_trackingId = trackingId;
+    m_slot = static_cast<uint32_t>(slot);
+
+    CreateDefaultDrumZones(m_zones);
+    for (int i = 0; i < DRUM_PIECE_COUNT; ++i)
+    {
+        m_kit[i] = i;
+    }
+
+    m_leftHand.Reset();
+    m_rightHand.Reset();
+    m_onsets.Reset();
+    m_predictor.Reset();
+    m_calibrator.Stop();
+    m_pedals.Reset();
+}
+
+/// <summary>
+/// Stops following the skeleton. Pending predictions are cancelled.
+/// </summary>
+/// <param name="pActions">receives the cancels</param>
+/// <param name="maxActions">capacity of pActions</param>
+/// <returns>number of actions written</returns>
+int CDrumPlayer::Detach(HitAction* pActions, int maxActions)
+{
+    int count = 0;
+    if (count < maxActions && m_predictor.ResetHand(DRUM_HAND_LEFT, &pActions[count]))
+    {
+        ++count;
+    }
+
+    if (count < maxActions && m_predictor.ResetHand(DRUM_HAND_RIGHT, &pActions[count]))
+    {
+        ++count;
+    }
+
+    TagTickets(pActions, count);
+    m_bActive = false;
+    return count;
+}
+
+/// <summary>
+/// Gets the kit piece a zone plays now; the hi-hat rings open while its pedal is up
+/// </summary>
+/// <param name="zone">zone index</param>
+int CDrumPlayer::ZonePiece(int zone) const
+{
+    int piece = m_zones.SampleId(zone);
+    return (DRUM_PIECE_HIHAT == piece && m_pedals.IsHihatOpen()) ? DRUM_PIECE_OPEN_HIHAT : piece;
+}
+
+/// <summary>
+/// Runs detection for one frame. Constant memory, no allocation, touches only this player.
+/// </summary>
+/// <param name="input">hands and feet of the skeleton</param>
+/// <param name="pOutput">receives the onsets, predictor actions and pedal strokes</param>
+void CDrumPlayer::Process(const DrumPlayerInput& input, DrumPlayerOutput* pOutput)
+{
+    DrumHandInput left = input.left;
+    DrumHandInput right = input.right;
+
+    // A hand only counts as moving down on the frame its stroke lands
+    left.motion = UpdateHandMotion(m_leftHand, input.leftHand, input.leftTracked, input.timeUs);
+    right.motion = UpdateHandMotion(m_rightHand, input.rightHand, input.rightTracked, input.timeUs);
+
+    // Where strokes land fits the zones to the player before they are tested
+    m_calibrator.Update(left, right, &m_zones);
+
+    // Only strokes on armed zones become notes, so a hand resting in a zone plays once
+    const HandMotion& leftMotion = m_leftHand.Motion();
+    const HandMotion& rightMotion = m_rightHand.Motion();
+    pOutput->onsetCount = m_onsets.Process(m_zones, left, right, leftMotion.hitVelocity, rightMotion.hitVelocity,
+                                           input.timeUs, pOutput->onsets, cDrumPlayerMaxOnsets);
+
+    // A stroke sounds at the instant it landed between frames, not at the frame that saw it; a flam at its first hand
+    for (int i = 0; i < pOutput->onsetCount; ++i)
+    {
+        DrumOnset& onset = pOutput->onsets[i];
+        if ((onset.hands & DRUM_HAND_LEFT) && leftMotion.struck && leftMotion.strikeUs < onset.timeUs)
+        {
+            onset.timeUs = leftMotion.strikeUs;
+        }
+
+        if ((onset.hands & DRUM_HAND_RIGHT) && rightMotion.struck && rightMotion.strikeUs < onset.timeUs)
+        {
+            onset.timeUs = rightMotion.strikeUs;
+        }
+    }
+
+    // Schedule strokes that are about to land; onsets they already cover are dropped
+    int actionCount = 0;
+    if (!input.leftTracked && m_predictor.ResetHand(DRUM_HAND_LEFT, &pOutput->actions[actionCount]))
+    {
+        ++actionCount;
+    }
+
+    if (!input.rightTracked && m_predictor.ResetHand(DRUM_HAND_RIGHT, &pOutput->actions[actionCount]))
+    {
+        ++actionCount;
+    }
+
+    actionCount += m_predictor.Process(m_zones, m_onsets, left, right,
+                                       leftMotion.downSpeed, rightMotion.downSpeed, leftMotion.hitVelocity, rightMotion.hitVelocity,
+                                       input.timeUs, pOutput->onsets, &pOutput->onsetCount,
+                                       pOutput->actions + actionCount, cDrumPlayerMaxActions - actionCount);
+
+    TagTickets(pOutput->actions, actionCount);
+    pOutput->actionCount = actionCount;
+
+    // The feet come with the same skeleton; the hi-hat state they leave is what the hands play on
+    pOutput->pedalCount = m_pedals.Update(input.leftFoot, input.rightFoot, input.timeUs, pOutput->pedals);
+}
+
+/// <summary>
+/// Makes a predictor ticket unique across the roster
+/// </summary>
+void CDrumPlayer::TagTickets(HitAction* pActions, int count) const
+{
+    // Predictor tickets start at 1, so tagged tickets are never 0
+    for (int i = 0; i < count; ++i)
+    {
+        pActions[i].ticket = (pActions[i].ticket << 3) | m_slot;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumPlayerRoster::CDrumPlayerRoster() :
+    m_bCalibrate(false)
+{
+}
+
+/// <summary>
+/// Finds the player following a skeleton
+/// </summary>
+/// <param name="trackingId">sensor tracking id</param>
+/// <returns>player, or NULL if none follows the skeleton</returns>
+CDrumPlayer* CDrumPlayerRoster::Find(uint32_t trackingId)
+{
+    for (int i = 0; i < cMaxPlayers; ++i)
+    {
+        if (m_players[i].IsActive() && m_players[i].TrackingId() == trackingId)
+        {
+            return &m_players[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// <summary>
+/// Finds the player following a skeleton, attaching a free one if there is none
+/// </summary>
+/// <param name="trackingId">sensor tracking id</param>
+/// <returns>player, or NULL if every player is taken</returns>
+CDrumPlayer* CDrumPlayerRoster::Acquire(uint32_t trackingId)
+{
+    CDrumPlayer* pPlayer = Find(trackingId);
+    if (NULL != pPlayer)
+    {
+        return pPlayer;
+    }
+
+    for (int i = 0; i < cMaxPlayers; ++i)
+    {
+        if (!m_players[i].IsActive())
+        {
+            m_players[i].Attach(trackingId, i);
+            if (m_bCalibrate)
+            {
+                m_players[i].StartCalibration();
+            }
+            return &m_players[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// <summary>
+/// Detaches the players whose skeletons are no longer tracked
+/// </summary>
+/// <param name="pTrackingIds">tracking ids present in the current frame</param>
+/// <param name="count">number of tracking ids</param>
+/// <param name="pActions">receives cancels of the detached players' predictions</param>
+/// <param name="maxActions">capacity of pActions</param>
+/// <returns>number of actions written</returns>
+int CDrumPlayerRoster::Reclaim(const uint32_t* pTrackingIds, int count, HitAction* pActions, int maxActions)
+{
+    int actionCount = 0;
+
+    for (int i = 0; i < cMaxPlayers; ++i)
+    {
+        CDrumPlayer& player = m_players[i];
+        if (!player.IsActive())
+        {
+            continue;
+        }
+
+        bool present = false;
+        for (int j = 0; j < count && !present; ++j)
+        {
+            present = (pTrackingIds[j] == player.TrackingId());
+        }
+
+        if (!present)
+        {
+            actionCount += player.Detach(pActions + actionCount, maxActions - actionCount);
+        }
+    }
+
+    return actionCount;
+}
+
+/// <summary>
+/// Arguments of one parallel Process call
+/// </summary>
+struct PlayerWork
+{
+    CDrumPlayer* const*     ppPlayers;
+    const DrumPlayerInput*  pInputs;
+    DrumPlayerOutput*       pOutputs;
+};
+
+/// <summary>
+/// Processes one player of a PlayerWork
+/// </summary>
+static void ProcessPlayer(void* pContext, int index)
+{
+    PlayerWork* pWork = static_cast<PlayerWork*>(pContext);
+    pWork->ppPlayers[index]->Process(pWork->pInputs[index], &pWork->pOutputs[index]);
+}
+
+/// <summary>
+/// Runs detection of several players in parallel
+/// </summary>
+/// <param name="ppPlayers">players to process, each at most once</param>
+/// <param name="pInputs">input of each player</param>
+/// <param name="pOutputs">receives the output of each player</param>
+/// <param name="count">number of players</param>
+void CDrumPlayerRoster::Process(CDrumPlayer* const* ppPlayers, const DrumPlayerInput* pInputs, DrumPlayerOutput* pOutputs, int count)
+{
+    PlayerWork work;
+    work.ppPlayers = ppPlayers;
+    work.pInputs = pInputs;
+    work.pOutputs = pOutputs;
+
+    m_workers.Run(ProcessPlayer, &work, count);
+}
+
+/// <summary>
+/// Measures the hands of a skeleton against its shoulder center for detection and
+/// takes its feet and ankles for the pedals. Works on skeleton space joints alone,
+/// so detection does not depend on any screen.
+/// </summary>
+/// <param name="skel">skeleton to measure</param>
+/// <param name="timeUs">capture time of the frame</param>
+/// <param name="pInput">receives the player input</param>
+void BuildDrumPlayerInput(const SkeletonData& skel, int64_t timeUs, DrumPlayerInput* pInput)
+{
+    const SkeletonPoint& shoulder = skel.joints[SKELETON_JOINT_SHOULDER_CENTER];
+    const SkeletonPoint& leftHand = skel.joints[SKELETON_JOINT_HAND_LEFT];
+    const SkeletonPoint& rightHand = skel.joints[SKELETON_JOINT_HAND_RIGHT];
+
+    pInput->leftHand = leftHand;
+    pInput->rightHand = rightHand;
+    pInput->leftTracked = (SKELETON_JOINT_NOT_TRACKED != skel.jointStates[SKELETON_JOINT_HAND_LEFT]);
+    pInput->rightTracked = (SKELETON_JOINT_NOT_TRACKED != skel.jointStates[SKELETON_JOINT_HAND_RIGHT]);
+    pInput->timeUs = timeUs;
+
+    // Zone space keeps the screen's downward y; depth grows towards the sensor
+    pInput->left.x = leftHand.x - shoulder.x;
+    pInput->left.y = shoulder.y - leftHand.y;
+    pInput->left.depth = shoulder.z - leftHand.z;
+    pInput->left.motion = DRUM_MOTION_NONE;
+
+    pInput->right.x = rightHand.x - shoulder.x;
+    pInput->right.y = shoulder.y - rightHand.y;
+    pInput->right.depth = shoulder.z - rightHand.z;
+    pInput->right.motion = DRUM_MOTION_NONE;
+
+    // Seated mode reports no legs; the pedal detector sits such gaps out
+    BuildFootInput(skel, SKELETON_JOINT_FOOT_LEFT, SKELETON_JOINT_ANKLE_LEFT, &pInput->leftFoot);
+    BuildFootInput(skel, SKELETON_JOINT_FOOT_RIGHT, SKELETON_JOINT_ANKLE_RIGHT, &pInput->rightFoot);
+}
@@ -0,0 +1,269 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumPlayer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumKit.h"
+#include "DrumZones.h"
+#include "HitPredictor.h"
+#include "OnsetGate.h"
+#include "PedalDetector.h"
+#include "SkeletonFrame.h"
+#include "StrikeDetector.h"
+#include "WorkerGroup.h"
+#include "ZoneCalibrator.h"
+
+static const int cDrumPlayerMaxOnsets  = 16;
+static const int cDrumPlayerMaxActions = 6;
+
+/// <summary>
+/// Hands and feet of one skeleton on one frame
+/// </summary>
+struct DrumPlayerInput
+{
+    SkeletonPoint           leftHand;           // skeleton space, drives the strike detectors
+    SkeletonPoint           rightHand;
+    bool                    leftTracked;
+    bool                    rightTracked;
+    DrumHandInput           left;               // zone space position, motion is filled in by the player
+    DrumHandInput           right;
+    DrumFootInput           leftFoot;           // skeleton space, untracked in seated mode
+    DrumFootInput           rightFoot;
+    int64_t                 timeUs;
+};
+
+/// <summary>
+/// What one skeleton played on one frame
+/// </summary>
+struct DrumPlayerOutput
+{
+    DrumOnset               onsets[cDrumPlayerMaxOnsets];
+    int                     onsetCount;
+    HitAction               actions[cDrumPlayerMaxActions];
+    int                     actionCount;
+    DrumPedalEvent          pedals[cPedalMaxEvents];
+    int                     pedalCount;
+};
+
+/// <summary>
+/// Everything that belongs to one drummer: hand trajectories, retrigger state,
+/// predictions, zone layout and kit. Players share nothing, so several can be
+/// processed at once on different threads.
+/// </summary>
+class CDrumPlayer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumPlayer();
+
+    /// <summary>
+    /// Starts following a skeleton with fresh state, the default zones and the default kit
+    /// </summary>
+    /// <param name="trackingId">sensor tracking id of the skeleton</param>
+    /// <param name="slot">index of the player in its roster, makes its tickets unique</param>
+    void                    Attach(uint32_t trackingId, int slot);
+
+    /// <summary>
+    /// Stops following the skeleton. Pending predictions are cancelled.
+    /// </summary>
+    /// <param name="pActions">receives the cancels</param>
+    /// <param name="maxActions">capacity of pActions</param>
+    /// <returns>number of actions written</returns>
+    int                     Detach(HitAction* pActions, int maxActions);
+
+    /// <summary>
+    /// Gets whether the player follows a skeleton
+    /// </summary>
+    bool                    IsActive() const { return m_bActive; }
+
+    /// <summary>
+    /// Gets the tracking id of the followed skeleton
+    /// </summary>
+    uint32_t                TrackingId() const { return m_trackingId; }
+
+    /// <summary>
+    /// Gets the zone layout, which may be changed between frames. A running calibration
+    /// lays out the zones it started with again; start it over after changing them.
+    /// </summary>
+    CDrumZoneTable&         Zones() { return m_zones; }
+    const CDrumZoneTable&   Zones() const { return m_zones; }
+
+    /// <summary>
+    /// Chooses the mixer sample a kit piece plays
+    /// </summary>
+    /// <param name="piece">kit piece</param>
+    /// <param name="sampleId">mixer sample slot</param>
+    void                    SetKitSample(DrumPiece piece, int sampleId) { m_kit[piece] = sampleId; }
+
+    /// <summary>
+    /// Gets the kit piece a zone plays now; the hi-hat rings open while its pedal is up
+    /// </summary>
+    /// <param name="zone">zone index</param>
+    int                     ZonePiece(int zone) const;
+
+    /// <summary>
+    /// Gets the mixer sample a zone plays now
+    /// </summary>
+    /// <param name="zone">zone index</param>
+    int                     ZoneSample(int zone) const { return PieceSample(ZonePiece(zone)); }
+
+    /// <summary>
+    /// Gets the mixer sample a kit piece plays
+    /// </summary>
+    /// <param name="piece">kit piece, or -1</param>
+    int                     PieceSample(int piece) const { return (piece >= 0 && piece < DRUM_PIECE_COUNT) ? m_kit[piece] : piece; }
+
+    /// <summary>
+    /// Starts fitting the current zones to the player's reach: a warm-up of strokes
+    /// around the kit, then slow adaptation while the player plays
+    /// </summary>
+    void                    StartCalibration() { m_calibrator.Start(m_zones); }
+
+    /// <summary>
+    /// Stops adapting the zones; they keep their latest fit
+    /// </summary>
+    void                    StopCalibration() { m_calibrator.Stop(); }
+
+    /// <summary>
+    /// Gets the calibration of the zones
+    /// </summary>
+    const CZoneCalibrator&  Calibrator() const { return m_calibrator; }
+
+    /// <summary>
+    /// Runs detection for one frame. Constant memory, no allocation, touches only this player.
+    /// </summary>
+    /// <param name="input">hands and feet of the skeleton</param>
+    /// <param name="pOutput">receives the onsets, predictor actions and pedal strokes</param>
+    void                    Process(const DrumPlayerInput& input, DrumPlayerOutput* pOutput);
+
+    /// <summary>
+    /// Gets the left hand strike detector
+    /// </summary>
+    const CStrikeDetector&  LeftHand() const { return m_leftHand; }
+
+    /// <summary>
+    /// Gets the right hand strike detector
+    /// </summary>
+    const CStrikeDetector&  RightHand() const { return m_rightHand; }
+
+    /// <summary>
+    /// Gets the hit predictor
+    /// </summary>
+    const CHitPredictor&    Predictor() const { return m_predictor; }
+
+    /// <summary>
+    /// Gets the pedal detector
+    /// </summary>
+    const CPedalDetector&   Pedals() const { return m_pedals; }
+
+private:
+    bool                    m_bActive;
+    uint32_t                m_trackingId;
+    uint32_t                m_slot;
+
+    CDrumZoneTable          m_zones;
+    int32_t                 m_kit[DRUM_PIECE_COUNT];
+
+    CStrikeDetector         m_leftHand;
+    CStrikeDetector         m_rightHand;
+    COnsetGate              m_onsets;
+    CHitPredictor           m_predictor;
+    CZoneCalibrator         m_calibrator;
+    CPedalDetector          m_pedals;
+
+    /// <summary>
+    /// Makes a predictor ticket unique across the roster
+    /// </summary>
+    void                    TagTickets(HitAction* pActions, int count) const;
+};
+
+/// <summary>
+/// Fixed set of players, one per skeleton the sensor can report, keyed by tracking id
+/// </summary>
+class CDrumPlayerRoster
+{
+public:
+    static const int        cMaxPlayers = cSkeletonCount;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumPlayerRoster();
+
+    /// <summary>
+    /// Starts the threads players are processed on
+    /// </summary>
+    /// <param name="threadCount">threads besides the caller, 0 to process players one after another</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Start(int threadCount) { return m_workers.Start(threadCount); }
+
+    /// <summary>
+    /// Joins the threads
+    /// </summary>
+    void                    Stop() { m_workers.Stop(); }
+
+    /// <summary>
+    /// Chooses whether players attached from now on calibrate their zones to their reach
+    /// </summary>
+    /// <param name="enable">true to calibrate</param>
+    void                    SetCalibration(bool enable) { m_bCalibrate = enable; }
+
+    /// <summary>
+    /// Finds the player following a skeleton
+    /// </summary>
+    /// <param name="trackingId">sensor tracking id</param>
+    /// <returns>player, or NULL if none follows the skeleton</returns>
+    CDrumPlayer*            Find(uint32_t trackingId);
+
+    /// <summary>
+    /// Finds the player following a skeleton, attaching a free one if there is none
+    /// </summary>
+    /// <param name="trackingId">sensor tracking id</param>
+    /// <returns>player, or NULL if every player is taken</returns>
+    CDrumPlayer*            Acquire(uint32_t trackingId);
+
+    /// <summary>
+    /// Detaches the players whose skeletons are no longer tracked
+    /// </summary>
+    /// <param name="pTrackingIds">tracking ids present in the current frame</param>
+    /// <param name="count">number of tracking ids</param>
+    /// <param name="pActions">receives cancels of the detached players' predictions</param>
+    /// <param name="maxActions">capacity of pActions</param>
+    /// <returns>number of actions written</returns>
+    int                     Reclaim(const uint32_t* pTrackingIds, int count, HitAction* pActions, int maxActions);
+
+    /// <summary>
+    /// Runs detection of several players in parallel
+    /// </summary>
+    /// <param name="ppPlayers">players to process, each at most once</param>
+    /// <param name="pInputs">input of each player</param>
+    /// <param name="pOutputs">receives the output of each player</param>
+    /// <param name="count">number of players</param>
+    void                    Process(CDrumPlayer* const* ppPlayers, const DrumPlayerInput* pInputs, DrumPlayerOutput* pOutputs, int count);
+
+    /// <summary>
+    /// Gets a player by slot
+    /// </summary>
+    CDrumPlayer&            Player(int slot) { return m_players[slot]; }
+
+private:
+    CDrumPlayer             m_players[cMaxPlayers];
+    CWorkerGroup            m_workers;
+    bool                    m_bCalibrate;
+};
+
+/// <summary>
+/// Measures the hands of a skeleton against its shoulder center for detection and
+/// takes its feet and ankles for the pedals. Works on skeleton space joints alone,
+/// so detection does not depend on any screen.
+/// </summary>
+/// <param name="skel">skeleton to measure</param>
+/// <param name="timeUs">capture time of the frame</param>
+/// <param name="pInput">receives the player input</param>
+void BuildDrumPlayerInput(const SkeletonData& skel, int64_t timeUs, DrumPlayerInput* pInput);
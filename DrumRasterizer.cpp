@@ -0,0 +1,659 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumRasterizer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumRasterizer.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef DRUM_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+static inline float MinF(float a, float b)
+{
+    return (a < b) ? a : b;
+}
+
+static inline float MaxF(float a, float b)
+{
+    return (a > b) ? a : b;
+}
+
+static inline float Clamp01(float v)
+{
+    return MinF(MaxF(v, 0.0f), 1.0f);
+}
+
+#ifdef DRUM_HAVE_SSE2
+static inline __m128 Abs4(__m128 v)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+static inline __m128 Clamp4(__m128 v)
+{
+    return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+#endif
+
+/// <summary>
+/// Pixels a shape may touch, clipped to the image
+/// </summary>
+struct PixelBounds
+{
+    int                     left;
+    int                     top;
+    int                     right;          // exclusive
+    int                     bottom;         // exclusive
+};
+
+/// <summary>
+/// Gets the pixels of a box, clipped to the image
+/// </summary>
+static PixelBounds ClipBounds(float left, float top, float right, float bottom, int width, int height)
+{
+    PixelBounds bounds;
+    bounds.left = static_cast<int>(floorf(MaxF(left, 0.0f)));
+    bounds.top = static_cast<int>(floorf(MaxF(top, 0.0f)));
+    bounds.right = static_cast<int>(ceilf(MinF(right, static_cast<float>(width))));
+    bounds.bottom = static_cast<int>(ceilf(MinF(bottom, static_cast<float>(height))));
+    return bounds;
+}
+
+/// <summary>
+/// Line with flat ends, as Direct2D strokes one by default
+/// </summary>
+struct LineShape
+{
+    float                   x0;
+    float                   y0;
+    float                   ux;             // unit direction
+    float                   uy;
+    float                   length;
+    float                   reach;          // half the width, plus half a pixel
+    float                   cornerX[4];     // outside this quad nothing is covered
+    float                   cornerY[4];
+
+    void FindCorners()
+    {
+        float ax = ux * 0.5f;
+        float ay = uy * 0.5f;
+        float nx = uy * reach;
+        float ny = -ux * reach;
+        float x1 = x0 + ux * length;
+        float y1 = y0 + uy * length;
+        cornerX[0] = x0 - ax + nx;  cornerY[0] = y0 - ay + ny;
+        cornerX[1] = x1 + ax + nx;  cornerY[1] = y1 + ay + ny;
+        cornerX[2] = x1 + ax - nx;  cornerY[2] = y1 + ay - ny;
+        cornerX[3] = x0 - ax - nx;  cornerY[3] = y0 - ay - ny;
+    }
+
+    // Narrows a row to the pixels whose centers may lie inside the quad, so a slanted
+    // bone visits a band of pixels rather than its whole bounding box
+    void Span(float py, int* pLeft, int* pRight) const
+    {
+        float left = 1e30f;
+        float right = -1e30f;
+        for (int i = 0; i < 4; ++i)
+        {
+            int j = (i + 1) & 3;
+            float ya = cornerY[i];
+            float yb = cornerY[j];
+            if ((py < ya && py < yb) || (py > ya && py > yb))
+            {
+                continue;
+            }
+
+            float x = (ya == yb) ? cornerX[i] : cornerX[i] + (py - ya) * (cornerX[j] - cornerX[i]) / (yb - ya);
+            float other = (ya == yb) ? cornerX[j] : x;
+            left = MinF(left, MinF(x, other));
+            right = MaxF(right, MaxF(x, other));
+        }
+
+        if (left > right)
+        {
+            *pRight = *pLeft;
+            return;
+        }
+
+        // A pixel of margin either side keeps rounding from cutting off an edge pixel
+        int spanLeft = static_cast<int>(floorf(left - 0.5f)) - 1;
+        int spanRight = static_cast<int>(floorf(right - 0.5f)) + 2;
+        *pLeft = (spanLeft > *pLeft) ? spanLeft : *pLeft;
+        *pRight = (spanRight < *pRight) ? spanRight : *pRight;
+    }
+
+    float At(float x, float y) const
+    {
+        float dx = x - x0;
+        float dy = y - y0;
+        float along = dx * ux + dy * uy;
+        float across = fabsf(dx * uy - dy * ux);
+        return Clamp01(reach - across) * Clamp01(MinF(along, length - along) + 0.5f);
+    }
+
+#ifdef DRUM_HAVE_SSE2
+    __m128 At4(__m128 x, __m128 y) const
+    {
+        __m128 dx = _mm_sub_ps(x, _mm_set1_ps(x0));
+        __m128 dy = _mm_sub_ps(y, _mm_set1_ps(y0));
+        __m128 along = _mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(ux)), _mm_mul_ps(dy, _mm_set1_ps(uy)));
+        __m128 across = Abs4(_mm_sub_ps(_mm_mul_ps(dx, _mm_set1_ps(uy)), _mm_mul_ps(dy, _mm_set1_ps(ux))));
+        __m128 ends = _mm_add_ps(_mm_min_ps(along, _mm_sub_ps(_mm_set1_ps(length), along)), _mm_set1_ps(0.5f));
+        return _mm_mul_ps(Clamp4(_mm_sub_ps(_mm_set1_ps(reach), across)), Clamp4(ends));
+    }
+#endif
+};
+
+/// <summary>
+/// Outline of an ellipse, its distance approximated by scaling it to a circle
+/// </summary>
+struct RingShape
+{
+    float                   cx;
+    float                   cy;
+    float                   ix;             // inverse radii
+    float                   iy;
+    float                   radius;         // mean radius
+    float                   reach;
+
+    float At(float x, float y) const
+    {
+        float u = (x - cx) * ix;
+        float v = (y - cy) * iy;
+        float distance = fabsf(sqrtf(u * u + v * v) - 1.0f) * radius;
+        return Clamp01(reach - distance);
+    }
+
+    // Joints are a few pixels across; their whole box is visited
+    void Span(float, int*, int*) const {}
+
+#ifdef DRUM_HAVE_SSE2
+    __m128 At4(__m128 x, __m128 y) const
+    {
+        __m128 u = _mm_mul_ps(_mm_sub_ps(x, _mm_set1_ps(cx)), _mm_set1_ps(ix));
+        __m128 v = _mm_mul_ps(_mm_sub_ps(y, _mm_set1_ps(cy)), _mm_set1_ps(iy));
+        __m128 f = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)));
+        __m128 distance = _mm_mul_ps(Abs4(_mm_sub_ps(f, _mm_set1_ps(1.0f))), _mm_set1_ps(radius));
+        return Clamp4(_mm_sub_ps(_mm_set1_ps(reach), distance));
+    }
+#endif
+};
+
+/// <summary>
+/// Outline of a rectangle, stroked on its edges
+/// </summary>
+struct FrameShape
+{
+    float                   left;
+    float                   top;
+    float                   right;
+    float                   bottom;
+    float                   reach;
+
+    float At(float x, float y) const
+    {
+        float ex = MaxF(left - x, x - right);
+        float ey = MaxF(top - y, y - bottom);
+        float ox = MaxF(ex, 0.0f);
+        float oy = MaxF(ey, 0.0f);
+        float distance = fabsf(sqrtf(ox * ox + oy * oy) + MinF(MaxF(ex, ey), 0.0f));
+        return Clamp01(reach - distance);
+    }
+
+    // Drawn band by band along the edges, each band visited whole
+    void Span(float, int*, int*) const {}
+
+#ifdef DRUM_HAVE_SSE2
+    __m128 At4(__m128 x, __m128 y) const
+    {
+        __m128 zero = _mm_setzero_ps();
+        __m128 ex = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(left), x), _mm_sub_ps(x, _mm_set1_ps(right)));
+        __m128 ey = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(top), y), _mm_sub_ps(y, _mm_set1_ps(bottom)));
+        __m128 ox = _mm_max_ps(ex, zero);
+        __m128 oy = _mm_max_ps(ey, zero);
+        __m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)));
+        __m128 distance = Abs4(_mm_add_ps(outside, _mm_min_ps(_mm_max_ps(ex, ey), zero)));
+        return Clamp4(_mm_sub_ps(_mm_set1_ps(reach), distance));
+    }
+#endif
+};
+
+/// <summary>
+/// Filled rectangle
+/// </summary>
+struct BoxShape
+{
+    float                   left;
+    float                   top;
+    float                   right;
+    float                   bottom;
+
+    float At(float x, float y) const
+    {
+        float ex = MaxF(left - x, x - right);
+        float ey = MaxF(top - y, y - bottom);
+        return Clamp01(0.5f - ex) * Clamp01(0.5f - ey);
+    }
+
+    void Span(float, int*, int*) const {}
+
+#ifdef DRUM_HAVE_SSE2
+    __m128 At4(__m128 x, __m128 y) const
+    {
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128 ex = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(left), x), _mm_sub_ps(x, _mm_set1_ps(right)));
+        __m128 ey = _mm_max_ps(_mm_sub_ps(_mm_set1_ps(top), y), _mm_sub_ps(y, _mm_set1_ps(bottom)));
+        return _mm_mul_ps(Clamp4(_mm_sub_ps(half, ex)), Clamp4(_mm_sub_ps(half, ey)));
+    }
+#endif
+};
+
+/// <summary>
+/// Blends a color over one pixel by coverage, in steps of 1/256
+/// </summary>
+static inline void BlendPixel(uint8_t* pPixel, const uint8_t* pColor, float coverage)
+{
+    int c = static_cast<int>(coverage * 256.0f + 0.5f);
+    for (int channel = 0; channel < 4; ++channel)
+    {
+        pPixel[channel] = static_cast<uint8_t>((pPixel[channel] * (256 - c) + pColor[channel] * c) >> 8);
+    }
+}
+
+/// <summary>
+/// Blends a color over every pixel of a shape by its coverage
+/// </summary>
+template <class TShape>
+static void FillShape(const TShape& shape, const PixelBounds& bounds, const uint8_t* pColor,
+                      uint8_t* pPixels, int width, bool vectorized)
+{
+#ifdef DRUM_HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(256);
+    const __m128i color = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(pColor[0] | (pColor[1] << 8) | (pColor[2] << 16) |
+                                                            (static_cast<uint32_t>(pColor[3]) << 24))), zero);
+    const __m128 steps = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 scale = _mm_set1_ps(256.0f);
+    const __m128 round = _mm_set1_ps(0.5f);
+#else
+    (void)vectorized;
+#endif
+
+    for (int y = bounds.top; y < bounds.bottom; ++y)
+    {
+        uint8_t* pRow = pPixels + static_cast<size_t>(y) * width * 4;
+        float py = y + 0.5f;
+        int x = bounds.left;
+        int right = bounds.right;
+        shape.Span(py, &x, &right);
+
+#ifdef DRUM_HAVE_SSE2
+        if (vectorized)
+        {
+            __m128 py4 = _mm_set1_ps(py);
+            for (; x + 4 <= right; x += 4)
+            {
+                __m128 coverage = shape.At4(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), steps), py4);
+                __m128i c = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(coverage, scale), round));
+                if (0 == _mm_movemask_epi8(_mm_cmpgt_epi32(c, _mm_setzero_si128())))
+                {
+                    continue;
+                }
+
+                // Coverage of each pixel repeated over its four channels
+                __m128i c16 = _mm_packs_epi32(c, c);
+                __m128i pairs = _mm_unpacklo_epi16(c16, c16);
+                __m128i cLo = _mm_unpacklo_epi32(pairs, pairs);
+                __m128i cHi = _mm_unpackhi_epi32(pairs, pairs);
+
+                __m128i* pDest = reinterpret_cast<__m128i*>(pRow + x * 4);
+                __m128i dest = _mm_loadu_si128(pDest);
+                __m128i dLo = _mm_unpacklo_epi8(dest, zero);
+                __m128i dHi = _mm_unpackhi_epi8(dest, zero);
+                dLo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dLo, _mm_sub_epi16(full, cLo)), _mm_mullo_epi16(color, cLo)), 8);
+                dHi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(dHi, _mm_sub_epi16(full, cHi)), _mm_mullo_epi16(color, cHi)), 8);
+                _mm_storeu_si128(pDest, _mm_packus_epi16(dLo, dHi));
+            }
+        }
+#endif
+
+        for (; x < right; ++x)
+        {
+            float coverage = shape.At(x + 0.5f, py);
+            if (coverage > 0.0f)
+            {
+                BlendPixel(pRow + x * 4, pColor, coverage);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumRasterizer::CDrumRasterizer() :
+    m_width(0),
+    m_height(0),
+    m_bVectorized(true)
+{
+}
+
+/// <summary>
+/// Sizes the image and clears it
+/// </summary>
+/// <param name="width">width in pixels</param>
+/// <param name="height">height in pixels</param>
+/// <returns>S_OK on success, E_INVALIDARG for a size that is not positive</returns>
+HRESULT CDrumRasterizer::Initialize(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_pixels.resize(static_cast<size_t>(width) * height * 4);
+    Clear();
+    return S_OK;
+}
+
+/// <summary>
+/// Fills the image with opaque black, as Direct2D clears the window
+/// </summary>
+void CDrumRasterizer::Clear()
+{
+    if (m_pixels.empty())
+    {
+        return;
+    }
+
+    // One pixel, then copies of what is already cleared, doubling each time
+    static const uint8_t black[4] = { 0, 0, 0, 255 };
+    memcpy(&m_pixels[0], black, sizeof(black));
+    for (size_t done = sizeof(black); done < m_pixels.size(); done *= 2)
+    {
+        size_t copy = (done < m_pixels.size() - done) ? done : m_pixels.size() - done;
+        memcpy(&m_pixels[done], &m_pixels[0], copy);
+    }
+}
+
+/// <summary>
+/// Draws every batch of a closed draw list over the image
+/// </summary>
+/// <param name="list">list to draw, recorded for a screen of any size</param>
+void CDrumRasterizer::Draw(const CDrumDrawList& list)
+{
+    if (m_pixels.empty())
+    {
+        return;
+    }
+
+    uint8_t* pPixels = &m_pixels[0];
+    const DrumDrawCommand* pCommands = list.Commands();
+    for (int b = 0; b < list.BatchCount(); ++b)
+    {
+        const DrumDrawBatch& batch = list.Batch(b);
+        const DrumBrushColor& brush = cDrumBrushColors[batch.brush];
+        uint8_t color[4] =
+        {
+            static_cast<uint8_t>(brush.r * 255.0f + 0.5f),
+            static_cast<uint8_t>(brush.g * 255.0f + 0.5f),
+            static_cast<uint8_t>(brush.b * 255.0f + 0.5f),
+            255
+        };
+
+        for (int i = batch.first; i < batch.first + batch.count; ++i)
+        {
+            const DrumDrawCommand& command = pCommands[i];
+            float half = command.width * 0.5f;
+
+            switch (command.op)
+            {
+            case DRUM_DRAW_LINE:
+                {
+                    float dx = command.x1 - command.x0;
+                    float dy = command.y1 - command.y0;
+                    float length = sqrtf(dx * dx + dy * dy);
+                    if (!(length > 0.0f))
+                    {
+                        break;
+                    }
+
+                    // The corners follow from the rest, FindCorners fills them in
+                    LineShape shape = { command.x0, command.y0, dx / length, dy / length, length, half + 0.5f,
+                                        { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } };
+                    shape.FindCorners();
+                    float pad = half + 1.0f;
+                    FillShape(shape, ClipBounds(MinF(command.x0, command.x1) - pad, MinF(command.y0, command.y1) - pad,
+                        MaxF(command.x0, command.x1) + pad, MaxF(command.y0, command.y1) + pad, m_width, m_height),
+                        color, pPixels, m_width, m_bVectorized);
+                }
+                break;
+
+            case DRUM_DRAW_ELLIPSE:
+                {
+                    if (!(command.x1 > 0.0f) || !(command.y1 > 0.0f))
+                    {
+                        break;
+                    }
+
+                    RingShape shape = { command.x0, command.y0, 1.0f / command.x1, 1.0f / command.y1,
+                                        sqrtf(command.x1 * command.y1), half + 0.5f };
+                    float padX = command.x1 + half + 1.0f;
+                    float padY = command.y1 + half + 1.0f;
+                    FillShape(shape, ClipBounds(command.x0 - padX, command.y0 - padY, command.x0 + padX, command.y0 + padY,
+                        m_width, m_height), color, pPixels, m_width, m_bVectorized);
+                }
+                break;
+
+            case DRUM_DRAW_RECT:
+            case DRUM_DRAW_FILL_RECT:
+                {
+                    // Zones project with their top below their bottom, so either corner may come first
+                    float left = MinF(command.x0, command.x1);
+                    float top = MinF(command.y0, command.y1);
+                    float right = MaxF(command.x0, command.x1);
+                    float bottom = MaxF(command.y0, command.y1);
+
+                    if (DRUM_DRAW_RECT == command.op)
+                    {
+                        // Only the bands along the edges are stroked, so the inside is never visited
+                        FrameShape shape = { left, top, right, bottom, half + 0.5f };
+                        float pad = half + 1.0f;
+                        PixelBounds outer = ClipBounds(left - pad, top - pad, right + pad, bottom + pad, m_width, m_height);
+                        PixelBounds inner = ClipBounds(left + pad, top + pad, right - pad, bottom - pad, m_width, m_height);
+                        inner.left = (inner.left > outer.left) ? inner.left : outer.left;
+                        inner.top = (inner.top > outer.top) ? inner.top : outer.top;
+                        inner.right = (inner.right > inner.left) ? inner.right : inner.left;
+                        inner.bottom = (inner.bottom > inner.top) ? inner.bottom : inner.top;
+
+                        PixelBounds bands[4] =
+                        {
+                            { outer.left, outer.top, outer.right, inner.top },
+                            { outer.left, inner.bottom, outer.right, outer.bottom },
+                            { outer.left, inner.top, inner.left, inner.bottom },
+                            { inner.right, inner.top, outer.right, inner.bottom }
+                        };
+                        for (int band = 0; band < 4; ++band)
+                        {
+                            FillShape(shape, bands[band], color, pPixels, m_width, m_bVectorized);
+                        }
+                    }
+                    else
+                    {
+                        BoxShape shape = { left, top, right, bottom };
+                        FillShape(shape, ClipBounds(left - 1.0f, top - 1.0f, right + 1.0f, bottom + 1.0f, m_width, m_height),
+                            color, pPixels, m_width, m_bVectorized);
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Gets the FNV-1a hash of the pixels, to compare images cheaply
+/// </summary>
+uint64_t CDrumRasterizer::Hash() const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < m_pixels.size(); ++i)
+    {
+        hash = (hash ^ m_pixels[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/// <summary>
+/// Counts the pixels of another image of the same size that differ in any channel by more than a tolerance
+/// </summary>
+/// <param name="other">image to compare with</param>
+/// <param name="tolerance">largest difference of a channel still counted as equal</param>
+/// <returns>number of differing pixels, or -1 if the sizes differ</returns>
+int CDrumRasterizer::CountDifferentPixels(const CDrumRasterizer& other, int tolerance) const
+{
+    if (m_width != other.m_width || m_height != other.m_height)
+    {
+        return -1;
+    }
+
+    int different = 0;
+    for (size_t i = 0; i < m_pixels.size(); i += 4)
+    {
+        bool differs = false;
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            int delta = static_cast<int>(m_pixels[i + channel]) - static_cast<int>(other.m_pixels[i + channel]);
+            differs = differs || (delta > tolerance || delta < -tolerance);
+        }
+        different += differs;
+    }
+
+    return different;
+}
+
+/// <summary>
+/// Appends a big endian 32-bit value
+/// </summary>
+static void AppendBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(static_cast<uint8_t>(v >> 24));
+    out.push_back(static_cast<uint8_t>(v >> 16));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+/// <summary>
+/// Gets the CRC-32 PNG chunks are checked with
+/// </summary>
+static uint32_t PngCrc(const uint8_t* pData, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc ^= pData[i];
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/// <summary>
+/// Appends a PNG chunk: length, type, data and CRC
+/// </summary>
+static void AppendPngChunk(std::vector<uint8_t>& out, const char* szType, const std::vector<uint8_t>& data)
+{
+    AppendBE32(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), szType, szType + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    AppendBE32(out, PngCrc(&out[start], out.size() - start));
+}
+
+/// <summary>
+/// Writes the image as an uncompressed PNG
+/// </summary>
+/// <param name="szPath">file to create</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CDrumRasterizer::WritePng(const char* szPath) const
+{
+    if (m_pixels.empty())
+    {
+        return E_FAIL;
+    }
+
+    // Every row is unfiltered, and the zlib stream holds it in stored deflate blocks
+    size_t rowBytes = static_cast<size_t>(m_width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * m_height);
+    for (int y = 0; y < m_height; ++y)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), m_pixels.begin() + y * rowBytes, m_pixels.begin() + (y + 1) * rowBytes);
+    }
+
+    std::vector<uint8_t> stream;
+    stream.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    stream.push_back(0x78);
+    stream.push_back(0x01);
+    size_t offset = 0;
+    do
+    {
+        size_t block = raw.size() - offset;
+        block = (block > 65535) ? 65535 : block;
+        bool last = (offset + block == raw.size());
+        stream.push_back(last ? 1 : 0);
+        stream.push_back(static_cast<uint8_t>(block));
+        stream.push_back(static_cast<uint8_t>(block >> 8));
+        stream.push_back(static_cast<uint8_t>(~block));
+        stream.push_back(static_cast<uint8_t>(~block >> 8));
+        stream.insert(stream.end(), raw.begin() + offset, raw.begin() + offset + block);
+        offset += block;
+    }
+    while (offset < raw.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < raw.size(); ++i)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    AppendBE32(stream, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    AppendBE32(header, static_cast<uint32_t>(m_width));
+    AppendBE32(header, static_cast<uint32_t>(m_height));
+    header.push_back(8);                // bits per channel
+    header.push_back(6);                // RGBA
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> file(signature, signature + sizeof(signature));
+    AppendPngChunk(file, "IHDR", header);
+    AppendPngChunk(file, "IDAT", stream);
+    AppendPngChunk(file, "IEND", std::vector<uint8_t>());
+
+    FILE* pFile = fopen(szPath, "wb");
+    if (NULL == pFile)
+    {
+        return E_FAIL;
+    }
+
+    bool written = (fwrite(&file[0], 1, file.size(), pFile) == file.size());
+    written = (0 == fclose(pFile)) && written;
+    return written ? S_OK : E_FAIL;
+}
@@ -0,0 +1,88 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumRasterizer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Draws a draw list into memory, so the overlay can be looked at and timed without
+// Direct2D. Every shape is a distance from the pixel center turned into coverage,
+// which antialiases edges about the way Direct2D does; four pixels of a row are
+// worked out at a time with SSE2, and the scalar fallback does the same arithmetic
+// in the same order, so both give the same pixels.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumDrawList.h"
+#include <vector>
+
+/// <summary>
+/// RGBA image a draw list is drawn into
+/// </summary>
+class CDrumRasterizer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumRasterizer();
+
+    /// <summary>
+    /// Sizes the image and clears it
+    /// </summary>
+    /// <param name="width">width in pixels</param>
+    /// <param name="height">height in pixels</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a size that is not positive</returns>
+    HRESULT                 Initialize(int width, int height);
+
+    /// <summary>
+    /// Chooses between the SSE2 path and the scalar one, where there is SSE2
+    /// </summary>
+    /// <param name="vectorized">true to work out four pixels at a time</param>
+    void                    SetVectorized(bool vectorized) { m_bVectorized = vectorized; }
+
+    /// <summary>
+    /// Fills the image with opaque black, as Direct2D clears the window
+    /// </summary>
+    void                    Clear();
+
+    /// <summary>
+    /// Draws every batch of a closed draw list over the image
+    /// </summary>
+    /// <param name="list">list to draw, recorded for a screen of any size</param>
+    void                    Draw(const CDrumDrawList& list);
+
+    /// <summary>
+    /// Gets the pixels, rows top first, four bytes per pixel in R, G, B, A order
+    /// </summary>
+    const uint8_t*          Pixels() const { return m_pixels.empty() ? NULL : &m_pixels[0]; }
+
+    int                     Width() const { return m_width; }
+    int                     Height() const { return m_height; }
+
+    /// <summary>
+    /// Gets the FNV-1a hash of the pixels, to compare images cheaply
+    /// </summary>
+    uint64_t                Hash() const;
+
+    /// <summary>
+    /// Counts the pixels of another image of the same size that differ in any channel by more than a tolerance
+    /// </summary>
+    /// <param name="other">image to compare with</param>
+    /// <param name="tolerance">largest difference of a channel still counted as equal</param>
+    /// <returns>number of differing pixels, or -1 if the sizes differ</returns>
+    int                     CountDifferentPixels(const CDrumRasterizer& other, int tolerance) const;
+
+    /// <summary>
+    /// Writes the image as an uncompressed PNG
+    /// </summary>
+    /// <param name="szPath">file to create</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 WritePng(const char* szPath) const;
+
+private:
+    std::vector<uint8_t>    m_pixels;
+    int                     m_width;
+    int                     m_height;
+    bool                    m_bVectorized;
+};
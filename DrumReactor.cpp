@@ -0,0 +1,593 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumReactor.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumReactor.h"
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+static const int        g_InvalidHandle = -1;
+
+// epoll tags of the reactor's own descriptors; sources are tagged with their index
+static const uint32_t   g_WakeTag = cDrumReactorMaxSources;
+static const uint32_t   g_TimerTag = cDrumReactorMaxSources + 1;
+#else
+static const HANDLE     g_InvalidHandle = NULL;
+#endif
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumReactorEvent::CDrumReactorEvent() :
+    m_handle(g_InvalidHandle)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CDrumReactorEvent::~CDrumReactorEvent()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates the underlying event or eventfd
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CDrumReactorEvent::Create()
+{
+    Close();
+
+#ifdef _WIN32
+    m_handle = CreateEventW(NULL, FALSE, FALSE, NULL);
+#else
+    m_handle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    return (g_InvalidHandle != m_handle) ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Closes the underlying object
+/// </summary>
+void CDrumReactorEvent::Close()
+{
+    if (g_InvalidHandle != m_handle)
+    {
+#ifdef _WIN32
+        CloseHandle(m_handle);
+#else
+        close(m_handle);
+#endif
+        m_handle = g_InvalidHandle;
+    }
+}
+
+/// <summary>
+/// Signals the event; safe from any thread
+/// </summary>
+void CDrumReactorEvent::Signal()
+{
+#ifdef _WIN32
+    SetEvent(m_handle);
+#else
+    uint64_t one = 1;
+    ssize_t written = write(m_handle, &one, sizeof(one));
+    (void)written;
+#endif
+}
+
+/// <summary>
+/// Clears the event
+/// </summary>
+/// <returns>true if it was signalled</returns>
+bool CDrumReactorEvent::Reset()
+{
+#ifdef _WIN32
+    return WAIT_OBJECT_0 == WaitForSingleObject(m_handle, 0);
+#else
+    uint64_t count = 0;
+    return sizeof(count) == read(m_handle, &count, sizeof(count));
+#endif
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumReactor::CDrumReactor() :
+    m_sourceCount(0),
+    m_readySources(0),
+    m_timerCount(0),
+    m_dropped(0),
+    m_uiBatch(cDrumReactorDefaultUiBatch),
+    m_bStopping(false)
+#ifndef _WIN32
+    , m_epoll(g_InvalidHandle),
+    m_timerFd(g_InvalidHandle)
+#endif
+{
+    memset(m_bHaveWork, 0, sizeof(m_bHaveWork));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CDrumReactor::~CDrumReactor()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates the wait backend and forgets every source, timer and posted work
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CDrumReactor::Initialize()
+{
+    Close();
+
+    HRESULT hr = m_wake.Create();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+#ifndef _WIN32
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_InvalidHandle == m_epoll || g_InvalidHandle == m_timerFd)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    struct epoll_event wake = {};
+    wake.events = EPOLLIN;
+    wake.data.u32 = g_WakeTag;
+    struct epoll_event timer = {};
+    timer.events = EPOLLIN;
+    timer.data.u32 = g_TimerTag;
+    if (0 != epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake.Handle(), &wake) ||
+        0 != epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timerFd, &timer))
+    {
+        Close();
+        return E_FAIL;
+    }
+#endif
+
+    // Work posted before is of no use to a loop that starts over
+    Work stale;
+    for (int p = 0; p < DRUM_REACTOR_PRIORITY_COUNT; ++p)
+    {
+        while (m_posted[p].Pop(stale))
+        {
+        }
+        m_bHaveWork[p] = false;
+    }
+
+    m_sourceCount = 0;
+    m_readySources = 0;
+    m_timerCount = 0;
+    m_dropped = 0;
+    m_bStopping = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+    return S_OK;
+}
+
+/// <summary>
+/// Releases the wait backend
+/// </summary>
+void CDrumReactor::Close()
+{
+#ifndef _WIN32
+    if (g_InvalidHandle != m_epoll)
+    {
+        close(m_epoll);
+        m_epoll = g_InvalidHandle;
+    }
+
+    if (g_InvalidHandle != m_timerFd)
+    {
+        close(m_timerFd);
+        m_timerFd = g_InvalidHandle;
+    }
+#endif
+
+    m_wake.Close();
+    m_sourceCount = 0;
+    m_timerCount = 0;
+}
+
+/// <summary>
+/// Adds a source
+/// </summary>
+HRESULT CDrumReactor::AddSource(const Source& source)
+{
+    if (source.priority < 0 || source.priority >= DRUM_REACTOR_PRIORITY_COUNT || NULL == source.handler ||
+        g_InvalidHandle == source.handle)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_sourceCount >= cDrumReactorMaxSources)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+#ifndef _WIN32
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = static_cast<uint32_t>(m_sourceCount);
+    if (0 != epoll_ctl(m_epoll, EPOLL_CTL_ADD, source.handle, &event))
+    {
+        return E_FAIL;
+    }
+#endif
+
+    m_sources[m_sourceCount++] = source;
+    return S_OK;
+}
+
+/// <summary>
+/// Calls a handler whenever a handle someone else owns is signalled. The handler
+/// must clear the handle, or it runs again on the next wakeup.
+/// </summary>
+/// <param name="handle">waitable handle, or file descriptor</param>
+/// <param name="priority">class the handler runs in</param>
+/// <param name="handler">function to call</param>
+/// <param name="pContext">passed to the handler</param>
+/// <returns>S_OK on success, E_INVALIDARG for a bad priority, E_OUTOFMEMORY with every source taken</returns>
+HRESULT CDrumReactor::AddHandle(DrumReactorHandle handle, DrumReactorPriority priority, DrumReactorHandler handler, void* pContext)
+{
+    Source source = { handle, NULL, priority, handler, pContext };
+    return AddSource(source);
+}
+
+/// <summary>
+/// Calls a handler whenever an event is signalled, clearing the event first
+/// </summary>
+/// <param name="pEvent">created event, which must outlive the reactor's use of it</param>
+/// <param name="priority">class the handler runs in</param>
+/// <param name="handler">function to call</param>
+/// <param name="pContext">passed to the handler</param>
+/// <returns>S_OK on success, E_INVALIDARG for a bad priority, E_OUTOFMEMORY with every source taken</returns>
+HRESULT CDrumReactor::AddEvent(CDrumReactorEvent* pEvent, DrumReactorPriority priority, DrumReactorHandler handler, void* pContext)
+{
+    if (NULL == pEvent)
+    {
+        return E_POINTER;
+    }
+
+    Source source = { pEvent->Handle(), pEvent, priority, handler, pContext };
+    return AddSource(source);
+}
+
+/// <summary>
+/// Adds a timer, disarmed
+/// </summary>
+/// <param name="priority">class the handler runs in</param>
+/// <param name="handler">function to call when the timer is due</param>
+/// <param name="pContext">passed to the handler</param>
+/// <param name="pTimer">receives the timer's index</param>
+/// <returns>S_OK on success, E_INVALIDARG for a bad priority, E_OUTOFMEMORY with every timer taken</returns>
+HRESULT CDrumReactor::AddTimer(DrumReactorPriority priority, DrumReactorHandler handler, void* pContext, int* pTimer)
+{
+    if (priority < 0 || priority >= DRUM_REACTOR_PRIORITY_COUNT || NULL == handler || NULL == pTimer)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_timerCount >= cDrumReactorMaxTimers)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    Timer timer = { priority, handler, pContext, 0, false };
+    m_timers[m_timerCount] = timer;
+    *pTimer = m_timerCount++;
+    return S_OK;
+}
+
+/// <summary>
+/// Arms a timer to run once, replacing any earlier time
+/// </summary>
+/// <param name="timer">index from AddTimer</param>
+/// <param name="dueUs">DrumGetTimeMicroseconds time to run at</param>
+void CDrumReactor::SetTimer(int timer, int64_t dueUs)
+{
+    if (timer >= 0 && timer < m_timerCount)
+    {
+        m_timers[timer].dueUs = dueUs;
+        m_timers[timer].bArmed = true;
+    }
+}
+
+/// <summary>
+/// Disarms a timer
+/// </summary>
+/// <param name="timer">index from AddTimer</param>
+void CDrumReactor::CancelTimer(int timer)
+{
+    if (timer >= 0 && timer < m_timerCount)
+    {
+        m_timers[timer].bArmed = false;
+    }
+}
+
+/// <summary>
+/// Queues work to run on the loop's thread; safe from any thread
+/// </summary>
+/// <param name="priority">class to run it in</param>
+/// <param name="handler">function to call</param>
+/// <param name="pContext">passed to the handler</param>
+/// <returns>false if the class's queue was full and the work was dropped</returns>
+bool CDrumReactor::Post(DrumReactorPriority priority, DrumReactorHandler handler, void* pContext)
+{
+    if (priority < 0 || priority >= DRUM_REACTOR_PRIORITY_COUNT || NULL == handler)
+    {
+        return false;
+    }
+
+    Work work = { handler, pContext };
+    if (!m_posted[priority].Push(work))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    m_wake.Signal();
+    return true;
+}
+
+/// <summary>
+/// Waits for handles, marking the ready ones in m_readySources
+/// </summary>
+/// <param name="timeoutUs">longest to wait, 0 to only look, cDrumReactorInfinite for no limit</param>
+void CDrumReactor::Wait(int64_t timeoutUs)
+{
+#ifdef _WIN32
+    HANDLE handles[cDrumReactorMaxSources + 1];
+    handles[0] = m_wake.Handle();
+    for (int i = 0; i < m_sourceCount; ++i)
+    {
+        handles[i + 1] = m_sources[i].handle;
+    }
+
+    // Timers are only as fine as the wait; round up so they are never early
+    DWORD dwTimeout = (timeoutUs < 0) ? INFINITE : static_cast<DWORD>((timeoutUs + 999) / 1000);
+    DWORD dwEvent = WaitForMultipleObjects(m_sourceCount + 1, handles, FALSE, dwTimeout);
+    if (dwEvent > WAIT_OBJECT_0 + static_cast<DWORD>(m_sourceCount))
+    {
+        return;
+    }
+
+    // The wait reports the first signalled handle only; the ones after it are looked at one by one
+    int signalled = static_cast<int>(dwEvent - WAIT_OBJECT_0);
+    for (int h = signalled; h <= m_sourceCount; ++h)
+    {
+        if (h > 0 && (h == signalled || WAIT_OBJECT_0 == WaitForSingleObject(handles[h], 0)))
+        {
+            m_readySources |= 1u << (h - 1);
+        }
+    }
+#else
+    int timeoutMs = 0;
+    if (timeoutUs < 0)
+    {
+        timeoutMs = -1;
+    }
+    else if (timeoutUs > 0)
+    {
+        // epoll_wait only counts milliseconds, so the timer descriptor ends the wait on time
+        int64_t dueUs = DrumGetTimeMicroseconds() + timeoutUs;
+        struct itimerspec due = {};
+        due.it_value.tv_sec = static_cast<time_t>(dueUs / 1000000);
+        due.it_value.tv_nsec = static_cast<long>((dueUs % 1000000) * 1000);
+        timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &due, NULL);
+        timeoutMs = -1;
+    }
+
+    struct epoll_event events[cDrumReactorMaxSources + 2];
+    int count = epoll_wait(m_epoll, events, cDrumReactorMaxSources + 2, timeoutMs);
+    for (int i = 0; i < count; ++i)
+    {
+        uint32_t tag = events[i].data.u32;
+        if (g_WakeTag == tag)
+        {
+            m_wake.Reset();
+        }
+        else if (g_TimerTag == tag)
+        {
+            uint64_t expirations = 0;
+            ssize_t bytes = read(m_timerFd, &expirations, sizeof(expirations));
+            (void)bytes;
+        }
+        else
+        {
+            m_readySources |= 1u << tag;
+        }
+    }
+#endif
+}
+
+/// <summary>
+/// Finds the highest class with something ready, taking posted work off its queue to look
+/// </summary>
+/// <param name="nowUs">current time, for the timers</param>
+/// <param name="skipUi">leave UI work out</param>
+/// <returns>priority, or DRUM_REACTOR_PRIORITY_COUNT if nothing is ready</returns>
+int CDrumReactor::HighestReady(int64_t nowUs, bool skipUi)
+{
+    int best = DRUM_REACTOR_PRIORITY_COUNT;
+    for (uint32_t ready = m_readySources; 0 != ready; ready &= ready - 1)
+    {
+        int priority = m_sources[DrumLowestBit(ready)].priority;
+        best = (priority < best) ? priority : best;
+    }
+
+    for (int t = 0; t < m_timerCount; ++t)
+    {
+        if (m_timers[t].bArmed && m_timers[t].dueUs <= nowUs && m_timers[t].priority < best)
+        {
+            best = m_timers[t].priority;
+        }
+    }
+
+    // Only classes above the best so far need their queues looked at
+    for (int p = 0; p < best; ++p)
+    {
+        if (!m_bHaveWork[p])
+        {
+            m_bHaveWork[p] = m_posted[p].Pop(m_nextWork[p]);
+        }
+
+        if (m_bHaveWork[p])
+        {
+            best = p;
+            break;
+        }
+    }
+
+    return (skipUi && DRUM_REACTOR_UI == best) ? DRUM_REACTOR_PRIORITY_COUNT : best;
+}
+
+/// <summary>
+/// Runs one ready handle, timer or piece of work of a class
+/// </summary>
+void CDrumReactor::RunOne(int priority, int64_t nowUs)
+{
+    for (uint32_t ready = m_readySources; 0 != ready; ready &= ready - 1)
+    {
+        int i = DrumLowestBit(ready);
+        const Source& source = m_sources[i];
+        if (priority == source.priority)
+        {
+            m_readySources &= ~(1u << i);
+            if (NULL != source.pEvent)
+            {
+                source.pEvent->Reset();
+            }
+
+            source.handler(source.pContext);
+            return;
+        }
+    }
+
+    for (int t = 0; t < m_timerCount; ++t)
+    {
+        Timer& timer = m_timers[t];
+        if (timer.bArmed && timer.dueUs <= nowUs && priority == timer.priority)
+        {
+            // Disarmed first, so the handler can set it again
+            timer.bArmed = false;
+            timer.handler(timer.pContext);
+            return;
+        }
+    }
+
+    if (m_bHaveWork[priority])
+    {
+        m_bHaveWork[priority] = false;
+        m_nextWork[priority].handler(m_nextWork[priority].pContext);
+    }
+}
+
+/// <summary>
+/// Waits once for something to be ready, up to a limit, and runs what is ready
+/// </summary>
+/// <param name="maxWaitUs">longest to wait, cDrumReactorInfinite for no limit</param>
+/// <returns>number of handlers run</returns>
+int CDrumReactor::RunOnce(int64_t maxWaitUs)
+{
+    // Nothing waits while something is ready, such as UI work a full batch left behind
+    int64_t nowUs = DrumGetTimeMicroseconds();
+    int64_t timeoutUs = maxWaitUs;
+    if (HighestReady(nowUs, false) < DRUM_REACTOR_PRIORITY_COUNT)
+    {
+        timeoutUs = 0;
+    }
+    else
+    {
+        for (int t = 0; t < m_timerCount; ++t)
+        {
+            if (m_timers[t].bArmed)
+            {
+                int64_t untilUs = (m_timers[t].dueUs > nowUs) ? m_timers[t].dueUs - nowUs : 0;
+                timeoutUs = (timeoutUs < 0 || untilUs < timeoutUs) ? untilUs : timeoutUs;
+            }
+        }
+    }
+
+    Wait(timeoutUs);
+    ++m_stats.wakeups;
+
+    int ran = 0;
+    int uiRan = 0;
+    while (!IsStopping())
+    {
+        nowUs = DrumGetTimeMicroseconds();
+        int priority = HighestReady(nowUs, uiRan >= m_uiBatch);
+        if (DRUM_REACTOR_PRIORITY_COUNT == priority)
+        {
+            break;
+        }
+
+        // Frames that came in while the last handler ran go ahead of lower class work
+        if (DRUM_REACTOR_SENSOR != priority)
+        {
+            uint32_t before = m_readySources;
+            Wait(0);
+            if (m_readySources != before)
+            {
+                int preempting = HighestReady(nowUs, uiRan >= m_uiBatch);
+                m_stats.preempted += (preempting < priority) ? 1 : 0;
+                priority = preempting;
+            }
+        }
+
+        RunOne(priority, nowUs);
+        ++m_stats.dispatched[priority];
+        ++ran;
+        uiRan += (DRUM_REACTOR_UI == priority) ? 1 : 0;
+    }
+
+    m_stats.maxUiBatch = (uiRan > m_stats.maxUiBatch) ? uiRan : m_stats.maxUiBatch;
+    return ran;
+}
+
+/// <summary>
+/// Runs the loop until Stop is called
+/// </summary>
+void CDrumReactor::Run()
+{
+    while (!IsStopping())
+    {
+        RunOnce(cDrumReactorInfinite);
+    }
+}
+
+/// <summary>
+/// Makes Run return after the handler running now; safe from any thread
+/// </summary>
+void CDrumReactor::Stop()
+{
+    m_bStopping.store(true, std::memory_order_release);
+    m_wake.Signal();
+}
+
+/// <summary>
+/// Reads what the loop has done so far, on the loop's thread or once it has stopped
+/// </summary>
+/// <param name="pStats">receives the counts</param>
+void CDrumReactor::GetStats(DrumReactorStats* pStats) const
+{
+    *pStats = m_stats;
+    pStats->dropped = m_dropped.load(std::memory_order_relaxed);
+}
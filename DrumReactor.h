@@ -0,0 +1,299 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumReactor.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Event loop of the detection thread. Waitable handles, timers and work posted
+// from other threads each belong to a priority class. Whatever is ready in the
+// highest class runs first, and before every piece of lower class work the loop
+// looks again for sensor frames, so a frame never waits behind more than one
+// piece of it. UI work runs at most a batch per wakeup. The loop waits with
+// WaitForMultipleObjects on Windows and with epoll and eventfd elsewhere, so its
+// scheduling can be measured away from the Kinect runtime.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "BoundedQueue.h"
+#include <atomic>
+
+#ifdef _WIN32
+typedef HANDLE DrumReactorHandle;           // waitable object
+#else
+typedef int DrumReactorHandle;              // pollable file descriptor
+#endif
+
+// Priority classes, highest first
+enum DrumReactorPriority
+{
+    DRUM_REACTOR_SENSOR = 0,                // skeleton frames
+    DRUM_REACTOR_TRIGGER,                   // notes and audio engine notifications
+    DRUM_REACTOR_CONFIG,                    // settings changed on other threads
+    DRUM_REACTOR_UI,                        // status and other UI work, run in bounded batches
+    DRUM_REACTOR_PRIORITY_COUNT
+};
+
+static const int        cDrumReactorMaxSources = 16;
+static const int        cDrumReactorMaxTimers = 8;
+static const uint32_t   cDrumReactorQueueDepth = 256;      // posted work per class
+static const int        cDrumReactorDefaultUiBatch = 8;
+
+// Waits for ever
+static const int64_t    cDrumReactorInfinite = -1;
+
+typedef void (*DrumReactorHandler)(void* pContext);
+
+/// <summary>
+/// What the loop has done so far
+/// </summary>
+struct DrumReactorStats
+{
+    uint64_t                wakeups;                                // waits that returned
+    uint64_t                dispatched[DRUM_REACTOR_PRIORITY_COUNT];
+    uint64_t                preempted;      // times higher class work turned up while lower class work was waiting
+    uint64_t                dropped;        // posts refused by a full queue
+    int                     maxUiBatch;     // most UI work run in one wakeup
+};
+
+/// <summary>
+/// Event any thread can signal and a reactor can wait for. Auto-reset: the reactor
+/// clears it before calling its handler, so signals that come together run it once.
+/// </summary>
+class CDrumReactorEvent
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumReactorEvent();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CDrumReactorEvent();
+
+    /// <summary>
+    /// Creates the underlying event or eventfd
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Create();
+
+    /// <summary>
+    /// Closes the underlying object
+    /// </summary>
+    void                    Close();
+
+    /// <summary>
+    /// Signals the event; safe from any thread
+    /// </summary>
+    void                    Signal();
+
+    /// <summary>
+    /// Clears the event
+    /// </summary>
+    /// <returns>true if it was signalled</returns>
+    bool                    Reset();
+
+    /// <summary>
+    /// Gets the handle the reactor waits on
+    /// </summary>
+    DrumReactorHandle       Handle() const { return m_handle; }
+
+private:
+    DrumReactorHandle       m_handle;
+
+    CDrumReactorEvent(const CDrumReactorEvent&);
+    CDrumReactorEvent& operator=(const CDrumReactorEvent&);
+};
+
+/// <summary>
+/// Priority event loop over waitable handles, timers and posted work. Sources and timers
+/// are added and timers set on the thread that runs the loop, or before it starts;
+/// Post and Stop are safe from any thread.
+/// </summary>
+class CDrumReactor
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumReactor();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CDrumReactor();
+
+    /// <summary>
+    /// Creates the wait backend and forgets every source, timer and posted work
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Initialize();
+
+    /// <summary>
+    /// Releases the wait backend
+    /// </summary>
+    void                    Close();
+
+    /// <summary>
+    /// Sets how much UI work runs per wakeup before the loop waits again
+    /// </summary>
+    /// <param name="batch">1 or more</param>
+    void                    SetUiBatch(int batch) { m_uiBatch = (batch < 1) ? 1 : batch; }
+
+    /// <summary>
+    /// Calls a handler whenever a handle someone else owns is signalled. The handler
+    /// must clear the handle, or it runs again on the next wakeup.
+    /// </summary>
+    /// <param name="handle">waitable handle, or file descriptor</param>
+    /// <param name="priority">class the handler runs in</param>
+    /// <param name="handler">function to call</param>
+    /// <param name="pContext">passed to the handler</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a bad priority, E_OUTOFMEMORY with every source taken</returns>
+    HRESULT                 AddHandle(DrumReactorHandle handle, DrumReactorPriority priority, DrumReactorHandler handler, void* pContext);
+
+    /// <summary>
+    /// Calls a handler whenever an event is signalled, clearing the event first
+    /// </summary>
+    /// <param name="pEvent">created event, which must outlive the reactor's use of it</param>
+    /// <param name="priority">class the handler runs in</param>
+    /// <param name="handler">function to call</param>
+    /// <param name="pContext">passed to the handler</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a bad priority, E_OUTOFMEMORY with every source taken</returns>
+    HRESULT                 AddEvent(CDrumReactorEvent* pEvent, DrumReactorPriority priority, DrumReactorHandler handler, void* pContext);
+
+    /// <summary>
+    /// Adds a timer, disarmed
+    /// </summary>
+    /// <param name="priority">class the handler runs in</param>
+    /// <param name="handler">function to call when the timer is due</param>
+    /// <param name="pContext">passed to the handler</param>
+    /// <param name="pTimer">receives the timer's index</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a bad priority, E_OUTOFMEMORY with every timer taken</returns>
+    HRESULT                 AddTimer(DrumReactorPriority priority, DrumReactorHandler handler, void* pContext, int* pTimer);
+
+    /// <summary>
+    /// Arms a timer to run once, replacing any earlier time
+    /// </summary>
+    /// <param name="timer">index from AddTimer</param>
+    /// <param name="dueUs">DrumGetTimeMicroseconds time to run at</param>
+    void                    SetTimer(int timer, int64_t dueUs);
+
+    /// <summary>
+    /// Disarms a timer
+    /// </summary>
+    /// <param name="timer">index from AddTimer</param>
+    void                    CancelTimer(int timer);
+
+    /// <summary>
+    /// Queues work to run on the loop's thread; safe from any thread
+    /// </summary>
+    /// <param name="priority">class to run it in</param>
+    /// <param name="handler">function to call</param>
+    /// <param name="pContext">passed to the handler</param>
+    /// <returns>false if the class's queue was full and the work was dropped</returns>
+    bool                    Post(DrumReactorPriority priority, DrumReactorHandler handler, void* pContext);
+
+    /// <summary>
+    /// Waits once for something to be ready, up to a limit, and runs what is ready
+    /// </summary>
+    /// <param name="maxWaitUs">longest to wait, cDrumReactorInfinite for no limit</param>
+    /// <returns>number of handlers run</returns>
+    int                     RunOnce(int64_t maxWaitUs);
+
+    /// <summary>
+    /// Runs the loop until Stop is called
+    /// </summary>
+    void                    Run();
+
+    /// <summary>
+    /// Makes Run return after the handler running now; safe from any thread
+    /// </summary>
+    void                    Stop();
+
+    /// <summary>
+    /// Tells whether Stop has been called since Initialize
+    /// </summary>
+    bool                    IsStopping() const { return m_bStopping.load(std::memory_order_acquire); }
+
+    /// <summary>
+    /// Reads what the loop has done so far, on the loop's thread or once it has stopped
+    /// </summary>
+    /// <param name="pStats">receives the counts</param>
+    void                    GetStats(DrumReactorStats* pStats) const;
+
+private:
+    /// <summary>
+    /// Handle or event the loop waits on
+    /// </summary>
+    struct Source
+    {
+        DrumReactorHandle   handle;
+        CDrumReactorEvent*  pEvent;         // NULL for handles the handler clears
+        DrumReactorPriority priority;
+        DrumReactorHandler  handler;
+        void*               pContext;
+    };
+
+    struct Timer
+    {
+        DrumReactorPriority priority;
+        DrumReactorHandler  handler;
+        void*               pContext;
+        int64_t             dueUs;
+        bool                bArmed;
+    };
+
+    struct Work
+    {
+        DrumReactorHandler  handler;
+        void*               pContext;
+    };
+
+    Source                  m_sources[cDrumReactorMaxSources];
+    int                     m_sourceCount;
+    uint32_t                m_readySources;                         // bit per source
+    Timer                   m_timers[cDrumReactorMaxTimers];
+    int                     m_timerCount;
+
+    // Work posted by other threads, and the next piece of each class taken off its queue
+    CBoundedQueue<Work, cDrumReactorQueueDepth> m_posted[DRUM_REACTOR_PRIORITY_COUNT];
+    Work                    m_nextWork[DRUM_REACTOR_PRIORITY_COUNT];
+    bool                    m_bHaveWork[DRUM_REACTOR_PRIORITY_COUNT];
+    CDrumReactorEvent       m_wake;
+    std::atomic<uint64_t>   m_dropped;
+
+    int                     m_uiBatch;
+    std::atomic<bool>       m_bStopping;
+    DrumReactorStats        m_stats;
+
+#ifndef _WIN32
+    int                     m_epoll;
+    int                     m_timerFd;      // wakes the wait at the earliest timer, to the microsecond
+#endif
+
+    /// <summary>
+    /// Adds a source
+    /// </summary>
+    HRESULT                 AddSource(const Source& source);
+
+    /// <summary>
+    /// Waits for handles, marking the ready ones in m_readySources
+    /// </summary>
+    /// <param name="timeoutUs">longest to wait, 0 to only look, cDrumReactorInfinite for no limit</param>
+    void                    Wait(int64_t timeoutUs);
+
+    /// <summary>
+    /// Finds the highest class with something ready, taking posted work off its queue to look
+    /// </summary>
+    /// <param name="nowUs">current time, for the timers</param>
+    /// <param name="skipUi">leave UI work out</param>
+    /// <returns>priority, or DRUM_REACTOR_PRIORITY_COUNT if nothing is ready</returns>
+    int                     HighestReady(int64_t nowUs, bool skipUi);
+
+    /// <summary>
+    /// Runs one ready handle, timer or piece of work of a class
+    /// </summary>
+    void                    RunOne(int priority, int64_t nowUs);
+};
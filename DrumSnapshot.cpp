@@ -0,0 +1,193 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumSnapshot.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumSnapshot.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumHitHistory::CDrumHitHistory()
+{
+    Clear();
+}
+
+/// <summary>
+/// Forgets every note
+/// </summary>
+void CDrumHitHistory::Clear()
+{
+    m_next = 0;
+    m_count = 0;
+}
+
+/// <summary>
+/// Remembers a note, forgetting the oldest once full
+/// </summary>
+/// <param name="hit">note that was played</param>
+void CDrumHitHistory::Add(const DrumSnapshotHit& hit)
+{
+    m_hits[m_next] = hit;
+    m_next = (m_next + 1) % cDrumSnapshotMaxHits;
+    if (m_count < cDrumSnapshotMaxHits)
+    {
+        ++m_count;
+    }
+}
+
+/// <summary>
+/// Copies the notes out, oldest first
+/// </summary>
+/// <param name="pHits">receives the notes</param>
+/// <param name="maxHits">capacity of pHits</param>
+/// <returns>number of notes written</returns>
+int CDrumHitHistory::CopyTo(DrumSnapshotHit* pHits, int maxHits) const
+{
+    int count = (m_count < maxHits) ? m_count : maxHits;
+    int first = m_next - count;
+    if (first < 0)
+    {
+        first += cDrumSnapshotMaxHits;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        pHits[i] = m_hits[(first + i) % cDrumSnapshotMaxHits];
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Fills a snapshot from a detected frame
+/// </summary>
+/// <param name="frame">frame detection ran on</param>
+/// <param name="roster">players, whose zones are drawn around their skeletons</param>
+/// <param name="hits">recent notes</param>
+/// <param name="frameTimeUs">capture time of the frame</param>
+/// <param name="pSnapshot">receives the snapshot</param>
+void FillDrumSnapshot(const SkeletonFrame& frame, CDrumPlayerRoster& roster, const CDrumHitHistory& hits,
+                      int64_t frameTimeUs, DrumSnapshot* pSnapshot)
+{
+    pSnapshot->frameNumber = frame.frameNumber;
+    pSnapshot->frameTimeUs = frameTimeUs;
+
+    for (int i = 0; i < cSkeletonCount; ++i)
+    {
+        const SkeletonData& skel = frame.skeletons[i];
+        DrumSnapshotSkeleton& out = pSnapshot->skeletons[i];
+
+        out.trackingState = skel.trackingState;
+        out.trackingId = skel.trackingId;
+        out.position = skel.position;
+        out.zoneCount = 0;
+        out.zoneTotal = 0;
+
+        if (SKELETON_TRACKED == skel.trackingState)
+        {
+            for (int j = 0; j < cSkeletonJointCount; ++j)
+            {
+                out.jointStates[j] = skel.jointStates[j];
+                out.joints[j] = skel.joints[j];
+            }
+
+            const CDrumPlayer* pPlayer = roster.Find(skel.trackingId);
+            if (NULL != pPlayer)
+            {
+                const CDrumZoneTable& zones = pPlayer->Zones();
+                out.zoneTotal = zones.Count();
+                out.zoneCount = (zones.Count() < cDrumSnapshotMaxZones) ? zones.Count() : cDrumSnapshotMaxZones;
+                for (int z = 0; z < out.zoneCount; ++z)
+                {
+                    out.zones[z] = zones.GetZone(z);
+                }
+
+                // The rest of a big kit still shows, as the box they all lie in
+                for (int z = out.zoneCount; z < out.zoneTotal; ++z)
+                {
+                    DrumZone zone = zones.GetZone(z);
+                    if (z == out.zoneCount)
+                    {
+                        out.overflow = zone;
+                        continue;
+                    }
+
+                    out.overflow.xMin = (zone.xMin < out.overflow.xMin) ? zone.xMin : out.overflow.xMin;
+                    out.overflow.xMax = (zone.xMax > out.overflow.xMax) ? zone.xMax : out.overflow.xMax;
+                    out.overflow.yMin = (zone.yMin < out.overflow.yMin) ? zone.yMin : out.overflow.yMin;
+                    out.overflow.yMax = (zone.yMax > out.overflow.yMax) ? zone.yMax : out.overflow.yMax;
+                    out.overflow.depthMin = (zone.depthMin < out.overflow.depthMin) ? zone.depthMin : out.overflow.depthMin;
+                    out.overflow.depthMax = (zone.depthMax > out.overflow.depthMax) ? zone.depthMax : out.overflow.depthMax;
+                }
+            }
+        }
+    }
+
+    pSnapshot->hitCount = hits.CopyTo(pSnapshot->hits, cDrumSnapshotMaxHits);
+}
+
+/// <summary>
+/// Projects a skeleton space point onto a screen
+/// </summary>
+static void ProjectPoint(const SkeletonPoint& point, int width, int height, float* pX, float* pY)
+{
+    DepthImagePoint image;
+    SkeletonToDepthImage(point, &image);
+    *pX = static_cast<float>(image.x * width) / cDepthImageWidth;
+    *pY = static_cast<float>(image.y * height) / cDepthImageHeight;
+}
+
+/// <summary>
+/// Projects a zone onto a screen. Zones are boxes around the shoulder; each is drawn as
+/// its cross section where hands strike it.
+/// </summary>
+static void ProjectZone(const SkeletonPoint& shoulder, const DrumZone& zone, int width, int height, DrumSnapshotRect* pRect)
+{
+    float depth = DrumZoneStrikeDepth(zone);
+    SkeletonPoint topLeft = { shoulder.x + zone.xMin, shoulder.y - zone.yMin, shoulder.z - depth };
+    SkeletonPoint bottomRight = { shoulder.x + zone.xMax, shoulder.y - zone.yMax, shoulder.z - depth };
+
+    ProjectPoint(topLeft, width, height, &pRect->left, &pRect->top);
+    ProjectPoint(bottomRight, width, height, &pRect->right, &pRect->bottom);
+}
+
+/// <summary>
+/// Projects one skeleton of a snapshot, joints and zones, onto a screen
+/// </summary>
+/// <param name="skel">skeleton to project</param>
+/// <param name="width">width (in pixels) of the screen</param>
+/// <param name="height">height (in pixels) of the screen</param>
+/// <param name="pView">receives the projection</param>
+void ProjectDrumSnapshotSkeleton(const DrumSnapshotSkeleton& skel, int width, int height, DrumSnapshotView* pView)
+{
+    if (SKELETON_POSITION_ONLY == skel.trackingState)
+    {
+        ProjectPoint(skel.position, width, height, &pView->positionX, &pView->positionY);
+        return;
+    }
+
+    if (SKELETON_TRACKED != skel.trackingState)
+    {
+        return;
+    }
+
+    SkeletonData data;
+    for (int j = 0; j < cSkeletonJointCount; ++j)
+    {
+        data.joints[j] = skel.joints[j];
+    }
+    ProjectSkeleton(data, width, height, &pView->joints);
+
+    const SkeletonPoint& shoulder = skel.joints[SKELETON_JOINT_SHOULDER_CENTER];
+    for (int z = 0; z < skel.zoneCount; ++z)
+    {
+        ProjectZone(shoulder, skel.zones[z], width, height, &pView->zones[z]);
+    }
+
+    if (skel.zoneTotal > skel.zoneCount)
+    {
+        ProjectZone(shoulder, skel.overflow, width, height, &pView->overflow);
+    }
+}
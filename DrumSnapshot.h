@@ -0,0 +1,137 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumSnapshot.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumPlayer.h"
+#include "DrumZones.h"
+#include "SkeletonFrame.h"
+#include "SkeletonProjection.h"
+
+// Zones drawn one by one; the zones of a bigger kit past these are drawn as one box around them
+static const int cDrumSnapshotMaxZones = 16;
+static const int cDrumSnapshotMaxHits  = 32;
+
+/// <summary>
+/// One skeleton as the render thread draws it
+/// </summary>
+struct DrumSnapshotSkeleton
+{
+    uint32_t                trackingState;
+    uint32_t                trackingId;
+    uint8_t                 jointStates[cSkeletonJointCount];
+    SkeletonPoint           joints[cSkeletonJointCount];    // skeleton space, valid when tracked
+    SkeletonPoint           position;           // body position, valid when tracked by position only
+    int                     zoneCount;          // zones copied into zones
+    int                     zoneTotal;          // zones the player has, more than zoneCount when the kit did not fit
+    DrumZone                zones[cDrumSnapshotMaxZones];   // meters relative to the shoulder, as in the player's table
+    DrumZone                overflow;           // box around the zones that did not fit, valid when zoneTotal > zoneCount
+};
+
+/// <summary>
+/// Screen rectangle of a zone
+/// </summary>
+struct DrumSnapshotRect
+{
+    float                   left;
+    float                   top;
+    float                   right;
+    float                   bottom;
+};
+
+/// <summary>
+/// One skeleton of a snapshot projected onto the screen it is drawn on
+/// </summary>
+struct DrumSnapshotView
+{
+    ProjectedSkeleton       joints;             // valid when tracked
+    float                   positionX;          // valid when tracked by position only
+    float                   positionY;
+    DrumSnapshotRect        zones[cDrumSnapshotMaxZones];   // each zone at the depth it is struck at
+    DrumSnapshotRect        overflow;           // the box around the zones that did not fit
+};
+
+/// <summary>
+/// A note that was played
+/// </summary>
+struct DrumSnapshotHit
+{
+    int64_t                 timeUs;             // frame time of the note
+    uint32_t                trackingId;
+    int                     zone;
+    float                   hitVelocity;
+};
+
+/// <summary>
+/// Everything the render thread needs to draw one frame. Detection fills a snapshot and
+/// publishes it; once published it is never written again, so drawing needs no locks.
+/// Snapshots are in skeleton space; the render thread projects them for its own screen.
+/// </summary>
+struct DrumSnapshot
+{
+    uint32_t                frameNumber;
+    int64_t                 frameTimeUs;
+    DrumSnapshotSkeleton    skeletons[cSkeletonCount];
+    DrumSnapshotHit         hits[cDrumSnapshotMaxHits];     // oldest first
+    int                     hitCount;
+};
+
+/// <summary>
+/// The most recent notes, carried from frame to frame so snapshots can show them
+/// </summary>
+class CDrumHitHistory
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumHitHistory();
+
+    /// <summary>
+    /// Forgets every note
+    /// </summary>
+    void                    Clear();
+
+    /// <summary>
+    /// Remembers a note, forgetting the oldest once full
+    /// </summary>
+    /// <param name="hit">note that was played</param>
+    void                    Add(const DrumSnapshotHit& hit);
+
+    /// <summary>
+    /// Copies the notes out, oldest first
+    /// </summary>
+    /// <param name="pHits">receives the notes</param>
+    /// <param name="maxHits">capacity of pHits</param>
+    /// <returns>number of notes written</returns>
+    int                     CopyTo(DrumSnapshotHit* pHits, int maxHits) const;
+
+private:
+    DrumSnapshotHit         m_hits[cDrumSnapshotMaxHits];
+    int                     m_next;
+    int                     m_count;
+};
+
+/// <summary>
+/// Fills a snapshot from a detected frame
+/// </summary>
+/// <param name="frame">frame detection ran on</param>
+/// <param name="roster">players, whose zones are drawn around their skeletons</param>
+/// <param name="hits">recent notes</param>
+/// <param name="frameTimeUs">capture time of the frame</param>
+/// <param name="pSnapshot">receives the snapshot</param>
+void FillDrumSnapshot(const SkeletonFrame& frame, CDrumPlayerRoster& roster, const CDrumHitHistory& hits,
+                      int64_t frameTimeUs, DrumSnapshot* pSnapshot);
+
+/// <summary>
+/// Projects one skeleton of a snapshot, joints and zones, onto a screen
+/// </summary>
+/// <param name="skel">skeleton to project</param>
+/// <param name="width">width (in pixels) of the screen</param>
+/// <param name="height">height (in pixels) of the screen</param>
+/// <param name="pView">receives the projection</param>
+void ProjectDrumSnapshotSkeleton(const DrumSnapshotSkeleton& skel, int width, int height, DrumSnapshotView* pView);
@@ -0,0 +1,329 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumTrace.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumTrace.h"
+#include <string.h>
+#include <algorithm>
+
+static const char     g_TraceMagic[4] = { 'D', 'T', 'R', 'C' };
+static const uint32_t g_TraceVersion = 1;
+
+// The tick rate is measured over at least this long before a dump
+static const int64_t  g_TraceMinCalibrationUs = 20000;
+
+DRUM_THREAD_LOCAL DrumTraceRing* g_pDrumTraceRing = NULL;
+
+static DrumTraceRing           g_TraceRings[cDrumTraceMaxThreads];
+static std::atomic<uint32_t>   g_TraceNextSerial(1);
+
+/// <summary>
+/// A tick count and the microsecond time read together
+/// </summary>
+struct TraceClockPoint
+{
+    int64_t                 ticks;
+    int64_t                 timeUs;
+
+    static TraceClockPoint  Now()
+    {
+        TraceClockPoint point;
+        point.ticks = DrumTraceTicks();
+        point.timeUs = DrumGetTimeMicroseconds();
+        return point;
+    }
+};
+
+static const TraceClockPoint g_TraceOrigin = TraceClockPoint::Now();
+
+/// <summary>
+/// Names of the events and of the fields each one fills in, NULL for fields it leaves alone
+/// </summary>
+struct TraceEventFormat
+{
+    const char*             name;
+    const char*             id;
+    const char*             values[2];
+    const char*             reals[2];
+};
+
+static const TraceEventFormat g_TraceEventFormats[DRUM_TRACE_EVENT_COUNT] =
+{
+    { "frame",          "frame",    { "players", "triggers" },  { NULL, NULL } },
+    { "trigger",        "skeleton", { "type", "piece" },        { "velocity", "lead_ms" } },
+    { "voice_start",    "sample",   { "voice", "stolen" },      { "gain", "latency_us" } },
+    { "voice_choke",    "sample",   { "voices", NULL },         { NULL, NULL } },
+    { "trigger_dropped", "sample",  { "ticket", NULL },         { NULL, NULL } },      // sample -1 a cancel, -2 a choke
+    { "midi_batch",     NULL,       { "messages", "failed" },   { NULL, NULL } },
+};
+
+/// <summary>
+/// Gives the calling thread a ring. Lock-free; fails once every ring is taken.
+/// </summary>
+/// <returns>the thread's ring, or NULL if none is free</returns>
+DrumTraceRing* DrumTraceAttachThread()
+{
+    if (NULL != g_pDrumTraceRing)
+    {
+        return g_pDrumTraceRing;
+    }
+
+    for (int i = 0; i < cDrumTraceMaxThreads; ++i)
+    {
+        uint32_t expected = 0;
+        if (g_TraceRings[i].owned.compare_exchange_strong(expected, 1, std::memory_order_acquire))
+        {
+            // Serial numbers tell apart the threads that used a ring one after another
+            g_TraceRings[i].thread = static_cast<uint16_t>(g_TraceNextSerial.fetch_add(1, std::memory_order_relaxed));
+            g_pDrumTraceRing = &g_TraceRings[i];
+            return g_pDrumTraceRing;
+        }
+    }
+
+    return NULL;
+}
+
+/// <summary>
+/// Hands the calling thread's ring back for another thread to use. Its records
+/// stay until they are overwritten.
+/// </summary>
+void DrumTraceDetachThread()
+{
+    if (NULL != g_pDrumTraceRing)
+    {
+        g_pDrumTraceRing->owned.store(0, std::memory_order_release);
+        g_pDrumTraceRing = NULL;
+    }
+}
+
+/// <summary>
+/// Gets the serial number the calling thread's records carry
+/// </summary>
+/// <returns>serial number, 0 if the thread has no ring</returns>
+uint16_t DrumTraceThreadSerial()
+{
+    DrumTraceRing* pRing = DrumTraceAttachThread();
+    return (NULL != pRing) ? pRing->thread : 0;
+}
+
+/// <summary>
+/// Orders records by time
+/// </summary>
+static bool TraceRecordEarlier(const DrumTraceRecord& a, const DrumTraceRecord& b)
+{
+    return a.ticks < b.ticks;
+}
+
+/// <summary>
+/// Copies the records every ring holds, sorted by time. Safe while threads trace;
+/// records overwritten during the copy are left out.
+/// </summary>
+/// <param name="pHeader">receives the clock and counts of the copy</param>
+/// <param name="records">receives the records</param>
+void DrumTraceCollect(DrumTraceFileHeader* pHeader, std::vector<DrumTraceRecord>& records)
+{
+    records.clear();
+
+    DrumTraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, g_TraceMagic, sizeof(header.magic));
+    header.version = g_TraceVersion;
+    header.recordSize = sizeof(DrumTraceRecord);
+
+    for (int i = 0; i < cDrumTraceMaxThreads; ++i)
+    {
+        const DrumTraceRing& ring = g_TraceRings[i];
+        // The writer's next record goes over the oldest slot, so one slot less than the ring is ever copied
+        uint64_t end = ring.head.load(std::memory_order_acquire);
+        uint64_t begin = (end > cDrumTraceRingRecords - 1) ? end - (cDrumTraceRingRecords - 1) : 0;
+        if (end == begin)
+        {
+            continue;
+        }
+
+        size_t first = records.size();
+        for (uint64_t r = begin; r < end; ++r)
+        {
+            records.push_back(ring.records[r & (cDrumTraceRingRecords - 1)]);
+        }
+
+        // The writer may have gone round onto the oldest copied slots meanwhile; those copies are torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = ring.head.load(std::memory_order_relaxed);
+        uint64_t safe = (after + 1 > cDrumTraceRingRecords) ? after + 1 - cDrumTraceRingRecords : 0;
+        uint64_t torn = (safe > begin) ? std::min(safe - begin, end - begin) : 0;
+        records.erase(records.begin() + first, records.begin() + first + static_cast<size_t>(torn));
+
+        header.overwritten += begin + torn;
+        header.threadCount += (end - begin > torn) ? 1 : 0;
+    }
+
+    std::stable_sort(records.begin(), records.end(), TraceRecordEarlier);
+
+    // Ticks are turned into microseconds by the rate seen since the process started
+    TraceClockPoint now = TraceClockPoint::Now();
+    if (now.timeUs - g_TraceOrigin.timeUs < g_TraceMinCalibrationUs)
+    {
+        DrumSleepMicroseconds(g_TraceMinCalibrationUs - (now.timeUs - g_TraceOrigin.timeUs));
+        now = TraceClockPoint::Now();
+    }
+
+    header.originTicks = g_TraceOrigin.ticks;
+    header.originUs = g_TraceOrigin.timeUs;
+    header.ticksPerUs = static_cast<double>(now.ticks - g_TraceOrigin.ticks) / (now.timeUs - g_TraceOrigin.timeUs);
+    header.recordCount = records.size();
+    *pHeader = header;
+}
+
+/// <summary>
+/// Writes what every ring holds to a file
+/// </summary>
+/// <param name="szPath">file to write</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT DrumTraceDump(const char* szPath)
+{
+    if (NULL == szPath)
+    {
+        return E_INVALIDARG;
+    }
+
+    DrumTraceFileHeader header;
+    std::vector<DrumTraceRecord> records;
+    DrumTraceCollect(&header, records);
+
+    FILE* pFile = fopen(szPath, "wb");
+    if (NULL == pFile)
+    {
+        return E_FAIL;
+    }
+
+    bool written = (1 == fwrite(&header, sizeof(header), 1, pFile));
+    if (written && !records.empty())
+    {
+        written = (records.size() == fwrite(&records[0], sizeof(DrumTraceRecord), records.size(), pFile));
+    }
+
+    written = (0 == fclose(pFile)) && written;
+    return written ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Reads a trace dump
+/// </summary>
+/// <param name="szPath">file to read</param>
+/// <param name="pHeader">receives the header</param>
+/// <param name="records">receives the records</param>
+/// <returns>S_OK on success, E_FAIL if the file is not a trace dump</returns>
+HRESULT DrumTraceRead(const char* szPath, DrumTraceFileHeader* pHeader, std::vector<DrumTraceRecord>& records)
+{
+    if (NULL == szPath || NULL == pHeader)
+    {
+        return E_INVALIDARG;
+    }
+
+    FILE* pFile = fopen(szPath, "rb");
+    if (NULL == pFile)
+    {
+        return E_FAIL;
+    }
+
+    DrumTraceFileHeader header;
+    bool valid = (1 == fread(&header, sizeof(header), 1, pFile)) &&
+                 0 == memcmp(header.magic, g_TraceMagic, sizeof(header.magic)) &&
+                 g_TraceVersion == header.version && sizeof(DrumTraceRecord) == header.recordSize &&
+                 header.recordCount < (1ull << 32);
+    if (valid)
+    {
+        records.resize(static_cast<size_t>(header.recordCount));
+        valid = records.empty() || (records.size() == fread(&records[0], sizeof(DrumTraceRecord), records.size(), pFile));
+    }
+
+    fclose(pFile);
+    if (!valid)
+    {
+        records.clear();
+        return E_FAIL;
+    }
+
+    *pHeader = header;
+    return S_OK;
+}
+
+/// <summary>
+/// Converts a record's ticks to DrumGetTimeMicroseconds time
+/// </summary>
+/// <param name="header">header of the dump the record came from</param>
+/// <param name="ticks">tick count of the record</param>
+/// <returns>time in microseconds</returns>
+double DrumTraceTimeUs(const DrumTraceFileHeader& header, int64_t ticks)
+{
+    double ticksPerUs = (header.ticksPerUs > 0.0) ? header.ticksPerUs : 1.0;
+    return header.originUs + (ticks - header.originTicks) / ticksPerUs;
+}
+
+/// <summary>
+/// Gets the name of a trace event
+/// </summary>
+/// <param name="event">DrumTraceEvent</param>
+/// <returns>short name, "unknown" for values out of range</returns>
+const char* DrumTraceEventName(int event)
+{
+    return (event >= 0 && event < DRUM_TRACE_EVENT_COUNT) ? g_TraceEventFormats[event].name : "unknown";
+}
+
+/// <summary>
+/// Prints one record as a line of text, the fields named after what the event puts in them
+/// </summary>
+/// <param name="pFile">file to print to</param>
+/// <param name="header">header of the dump the record came from</param>
+/// <param name="record">record to print</param>
+/// <param name="baseUs">time the printed times count from</param>
+void DrumTracePrintText(FILE* pFile, const DrumTraceFileHeader& header, const DrumTraceRecord& record, double baseUs)
+{
+    fprintf(pFile, "%12.3f ms  thread %-4u %-16s", (DrumTraceTimeUs(header, record.ticks) - baseUs) / 1000.0,
+        record.thread, DrumTraceEventName(record.event));
+
+    if (record.event >= DRUM_TRACE_EVENT_COUNT)
+    {
+        fprintf(pFile, " id=%u values=%d,%d reals=%g,%g\n", record.id, record.values[0], record.values[1], record.reals[0], record.reals[1]);
+        return;
+    }
+
+    const TraceEventFormat& format = g_TraceEventFormats[record.event];
+    if (NULL != format.id)
+    {
+        fprintf(pFile, " %s=%u", format.id, record.id);
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (NULL != format.values[i])
+        {
+            fprintf(pFile, " %s=%d", format.values[i], record.values[i]);
+        }
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (NULL != format.reals[i])
+        {
+            fprintf(pFile, " %s=%.3f", format.reals[i], record.reals[i]);
+        }
+    }
+
+    fprintf(pFile, "\n");
+}
+
+/// <summary>
+/// Prints one record as a CSV row: time_us, thread, event, id, value0, value1, real0, real1
+/// </summary>
+/// <param name="pFile">file to print to</param>
+/// <param name="header">header of the dump the record came from</param>
+/// <param name="record">record to print</param>
+void DrumTracePrintCsv(FILE* pFile, const DrumTraceFileHeader& header, const DrumTraceRecord& record)
+{
+    fprintf(pFile, "%.3f,%u,%s,%u,%d,%d,%g,%g\n", DrumTraceTimeUs(header, record.ticks), record.thread,
+        DrumTraceEventName(record.event), record.id, record.values[0], record.values[1], record.reals[0], record.reals[1]);
+}
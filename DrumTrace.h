@@ -0,0 +1,223 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumTrace.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Binary tracing for the hot path. A trace point writes one fixed size record,
+// an event id, a tick count and a few numbers, into a ring owned by the calling
+// thread: no lock, no allocation, no formatting and no system call. The rings
+// keep the latest records of every thread and can be dumped at any time, also
+// while the threads go on tracing; DrumTraceDecode turns a dump into text or CSV.
+// Built with DRUM_TRACE_ENABLED defined to 0, every trace point compiles to nothing.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+
+#ifndef DRUM_TRACE_ENABLED
+#define DRUM_TRACE_ENABLED 1
+#endif
+
+static const int      cDrumTraceMaxThreads  = 16;
+static const uint32_t cDrumTraceRingRecords = 8192;     // per thread, a power of two
+
+// What a trace record says happened. The fields each event fills in are listed
+// with its name in DrumTrace.cpp.
+enum DrumTraceEvent
+{
+    DRUM_TRACE_FRAME = 0,           // the engine finished a frame
+    DRUM_TRACE_TRIGGER,             // the engine passed a trigger to its sink
+    DRUM_TRACE_VOICE_START,         // the mixer started a sample
+    DRUM_TRACE_VOICE_CHOKE,         // the mixer faded out the voices of a sample
+    DRUM_TRACE_TRIGGER_DROPPED,     // the mixer's trigger queue was full
+    DRUM_TRACE_MIDI_BATCH,          // the MIDI sink sent its due messages
+    DRUM_TRACE_EVENT_COUNT
+};
+
+/// <summary>
+/// One trace record, 32 bytes
+/// </summary>
+struct DrumTraceRecord
+{
+    int64_t                 ticks;              // DrumTraceTicks when written
+    uint16_t                event;              // DrumTraceEvent
+    uint16_t                thread;             // serial number of the writing thread
+    uint32_t                id;                 // frame number, tracking id or sample slot
+    int32_t                 values[2];
+    float                   reals[2];
+};
+
+/// <summary>
+/// Start of a trace dump, followed by recordCount records sorted by time
+/// </summary>
+struct DrumTraceFileHeader
+{
+    char                    magic[4];           // "DTRC"
+    uint32_t                version;
+    uint32_t                recordSize;
+    uint32_t                threadCount;        // rings that held records
+    int64_t                 originTicks;        // a tick count and the DrumGetTimeMicroseconds time it was read at
+    int64_t                 originUs;
+    double                  ticksPerUs;
+    uint64_t                recordCount;
+    uint64_t                overwritten;        // older records the rings no longer held
+};
+
+/// <summary>
+/// Ring of one thread's latest records. Only the owning thread writes; anyone may copy.
+/// </summary>
+struct DrumTraceRing
+{
+    std::atomic<uint64_t>   head;               // records ever written
+    std::atomic<uint32_t>   owned;              // nonzero while a thread writes to the ring
+    uint16_t                thread;
+    DrumTraceRecord         records[cDrumTraceRingRecords];
+};
+
+// Ring of the calling thread, NULL until its first trace point
+extern DRUM_THREAD_LOCAL DrumTraceRing* g_pDrumTraceRing;
+
+/// <summary>
+/// Reads the tick counter records are stamped with: the processor's time stamp
+/// counter where there is one, otherwise the microsecond clock
+/// </summary>
+inline int64_t DrumTraceTicks()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    return static_cast<int64_t>(__rdtsc());
+#else
+    return DrumGetTimeMicroseconds();
+#endif
+}
+
+/// <summary>
+/// Gives the calling thread a ring. Lock-free; fails once every ring is taken.
+/// </summary>
+/// <returns>the thread's ring, or NULL if none is free</returns>
+DrumTraceRing* DrumTraceAttachThread();
+
+/// <summary>
+/// Hands the calling thread's ring back for another thread to use. Its records
+/// stay until they are overwritten.
+/// </summary>
+void DrumTraceDetachThread();
+
+/// <summary>
+/// Gets the serial number the calling thread's records carry
+/// </summary>
+/// <returns>serial number, 0 if the thread has no ring</returns>
+uint16_t DrumTraceThreadSerial();
+
+/// <summary>
+/// Writes one record into the calling thread's ring. Lock-free and allocation-free.
+/// </summary>
+inline void DrumTraceWrite(DrumTraceEvent event, uint32_t id, int32_t value0, int32_t value1, float real0, float real1)
+{
+    DrumTraceRing* pRing = g_pDrumTraceRing;
+    if (NULL == pRing)
+    {
+        pRing = DrumTraceAttachThread();
+        if (NULL == pRing)
+        {
+            return;
+        }
+    }
+
+    // The previous record is published before this slot is overwritten, so a reader can tell what it missed
+    uint64_t head = pRing->head.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    DrumTraceRecord& record = pRing->records[head & (cDrumTraceRingRecords - 1)];
+    record.ticks = DrumTraceTicks();
+    record.event = static_cast<uint16_t>(event);
+    record.thread = pRing->thread;
+    record.id = id;
+    record.values[0] = value0;
+    record.values[1] = value1;
+    record.reals[0] = real0;
+    record.reals[1] = real1;
+
+    pRing->head.store(head + 1, std::memory_order_release);
+}
+
+#if DRUM_TRACE_ENABLED
+#define DRUM_TRACE(event, id, value0, value1, real0, real1) \
+    DrumTraceWrite((event), (id), (value0), (value1), (real0), (real1))
+#else
+#define DRUM_TRACE(event, id, value0, value1, real0, real1) ((void)0)
+#endif
+
+/// <summary>
+/// Gives the ring of a thread back when the thread function returns
+/// </summary>
+class CDrumTraceThreadScope
+{
+public:
+    ~CDrumTraceThreadScope()
+    {
+#if DRUM_TRACE_ENABLED
+        DrumTraceDetachThread();
+#endif
+    }
+};
+
+/// <summary>
+/// Copies the records every ring holds, up to the newest cDrumTraceRingRecords - 1 of
+/// each thread, sorted by time. Safe while threads trace; records overwritten during
+/// the copy are left out.
+/// </summary>
+/// <param name="pHeader">receives the clock and counts of the copy</param>
+/// <param name="records">receives the records</param>
+void DrumTraceCollect(DrumTraceFileHeader* pHeader, std::vector<DrumTraceRecord>& records);
+
+/// <summary>
+/// Writes what every ring holds to a file
+/// </summary>
+/// <param name="szPath">file to write</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT DrumTraceDump(const char* szPath);
+
+/// <summary>
+/// Reads a trace dump
+/// </summary>
+/// <param name="szPath">file to read</param>
+/// <param name="pHeader">receives the header</param>
+/// <param name="records">receives the records</param>
+/// <returns>S_OK on success, E_FAIL if the file is not a trace dump</returns>
+HRESULT DrumTraceRead(const char* szPath, DrumTraceFileHeader* pHeader, std::vector<DrumTraceRecord>& records);
+
+/// <summary>
+/// Converts a record's ticks to DrumGetTimeMicroseconds time
+/// </summary>
+/// <param name="header">header of the dump the record came from</param>
+/// <param name="ticks">tick count of the record</param>
+/// <returns>time in microseconds</returns>
+double DrumTraceTimeUs(const DrumTraceFileHeader& header, int64_t ticks);
+
+/// <summary>
+/// Gets the name of a trace event
+/// </summary>
+/// <param name="event">DrumTraceEvent</param>
+/// <returns>short name, "unknown" for values out of range</returns>
+const char* DrumTraceEventName(int event);
+
+/// <summary>
+/// Prints one record as a line of text, the fields named after what the event puts in them
+/// </summary>
+/// <param name="pFile">file to print to</param>
+/// <param name="header">header of the dump the record came from</param>
+/// <param name="record">record to print</param>
+/// <param name="baseUs">time the printed times count from</param>
+void DrumTracePrintText(FILE* pFile, const DrumTraceFileHeader& header, const DrumTraceRecord& record, double baseUs);
+
+/// <summary>
+/// Prints one record as a CSV row: time_us, thread, event, id, value0, value1, real0, real1
+/// </summary>
+/// <param name="pFile">file to print to</param>
+/// <param name="header">header of the dump the record came from</param>
+/// <param name="record">record to print</param>
+void DrumTracePrintCsv(FILE* pFile, const DrumTraceFileHeader& header, const DrumTraceRecord& record);
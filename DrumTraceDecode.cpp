@@ -0,0 +1,101 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumTraceDecode.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Turns a trace dump from the application (/trace) or DrumHeadless (-trace) into
+// text, one record per line with times in milliseconds from the first record, or
+// into CSV with times on the microsecond clock the engine stamps frames with.
+//
+//   DrumTraceDecode <dump> [-csv] [-event <name>]
+
+#include "DrumTrace.h"
+#include <stdio.h>
+#include <string.h>
+
+/// <summary>
+/// Prints how the decoder is used
+/// </summary>
+static void PrintUsage()
+{
+    printf("usage: DrumTraceDecode <dump> [-csv] [-event <name>]\n");
+}
+
+/// <summary>
+/// Entry point of the trace decoder
+/// </summary>
+/// <returns>0 on success, 1 on bad arguments or a file that is not a trace dump</returns>
+int main(int argc, char** argv)
+{
+    const char* szPath = NULL;
+    const char* szEvent = NULL;
+    bool csv = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == strcmp(argv[i], "-csv"))
+        {
+            csv = true;
+        }
+        else if (0 == strcmp(argv[i], "-event") && i + 1 < argc)
+        {
+            szEvent = argv[++i];
+        }
+        else if (NULL == szPath && '-' != argv[i][0])
+        {
+            szPath = argv[i];
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (NULL == szPath)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    DrumTraceFileHeader header;
+    std::vector<DrumTraceRecord> records;
+    if (FAILED(DrumTraceRead(szPath, &header, records)))
+    {
+        printf("cannot read trace dump %s\n", szPath);
+        return 1;
+    }
+
+    if (csv)
+    {
+        printf("time_us,thread,event,id,value0,value1,real0,real1\n");
+    }
+    else
+    {
+        printf("%llu records from %u threads, %llu older ones overwritten, %.1f ticks/us\n",
+            static_cast<unsigned long long>(header.recordCount), header.threadCount,
+            static_cast<unsigned long long>(header.overwritten), header.ticksPerUs);
+    }
+
+    double baseUs = records.empty() ? 0.0 : DrumTraceTimeUs(header, records[0].ticks);
+    for (size_t r = 0; r < records.size(); ++r)
+    {
+        const DrumTraceRecord& record = records[r];
+        if (NULL != szEvent && 0 != strcmp(szEvent, DrumTraceEventName(record.event)))
+        {
+            continue;
+        }
+
+        if (csv)
+        {
+            DrumTracePrintCsv(stdout, header, record);
+        }
+        else
+        {
+            DrumTracePrintText(stdout, header, record, baseUs);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumTriggerSinks.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumTriggerSinks.h"
+#include <string.h>
+
+static const char* const g_TriggerTypeNames[DRUM_TRIGGER_TYPE_COUNT] = { "play", "schedule", "cancel", "choke" };
+
+/// <summary>
+/// Constructor
+/// </summary>
+CNullTriggerSink::CNullTriggerSink()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+/// <summary>
+/// Counts one trigger
+/// </summary>
+/// <param name="trigger">trigger to drop</param>
+void CNullTriggerSink::Trigger(const DrumHitTrigger& trigger)
+{
+    ++m_counts[trigger.type];
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CFileTriggerSink::CFileTriggerSink() :
+    m_pFile(NULL)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CFileTriggerSink::~CFileTriggerSink()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates the file
+/// </summary>
+/// <param name="szPath">file to create, "-" for standard output</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CFileTriggerSink::Open(const char* szPath)
+{
+    Close();
+
+    if (0 == strcmp(szPath, "-"))
+    {
+        m_pFile = stdout;
+    }
+    else
+    {
+        m_pFile = fopen(szPath, "w");
+        if (NULL == m_pFile)
+        {
+            return E_FAIL;
+        }
+    }
+
+    fprintf(m_pFile, "# time_us type tracking_id zone piece velocity ticket\n");
+    return S_OK;
+}
+
+/// <summary>
+/// Flushes and closes the file
+/// </summary>
+void CFileTriggerSink::Close()
+{
+    if (NULL == m_pFile)
+    {
+        return;
+    }
+
+    if (stdout == m_pFile)
+    {
+        fflush(m_pFile);
+    }
+    else
+    {
+        fclose(m_pFile);
+    }
+
+    m_pFile = NULL;
+}
+
+/// <summary>
+/// Writes one trigger
+/// </summary>
+/// <param name="trigger">trigger to write</param>
+void CFileTriggerSink::Trigger(const DrumHitTrigger& trigger)
+{
+    CNullTriggerSink::Trigger(trigger);
+
+    if (NULL == m_pFile)
+    {
+        return;
+    }
+
+    const char* szPiece = (trigger.piece >= 0) ? DrumPieceName(static_cast<DrumPiece>(trigger.piece)) : "-";
+    fprintf(m_pFile, "%lld %s%s %u %d %s %.3f %u\n",
+        static_cast<long long>(trigger.timeUs), g_TriggerTypeNames[trigger.type], trigger.flam ? "+flam" : "",
+        trigger.trackingId, trigger.zone, szPiece, trigger.hitVelocity, trigger.ticket);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CTeeTriggerSink::CTeeTriggerSink() :
+    m_sinkCount(0)
+{
+}
+
+/// <summary>
+/// Adds a sink
+/// </summary>
+/// <param name="pSink">sink to pass triggers on to, must outlive the tee</param>
+/// <returns>S_OK on success, E_OUTOFMEMORY if cMaxSinks are already added</returns>
+HRESULT CTeeTriggerSink::Add(IDrumTriggerSink* pSink)
+{
+    if (NULL == pSink)
+    {
+        return E_POINTER;
+    }
+
+    if (m_sinkCount >= cMaxSinks)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_pSinks[m_sinkCount++] = pSink;
+    return S_OK;
+}
+
+/// <summary>
+/// Passes one trigger on
+/// </summary>
+/// <param name="trigger">trigger to pass on</param>
+void CTeeTriggerSink::Trigger(const DrumHitTrigger& trigger)
+{
+    for (int i = 0; i < m_sinkCount; ++i)
+    {
+        m_pSinks[i]->Trigger(trigger);
+    }
+}
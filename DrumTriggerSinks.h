@@ -0,0 +1,108 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumTriggerSinks.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Trigger sinks that need no audio device: one that only counts, one that
+// writes every trigger to a text file and one that passes triggers on to several.
+
+#pragma once
+
+#include "DrumEngine.h"
+#include <stdio.h>
+
+/// <summary>
+/// Counts triggers and drops them
+/// </summary>
+class CNullTriggerSink : public IDrumTriggerSink
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CNullTriggerSink();
+
+    /// <summary>
+    /// Counts one trigger
+    /// </summary>
+    /// <param name="trigger">trigger to drop</param>
+    virtual void            Trigger(const DrumHitTrigger& trigger);
+
+    /// <summary>
+    /// Gets the number of triggers of one type seen so far
+    /// </summary>
+    uint64_t                Count(DrumHitTriggerType type) const { return m_counts[type]; }
+
+private:
+    uint64_t                m_counts[DRUM_TRIGGER_TYPE_COUNT];
+};
+
+/// <summary>
+/// Writes one line per trigger: time, type, skeleton, zone, piece, velocity and ticket
+/// </summary>
+class CFileTriggerSink : public CNullTriggerSink
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CFileTriggerSink();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~CFileTriggerSink();
+
+    /// <summary>
+    /// Creates the file
+    /// </summary>
+    /// <param name="szPath">file to create, "-" for standard output</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// <summary>
+    /// Flushes and closes the file
+    /// </summary>
+    void                    Close();
+
+    /// <summary>
+    /// Writes one trigger
+    /// </summary>
+    /// <param name="trigger">trigger to write</param>
+    virtual void            Trigger(const DrumHitTrigger& trigger);
+
+private:
+    FILE*                   m_pFile;
+};
+
+/// <summary>
+/// Passes every trigger on to several sinks, in the order they were added
+/// </summary>
+class CTeeTriggerSink : public IDrumTriggerSink
+{
+public:
+    static const int        cMaxSinks = 4;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CTeeTriggerSink();
+
+    /// <summary>
+    /// Adds a sink
+    /// </summary>
+    /// <param name="pSink">sink to pass triggers on to, must outlive the tee</param>
+    /// <returns>S_OK on success, E_OUTOFMEMORY if cMaxSinks are already added</returns>
+    HRESULT                 Add(IDrumTriggerSink* pSink);
+
+    /// <summary>
+    /// Passes one trigger on
+    /// </summary>
+    /// <param name="trigger">trigger to pass on</param>
+    virtual void            Trigger(const DrumHitTrigger& trigger);
+
+private:
+    IDrumTriggerSink*       m_pSinks[cMaxSinks];
+    int                     m_sinkCount;
+};
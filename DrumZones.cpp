@@ -0,0 +1,607 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumZones.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "DrumZones.h"
+#include "DrumKit.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#ifdef DRUM_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Depth bands in meters ahead of the shoulder. The near band reaches behind the shoulder
+// further than any hand can, so it has no practical lower bound.
+static const float g_NearDepthMin = -1.0f;
+static const float g_NearDepthMax = 0.31f;
+static const float g_FarDepthMin  = 0.35f;
+static const float g_FarDepthMax  = FLT_MAX;
+
+// A forearm ahead of the near bound, where hands play zones without a far bound
+static const float g_ForwardReach = 0.1f;
+
+/// <summary>
+/// Constructor
+/// </summary>
+CDrumZoneTable::CDrumZoneTable()
+{
+    Clear();
+}
+
+/// <summary>
+/// Removes all zones
+/// </summary>
+void CDrumZoneTable::Clear()
+{
+    m_count = 0;
+    m_indexed = false;
+
+    memset(m_xMin, 0, sizeof(m_xMin));
+    memset(m_xMax, 0, sizeof(m_xMax));
+    memset(m_yMin, 0, sizeof(m_yMin));
+    memset(m_yMax, 0, sizeof(m_yMax));
+    memset(m_depthMin, 0, sizeof(m_depthMin));
+    memset(m_depthMax, 0, sizeof(m_depthMax));
+    memset(m_hands, 0, sizeof(m_hands));
+    memset(m_motion, 0, sizeof(m_motion));
+    memset(m_sampleId, 0, sizeof(m_sampleId));
+}
+
+/// <summary>
+/// Appends a zone. The spatial index is dropped until it is built again.
+/// </summary>
+/// <param name="zone">zone to add</param>
+/// <returns>index of the zone, or -1 if the table is full</returns>
+int CDrumZoneTable::AddZone(const DrumZone& zone)
+{
+    if (m_count >= cDrumZoneMaxCount)
+    {
+        return -1;
+    }
+
+    m_indexed = false;
+
+    int index = m_count++;
+    m_xMin[index] = zone.xMin;
+    m_xMax[index] = zone.xMax;
+    m_yMin[index] = zone.yMin;
+    m_yMax[index] = zone.yMax;
+    m_depthMin[index] = zone.depthMin;
+    m_depthMax[index] = zone.depthMax;
+    m_hands[index] = zone.hands;
+    m_motion[index] = zone.motion;
+    m_sampleId[index] = zone.sampleId;
+
+    return index;
+}
+
+/// <summary>
+/// Reads a zone back
+/// </summary>
+/// <param name="index">zone index</param>
+/// <returns>the zone</returns>
+DrumZone CDrumZoneTable::GetZone(int index) const
+{
+    DrumZone zone;
+    zone.xMin = m_xMin[index];
+    zone.xMax = m_xMax[index];
+    zone.yMin = m_yMin[index];
+    zone.yMax = m_yMax[index];
+    zone.depthMin = m_depthMin[index];
+    zone.depthMax = m_depthMax[index];
+    zone.hands = m_hands[index];
+    zone.motion = m_motion[index];
+    zone.sampleId = m_sampleId[index];
+
+    return zone;
+}
+
+/// <summary>
+/// Builds the spatial index HitTest and OccupancyTest use. Call once the layout is complete;
+/// without it, or with fewer than cDrumZoneIndexMinCount zones, they scan every zone.
+/// Uses no memory besides the table's own.
+/// </summary>
+void CDrumZoneTable::BuildIndex()
+{
+    m_indexed = false;
+    if (m_count < cDrumZoneIndexMinCount)
+    {
+        return;
+    }
+
+    // The grid spans the finite zone edges; zones open towards a side fill the cells along it
+    float xLo = FLT_MAX, xHi = -FLT_MAX, yLo = FLT_MAX, yHi = -FLT_MAX;
+    for (int i = 0; i < m_count; ++i)
+    {
+        const float xs[2] = { m_xMin[i], m_xMax[i] };
+        const float ys[2] = { m_yMin[i], m_yMax[i] };
+        for (int e = 0; e < 2; ++e)
+        {
+            if (fabsf(xs[e]) < FLT_MAX)
+            {
+                xLo = (xs[e] < xLo) ? xs[e] : xLo;
+                xHi = (xs[e] > xHi) ? xs[e] : xHi;
+            }
+
+            if (fabsf(ys[e]) < FLT_MAX)
+            {
+                yLo = (ys[e] < yLo) ? ys[e] : yLo;
+                yHi = (ys[e] > yHi) ? ys[e] : yHi;
+            }
+        }
+    }
+
+    if (xLo > xHi)
+    {
+        xLo = xHi = 0.0f;
+    }
+
+    if (yLo > yHi)
+    {
+        yLo = yHi = 0.0f;
+    }
+
+    m_gridX = xLo;
+    m_gridY = yLo;
+
+    // About two cells per zone along each side, fewer if the zones overlap so much the lists overflow
+    int side = 2 * static_cast<int>(ceilf(sqrtf(static_cast<float>(m_count))));
+    side = (side < 1) ? 1 : ((side > cDrumZoneGridMaxSide) ? cDrumZoneGridMaxSide : side);
+    for (; side >= 1; side /= 2)
+    {
+        m_gridSide = side;
+        m_gridInverseWidth = (xHi > xLo) ? side / (xHi - xLo) : 0.0f;
+        m_gridInverseHeight = (yHi > yLo) ? side / (yHi - yLo) : 0.0f;
+        if (FillIndex(side))
+        {
+            m_indexed = true;
+            return;
+        }
+    }
+}
+
+/// <summary>
+/// Lays the zones out on a grid of side by side cells
+/// </summary>
+/// <param name="side">cells along each axis</param>
+/// <returns>false if the cells would list more zones than the index holds</returns>
+bool CDrumZoneTable::FillIndex(int side)
+{
+    const int cellCount = side * side;
+
+    // Count the zones of every cell, then place them
+    uint32_t counts[cDrumZoneGridMaxSide * cDrumZoneGridMaxSide];
+    memset(counts, 0, sizeof(counts));
+
+    uint32_t total = 0;
+    for (int i = 0; i < m_count; ++i)
+    {
+        if (0 == m_hands[i])
+        {
+            continue;
+        }
+
+        int x0, x1, y0, y1;
+        CellRange(m_xMin[i], m_xMax[i], m_gridX, m_gridInverseWidth, &x0, &x1);
+        CellRange(m_yMin[i], m_yMax[i], m_gridY, m_gridInverseHeight, &y0, &y1);
+        for (int cy = y0; cy <= y1; ++cy)
+        {
+            for (int cx = x0; cx <= x1; ++cx)
+            {
+                ++counts[cy * side + cx];
+            }
+        }
+
+        total += (x1 - x0 + 1) * (y1 - y0 + 1);
+        if (total > cDrumZoneIndexMaxEntries)
+        {
+            return false;
+        }
+    }
+
+    uint32_t start = 0;
+    for (int c = 0; c < cellCount; ++c)
+    {
+        m_cellStart[c] = static_cast<uint16_t>(start);
+        start += counts[c];
+        counts[c] = m_cellStart[c];
+    }
+    m_cellStart[cellCount] = static_cast<uint16_t>(start);
+
+    // Zones go in index order, so each cell lists its zones in the order a scan would find them
+    for (int i = 0; i < m_count; ++i)
+    {
+        if (0 == m_hands[i])
+        {
+            continue;
+        }
+
+        int x0, x1, y0, y1;
+        CellRange(m_xMin[i], m_xMax[i], m_gridX, m_gridInverseWidth, &x0, &x1);
+        CellRange(m_yMin[i], m_yMax[i], m_gridY, m_gridInverseHeight, &y0, &y1);
+        for (int cy = y0; cy <= y1; ++cy)
+        {
+            for (int cx = x0; cx <= x1; ++cx)
+            {
+                m_cellZones[counts[cy * side + cx]++] = static_cast<uint16_t>(i);
+            }
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Gets the cells a range of values overlaps along one axis of the grid. Values
+/// off the grid, including infinite and NaN ones, land in the cell at its edge.
+/// </summary>
+/// <param name="lo">start of the range</param>
+/// <param name="hi">end of the range</param>
+/// <param name="origin">where the first cell starts</param>
+/// <param name="inverseCell">cells per meter</param>
+/// <param name="pFirst">receives the first cell</param>
+/// <param name="pLast">receives the last cell</param>
+void CDrumZoneTable::CellRange(float lo, float hi, float origin, float inverseCell, int* pFirst, int* pLast) const
+{
+    const float lastCell = static_cast<float>(m_gridSide - 1);
+
+    float first = (lo - origin) * inverseCell;
+    float last = (hi - origin) * inverseCell;
+    first = (first > 0.0f) ? ((first < lastCell) ? first : lastCell) : 0.0f;
+    last = (last > 0.0f) ? ((last < lastCell) ? last : lastCell) : 0.0f;
+
+    *pFirst = static_cast<int>(first);
+    *pLast = static_cast<int>(last);
+}
+
+/// <summary>
+/// Gets the zones that may contain a point, going by x and y only
+/// </summary>
+/// <param name="x">x of the point</param>
+/// <param name="y">y of the point</param>
+/// <param name="ppZones">receives the indices of the candidate zones</param>
+/// <returns>number of candidates, or -1 if the index is not built</returns>
+int CDrumZoneTable::Candidates(float x, float y, const uint16_t** ppZones) const
+{
+    if (!m_indexed)
+    {
+        *ppZones = NULL;
+        return -1;
+    }
+
+    int cx, cy, unused;
+    CellRange(x, x, m_gridX, m_gridInverseWidth, &cx, &unused);
+    CellRange(y, y, m_gridY, m_gridInverseHeight, &cy, &unused);
+
+    int cell = cy * m_gridSide + cx;
+    *ppZones = m_cellZones + m_cellStart[cell];
+    return m_cellStart[cell + 1] - m_cellStart[cell];
+}
+
+/// <summary>
+/// Finds the zones that may overlap a box, going by x and y only
+/// </summary>
+/// <param name="xLo">left of the box</param>
+/// <param name="xHi">right of the box</param>
+/// <param name="yLo">top of the box</param>
+/// <param name="yHi">bottom of the box</param>
+/// <param name="pZones">receives the candidates; every zone if the index is not built</param>
+void CDrumZoneTable::Overlapping(float xLo, float xHi, float yLo, float yHi, DrumZoneMask* pZones) const
+{
+    pZones->Clear();
+
+    if (!m_indexed)
+    {
+        for (int i = 0; i < m_count; ++i)
+        {
+            pZones->Set(i);
+        }
+        return;
+    }
+
+    int x0, x1, y0, y1;
+    CellRange(xLo, xHi, m_gridX, m_gridInverseWidth, &x0, &x1);
+    CellRange(yLo, yHi, m_gridY, m_gridInverseHeight, &y0, &y1);
+    for (int cy = y0; cy <= y1; ++cy)
+    {
+        for (int cx = x0; cx <= x1; ++cx)
+        {
+            const int cell = cy * m_gridSide + cx;
+            for (int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k)
+            {
+                pZones->Set(m_cellZones[k]);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Zone test through the spatial index, shared by HitTest and OccupancyTest
+/// </summary>
+/// <param name="left">left hand</param>
+/// <param name="right">right hand</param>
+/// <param name="xyMargin">amount every zone is grown by in x and y</param>
+/// <param name="depthMargin">amount every zone is grown by in depth</param>
+/// <param name="pHits">receives the zones hit by each hand</param>
+void CDrumZoneTable::TestIndexed(const DrumHandInput& left, const DrumHandInput& right, float xyMargin, float depthMargin, DrumZoneHits* pHits) const
+{
+    pHits->left.Clear();
+    pHits->right.Clear();
+
+    const DrumHandInput* hands[2] = { &left, &right };
+    const uint32_t handBits[2] = { DRUM_HAND_LEFT, DRUM_HAND_RIGHT };
+    DrumZoneMask* masks[2] = { &pHits->left, &pHits->right };
+
+    for (int h = 0; h < 2; ++h)
+    {
+        // Same comparisons as the scan, so both find exactly the same zones
+        const DrumHandInput& hand = *hands[h];
+        const float xLo = hand.x + xyMargin;
+        const float xHi = hand.x - xyMargin;
+        const float yLo = hand.y + xyMargin;
+        const float yHi = hand.y - xyMargin;
+        const float depthLo = hand.depth + depthMargin;
+        const float depthHi = hand.depth - depthMargin;
+
+        // A grown zone reaches a hand when the hand, grown instead, reaches the zone's cells
+        int x0, x1, y0, y1;
+        CellRange(xHi, xLo, m_gridX, m_gridInverseWidth, &x0, &x1);
+        CellRange(yHi, yLo, m_gridY, m_gridInverseHeight, &y0, &y1);
+
+        for (int cy = y0; cy <= y1; ++cy)
+        {
+            for (int cx = x0; cx <= x1; ++cx)
+            {
+                const int cell = cy * m_gridSide + cx;
+                for (int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k)
+                {
+                    // Evaluated without branches: whether a hand is in a zone is as good as random
+                    const int i = m_cellZones[k];
+                    const uint64_t hit =
+                        static_cast<uint64_t>(0 != (m_hands[i] & handBits[h])) &
+                        static_cast<uint64_t>((hand.motion & m_motion[i]) == m_motion[i]) &
+                        static_cast<uint64_t>(m_xMin[i] < xLo) & static_cast<uint64_t>(xHi < m_xMax[i]) &
+                        static_cast<uint64_t>(m_yMin[i] < yLo) & static_cast<uint64_t>(yHi < m_yMax[i]) &
+                        static_cast<uint64_t>(m_depthMin[i] < depthLo) & static_cast<uint64_t>(depthHi <= m_depthMax[i]);
+                    masks[h]->bits[i >> 6] |= hit << (i & 63);
+                }
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Tests both hands against every zone, through the spatial index when it is built
+/// </summary>
+/// <param name="left">left hand</param>
+/// <param name="right">right hand</param>
+/// <param name="pHits">receives the zones hit by each hand</param>
+void CDrumZoneTable::HitTest(const DrumHandInput& left, const DrumHandInput& right, DrumZoneHits* pHits) const
+{
+    if (m_indexed)
+    {
+        TestIndexed(left, right, 0.0f, 0.0f, pHits);
+        return;
+    }
+
+    HitTestLinear(left, right, pHits);
+}
+
+/// <summary>
+/// Tests both hands against every zone by scanning them all, four at a time
+/// </summary>
+/// <param name="left">left hand</param>
+/// <param name="right">right hand</param>
+/// <param name="pHits">receives the zones hit by each hand</param>
+void CDrumZoneTable::HitTestLinear(const DrumHandInput& left, const DrumHandInput& right, DrumZoneHits* pHits) const
+{
+#ifdef DRUM_HAVE_SSE2
+    TestZones(left, right, 0.0f, 0.0f, pHits);
+#else
+    HitTestScalar(left, right, pHits);
+#endif
+}
+
+/// <summary>
+/// Finds the zones each hand is inside of, whatever it is doing
+/// </summary>
+/// <param name="left">left hand</param>
+/// <param name="right">right hand</param>
+/// <param name="xyMargin">amount every zone is grown by in x and y</param>
+/// <param name="depthMargin">amount every zone is grown by in depth</param>
+/// <param name="pHits">receives the zones each hand is inside of</param>
+void CDrumZoneTable::OccupancyTest(const DrumHandInput& left, const DrumHandInput& right, float xyMargin, float depthMargin, DrumZoneHits* pHits) const
+{
+    // Claiming every kind of motion satisfies any zone's requirement
+    DrumHandInput anyLeft = left;
+    DrumHandInput anyRight = right;
+    anyLeft.motion = 0xFFFFFFFF;
+    anyRight.motion = 0xFFFFFFFF;
+
+    if (m_indexed)
+    {
+        TestIndexed(anyLeft, anyRight, xyMargin, depthMargin, pHits);
+        return;
+    }
+
+#ifdef DRUM_HAVE_SSE2
+    TestZones(anyLeft, anyRight, xyMargin, depthMargin, pHits);
+#else
+    pHits->left.Clear();
+    pHits->right.Clear();
+
+    const DrumHandInput* hands[2] = { &anyLeft, &anyRight };
+    const uint32_t handBits[2] = { DRUM_HAND_LEFT, DRUM_HAND_RIGHT };
+    DrumZoneMask* masks[2] = { &pHits->left, &pHits->right };
+
+    for (int i = 0; i < m_count; ++i)
+    {
+        for (int h = 0; h < 2; ++h)
+        {
+            const DrumHandInput& hand = *hands[h];
+            if ((m_hands[i] & handBits[h]) &&
+                hand.x + xyMargin > m_xMin[i] && hand.x - xyMargin < m_xMax[i] &&
+                hand.y + xyMargin > m_yMin[i] && hand.y - xyMargin < m_yMax[i] &&
+                hand.depth + depthMargin > m_depthMin[i] && hand.depth - depthMargin <= m_depthMax[i])
+            {
+                masks[h]->Set(i);
+            }
+        }
+    }
+#endif
+}
+
+#ifdef DRUM_HAVE_SSE2
+
+/// <summary>
+/// SSE2 zone test shared by HitTest and OccupancyTest
+/// </summary>
+/// <param name="left">left hand</param>
+/// <param name="right">right hand</param>
+/// <param name="xyMargin">amount every zone is grown by in x and y</param>
+/// <param name="depthMargin">amount every zone is grown by in depth</param>
+/// <param name="pHits">receives the zones hit by each hand</param>
+void CDrumZoneTable::TestZones(const DrumHandInput& left, const DrumHandInput& right, float xyMargin, float depthMargin, DrumZoneHits* pHits) const
+{
+    pHits->left.Clear();
+    pHits->right.Clear();
+
+    // Growing a zone by a margin is the same as moving the hand towards each bound
+    const __m128 leftXLo = _mm_set1_ps(left.x + xyMargin);
+    const __m128 leftXHi = _mm_set1_ps(left.x - xyMargin);
+    const __m128 leftYLo = _mm_set1_ps(left.y + xyMargin);
+    const __m128 leftYHi = _mm_set1_ps(left.y - xyMargin);
+    const __m128 leftDepthLo = _mm_set1_ps(left.depth + depthMargin);
+    const __m128 leftDepthHi = _mm_set1_ps(left.depth - depthMargin);
+    const __m128i leftMotion = _mm_set1_epi32(static_cast<int>(left.motion));
+    const __m128i leftHand = _mm_set1_epi32(DRUM_HAND_LEFT);
+
+    const __m128 rightXLo = _mm_set1_ps(right.x + xyMargin);
+    const __m128 rightXHi = _mm_set1_ps(right.x - xyMargin);
+    const __m128 rightYLo = _mm_set1_ps(right.y + xyMargin);
+    const __m128 rightYHi = _mm_set1_ps(right.y - xyMargin);
+    const __m128 rightDepthLo = _mm_set1_ps(right.depth + depthMargin);
+    const __m128 rightDepthHi = _mm_set1_ps(right.depth - depthMargin);
+    const __m128i rightMotion = _mm_set1_epi32(static_cast<int>(right.motion));
+    const __m128i rightHand = _mm_set1_epi32(DRUM_HAND_RIGHT);
+
+    // Zones past m_count accept no hands, so the last partial block needs no special case
+    for (int base = 0; base < m_count; base += 4)
+    {
+        const __m128 xMin = _mm_loadu_ps(m_xMin + base);
+        const __m128 xMax = _mm_loadu_ps(m_xMax + base);
+        const __m128 yMin = _mm_loadu_ps(m_yMin + base);
+        const __m128 yMax = _mm_loadu_ps(m_yMax + base);
+        const __m128 depthMin = _mm_loadu_ps(m_depthMin + base);
+        const __m128 depthMax = _mm_loadu_ps(m_depthMax + base);
+        const __m128i hands = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_hands + base));
+        const __m128i motion = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_motion + base));
+
+        // Left hand
+        __m128 inside = _mm_and_ps(_mm_cmplt_ps(xMin, leftXLo), _mm_cmplt_ps(leftXHi, xMax));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(yMin, leftYLo), _mm_cmplt_ps(leftYHi, yMax)));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(depthMin, leftDepthLo), _mm_cmple_ps(leftDepthHi, depthMax)));
+        __m128i allowed = _mm_cmpeq_epi32(_mm_and_si128(hands, leftHand), leftHand);
+        allowed = _mm_and_si128(allowed, _mm_cmpeq_epi32(_mm_and_si128(motion, leftMotion), motion));
+        uint64_t leftBits = static_cast<uint64_t>(_mm_movemask_ps(_mm_and_ps(inside, _mm_castsi128_ps(allowed))));
+
+        // Right hand
+        inside = _mm_and_ps(_mm_cmplt_ps(xMin, rightXLo), _mm_cmplt_ps(rightXHi, xMax));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(yMin, rightYLo), _mm_cmplt_ps(rightYHi, yMax)));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(depthMin, rightDepthLo), _mm_cmple_ps(rightDepthHi, depthMax)));
+        allowed = _mm_cmpeq_epi32(_mm_and_si128(hands, rightHand), rightHand);
+        allowed = _mm_and_si128(allowed, _mm_cmpeq_epi32(_mm_and_si128(motion, rightMotion), motion));
+        uint64_t rightBits = static_cast<uint64_t>(_mm_movemask_ps(_mm_and_ps(inside, _mm_castsi128_ps(allowed))));
+
+        pHits->left.bits[base >> 6] |= leftBits << (base & 63);
+        pHits->right.bits[base >> 6] |= rightBits << (base & 63);
+    }
+}
+
+#endif
+
+/// <summary>
+/// Reference implementation of HitTest without SIMD
+/// </summary>
+/// <param name="left">left hand</param>
+/// <param name="right">right hand</param>
+/// <param name="pHits">receives the zones hit by each hand</param>
+void CDrumZoneTable::HitTestScalar(const DrumHandInput& left, const DrumHandInput& right, DrumZoneHits* pHits) const
+{
+    pHits->left.Clear();
+    pHits->right.Clear();
+
+    const DrumHandInput* hands[2] = { &left, &right };
+    const uint32_t handBits[2] = { DRUM_HAND_LEFT, DRUM_HAND_RIGHT };
+    DrumZoneMask* masks[2] = { &pHits->left, &pHits->right };
+
+    for (int i = 0; i < m_count; ++i)
+    {
+        for (int h = 0; h < 2; ++h)
+        {
+            const DrumHandInput& hand = *hands[h];
+            if ((m_hands[i] & handBits[h]) &&
+                (hand.motion & m_motion[i]) == m_motion[i] &&
+                hand.x > m_xMin[i] && hand.x < m_xMax[i] &&
+                hand.y > m_yMin[i] && hand.y < m_yMax[i] &&
+                hand.depth > m_depthMin[i] && hand.depth <= m_depthMax[i])
+            {
+                masks[h]->Set(i);
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Adds one zone of the default kit
+/// </summary>
+static void AddDefaultZone(CDrumZoneTable& table, DrumPiece piece, float xMin, float xMax, float yMin, float yMax,
+                           bool forward, uint32_t hands, uint32_t motion)
+{
+    DrumZone zone;
+    zone.xMin = xMin;
+    zone.xMax = xMax;
+    zone.yMin = yMin;
+    zone.yMax = yMax;
+    zone.depthMin = forward ? g_FarDepthMin : g_NearDepthMin;
+    zone.depthMax = forward ? g_FarDepthMax : g_NearDepthMax;
+    zone.hands = hands;
+    zone.motion = motion;
+    zone.sampleId = piece;
+
+    table.AddZone(zone);
+}
+
+/// <summary>
+/// Fills a table with the standard six piece kit
+/// </summary>
+/// <param name="table">table to fill, existing zones are removed</param>
+void CreateDefaultDrumZones(CDrumZoneTable& table)
+{
+    table.Clear();
+
+    // Bounds are meters relative to the shoulder, y downwards; toms sit further forward than the rest
+    AddDefaultZone(table, DRUM_PIECE_SNARE,    -0.15f,  0.20f, 0.45f, 0.70f, false, DRUM_HAND_LEFT,  DRUM_MOTION_DOWN);
+    AddDefaultZone(table, DRUM_PIECE_HIHAT,    -0.10f,  0.20f, 0.18f, 0.40f, false, DRUM_HAND_RIGHT, DRUM_MOTION_DOWN);
+    AddDefaultZone(table, DRUM_PIECE_CRASH,    -0.70f, -0.20f, 0.15f, 0.35f, false, DRUM_HAND_RIGHT, DRUM_MOTION_DOWN);
+    AddDefaultZone(table, DRUM_PIECE_RIDE,      0.55f,  1.05f, 0.07f, 0.53f, false, DRUM_HAND_RIGHT, DRUM_MOTION_RIGHT);
+    AddDefaultZone(table, DRUM_PIECE_HIGH_TOM,  0.07f,  0.65f, 0.32f, 0.60f, true,  DRUM_HAND_BOTH,  DRUM_MOTION_DOWN);
+    AddDefaultZone(table, DRUM_PIECE_LOW_TOM,  -0.65f,  0.00f, 0.32f, 0.60f, true,  DRUM_HAND_BOTH,  DRUM_MOTION_DOWN);
+    table.BuildIndex();
+}
+
+/// <summary>
+/// Gets the depth a hand typically strikes a zone at: the middle of its depth band, or a
+/// forearm ahead of the near bound for bands that are open ended
+/// </summary>
+/// <param name="zone">zone to strike</param>
+/// <returns>meters ahead of the shoulder</returns>
+float DrumZoneStrikeDepth(const DrumZone& zone)
+{
+    float nearDepth = (zone.depthMin > 0.0f) ? zone.depthMin : 0.0f;
+    return (zone.depthMax - nearDepth > 4.0f * g_ForwardReach) ? nearDepth + g_ForwardReach : (nearDepth + zone.depthMax) * 0.5f;
+}
@@ -0,0 +1,255 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="DrumZones.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+
+static const int cDrumZoneMaxCount = 512;
+static const int cDrumZoneMaskWords = cDrumZoneMaxCount / 64;
+
+// Spatial index: a grid of up to 32x32 cells over the zones in x and y, each cell
+// listing the zones that overlap it. Smaller kits are scanned faster than looked up.
+static const int cDrumZoneGridMaxSide     = 32;
+static const int cDrumZoneIndexMaxEntries = 8192;
+static const int cDrumZoneIndexMinCount   = 32;
+
+// Hands allowed to play a zone
+enum DrumHand
+{
+    DRUM_HAND_LEFT  = 0x1,
+    DRUM_HAND_RIGHT = 0x2,
+    DRUM_HAND_BOTH  = DRUM_HAND_LEFT | DRUM_HAND_RIGHT
+};
+
+// Motion of a hand on this frame. DOWN is set on the frame a downward stroke lands.
+enum DrumMotion
+{
+    DRUM_MOTION_NONE  = 0x0,
+    DRUM_MOTION_DOWN  = 0x1,
+    DRUM_MOTION_RIGHT = 0x2
+};
+
+/// <summary>
+/// One trigger zone, a box in skeleton space meters relative to the shoulder center:
+/// x to the sensor's right, y downwards and depth towards the sensor. A hand is inside
+/// when xMin &lt; x &lt; xMax, yMin &lt; y &lt; yMax and depthMin &lt; depth &lt;= depthMax.
+/// </summary>
+struct DrumZone
+{
+    float                   xMin;
+    float                   xMax;
+    float                   yMin;
+    float                   yMax;
+    float                   depthMin;
+    float                   depthMax;
+    uint32_t                hands;
+    uint32_t                motion;
+    int32_t                 sampleId;
+};
+
+/// <summary>
+/// Hand position relative to the shoulder center, in the meters the zones are laid out in
+/// </summary>
+struct DrumHandInput
+{
+    float                   x;
+    float                   y;
+    float                   depth;
+    uint32_t                motion;
+};
+
+/// <summary>
+/// One bit per zone index
+/// </summary>
+struct DrumZoneMask
+{
+    uint64_t                bits[cDrumZoneMaskWords];
+
+    void                    Clear() { for (int i = 0; i < cDrumZoneMaskWords; ++i) bits[i] = 0; }
+    bool                    Test(int zone) const { return 0 != (bits[zone >> 6] & (1ULL << (zone & 63))); }
+    void                    Set(int zone) { bits[zone >> 6] |= (1ULL << (zone & 63)); }
+    void                    Clear(int zone) { bits[zone >> 6] &= ~(1ULL << (zone & 63)); }
+};
+
+/// <summary>
+/// Zones hit by each hand in one frame
+/// </summary>
+struct DrumZoneHits
+{
+    DrumZoneMask            left;
+    DrumZoneMask            right;
+};
+
+/// <summary>
+/// Kit layout stored as one array per field, so both hands can be tested
+/// against four zones at a time with SSE. Large layouts build a uniform grid
+/// over the zones once they are complete, so a hand is only tested against
+/// the few zones of the cell it is in, however many zones the kit has.
+/// </summary>
+class CDrumZoneTable
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CDrumZoneTable();
+
+    /// <summary>
+    /// Removes all zones
+    /// </summary>
+    void                    Clear();
+
+    /// <summary>
+    /// Appends a zone. The spatial index is dropped until it is built again.
+    /// </summary>
+    /// <param name="zone">zone to add</param>
+    /// <returns>index of the zone, or -1 if the table is full</returns>
+    int                     AddZone(const DrumZone& zone);
+
+    /// <summary>
+    /// Builds the spatial index HitTest and OccupancyTest use. Call once the layout is complete;
+    /// without it, or with fewer than cDrumZoneIndexMinCount zones, they scan every zone.
+    /// Uses no memory besides the table's own.
+    /// </summary>
+    void                    BuildIndex();
+
+    /// <summary>
+    /// Gets whether the spatial index is built
+    /// </summary>
+    bool                    IsIndexed() const { return m_indexed; }
+
+    /// <summary>
+    /// Gets the zones that may contain a point, going by x and y only
+    /// </summary>
+    /// <param name="x">x of the point</param>
+    /// <param name="y">y of the point</param>
+    /// <param name="ppZones">receives the indices of the candidate zones</param>
+    /// <returns>number of candidates, or -1 if the index is not built</returns>
+    int                     Candidates(float x, float y, const uint16_t** ppZones) const;
+
+    /// <summary>
+    /// Finds the zones that may overlap a box, going by x and y only
+    /// </summary>
+    /// <param name="xLo">left of the box</param>
+    /// <param name="xHi">right of the box</param>
+    /// <param name="yLo">top of the box</param>
+    /// <param name="yHi">bottom of the box</param>
+    /// <param name="pZones">receives the candidates; every zone if the index is not built</param>
+    void                    Overlapping(float xLo, float xHi, float yLo, float yHi, DrumZoneMask* pZones) const;
+
+    /// <summary>
+    /// Reads a zone back
+    /// </summary>
+    /// <param name="index">zone index</param>
+    /// <returns>the zone</returns>
+    DrumZone                GetZone(int index) const;
+
+    /// <summary>
+    /// Gets the number of zones
+    /// </summary>
+    int                     Count() const { return m_count; }
+
+    /// <summary>
+    /// Gets the sample played by a zone
+    /// </summary>
+    int32_t                 SampleId(int index) const { return m_sampleId[index]; }
+
+    /// <summary>
+    /// Tests both hands against every zone, through the spatial index when it is built
+    /// </summary>
+    /// <param name="left">left hand</param>
+    /// <param name="right">right hand</param>
+    /// <param name="pHits">receives the zones hit by each hand</param>
+    void                    HitTest(const DrumHandInput& left, const DrumHandInput& right, DrumZoneHits* pHits) const;
+
+    /// <summary>
+    /// Tests both hands against every zone by scanning them all, four at a time
+    /// </summary>
+    /// <param name="left">left hand</param>
+    /// <param name="right">right hand</param>
+    /// <param name="pHits">receives the zones hit by each hand</param>
+    void                    HitTestLinear(const DrumHandInput& left, const DrumHandInput& right, DrumZoneHits* pHits) const;
+
+    /// <summary>
+    /// Finds the zones each hand is inside of, whatever it is doing
+    /// </summary>
+    /// <param name="left">left hand</param>
+    /// <param name="right">right hand</param>
+    /// <param name="xyMargin">amount every zone is grown by in x and y</param>
+    /// <param name="depthMargin">amount every zone is grown by in depth</param>
+    /// <param name="pHits">receives the zones each hand is inside of</param>
+    void                    OccupancyTest(const DrumHandInput& left, const DrumHandInput& right, float xyMargin, float depthMargin, DrumZoneHits* pHits) const;
+
+    /// <summary>
+    /// Reference implementation of HitTest without SIMD
+    /// </summary>
+    /// <param name="left">left hand</param>
+    /// <param name="right">right hand</param>
+    /// <param name="pHits">receives the zones hit by each hand</param>
+    void                    HitTestScalar(const DrumHandInput& left, const DrumHandInput& right, DrumZoneHits* pHits) const;
+
+private:
+#ifdef DRUM_HAVE_SSE2
+    /// <summary>
+    /// SSE2 zone test shared by HitTest and OccupancyTest
+    /// </summary>
+    void                    TestZones(const DrumHandInput& left, const DrumHandInput& right, float xyMargin, float depthMargin, DrumZoneHits* pHits) const;
+#endif
+
+    /// <summary>
+    /// Zone test through the spatial index, shared by HitTest and OccupancyTest
+    /// </summary>
+    void                    TestIndexed(const DrumHandInput& left, const DrumHandInput& right, float xyMargin, float depthMargin, DrumZoneHits* pHits) const;
+
+    /// <summary>
+    /// Lays the zones out on a grid of side by side cells
+    /// </summary>
+    /// <returns>false if the cells would list more zones than the index holds</returns>
+    bool                    FillIndex(int side);
+
+    /// <summary>
+    /// Gets the cells a range of values overlaps along one axis of the grid
+    /// </summary>
+    void                    CellRange(float lo, float hi, float origin, float inverseCell, int* pFirst, int* pLast) const;
+
+    int                     m_count;
+
+    // Padded to a multiple of four, unused zones accept no hands
+    float                   m_xMin[cDrumZoneMaxCount];
+    float                   m_xMax[cDrumZoneMaxCount];
+    float                   m_yMin[cDrumZoneMaxCount];
+    float                   m_yMax[cDrumZoneMaxCount];
+    float                   m_depthMin[cDrumZoneMaxCount];
+    float                   m_depthMax[cDrumZoneMaxCount];
+    uint32_t                m_hands[cDrumZoneMaxCount];
+    uint32_t                m_motion[cDrumZoneMaxCount];
+    int32_t                 m_sampleId[cDrumZoneMaxCount];
+
+    // Spatial index, valid while m_indexed is set
+    bool                    m_indexed;
+    int                     m_gridSide;
+    float                   m_gridX;            // where the first cell starts
+    float                   m_gridY;
+    float                   m_gridInverseWidth; // cells per meter
+    float                   m_gridInverseHeight;
+    uint16_t                m_cellStart[cDrumZoneGridMaxSide * cDrumZoneGridMaxSide + 1];  // cell c lists m_cellZones[m_cellStart[c]..m_cellStart[c + 1])
+    uint16_t                m_cellZones[cDrumZoneIndexMaxEntries];
+};
+
+/// <summary>
+/// Fills a table with the standard six piece kit
+/// </summary>
+/// <param name="table">table to fill, existing zones are removed</param>
+void CreateDefaultDrumZones(CDrumZoneTable& table);
+
+/// <summary>
+/// Gets the depth a hand typically strikes a zone at: the middle of its depth band, or a
+/// forearm ahead of the near bound for bands that are open ended
+/// </summary>
+/// <param name="zone">zone to strike</param>
+/// <returns>meters ahead of the shoulder</returns>
+float DrumZoneStrikeDepth(const DrumZone& zone);
@@ -0,0 +1,414 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="HitPredictor.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "HitPredictor.h"
+#include <string.h>
+
+/// <summary>
+/// Constructor
+/// </summary>
+/// <param name="alpha">position correction gain, 0..1</param>
+/// <param name="beta">velocity correction gain, 0..2</param>
+CAlphaBetaFilter::CAlphaBetaFilter(float alpha, float beta) :
+    m_alpha(alpha),
+    m_beta(beta)
+{
+    Reset();
+}
+
+/// <summary>
+/// Forgets the track
+/// </summary>
+void CAlphaBetaFilter::Reset()
+{
+    memset(m_position, 0, sizeof(m_position));
+    memset(m_velocity, 0, sizeof(m_velocity));
+    m_timeUs = 0;
+    m_count = 0;
+}
+
+/// <summary>
+/// Corrects the estimate with a measurement
+/// </summary>
+/// <param name="x">measured x</param>
+/// <param name="y">measured y</param>
+/// <param name="z">measured depth</param>
+/// <param name="timeUs">time of the measurement</param>
+void CAlphaBetaFilter::Update(float x, float y, float z, int64_t timeUs)
+{
+    const float measured[3] = { x, y, z };
+
+    if (0 == m_count)
+    {
+        memcpy(m_position, measured, sizeof(m_position));
+        m_timeUs = timeUs;
+        m_count = 1;
+        return;
+    }
+
+    // Repeated or out of order timestamps carry no motion information
+    if (timeUs <= m_timeUs)
+    {
+        return;
+    }
+
+    float dt = (timeUs - m_timeUs) * 1e-6f;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (1 == m_count)
+        {
+            // Two samples give the first velocity directly
+            m_velocity[i] = (measured[i] - m_position[i]) / dt;
+            m_position[i] = measured[i];
+            continue;
+        }
+
+        float predicted = m_position[i] + m_velocity[i] * dt;
+        float residual = measured[i] - predicted;
+        m_position[i] = predicted + m_alpha * residual;
+        m_velocity[i] += m_beta * residual / dt;
+    }
+
+    m_timeUs = timeUs;
+    if (m_count < 2)
+    {
+        ++m_count;
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CHitPredictor::CHitPredictor()
+{
+    SetParams(DefaultParams());
+    Reset();
+}
+
+/// <summary>
+/// Gets the default tuning
+/// </summary>
+HitPredictorParams CHitPredictor::DefaultParams()
+{
+    HitPredictorParams params;
+    params.alpha = 0.7f;
+    params.beta = 0.4f;
+    params.minStrikeSpeed = 0.6f;
+    params.strikePlane = 0.5f;
+    params.horizonUs = 50000;
+    params.confirmWindowUs = 70000;
+    return params;
+}
+
+/// <summary>
+/// Changes the tuning
+/// </summary>
+/// <param name="params">new tuning</param>
+void CHitPredictor::SetParams(const HitPredictorParams& params)
+{
+    m_params = params;
+    for (int h = 0; h < 2; ++h)
+    {
+        m_hands[h].filter.SetGains(params.alpha, params.beta);
+    }
+}
+
+/// <summary>
+/// Forgets both hands and the statistics
+/// </summary>
+void CHitPredictor::Reset()
+{
+    for (int h = 0; h < 2; ++h)
+    {
+        m_hands[h].filter.Reset();
+        memset(&m_hands[h].prediction, 0, sizeof(m_hands[h].prediction));
+        m_hands[h].lastY = 0.0f;
+        m_hands[h].lastTimeUs = 0;
+        m_hands[h].hasLast = false;
+    }
+
+    m_nextTicket = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/// <summary>
+/// Forgets one hand, e.g. when it stops being tracked. A pending prediction is cancelled.
+/// </summary>
+/// <param name="hand">DRUM_HAND_LEFT or DRUM_HAND_RIGHT</param>
+/// <param name="pAction">receives the cancel, if there was a pending prediction</param>
+/// <returns>true if pAction was written</returns>
+bool CHitPredictor::ResetHand(DrumHand hand, HitAction* pAction)
+{
+    HandState& state = m_hands[(DRUM_HAND_LEFT == hand) ? 0 : 1];
+    state.filter.Reset();
+    state.hasLast = false;
+
+    if (!state.prediction.active)
+    {
+        return false;
+    }
+
+    ++m_stats.cancelled;
+    CancelPrediction(hand, state, pAction);
+    return true;
+}
+
+/// <summary>
+/// Runs after the onset gate for one frame. Constant memory, no allocation.
+/// </summary>
+/// <param name="zones">kit layout</param>
+/// <param name="gate">onset gate, already run on this frame</param>
+/// <param name="left">left hand position</param>
+/// <param name="right">right hand position</param>
+/// <param name="leftDownSpeed">downward speed of the left hand in m/s</param>
+/// <param name="rightDownSpeed">downward speed of the right hand in m/s</param>
+/// <param name="leftVelocity">hit velocity of the left hand</param>
+/// <param name="rightVelocity">hit velocity of the right hand</param>
+/// <param name="timeUs">time the frame was captured</param>
+/// <param name="pOnsets">onsets of the frame; confirmed ones are removed</param>
+/// <param name="pOnsetCount">number of onsets, updated</param>
+/// <param name="pActions">receives schedule and cancel requests</param>
+/// <param name="maxActions">capacity of pActions, at least 4</param>
+/// <returns>number of actions written</returns>
+int CHitPredictor::Process(const CDrumZoneTable& zones, const COnsetGate& gate,
+                           const DrumHandInput& left, const DrumHandInput& right,
+                           float leftDownSpeed, float rightDownSpeed, float leftVelocity, float rightVelocity,
+                           int64_t timeUs, DrumOnset* pOnsets, int* pOnsetCount, HitAction* pActions, int maxActions)
+{
+    const DrumHandInput* inputs[2] = { &left, &right };
+    const float downSpeeds[2] = { leftDownSpeed, rightDownSpeed };
+    const float velocities[2] = { leftVelocity, rightVelocity };
+    const DrumHand handIds[2] = { DRUM_HAND_LEFT, DRUM_HAND_RIGHT };
+
+    DrumZoneMask confirmedZones;
+    confirmedZones.Clear();
+
+    int actionCount = 0;
+
+    for (int h = 0; h < 2; ++h)
+    {
+        HandState& state = m_hands[h];
+        Prediction& prediction = state.prediction;
+        const DrumHandInput& input = *inputs[h];
+
+        state.filter.Update(input.x, input.y, input.depth, timeUs);
+
+        // Time the measured hand passed the plane, interpolated between frames
+        if (prediction.active && !prediction.crossed && state.hasLast &&
+            state.lastY < prediction.planeY && input.y >= prediction.planeY && timeUs > state.lastTimeUs)
+        {
+            float fraction = (prediction.planeY - state.lastY) / (input.y - state.lastY);
+            prediction.crossedUs = state.lastTimeUs + static_cast<int64_t>(fraction * (timeUs - state.lastTimeUs));
+            prediction.crossed = true;
+        }
+
+        // Onset of this hand on this frame, if the gate let one through
+        int onset = -1;
+        for (int i = 0; i < *pOnsetCount; ++i)
+        {
+            if (pOnsets[i].hands & handIds[h])
+            {
+                onset = i;
+                break;
+            }
+        }
+
+        if (prediction.active && actionCount < maxActions)
+        {
+            if (onset >= 0 && pOnsets[onset].zone == prediction.zone)
+            {
+                // The stroke landed where it was predicted; its sample is already scheduled
+                ++m_stats.confirmed;
+                m_stats.gainSumUs += timeUs - prediction.timeUs;
+                if (prediction.crossed)
+                {
+                    int64_t errorUs = prediction.timeUs - prediction.crossedUs;
+                    int64_t absErrorUs = (errorUs < 0) ? -errorUs : errorUs;
+                    ++m_stats.errorCount;
+                    m_stats.errorSumUs += errorUs;
+                    m_stats.errorAbsSumUs += absErrorUs;
+                    if (absErrorUs > m_stats.errorAbsMaxUs)
+                    {
+                        m_stats.errorAbsMaxUs = absErrorUs;
+                    }
+                }
+
+                confirmedZones.Set(prediction.zone);
+                prediction.active = false;
+            }
+            else if (onset >= 0)
+            {
+                // Struck somewhere else
+                ++m_stats.cancelled;
+                CancelPrediction(handIds[h], state, &pActions[actionCount++]);
+            }
+            else if (timeUs - prediction.timeUs > m_params.confirmWindowUs)
+            {
+                // Passed the plane without a stroke; the sample has most likely played already
+                ++m_stats.unconfirmed;
+                CancelPrediction(handIds[h], state, &pActions[actionCount++]);
+            }
+            else if (!prediction.crossed && state.filter.Position()[1] < prediction.planeY)
+            {
+                // Still on the way down; the new frame has to agree on the zone
+                float planeY;
+                int64_t crossUs;
+                if (PredictCrossing(zones, gate, handIds[h], state, timeUs, &planeY, &crossUs) != prediction.zone)
+                {
+                    ++m_stats.cancelled;
+                    CancelPrediction(handIds[h], state, &pActions[actionCount++]);
+                }
+            }
+        }
+
+        if (!prediction.active && downSpeeds[h] >= m_params.minStrikeSpeed && actionCount < maxActions)
+        {
+            float planeY;
+            int64_t crossUs;
+            int zone = PredictCrossing(zones, gate, handIds[h], state, timeUs, &planeY, &crossUs);
+            if (zone >= 0)
+            {
+                prediction.active = true;
+                prediction.crossed = false;
+                prediction.zone = zone;
+                prediction.ticket = ++m_nextTicket;
+                if (0 == prediction.ticket)
+                {
+                    prediction.ticket = ++m_nextTicket;
+                }
+                prediction.planeY = planeY;
+                prediction.timeUs = crossUs;
+                prediction.crossedUs = 0;
+                ++m_stats.predicted;
+
+                HitAction& action = pActions[actionCount++];
+                action.type = HIT_ACTION_SCHEDULE;
+                action.hand = handIds[h];
+                action.zone = zone;
+                action.ticket = prediction.ticket;
+                action.timeUs = crossUs;
+                action.leadUs = crossUs - timeUs;
+                action.hitVelocity = velocities[h];
+            }
+        }
+
+        state.lastY = input.y;
+        state.lastTimeUs = timeUs;
+        state.hasLast = true;
+    }
+
+    // Confirmed onsets were already sounded by their prediction, the rest were not foreseen
+    int kept = 0;
+    for (int i = 0; i < *pOnsetCount; ++i)
+    {
+        if (!confirmedZones.Test(pOnsets[i].zone))
+        {
+            pOnsets[kept++] = pOnsets[i];
+        }
+    }
+
+    m_stats.missed += kept;
+    *pOnsetCount = kept;
+
+    return actionCount;
+}
+
+/// <summary>
+/// Finds the earliest strike plane crossing of a hand within the horizon
+/// </summary>
+/// <returns>zone index, or -1 if the hand is not heading into an armed zone</returns>
+int CHitPredictor::PredictCrossing(const CDrumZoneTable& zones, const COnsetGate& gate, DrumHand hand,
+                                   const HandState& state, int64_t timeUs, float* pPlaneY, int64_t* pCrossUs) const
+{
+    if (!state.filter.IsValid())
+    {
+        return -1;
+    }
+
+    // Zone space y grows downwards
+    const float* position = state.filter.Position();
+    const float* velocity = state.filter.Velocity();
+    if (velocity[1] <= 0.0f)
+    {
+        return -1;
+    }
+
+    const float horizon = m_params.horizonUs * 1e-6f;
+    int best = -1;
+    float bestDt = horizon;
+
+    // Only zones the hand can reach within the horizon; in zone order, as the earliest crossing wins ties
+    float xEnd = position[0] + velocity[0] * horizon;
+    DrumZoneMask reachable;
+    zones.Overlapping((xEnd < position[0]) ? xEnd : position[0], (xEnd < position[0]) ? position[0] : xEnd,
+                      position[1], position[1] + velocity[1] * horizon, &reachable);
+
+    for (int w = 0; w < cDrumZoneMaskWords; ++w)
+    {
+        for (uint64_t bits = reachable.bits[w]; 0 != bits; bits &= bits - 1)
+        {
+            const int i = (w << 6) + DrumLowestBit(bits);
+            DrumZone zone = zones.GetZone(i);
+
+            // Only zones a plain downward stroke of this hand can play
+            if (0 == (zone.hands & hand) || 0 != (zone.motion & ~DRUM_MOTION_DOWN))
+            {
+                continue;
+            }
+
+            float planeY = zone.yMin + m_params.strikePlane * (zone.yMax - zone.yMin);
+            if (position[1] >= planeY)
+            {
+                continue;
+            }
+
+            float dt = (planeY - position[1]) / velocity[1];
+            if (dt > bestDt)
+            {
+                continue;
+            }
+
+            float x = position[0] + velocity[0] * dt;
+            float depth = position[2] + velocity[2] * dt;
+            if (x <= zone.xMin || x >= zone.xMax || depth <= zone.depthMin || depth > zone.depthMax)
+            {
+                continue;
+            }
+
+            int64_t crossUs = timeUs + static_cast<int64_t>(dt * 1e6f);
+            if (!gate.IsArmed(hand, i, crossUs))
+            {
+                continue;
+            }
+
+            best = i;
+            bestDt = dt;
+            *pPlaneY = planeY;
+            *pCrossUs = crossUs;
+        }
+    }
+
+    return best;
+}
+
+/// <summary>
+/// Writes a cancel for the pending prediction of a hand and clears it
+/// </summary>
+void CHitPredictor::CancelPrediction(DrumHand hand, HandState& state, HitAction* pAction)
+{
+    Prediction& prediction = state.prediction;
+
+    pAction->type = HIT_ACTION_CANCEL;
+    pAction->hand = hand;
+    pAction->zone = prediction.zone;
+    pAction->ticket = prediction.ticket;
+    pAction->timeUs = prediction.timeUs;
+    pAction->leadUs = 0;
+    pAction->hitVelocity = 0.0f;
+
+    prediction.active = false;
+}
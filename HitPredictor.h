@@ -0,0 +1,239 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="HitPredictor.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumZones.h"
+#include "OnsetGate.h"
+
+/// <summary>
+/// Alpha-beta tracker of one hand in zone space. Estimates position and velocity
+/// from noisy samples and extrapolates them at constant velocity.
+/// </summary>
+class CAlphaBetaFilter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="alpha">position correction gain, 0..1</param>
+    /// <param name="beta">velocity correction gain, 0..2</param>
+    CAlphaBetaFilter(float alpha, float beta);
+
+    /// <summary>
+    /// Changes the gains
+    /// </summary>
+    /// <param name="alpha">position correction gain, 0..1</param>
+    /// <param name="beta">velocity correction gain, 0..2</param>
+    void                    SetGains(float alpha, float beta) { m_alpha = alpha; m_beta = beta; }
+
+    /// <summary>
+    /// Forgets the track
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Corrects the estimate with a measurement
+    /// </summary>
+    /// <param name="x">measured x</param>
+    /// <param name="y">measured y</param>
+    /// <param name="z">measured depth</param>
+    /// <param name="timeUs">time of the measurement</param>
+    void                    Update(float x, float y, float z, int64_t timeUs);
+
+    /// <summary>
+    /// Gets whether the velocity estimate is usable
+    /// </summary>
+    bool                    IsValid() const { return m_count >= 2; }
+
+    /// <summary>
+    /// Gets the estimated position, x y z
+    /// </summary>
+    const float*            Position() const { return m_position; }
+
+    /// <summary>
+    /// Gets the estimated velocity in units per second, x y z
+    /// </summary>
+    const float*            Velocity() const { return m_velocity; }
+
+    /// <summary>
+    /// Gets the time of the latest measurement
+    /// </summary>
+    int64_t                 TimeUs() const { return m_timeUs; }
+
+private:
+    float                   m_alpha;
+    float                   m_beta;
+    float                   m_position[3];
+    float                   m_velocity[3];
+    int64_t                 m_timeUs;
+    int                     m_count;
+};
+
+/// <summary>
+/// Tuning of the hit predictor
+/// </summary>
+struct HitPredictorParams
+{
+    float                   alpha;              // position gain of the hand trackers
+    float                   beta;               // velocity gain of the hand trackers
+    float                   minStrikeSpeed;     // downward speed in m/s before a stroke is predicted
+    float                   strikePlane;        // height of the strike plane inside a zone, 0 top .. 1 bottom
+    int64_t                 horizonUs;          // furthest ahead a crossing is scheduled
+    int64_t                 confirmWindowUs;    // how long after its crossing a prediction waits for the stroke
+};
+
+// What the caller has to do with the mixer
+enum HitActionType
+{
+    HIT_ACTION_SCHEDULE,
+    HIT_ACTION_CANCEL
+};
+
+/// <summary>
+/// Schedule or cancel request produced by the predictor
+/// </summary>
+struct HitAction
+{
+    HitActionType           type;
+    uint32_t                hand;               // DrumHand
+    int32_t                 zone;
+    uint32_t                ticket;             // nonzero, names the scheduled sample
+    int64_t                 timeUs;             // predicted crossing, on the frame clock
+    int64_t                 leadUs;             // how far the crossing is past the frame that predicted it
+    float                   hitVelocity;
+};
+
+/// <summary>
+/// Accuracy of the predictions since the last reset. Errors are predicted minus
+/// measured crossing time, so negative means the sample was scheduled early.
+/// </summary>
+struct HitPredictorStats
+{
+    uint64_t                predicted;
+    uint64_t                confirmed;          // a stroke landed on the predicted zone
+    uint64_t                cancelled;          // the next frames disagreed
+    uint64_t                unconfirmed;        // the crossing passed without a stroke
+    uint64_t                missed;             // strokes that were not predicted
+    uint64_t                errorCount;
+    int64_t                 errorSumUs;
+    int64_t                 errorAbsSumUs;
+    int64_t                 errorAbsMaxUs;
+    int64_t                 gainSumUs;          // how much earlier than stroke detection the confirmed hits were scheduled
+};
+
+/// <summary>
+/// Hides sensor latency by predicting strokes. Tracks both hands of one skeleton,
+/// extrapolates each hand to the strike plane of the zone it is heading into and
+/// schedules the sample for that moment. A prediction is cancelled when the next
+/// frames disagree and confirmed when the stroke detector reports the stroke, in
+/// which case the stroke's own onset is swallowed.
+/// </summary>
+class CHitPredictor
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CHitPredictor();
+
+    /// <summary>
+    /// Gets the default tuning
+    /// </summary>
+    static HitPredictorParams DefaultParams();
+
+    /// <summary>
+    /// Changes the tuning
+    /// </summary>
+    /// <param name="params">new tuning</param>
+    void                    SetParams(const HitPredictorParams& params);
+
+    /// <summary>
+    /// Gets the tuning
+    /// </summary>
+    const HitPredictorParams& Params() const { return m_params; }
+
+    /// <summary>
+    /// Forgets both hands and the statistics
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Forgets one hand, e.g. when it stops being tracked. A pending prediction is cancelled.
+    /// </summary>
+    /// <param name="hand">DRUM_HAND_LEFT or DRUM_HAND_RIGHT</param>
+    /// <param name="pAction">receives the cancel, if there was a pending prediction</param>
+    /// <returns>true if pAction was written</returns>
+    bool                    ResetHand(DrumHand hand, HitAction* pAction);
+
+    /// <summary>
+    /// Runs after the onset gate for one frame. Constant memory, no allocation.
+    /// </summary>
+    /// <param name="zones">kit layout</param>
+    /// <param name="gate">onset gate, already run on this frame</param>
+    /// <param name="left">left hand position</param>
+    /// <param name="right">right hand position</param>
+    /// <param name="leftDownSpeed">downward speed of the left hand in m/s</param>
+    /// <param name="rightDownSpeed">downward speed of the right hand in m/s</param>
+    /// <param name="leftVelocity">hit velocity of the left hand</param>
+    /// <param name="rightVelocity">hit velocity of the right hand</param>
+    /// <param name="timeUs">time the frame was captured</param>
+    /// <param name="pOnsets">onsets of the frame; confirmed ones are removed</param>
+    /// <param name="pOnsetCount">number of onsets, updated</param>
+    /// <param name="pActions">receives schedule and cancel requests</param>
+    /// <param name="maxActions">capacity of pActions, at least 4</param>
+    /// <returns>number of actions written</returns>
+    int                     Process(const CDrumZoneTable& zones, const COnsetGate& gate,
+                                    const DrumHandInput& left, const DrumHandInput& right,
+                                    float leftDownSpeed, float rightDownSpeed, float leftVelocity, float rightVelocity,
+                                    int64_t timeUs, DrumOnset* pOnsets, int* pOnsetCount, HitAction* pActions, int maxActions);
+
+    /// <summary>
+    /// Reads the accuracy counters
+    /// </summary>
+    const HitPredictorStats& Stats() const { return m_stats; }
+
+private:
+    struct Prediction
+    {
+        bool                active;
+        bool                crossed;            // the measured hand passed the plane
+        int32_t             zone;
+        uint32_t            ticket;
+        float               planeY;
+        int64_t             timeUs;             // predicted crossing
+        int64_t             crossedUs;          // measured crossing, valid once crossed
+    };
+
+    struct HandState
+    {
+        CAlphaBetaFilter    filter;
+        Prediction          prediction;
+        float               lastY;
+        int64_t             lastTimeUs;
+        bool                hasLast;
+
+        HandState() : filter(0.0f, 0.0f) {}
+    };
+
+    /// <summary>
+    /// Finds the earliest strike plane crossing of a hand within the horizon
+    /// </summary>
+    /// <returns>zone index, or -1 if the hand is not heading into an armed zone</returns>
+    int                     PredictCrossing(const CDrumZoneTable& zones, const COnsetGate& gate, DrumHand hand,
+                                            const HandState& state, int64_t timeUs, float* pPlaneY, int64_t* pCrossUs) const;
+
+    /// <summary>
+    /// Writes a cancel for the pending prediction of a hand and clears it
+    /// </summary>
+    void                    CancelPrediction(DrumHand hand, HandState& state, HitAction* pAction);
+
+    HitPredictorParams      m_params;
+    HandState               m_hands[2];
+    uint32_t                m_nextTicket;
+    HitPredictorStats       m_stats;
+};
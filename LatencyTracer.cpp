@@ -0,0 +1,211 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="LatencyTracer.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "LatencyTracer.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+CLatencyHistogram::CLatencyHistogram()
+{
+    Reset();
+}
+
+/// <summary>
+/// Forgets every recorded value
+/// </summary>
+void CLatencyHistogram::Reset()
+{
+    for (int i = 0; i < cBucketCount; ++i)
+    {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Maps a value to its bucket
+/// </summary>
+int CLatencyHistogram::BucketIndex(uint64_t value)
+{
+    if (value < 2 * cSubBucketCount)
+    {
+        return static_cast<int>(value);
+    }
+
+    // Keep the top cSubBucketBits + 1 bits; the leading one picks the half
+    int shift = DrumHighestBit(value) - cSubBucketBits;
+    return shift * cSubBucketCount + static_cast<int>(value >> shift);
+}
+
+/// <summary>
+/// Gets the largest value that maps to a bucket
+/// </summary>
+int64_t CLatencyHistogram::BucketUpperBound(int index)
+{
+    if (index < 2 * cSubBucketCount)
+    {
+        return index;
+    }
+
+    int shift = index / cSubBucketCount - 1;
+    int64_t sub = index - shift * cSubBucketCount;
+    return ((sub + 1) << shift) - 1;
+}
+
+/// <summary>
+/// Adds one duration. Negative durations count as zero, huge ones are clamped.
+/// </summary>
+/// <param name="valueUs">duration in microseconds</param>
+void CLatencyHistogram::Record(int64_t valueUs)
+{
+    static const int64_t maxValue = (1LL << cMaxValueBits) - 1;
+
+    if (valueUs < 0)
+    {
+        valueUs = 0;
+    }
+    else if (valueUs > maxValue)
+    {
+        valueUs = maxValue;
+    }
+
+    m_buckets[BucketIndex(static_cast<uint64_t>(valueUs))].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t max = m_max.load(std::memory_order_relaxed);
+    while (valueUs > max && !m_max.compare_exchange_weak(max, valueUs, std::memory_order_relaxed))
+    {
+    }
+}
+
+/// <summary>
+/// Finds the value below which a fraction of the recorded values fall
+/// </summary>
+/// <param name="fraction">0..1</param>
+/// <returns>upper bound of the bucket holding the percentile, 0 if empty</returns>
+int64_t CLatencyHistogram::Percentile(double fraction) const
+{
+    uint64_t count = m_count.load(std::memory_order_relaxed);
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(fraction * count + 0.5);
+    if (target < 1)
+    {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < cBucketCount; ++i)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            // Never report more than was actually recorded
+            int64_t bound = BucketUpperBound(i);
+            int64_t max = m_max.load(std::memory_order_relaxed);
+            return (bound < max) ? bound : max;
+        }
+    }
+
+    return m_max.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Reads the percentiles
+/// </summary>
+/// <param name="pSummary">receives the count, p50, p99 and max</param>
+void CLatencyHistogram::GetSummary(LatencySummary* pSummary) const
+{
+    pSummary->count = m_count.load(std::memory_order_relaxed);
+    pSummary->p50Us = Percentile(0.50);
+    pSummary->p99Us = Percentile(0.99);
+    pSummary->maxUs = m_max.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CLatencyTracer::CLatencyTracer() :
+    m_minSensorOffsetUs(0),
+    m_bHaveSensorOffset(false)
+{
+}
+
+/// <summary>
+/// Forgets every recorded value
+/// </summary>
+void CLatencyTracer::Reset()
+{
+    for (int i = 0; i < LATENCY_STAGE_COUNT; ++i)
+    {
+        m_stages[i].Reset();
+    }
+
+    m_bHaveSensorOffset = false;
+}
+
+/// <summary>
+/// Adds the arrival delay of a frame. The sensor clock is unrelated to ours, so the
+/// delay is measured above the quickest frame seen so far. Call from one thread only.
+/// </summary>
+/// <param name="sensorUs">capture time on the sensor clock</param>
+/// <param name="arrivalUs">arrival time on our clock</param>
+void CLatencyTracer::RecordSensor(int64_t sensorUs, int64_t arrivalUs)
+{
+    int64_t offsetUs = arrivalUs - sensorUs;
+    if (!m_bHaveSensorOffset || offsetUs < m_minSensorOffsetUs)
+    {
+        m_minSensorOffsetUs = offsetUs;
+        m_bHaveSensorOffset = true;
+    }
+
+    m_stages[LATENCY_STAGE_SENSOR].Record(offsetUs - m_minSensorOffsetUs);
+}
+
+/// <summary>
+/// Writes a table of every stage
+/// </summary>
+/// <param name="pFile">stream to write to</param>
+void CLatencyTracer::Print(FILE* pFile) const
+{
+    fprintf(pFile, "%-12s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "max us");
+    for (int i = 0; i < LATENCY_STAGE_COUNT; ++i)
+    {
+        LatencySummary summary;
+        GetSummary(static_cast<LatencyStage>(i), &summary);
+        fprintf(pFile, "%-12s %10llu %10lld %10lld %10lld\n", StageName(static_cast<LatencyStage>(i)),
+            static_cast<unsigned long long>(summary.count), static_cast<long long>(summary.p50Us),
+            static_cast<long long>(summary.p99Us), static_cast<long long>(summary.maxUs));
+    }
+}
+
+/// <summary>
+/// Gets the display name of a stage
+/// </summary>
+const char* CLatencyTracer::StageName(LatencyStage stage)
+{
+    static const char* names[LATENCY_STAGE_COUNT] =
+    {
+        "sensor",
+        "fetch",
+        "smoothing",
+        "fusion",
+        "zone space",
+        "detection",
+        "trigger",
+        "audio start",
+        "render",
+        "end to end",
+    };
+
+    return (stage >= 0 && stage < LATENCY_STAGE_COUNT) ? names[stage] : "unknown";
+}
@@ -0,0 +1,151 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="LatencyTracer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include <atomic>
+#include <stdio.h>
+
+// Pipeline stages timed from sensor to speaker
+enum LatencyStage
+{
+    LATENCY_STAGE_SENSOR = 0,       // sensor timestamp to frame arrival, above the quickest frame seen
+    LATENCY_STAGE_FETCH,            // frame arrival to frame copied out of the runtime
+    LATENCY_STAGE_SMOOTHING,        // skeleton smoothing
+    LATENCY_STAGE_FUSION,           // frame of the first sensor arrived to fused with the other sensors'
+    LATENCY_STAGE_ZONE_SPACE,       // hands measured against the shoulder
+    LATENCY_STAGE_DETECTION,        // strike detection, zone test, gating and prediction
+    LATENCY_STAGE_TRIGGER,          // end of detection to triggers queued
+    LATENCY_STAGE_AUDIO_START,      // trigger queued to first sample heard
+    LATENCY_STAGE_RENDER,           // drawing the frame
+    LATENCY_STAGE_END_TO_END,       // frame arrival to first sample heard
+    LATENCY_STAGE_COUNT
+};
+
+/// <summary>
+/// Percentiles of one histogram, in microseconds
+/// </summary>
+struct LatencySummary
+{
+    uint64_t                count;
+    int64_t                 p50Us;
+    int64_t                 p99Us;
+    int64_t                 maxUs;
+};
+
+/// <summary>
+/// Fixed size log-linear histogram of durations, in the style of HdrHistogram.
+/// Values below 32 us are exact, larger ones land in buckets within 1/16 of
+/// their value. Recording is lock-free and safe from any thread.
+/// </summary>
+class CLatencyHistogram
+{
+public:
+    static const int        cSubBucketBits = 4;
+    static const int        cSubBucketCount = 1 << cSubBucketBits;
+    static const int        cMaxValueBits = 31;
+    static const int        cBucketCount = (cMaxValueBits - cSubBucketBits + 1) * cSubBucketCount;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CLatencyHistogram();
+
+    /// <summary>
+    /// Forgets every recorded value
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Adds one duration. Negative durations count as zero, huge ones are clamped.
+    /// </summary>
+    /// <param name="valueUs">duration in microseconds</param>
+    void                    Record(int64_t valueUs);
+
+    /// <summary>
+    /// Reads the percentiles
+    /// </summary>
+    /// <param name="pSummary">receives the count, p50, p99 and max</param>
+    void                    GetSummary(LatencySummary* pSummary) const;
+
+    /// <summary>
+    /// Finds the value below which a fraction of the recorded values fall
+    /// </summary>
+    /// <param name="fraction">0..1</param>
+    /// <returns>upper bound of the bucket holding the percentile, 0 if empty</returns>
+    int64_t                 Percentile(double fraction) const;
+
+    /// <summary>
+    /// Maps a value to its bucket
+    /// </summary>
+    static int              BucketIndex(uint64_t value);
+
+    /// <summary>
+    /// Gets the largest value that maps to a bucket
+    /// </summary>
+    static int64_t          BucketUpperBound(int index);
+
+private:
+    std::atomic<uint64_t>   m_buckets[cBucketCount];
+    std::atomic<uint64_t>   m_count;
+    std::atomic<int64_t>    m_max;
+};
+
+/// <summary>
+/// One histogram per pipeline stage
+/// </summary>
+class CLatencyTracer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CLatencyTracer();
+
+    /// <summary>
+    /// Forgets every recorded value
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Adds the duration of a stage
+    /// </summary>
+    /// <param name="stage">stage that took the time</param>
+    /// <param name="durationUs">duration in microseconds</param>
+    void                    Record(LatencyStage stage, int64_t durationUs) { m_stages[stage].Record(durationUs); }
+
+    /// <summary>
+    /// Adds the arrival delay of a frame. The sensor clock is unrelated to ours, so the
+    /// delay is measured above the quickest frame seen so far. Call from one thread only.
+    /// </summary>
+    /// <param name="sensorUs">capture time on the sensor clock</param>
+    /// <param name="arrivalUs">arrival time on our clock</param>
+    void                    RecordSensor(int64_t sensorUs, int64_t arrivalUs);
+
+    /// <summary>
+    /// Reads the percentiles of a stage
+    /// </summary>
+    /// <param name="stage">stage to read</param>
+    /// <param name="pSummary">receives the count, p50, p99 and max</param>
+    void                    GetSummary(LatencyStage stage, LatencySummary* pSummary) const { m_stages[stage].GetSummary(pSummary); }
+
+    /// <summary>
+    /// Writes a table of every stage
+    /// </summary>
+    /// <param name="pFile">stream to write to</param>
+    void                    Print(FILE* pFile) const;
+
+    /// <summary>
+    /// Gets the display name of a stage
+    /// </summary>
+    static const char*      StageName(LatencyStage stage);
+
+private:
+    CLatencyHistogram       m_stages[LATENCY_STAGE_COUNT];
+    int64_t                 m_minSensorOffsetUs;
+    bool                    m_bHaveSensorOffset;
+};
@@ -0,0 +1,397 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="MidiFile.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "MidiFile.h"
+#include <string.h>
+
+// Offset of the track length field: 14 bytes of MThd, then "MTrk"
+static const long cMidiTrackLengthOffset = 18;
+
+static uint16_t ReadBE16(const unsigned char* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t ReadBE32(const unsigned char* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+static void WriteBE16(unsigned char* p, uint16_t v)
+{
+    p[0] = static_cast<unsigned char>(v >> 8);
+    p[1] = static_cast<unsigned char>(v);
+}
+
+static void WriteBE32(unsigned char* p, uint32_t v)
+{
+    p[0] = static_cast<unsigned char>(v >> 24);
+    p[1] = static_cast<unsigned char>(v >> 16);
+    p[2] = static_cast<unsigned char>(v >> 8);
+    p[3] = static_cast<unsigned char>(v);
+}
+
+/// <summary>
+/// Encodes a variable length quantity, seven bits per byte, most significant first
+/// </summary>
+/// <returns>number of bytes written, at most 4</returns>
+static int WriteVarLen(unsigned char* p, uint32_t value)
+{
+    if (value > 0x0FFFFFFF)
+    {
+        value = 0x0FFFFFFF;
+    }
+
+    unsigned char bytes[4];
+    int count = 0;
+    do
+    {
+        bytes[count++] = static_cast<unsigned char>(value & 0x7F);
+        value >>= 7;
+    } while (0 != value);
+
+    for (int i = 0; i < count; ++i)
+    {
+        p[i] = bytes[count - 1 - i] | ((i < count - 1) ? 0x80 : 0x00);
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Decodes a variable length quantity
+/// </summary>
+/// <returns>false if it runs past the end</returns>
+static bool ReadVarLen(const unsigned char*& p, const unsigned char* pEnd, uint32_t* pValue)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4 && p < pEnd; ++i)
+    {
+        unsigned char byte = *p++;
+        value = (value << 7) | (byte & 0x7F);
+        if (0 == (byte & 0x80))
+        {
+            *pValue = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Number of data bytes that follow a channel message status
+/// </summary>
+static int ChannelDataBytes(uint8_t status)
+{
+    uint8_t type = status & 0xF0;
+    return (0xC0 == type || 0xD0 == type) ? 1 : 2;
+}
+
+/// <summary>
+/// Loads the channel messages of a Standard MIDI File, format 0 or the first track of format 1
+/// </summary>
+/// <param name="szPath">file to load</param>
+/// <param name="events">receives the messages in file order, timed from the start of the file</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT LoadMidiFile(const char* szPath, std::vector<MidiEvent>& events)
+{
+    events.clear();
+
+    FILE* pFile = fopen(szPath, "rb");
+    if (NULL == pFile)
+    {
+        return E_FAIL;
+    }
+
+    std::vector<unsigned char> bytes;
+    unsigned char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), pFile)) > 0)
+    {
+        bytes.insert(bytes.end(), chunk, chunk + read);
+    }
+    fclose(pFile);
+
+    if (bytes.size() < 22 || 0 != memcmp(&bytes[0], "MThd", 4) || ReadBE32(&bytes[4]) < 6)
+    {
+        return E_FAIL;
+    }
+
+    // SMPTE divisions are not used by anything we write
+    uint16_t division = ReadBE16(&bytes[12]);
+    if (0 == division || 0 != (division & 0x8000))
+    {
+        return E_FAIL;
+    }
+
+    size_t pos = 8 + ReadBE32(&bytes[4]);
+    if (pos + 8 > bytes.size() || 0 != memcmp(&bytes[pos], "MTrk", 4))
+    {
+        return E_FAIL;
+    }
+
+    uint32_t trackBytes = ReadBE32(&bytes[pos + 4]);
+    if (pos + 8 + trackBytes > bytes.size())
+    {
+        return E_FAIL;
+    }
+
+    const unsigned char* p = &bytes[pos + 8];
+    const unsigned char* pEnd = p + trackBytes;
+    double tempoUs = 500000.0;
+    double timeUs = 0.0;
+    uint8_t runningStatus = 0;
+    while (p < pEnd)
+    {
+        uint32_t delta;
+        if (!ReadVarLen(p, pEnd, &delta) || p >= pEnd)
+        {
+            return E_FAIL;
+        }
+        timeUs += delta * tempoUs / division;
+
+        uint8_t status = *p;
+        if (0xFF == status)
+        {
+            uint32_t length;
+            uint8_t type = (p + 1 < pEnd) ? p[1] : 0;
+            p += 2;
+            if (!ReadVarLen(p, pEnd, &length) || p + length > pEnd)
+            {
+                return E_FAIL;
+            }
+
+            if (0x51 == type && 3 == length)
+            {
+                tempoUs = static_cast<double>((p[0] << 16) | (p[1] << 8) | p[2]);
+            }
+            else if (0x2F == type)
+            {
+                return S_OK;
+            }
+
+            p += length;
+            continue;
+        }
+
+        if (0xF0 == status || 0xF7 == status)
+        {
+            uint32_t length;
+            ++p;
+            if (!ReadVarLen(p, pEnd, &length) || p + length > pEnd)
+            {
+                return E_FAIL;
+            }
+
+            p += length;
+            continue;
+        }
+
+        if (status & 0x80)
+        {
+            runningStatus = status;
+            ++p;
+        }
+        else if (0 == runningStatus)
+        {
+            return E_FAIL;
+        }
+
+        int dataBytes = ChannelDataBytes(runningStatus);
+        if (p + dataBytes > pEnd)
+        {
+            return E_FAIL;
+        }
+
+        MidiEvent event;
+        event.timeUs = static_cast<int64_t>(timeUs + 0.5);
+        event.frameTimeUs = event.timeUs;
+        event.status = runningStatus;
+        event.data1 = p[0];
+        event.data2 = (2 == dataBytes) ? p[1] : 0;
+        events.push_back(event);
+        p += dataBytes;
+    }
+
+    // A track has to end with its end of track event
+    return E_FAIL;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CMidiFileWriter::CMidiFileWriter() :
+    m_pFile(NULL),
+    m_trackBytes(0),
+    m_bStarted(false),
+    m_originUs(0),
+    m_lastTick(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CMidiFileWriter::~CMidiFileWriter()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates the file and writes the header and tempo
+/// </summary>
+/// <param name="szPath">file to create</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiFileWriter::Open(const char* szPath)
+{
+    Close();
+
+    m_pFile = fopen(szPath, "wb");
+    if (NULL == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    // Format 0, one track; the track length is patched on close
+    unsigned char header[22];
+    memcpy(header, "MThd", 4);
+    WriteBE32(header + 4, 6);
+    WriteBE16(header + 8, 0);
+    WriteBE16(header + 10, 1);
+    WriteBE16(header + 12, cMidiFileDivision);
+    memcpy(header + 14, "MTrk", 4);
+    WriteBE32(header + 18, 0);
+
+    m_trackBytes = 0;
+    m_bStarted = false;
+    m_originUs = 0;
+    m_lastTick = 0;
+    if (fwrite(header, 1, sizeof(header), m_pFile) != sizeof(header))
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    const unsigned char tempo[] =
+    {
+        0x00, 0xFF, 0x51, 0x03,
+        static_cast<unsigned char>(cMidiFileTempoUs >> 16),
+        static_cast<unsigned char>(cMidiFileTempoUs >> 8),
+        static_cast<unsigned char>(cMidiFileTempoUs)
+    };
+
+    HRESULT hr = WriteTrack(tempo, sizeof(tempo));
+    if (FAILED(hr))
+    {
+        Close();
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Appends messages. The first message ever written is at the start of the file;
+/// messages earlier than the one before them are moved up to it.
+/// </summary>
+/// <param name="pEvents">messages in time order</param>
+/// <param name="count">number of messages</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiFileWriter::Write(const MidiEvent* pEvents, int count)
+{
+    if (NULL == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    if (count > 0 && !m_bStarted)
+    {
+        m_originUs = pEvents[0].timeUs;
+        m_bStarted = true;
+    }
+
+    static const int64_t usPerTick = cMidiFileTempoUs / cMidiFileDivision;
+
+    unsigned char buffer[512];
+    uint32_t used = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const MidiEvent& event = pEvents[i];
+        int64_t sinceOriginUs = event.timeUs - m_originUs;
+        uint64_t tick = (sinceOriginUs > 0) ? static_cast<uint64_t>((sinceOriginUs + usPerTick / 2) / usPerTick) : 0;
+        if (tick < m_lastTick)
+        {
+            tick = m_lastTick;
+        }
+
+        used += WriteVarLen(buffer + used, static_cast<uint32_t>(tick - m_lastTick));
+        buffer[used++] = event.status;
+        buffer[used++] = event.data1 & 0x7F;
+        if (2 == ChannelDataBytes(event.status))
+        {
+            buffer[used++] = event.data2 & 0x7F;
+        }
+        m_lastTick = tick;
+
+        // Room for another event: four bytes of delta and three of message
+        if (used + 7 > sizeof(buffer))
+        {
+            HRESULT hr = WriteTrack(buffer, used);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+            used = 0;
+        }
+    }
+
+    return WriteTrack(buffer, used);
+}
+
+/// <summary>
+/// Ends the track, patches its length and closes the file
+/// </summary>
+void CMidiFileWriter::Close()
+{
+    if (NULL == m_pFile)
+    {
+        return;
+    }
+
+    const unsigned char endOfTrack[] = { 0x00, 0xFF, 0x2F, 0x00 };
+    WriteTrack(endOfTrack, sizeof(endOfTrack));
+
+    unsigned char size[4];
+    WriteBE32(size, m_trackBytes);
+    fseek(m_pFile, cMidiTrackLengthOffset, SEEK_SET);
+    fwrite(size, 1, 4, m_pFile);
+
+    fclose(m_pFile);
+    m_pFile = NULL;
+}
+
+/// <summary>
+/// Appends bytes to the track
+/// </summary>
+/// <param name="pBytes">bytes to append</param>
+/// <param name="count">number of bytes</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiFileWriter::WriteTrack(const unsigned char* pBytes, uint32_t count)
+{
+    if (0 == count)
+    {
+        return S_OK;
+    }
+
+    if (fwrite(pBytes, 1, count, m_pFile) != count)
+    {
+        return E_FAIL;
+    }
+
+    m_trackBytes += count;
+    return S_OK;
+}
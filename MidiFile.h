@@ -0,0 +1,92 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="MidiFile.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Standard MIDI Files, format 0. Files are written at 120 bpm with 1000 ticks
+// per quarter note, so one tick is 500 us.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include <stdio.h>
+#include <vector>
+
+static const uint16_t cMidiFileDivision = 1000;        // ticks per quarter note
+static const uint32_t cMidiFileTempoUs  = 500000;      // microseconds per quarter note
+
+/// <summary>
+/// One timestamped channel message
+/// </summary>
+struct MidiEvent
+{
+    int64_t                 timeUs;             // when the message takes effect, on the frame clock
+    int64_t                 frameTimeUs;        // capture time of the frame that produced it
+    uint8_t                 status;
+    uint8_t                 data1;
+    uint8_t                 data2;
+};
+
+/// <summary>
+/// Loads the channel messages of a Standard MIDI File, format 0 or the first track of format 1
+/// </summary>
+/// <param name="szPath">file to load</param>
+/// <param name="events">receives the messages in file order, timed from the start of the file; frameTimeUs is not stored and reads back as timeUs</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT LoadMidiFile(const char* szPath, std::vector<MidiEvent>& events);
+
+/// <summary>
+/// Writes channel messages to a format 0 Standard MIDI File
+/// </summary>
+class CMidiFileWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CMidiFileWriter();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CMidiFileWriter();
+
+    /// <summary>
+    /// Creates the file and writes the header and tempo
+    /// </summary>
+    /// <param name="szPath">file to create</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// <summary>
+    /// Appends messages. The first message ever written is at the start of the file;
+    /// messages earlier than the one before them are moved up to it.
+    /// </summary>
+    /// <param name="pEvents">messages in time order</param>
+    /// <param name="count">number of messages</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Write(const MidiEvent* pEvents, int count);
+
+    /// <summary>
+    /// Ends the track, patches its length and closes the file
+    /// </summary>
+    void                    Close();
+
+    /// <summary>
+    /// Checks whether a file is open
+    /// </summary>
+    bool                    IsOpen() const { return NULL != m_pFile; }
+
+private:
+    FILE*                   m_pFile;
+    uint32_t                m_trackBytes;
+    bool                    m_bStarted;
+    int64_t                 m_originUs;
+    uint64_t                m_lastTick;
+
+    /// <summary>
+    /// Appends bytes to the track
+    /// </summary>
+    HRESULT                 WriteTrack(const unsigned char* pBytes, uint32_t count);
+};
@@ -0,0 +1,559 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="MidiOutput.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "MidiOutput.h"
+#include "DrumTrace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// General MIDI percussion key map, in DrumPiece order
+static const uint8_t g_DrumPieceMidiNotes[DRUM_PIECE_COUNT] =
+{
+    38,     // acoustic snare
+    42,     // closed hi-hat
+    49,     // crash cymbal 1
+    51,     // ride cymbal 1
+    48,     // hi-mid tom
+    45,     // low tom
+    36,     // bass drum 1
+    44,     // pedal hi-hat, also closes a ringing open hi-hat on General MIDI synths
+    46,     // open hi-hat
+};
+
+/// <summary>
+/// Gets the General MIDI percussion note of a kit piece
+/// </summary>
+/// <param name="piece">kit piece</param>
+/// <returns>note number, 38 snare, 42 closed hi-hat, 49 crash, 51 ride, 48 high tom, 45 low tom,
+/// 36 kick, 44 pedal hi-hat, 46 open hi-hat</returns>
+uint8_t DrumPieceMidiNote(DrumPiece piece)
+{
+    return (piece >= 0 && piece < DRUM_PIECE_COUNT) ? g_DrumPieceMidiNotes[piece] : g_DrumPieceMidiNotes[DRUM_PIECE_SNARE];
+}
+
+/// <summary>
+/// Turns a hit velocity from hand speed into a note velocity
+/// </summary>
+/// <param name="hitVelocity">0..1</param>
+/// <returns>1..127</returns>
+uint8_t DrumMidiVelocity(float hitVelocity)
+{
+    int velocity = static_cast<int>(1.0f + hitVelocity * 126.0f + 0.5f);
+    return static_cast<uint8_t>((velocity < 1) ? 1 : (velocity > 127) ? 127 : velocity);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CMidiPortOutput::CMidiPortOutput() :
+#ifdef _WIN32
+    m_hMidiOut(NULL)
+#else
+    m_fd(-1)
+#endif
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CMidiPortOutput::~CMidiPortOutput()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+/// <summary>
+/// Opens the port
+/// </summary>
+/// <param name="szName">device number, or part of the device name</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiPortOutput::Open(const char* szName)
+{
+    Close();
+
+    char* pEnd = NULL;
+    unsigned long index = strtoul(szName, &pEnd, 10);
+    UINT deviceId = static_cast<UINT>(index);
+    if (pEnd == szName || '\0' != *pEnd)
+    {
+        deviceId = static_cast<UINT>(-1);
+        UINT deviceCount = midiOutGetNumDevs();
+        for (UINT i = 0; i < deviceCount; ++i)
+        {
+            MIDIOUTCAPSA caps;
+            if (MMSYSERR_NOERROR == midiOutGetDevCapsA(i, &caps, sizeof(caps)) && NULL != strstr(caps.szPname, szName))
+            {
+                deviceId = i;
+                break;
+            }
+        }
+
+        if (static_cast<UINT>(-1) == deviceId)
+        {
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        }
+    }
+
+    HMIDIOUT hMidiOut = NULL;
+    MMRESULT result = midiOutOpen(&hMidiOut, deviceId, 0, 0, CALLBACK_NULL);
+    if (MMSYSERR_NOERROR != result)
+    {
+        return E_FAIL;
+    }
+
+    m_hMidiOut = hMidiOut;
+    return S_OK;
+}
+
+/// <summary>
+/// Silences every note and closes the port
+/// </summary>
+void CMidiPortOutput::Close()
+{
+    if (NULL != m_hMidiOut)
+    {
+        midiOutReset(static_cast<HMIDIOUT>(m_hMidiOut));
+        midiOutClose(static_cast<HMIDIOUT>(m_hMidiOut));
+        m_hMidiOut = NULL;
+    }
+}
+
+/// <summary>
+/// Sends a batch of messages
+/// </summary>
+/// <param name="pEvents">messages in time order</param>
+/// <param name="count">number of messages</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiPortOutput::Write(const MidiEvent* pEvents, int count)
+{
+    if (NULL == m_hMidiOut)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = S_OK;
+    for (int i = 0; i < count; ++i)
+    {
+        DWORD message = pEvents[i].status | (pEvents[i].data1 << 8) | (pEvents[i].data2 << 16);
+        if (MMSYSERR_NOERROR != midiOutShortMsg(static_cast<HMIDIOUT>(m_hMidiOut), message))
+        {
+            hr = E_FAIL;
+        }
+    }
+
+    return hr;
+}
+
+#else
+
+/// <summary>
+/// Opens the port
+/// </summary>
+/// <param name="szName">path of a raw MIDI device or pipe</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiPortOutput::Open(const char* szName)
+{
+    Close();
+
+    m_fd = open(szName, O_WRONLY | O_NOCTTY);
+    return (m_fd >= 0) ? S_OK : E_FAIL;
+}
+
+/// <summary>
+/// Silences every note and closes the port
+/// </summary>
+void CMidiPortOutput::Close()
+{
+    if (m_fd >= 0)
+    {
+        // All notes off on the drum channel
+        const unsigned char allNotesOff[] = { static_cast<unsigned char>(0xB0 | cMidiDrumChannel), 123, 0 };
+        ssize_t written = write(m_fd, allNotesOff, sizeof(allNotesOff));
+        (void)written;
+
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+/// <summary>
+/// Sends a batch of messages
+/// </summary>
+/// <param name="pEvents">messages in time order</param>
+/// <param name="count">number of messages</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiPortOutput::Write(const MidiEvent* pEvents, int count)
+{
+    if (m_fd < 0)
+    {
+        return E_FAIL;
+    }
+
+    unsigned char buffer[3 * CMidiTriggerSink::cMaxPending];
+    int used = 0;
+    for (int i = 0; i < count && used + 3 <= static_cast<int>(sizeof(buffer)); ++i)
+    {
+        buffer[used++] = pEvents[i].status;
+        buffer[used++] = pEvents[i].data1 & 0x7F;
+        buffer[used++] = pEvents[i].data2 & 0x7F;
+    }
+
+    int offset = 0;
+    while (offset < used)
+    {
+        ssize_t written = write(m_fd, buffer + offset, used - offset);
+        if (written < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            return E_FAIL;
+        }
+
+        offset += static_cast<int>(written);
+    }
+
+    return S_OK;
+}
+
+#endif
+
+/// <summary>
+/// Constructor
+/// </summary>
+CMidiTriggerSink::CMidiTriggerSink() :
+    m_pOutput(NULL),
+    m_sensorLatencyUs(0),
+    m_running(false),
+    m_queued(0),
+    m_taken(0),
+    m_pendingCount(0),
+    m_latestFrameUs(0),
+    m_notes(0),
+    m_cancelled(0),
+    m_dropped(0),
+    m_batches(0),
+    m_failed(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CMidiTriggerSink::~CMidiTriggerSink()
+{
+    Stop();
+}
+
+/// <summary>
+/// Starts the sink's thread
+/// </summary>
+/// <param name="pOutput">where the messages go, must outlive the sink or Stop</param>
+/// <param name="sensorLatencyUs">paced outputs only: delay between a hand moving and its frame arriving, taken off predicted note times</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CMidiTriggerSink::Start(IMidiOutput* pOutput, int64_t sensorLatencyUs)
+{
+    if (NULL == pOutput)
+    {
+        return E_POINTER;
+    }
+
+    Stop();
+
+    // Anything queued while stopped belongs to nobody
+    Request stale;
+    while (m_queue.Pop(stale))
+    {
+    }
+
+    m_pOutput = pOutput;
+    m_sensorLatencyUs = sensorLatencyUs;
+    m_queued = 0;
+    m_taken = 0;
+    m_pendingCount = 0;
+    m_latestFrameUs = INT64_MIN;
+    m_notes = 0;
+    m_cancelled = 0;
+    m_dropped = 0;
+    m_batches = 0;
+    m_failed = 0;
+
+    m_running = true;
+    m_thread = std::thread(&CMidiTriggerSink::ThreadProc, this);
+    return S_OK;
+}
+
+/// <summary>
+/// Sends every note still held back, closes the open notes and joins the thread
+/// </summary>
+void CMidiTriggerSink::Stop()
+{
+    m_running = false;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+/// <summary>
+/// Queues one trigger for the sink's thread
+/// </summary>
+/// <param name="trigger">what the engine detected or predicted</param>
+void CMidiTriggerSink::Trigger(const DrumHitTrigger& trigger)
+{
+    // General MIDI synths choke the open hi-hat on the pedal note themselves
+    if ((DRUM_TRIGGER_CANCEL != trigger.type && trigger.piece < 0) || DRUM_TRIGGER_CHOKE == trigger.type)
+    {
+        return;
+    }
+
+    Request request;
+    request.type = trigger.type;
+    request.note = (trigger.piece >= 0) ? DrumPieceMidiNote(static_cast<DrumPiece>(trigger.piece)) : 0;
+    request.velocity = DrumMidiVelocity(trigger.hitVelocity);
+    request.ticket = trigger.ticket;
+    request.timeUs = trigger.timeUs;
+    request.frameTimeUs = trigger.timeUs - trigger.leadUs;
+    request.queuedUs = DrumGetTimeMicroseconds();
+
+    if (m_queue.Push(request))
+    {
+        m_queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/// <summary>
+/// Reads the counters
+/// </summary>
+/// <param name="pStats">receives the counters</param>
+void CMidiTriggerSink::GetStats(MidiSinkStats* pStats) const
+{
+    if (NULL == pStats)
+    {
+        return;
+    }
+
+    pStats->notes = m_notes.load(std::memory_order_relaxed);
+    pStats->cancelled = m_cancelled.load(std::memory_order_relaxed);
+    pStats->dropped = m_dropped.load(std::memory_order_relaxed);
+    pStats->batches = m_batches.load(std::memory_order_relaxed);
+    pStats->failed = m_failed.load(std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Sink thread body
+/// </summary>
+void CMidiTriggerSink::ThreadProc()
+{
+    CDrumTraceThreadScope trace;
+    bool paced = m_pOutput->IsPaced();
+
+    while (m_running)
+    {
+        int drained = Drain();
+
+        // A file gets a note once no later frame can cancel it or land a stroke before it, a port once it is due
+        Release(ReleaseUntilUs(paced));
+
+        // Keep up with a detector running faster than real time; otherwise batch what a period brings
+        if (0 == drained)
+        {
+            DrumSleepMicroseconds(cBatchPeriodUs);
+        }
+    }
+
+    // Everything still queued or held goes out now
+    while (Drain() > 0)
+    {
+        Release(ReleaseUntilUs(paced));
+    }
+    Release(INT64_MAX);
+}
+
+/// <summary>
+/// Moves queued requests into the pending messages, no more than half of them at a time
+/// so the pending ones can be released before they fill up
+/// </summary>
+/// <returns>number of requests taken from the queue</returns>
+int CMidiTriggerSink::Drain()
+{
+    bool paced = m_pOutput->IsPaced();
+    int drained = 0;
+
+    Request request;
+    while (drained < cMaxPending / 2 && m_queue.Pop(request))
+    {
+        ++drained;
+
+        if (request.frameTimeUs > m_latestFrameUs)
+        {
+            m_latestFrameUs = request.frameTimeUs;
+        }
+
+        if (DRUM_TRIGGER_CANCEL == request.type)
+        {
+            // Like the mixer, a note that has started by the cancelling frame is left alone
+            for (int i = 0; i < m_pendingCount; ++i)
+            {
+                Pending& pending = m_pending[i];
+                if (request.ticket == pending.ticket && (paced || pending.event.timeUs > request.timeUs))
+                {
+                    m_pending[i] = m_pending[--m_pendingCount];
+                    m_cancelled.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        MidiEvent event;
+        event.timeUs = request.timeUs;
+        event.frameTimeUs = request.frameTimeUs;
+        event.status = cMidiNoteOn | cMidiDrumChannel;
+        event.data1 = request.note;
+        event.data2 = request.velocity;
+
+        int64_t dueUs = request.timeUs;
+        if (paced)
+        {
+            // Same clock move as the mixer's scheduled samples
+            int64_t leadUs = request.timeUs - request.frameTimeUs;
+            dueUs = request.queuedUs + ((leadUs > 0) ? leadUs - m_sensorLatencyUs : 0);
+            dueUs = (dueUs < request.queuedUs) ? request.queuedUs : dueUs;
+        }
+
+        Hold(event, dueUs, (DRUM_TRIGGER_SCHEDULE == request.type) ? request.ticket : 0);
+    }
+
+    m_taken.fetch_add(drained, std::memory_order_relaxed);
+    return drained;
+}
+
+/// <summary>
+/// Adds a message to the pending ones
+/// </summary>
+/// <param name="event">message to send</param>
+/// <param name="dueUs">when to send it</param>
+/// <param name="ticket">nonzero if a cancel may still withdraw it</param>
+void CMidiTriggerSink::Hold(const MidiEvent& event, int64_t dueUs, uint32_t ticket)
+{
+    if (m_pendingCount >= cMaxPending)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Pending& pending = m_pending[m_pendingCount++];
+    pending.event = event;
+    pending.dueUs = dueUs;
+    pending.ticket = ticket;
+}
+
+/// <summary>
+/// Gets the time Release may send up to: now for a paced output, otherwise the latest frame
+/// less the longest a stroke can land late, or nothing before the first frame
+/// </summary>
+/// <param name="paced">whether the output plays messages as they are sent</param>
+/// <returns>latest due time to send</returns>
+int64_t CMidiTriggerSink::ReleaseUntilUs(bool paced) const
+{
+    if (paced)
+    {
+        return DrumGetTimeMicroseconds();
+    }
+
+    // m_latestFrameUs is INT64_MIN until a frame arrives, and the subtraction would overflow
+    return (m_latestFrameUs < INT64_MIN + cStrikeMaxLateUs) ? INT64_MIN : m_latestFrameUs - cStrikeMaxLateUs;
+}
+
+/// <summary>
+/// Sends every pending message due by a time, oldest first, as one batch
+/// </summary>
+/// <param name="untilUs">latest due time to send</param>
+void CMidiTriggerSink::Release(int64_t untilUs)
+{
+    int batchCount = 0;
+    for (;;)
+    {
+        // Few notes are ever pending, a scan beats keeping them sorted; note offs go first on a tie
+        int next = -1;
+        for (int i = 0; i < m_pendingCount; ++i)
+        {
+            const Pending& pending = m_pending[i];
+            if (pending.dueUs > untilUs)
+            {
+                continue;
+            }
+
+            if (next < 0 || pending.dueUs < m_pending[next].dueUs ||
+                (pending.dueUs == m_pending[next].dueUs && pending.event.status < m_pending[next].event.status))
+            {
+                next = i;
+            }
+        }
+
+        if (next < 0)
+        {
+            break;
+        }
+
+        Pending released = m_pending[next];
+        m_pending[next] = m_pending[--m_pendingCount];
+
+        if (batchCount == cMaxPending)
+        {
+            SendBatch(batchCount);
+            batchCount = 0;
+        }
+        m_batch[batchCount++] = released.event;
+
+        // Every note on gets its note off
+        if ((released.event.status & 0xF0) == cMidiNoteOn)
+        {
+            m_notes.fetch_add(1, std::memory_order_relaxed);
+
+            MidiEvent off = released.event;
+            off.timeUs += cMidiNoteLengthUs;
+            off.status = cMidiNoteOff | cMidiDrumChannel;
+            off.data2 = 0;
+            Hold(off, released.dueUs + cMidiNoteLengthUs, 0);
+        }
+    }
+
+    if (batchCount > 0)
+    {
+        SendBatch(batchCount);
+    }
+}
+
+/// <summary>
+/// Writes the batched messages to the output
+/// </summary>
+/// <param name="count">number of messages in the batch</param>
+void CMidiTriggerSink::SendBatch(int count)
+{
+    bool failed = FAILED(m_pOutput->Write(m_batch, count));
+    m_failed.fetch_add(failed ? 1 : 0, std::memory_order_relaxed);
+    m_batches.fetch_add(1, std::memory_order_relaxed);
+    DRUM_TRACE(DRUM_TRACE_MIDI_BATCH, 0, count, failed ? 1 : 0, 0.0f, 0.0f);
+}
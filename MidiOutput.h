@@ -0,0 +1,269 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="MidiOutput.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Drives external synths and sequencers: every stroke becomes a General MIDI
+// drum note on channel 10, written to a Standard MIDI File or a local port.
+
+#pragma once
+
+#include "DrumEngine.h"
+#include "BoundedQueue.h"
+#include "MidiFile.h"
+#include <atomic>
+#include <thread>
+
+static const uint8_t cMidiDrumChannel   = 9;            // channel 10 counted from 1
+static const uint8_t cMidiNoteOn        = 0x90;
+static const uint8_t cMidiNoteOff       = 0x80;
+static const int64_t cMidiNoteLengthUs  = 50000;        // drum notes are one shots, the note off only closes them
+
+/// <summary>
+/// Gets the General MIDI percussion note of a kit piece
+/// </summary>
+/// <param name="piece">kit piece</param>
+/// <returns>note number, 38 snare, 42 closed hi-hat, 49 crash, 51 ride, 48 high tom, 45 low tom,
+/// 36 kick, 44 pedal hi-hat, 46 open hi-hat</returns>
+uint8_t DrumPieceMidiNote(DrumPiece piece);
+
+/// <summary>
+/// Turns a hit velocity from hand speed into a note velocity
+/// </summary>
+/// <param name="hitVelocity">0..1</param>
+/// <returns>1..127</returns>
+uint8_t DrumMidiVelocity(float hitVelocity);
+
+/// <summary>
+/// Destination for MIDI messages. Messages are handed over in batches from the
+/// MIDI sink's own thread, never from the detection thread.
+/// </summary>
+class IMidiOutput
+{
+public:
+    virtual ~IMidiOutput() {}
+
+    /// <summary>
+    /// Gets whether messages go out when they are due on the wall clock instead of as soon as they are final
+    /// </summary>
+    virtual bool            IsPaced() const = 0;
+
+    /// <summary>
+    /// Sends a batch of messages
+    /// </summary>
+    /// <param name="pEvents">messages in time order</param>
+    /// <param name="count">number of messages</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    virtual HRESULT         Write(const MidiEvent* pEvents, int count) = 0;
+};
+
+/// <summary>
+/// Output to a Standard MIDI File, timed by the frame timestamps
+/// </summary>
+class CMidiFileOutput : public IMidiOutput
+{
+public:
+    /// <summary>
+    /// Creates the file
+    /// </summary>
+    /// <param name="szPath">file to create</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szPath) { return m_writer.Open(szPath); }
+
+    /// <summary>
+    /// Finishes the file
+    /// </summary>
+    void                    Close() { m_writer.Close(); }
+
+    virtual bool            IsPaced() const { return false; }
+    virtual HRESULT         Write(const MidiEvent* pEvents, int count) { return m_writer.Write(pEvents, count); }
+
+private:
+    CMidiFileWriter         m_writer;
+};
+
+/// <summary>
+/// Output to a local MIDI port, such as a loopback port a DAW listens on. On Windows
+/// this is a midiOut device, elsewhere a raw MIDI device or pipe such as /dev/snd/midiC1D0.
+/// </summary>
+class CMidiPortOutput : public IMidiOutput
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CMidiPortOutput();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~CMidiPortOutput();
+
+    /// <summary>
+    /// Opens the port
+    /// </summary>
+    /// <param name="szName">Windows: device number, or part of the device name; elsewhere: path of the device</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szName);
+
+    /// <summary>
+    /// Silences every note and closes the port
+    /// </summary>
+    void                    Close();
+
+    virtual bool            IsPaced() const { return true; }
+    virtual HRESULT         Write(const MidiEvent* pEvents, int count);
+
+private:
+#ifdef _WIN32
+    void*                   m_hMidiOut;         // HMIDIOUT
+#else
+    int                     m_fd;
+#endif
+};
+
+/// <summary>
+/// Counters of the MIDI sink since it was started
+/// </summary>
+struct MidiSinkStats
+{
+    uint64_t                notes;              // note ons sent
+    uint64_t                cancelled;          // scheduled notes withdrawn before they were sent
+    uint64_t                dropped;            // triggers lost because the queue or the pending notes were full
+    uint64_t                batches;
+    uint64_t                failed;             // batches the output did not take
+};
+
+/// <summary>
+/// Trigger sink that plays the kit on an IMidiOutput. Trigger only copies the
+/// request into a lock-free queue, so it never allocates, locks or waits; the
+/// sink's thread turns requests into note on/off pairs, holds scheduled notes
+/// until they can no longer be cancelled, and sends them out in batches.
+/// </summary>
+class CMidiTriggerSink : public IDrumTriggerSink
+{
+public:
+    static const uint32_t   cQueueCapacity  = 1024;
+    static const int        cMaxPending     = 256;
+    static const int64_t    cBatchPeriodUs  = 1000;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CMidiTriggerSink();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    virtual ~CMidiTriggerSink();
+
+    /// <summary>
+    /// Starts the sink's thread
+    /// </summary>
+    /// <param name="pOutput">where the messages go, must outlive the sink or Stop</param>
+    /// <param name="sensorLatencyUs">paced outputs only: delay between a hand moving and its frame arriving, taken off predicted note times</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Start(IMidiOutput* pOutput, int64_t sensorLatencyUs);
+
+    /// <summary>
+    /// Sends every note still held back, closes the open notes and joins the thread
+    /// </summary>
+    void                    Stop();
+
+    /// <summary>
+    /// Queues one trigger for the sink's thread
+    /// </summary>
+    /// <param name="trigger">what the engine detected or predicted</param>
+    virtual void            Trigger(const DrumHitTrigger& trigger);
+
+    /// <summary>
+    /// Reads the counters
+    /// </summary>
+    /// <param name="pStats">receives the counters</param>
+    void                    GetStats(MidiSinkStats* pStats) const;
+
+    /// <summary>
+    /// Gets the number of triggers queued but not yet taken by the sink's thread. A driver
+    /// running faster than real time can back off on it instead of losing notes.
+    /// </summary>
+    uint64_t                Backlog() const { return m_queued.load(std::memory_order_relaxed) - m_taken.load(std::memory_order_relaxed); }
+
+private:
+    /// <summary>
+    /// Trigger as queued from the detection thread
+    /// </summary>
+    struct Request
+    {
+        DrumHitTriggerType  type;
+        uint8_t             note;
+        uint8_t             velocity;
+        uint32_t            ticket;
+        int64_t             timeUs;
+        int64_t             frameTimeUs;
+        int64_t             queuedUs;           // wall clock when the trigger was queued
+    };
+
+    /// <summary>
+    /// Message held by the sink's thread until it is due
+    /// </summary>
+    struct Pending
+    {
+        MidiEvent           event;
+        int64_t             dueUs;              // wall clock for paced outputs, frame clock otherwise
+        uint32_t            ticket;             // nonzero while the note can still be cancelled
+    };
+
+    IMidiOutput*            m_pOutput;
+    int64_t                 m_sensorLatencyUs;
+    std::thread             m_thread;
+    std::atomic<bool>       m_running;
+    CBoundedQueue<Request, cQueueCapacity> m_queue;
+    std::atomic<uint64_t>   m_queued;
+    std::atomic<uint64_t>   m_taken;
+
+    // Owned by the sink's thread
+    Pending                 m_pending[cMaxPending];
+    int                     m_pendingCount;
+    int64_t                 m_latestFrameUs;
+    MidiEvent               m_batch[cMaxPending];
+
+    std::atomic<uint64_t>   m_notes;
+    std::atomic<uint64_t>   m_cancelled;
+    std::atomic<uint64_t>   m_dropped;
+    std::atomic<uint64_t>   m_batches;
+    std::atomic<uint64_t>   m_failed;
+
+    /// <summary>
+    /// Sink thread body
+    /// </summary>
+    void                    ThreadProc();
+
+    /// <summary>
+    /// Moves queued requests into the pending messages, no more than half of them at a time
+    /// </summary>
+    /// <returns>number of requests taken from the queue</returns>
+    int                     Drain();
+
+    /// <summary>
+    /// Adds a message to the pending ones
+    /// </summary>
+    void                    Hold(const MidiEvent& event, int64_t dueUs, uint32_t ticket);
+
+    /// <summary>
+    /// Sends every pending message due by a time, oldest first, as one batch
+    /// </summary>
+    void                    Release(int64_t untilUs);
+
+    /// <summary>
+    /// Gets the time Release may send up to: now for a paced output, otherwise the latest frame
+    /// less the longest a stroke can land late, or nothing before the first frame
+    /// </summary>
+    int64_t                 ReleaseUntilUs(bool paced) const;
+
+    /// <summary>
+    /// Writes the batched messages to the output
+    /// </summary>
+    /// <param name="count">number of messages in the batch</param>
+    void                    SendBatch(int count);
+};
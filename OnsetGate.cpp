@@ -0,0 +1,174 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="OnsetGate.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "OnsetGate.h"
+
+// Far enough in the past that the first stroke is never too soon
+static const int64_t g_NeverStruckUs = INT64_MIN / 2;
+
+/// <summary>
+/// Constructor
+/// </summary>
+COnsetGate::COnsetGate() :
+    m_params(DefaultParams())
+{
+    Reset();
+}
+
+/// <summary>
+/// Gets the default tuning
+/// </summary>
+OnsetGateParams COnsetGate::DefaultParams()
+{
+    OnsetGateParams params;
+    params.exitMargin = 0.035f;
+    params.exitDepthMargin = 0.0125f;
+    params.riseMargin = 0.05f;
+    params.minRestrikeUs = 60000;
+    params.flamWindowUs = 15000;
+    return params;
+}
+
+/// <summary>
+/// Re-arms every zone, e.g. when the skeleton stops being tracked or the kit changes
+/// </summary>
+void COnsetGate::Reset()
+{
+    for (int h = 0; h < 2; ++h)
+    {
+        m_latched[h].Clear();
+        for (int i = 0; i < cDrumZoneMaxCount; ++i)
+        {
+            m_strikeY[h][i] = 0.0f;
+            m_lastStrikeUs[h][i] = g_NeverStruckUs;
+        }
+    }
+
+    m_suppressed = 0;
+}
+
+/// <summary>
+/// Runs the state machine for one frame. Constant memory, no allocation.
+/// </summary>
+/// <param name="zones">kit layout</param>
+/// <param name="left">left hand</param>
+/// <param name="right">right hand</param>
+/// <param name="leftVelocity">hit velocity of the left hand</param>
+/// <param name="rightVelocity">hit velocity of the right hand</param>
+/// <param name="timeUs">time the frame was captured</param>
+/// <param name="pOnsets">receives the onsets, in zone order</param>
+/// <param name="maxOnsets">capacity of pOnsets</param>
+/// <returns>number of onsets written</returns>
+int COnsetGate::Process(const CDrumZoneTable& zones, const DrumHandInput& left, const DrumHandInput& right,
+                        float leftVelocity, float rightVelocity, int64_t timeUs, DrumOnset* pOnsets, int maxOnsets)
+{
+    const DrumHandInput* hands[2] = { &left, &right };
+    const float velocities[2] = { leftVelocity, rightVelocity };
+
+    // Latched -> re-armed: the hand left the grown zone or rose above where it struck
+    uint64_t anyLatched = 0;
+    for (int w = 0; w < cDrumZoneMaskWords; ++w)
+    {
+        anyLatched |= m_latched[0].bits[w] | m_latched[1].bits[w];
+    }
+
+    if (0 != anyLatched)
+    {
+        DrumZoneHits inside;
+        zones.OccupancyTest(left, right, m_params.exitMargin, m_params.exitDepthMargin, &inside);
+        const DrumZoneMask* insideMasks[2] = { &inside.left, &inside.right };
+
+        for (int h = 0; h < 2; ++h)
+        {
+            for (int w = 0; w < cDrumZoneMaskWords; ++w)
+            {
+                uint64_t bits = m_latched[h].bits[w];
+                while (0 != bits)
+                {
+                    const int zone = (w << 6) + DrumLowestBit(bits);
+                    bits &= bits - 1;
+
+                    if (!insideMasks[h]->Test(zone) || hands[h]->y < m_strikeY[h][zone] - m_params.riseMargin)
+                    {
+                        m_latched[h].Clear(zone);
+                    }
+                }
+            }
+        }
+    }
+
+    // Armed -> struck
+    DrumZoneHits hits;
+    zones.HitTest(left, right, &hits);
+    const DrumZoneMask* hitMasks[2] = { &hits.left, &hits.right };
+
+    int count = 0;
+    for (int w = 0; w < cDrumZoneMaskWords; ++w)
+    {
+        uint64_t struck = hits.left.bits[w] | hits.right.bits[w];
+        while (0 != struck)
+        {
+            const int zone = (w << 6) + DrumLowestBit(struck);
+            struck &= struck - 1;
+
+            DrumOnset onset;
+            onset.zone = zone;
+            onset.hands = 0;
+            onset.timeUs = timeUs;
+            onset.hitVelocity = 0.0f;
+            onset.flam = false;
+
+            // Set when the other hand sounded this zone moments ago, so this stroke is its flam partner
+            bool partnerSounded = false;
+
+            for (int h = 0; h < 2; ++h)
+            {
+                if (!hitMasks[h]->Test(zone))
+                {
+                    continue;
+                }
+
+                if (m_latched[h].Test(zone) || timeUs - m_lastStrikeUs[h][zone] < m_params.minRestrikeUs)
+                {
+                    ++m_suppressed;
+                    continue;
+                }
+
+                const int other = 1 - h;
+                if (timeUs != m_lastStrikeUs[other][zone] && timeUs - m_lastStrikeUs[other][zone] < m_params.flamWindowUs)
+                {
+                    partnerSounded = true;
+                }
+
+                m_latched[h].Set(zone);
+                m_strikeY[h][zone] = hands[h]->y;
+                m_lastStrikeUs[h][zone] = timeUs;
+
+                onset.hands |= (0 == h) ? DRUM_HAND_LEFT : DRUM_HAND_RIGHT;
+                if (velocities[h] > onset.hitVelocity)
+                {
+                    onset.hitVelocity = velocities[h];
+                }
+            }
+
+            if (DRUM_HAND_BOTH == onset.hands)
+            {
+                onset.flam = true;
+            }
+
+            if (partnerSounded)
+            {
+                ++m_suppressed;
+            }
+            else if (0 != onset.hands && count < maxOnsets)
+            {
+                pOnsets[count++] = onset;
+            }
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,122 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="OnsetGate.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumZones.h"
+
+/// <summary>
+/// Tuning of the onset gate. Margins are in meters, like the zone table.
+/// </summary>
+struct OnsetGateParams
+{
+    float                   exitMargin;         // zone grows by this in x and y before a hand counts as having left
+    float                   exitDepthMargin;    // zone grows by this in depth before a hand counts as having left
+    float                   riseMargin;         // hand re-arms a zone after rising this far above where it struck
+    int64_t                 minRestrikeUs;      // shortest time between two onsets of one hand on one zone
+    int64_t                 flamWindowUs;       // both hands striking a zone this close together make one onset
+};
+
+/// <summary>
+/// One note to play
+/// </summary>
+struct DrumOnset
+{
+    int32_t                 zone;
+    uint32_t                hands;              // DrumHand bits of the hands that struck
+    int64_t                 timeUs;             // time of the frame; the player refines it to when the stroke landed
+    float                   hitVelocity;        // 0..1, loudest of the hands that struck
+    bool                    flam;               // both hands struck within the flam window
+};
+
+/// <summary>
+/// Turns per-frame zone hits of one skeleton into note onsets. Every hand and zone
+/// pair is armed until it fires, then latched until the hand leaves the zone
+/// (with hysteresis) or rises back above the point it struck, and it never fires
+/// again within the minimum re-strike interval. Frames that only repeat a latched
+/// hit produce nothing.
+/// </summary>
+class COnsetGate
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    COnsetGate();
+
+    /// <summary>
+    /// Gets the default tuning
+    /// </summary>
+    static OnsetGateParams  DefaultParams();
+
+    /// <summary>
+    /// Changes the tuning
+    /// </summary>
+    /// <param name="params">new tuning</param>
+    void                    SetParams(const OnsetGateParams& params) { m_params = params; }
+
+    /// <summary>
+    /// Gets the tuning
+    /// </summary>
+    const OnsetGateParams&  Params() const { return m_params; }
+
+    /// <summary>
+    /// Re-arms every zone, e.g. when the skeleton stops being tracked or the kit changes
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Runs the state machine for one frame. Constant memory, no allocation.
+    /// </summary>
+    /// <param name="zones">kit layout</param>
+    /// <param name="left">left hand</param>
+    /// <param name="right">right hand</param>
+    /// <param name="leftVelocity">hit velocity of the left hand</param>
+    /// <param name="rightVelocity">hit velocity of the right hand</param>
+    /// <param name="timeUs">time the frame was captured</param>
+    /// <param name="pOnsets">receives the onsets, in zone order</param>
+    /// <param name="maxOnsets">capacity of pOnsets</param>
+    /// <returns>number of onsets written</returns>
+    int                     Process(const CDrumZoneTable& zones, const DrumHandInput& left, const DrumHandInput& right,
+                                    float leftVelocity, float rightVelocity, int64_t timeUs, DrumOnset* pOnsets, int maxOnsets);
+
+    /// <summary>
+    /// Gets whether a hand has to leave or rise before it can play a zone again
+    /// </summary>
+    /// <param name="hand">DRUM_HAND_LEFT or DRUM_HAND_RIGHT</param>
+    /// <param name="zone">zone index</param>
+    bool                    IsLatched(DrumHand hand, int zone) const { return m_latched[HandIndex(hand)].Test(zone); }
+
+    /// <summary>
+    /// Gets whether a stroke of a hand on a zone at a given time would become an onset
+    /// </summary>
+    /// <param name="hand">DRUM_HAND_LEFT or DRUM_HAND_RIGHT</param>
+    /// <param name="zone">zone index</param>
+    /// <param name="timeUs">time of the stroke</param>
+    bool                    IsArmed(DrumHand hand, int zone, int64_t timeUs) const
+    {
+        const int h = HandIndex(hand);
+        return !m_latched[h].Test(zone) && timeUs - m_lastStrikeUs[h][zone] >= m_params.minRestrikeUs;
+    }
+
+    /// <summary>
+    /// Gets the number of strokes swallowed because their zone was latched or struck too recently
+    /// </summary>
+    uint64_t                Suppressed() const { return m_suppressed; }
+
+private:
+    static int              HandIndex(DrumHand hand) { return (hand == DRUM_HAND_LEFT) ? 0 : 1; }
+
+    OnsetGateParams         m_params;
+
+    // Per hand, per zone state
+    DrumZoneMask            m_latched[2];
+    float                   m_strikeY[2][cDrumZoneMaxCount];
+    int64_t                 m_lastStrikeUs[2][cDrumZoneMaxCount];
+
+    uint64_t                m_suppressed;
+};
@@ -0,0 +1,172 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PedalDetector.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "PedalDetector.h"
+#include <string.h>
+
+// How fast the ankle to foot offset follows the latest frame that tracked both
+static const float g_AnkleOffsetRate = 0.1f;
+
+/// <summary>
+/// Constructor
+/// </summary>
+CPedalDetector::CPedalDetector() :
+    m_params(DefaultParams())
+{
+    Reset();
+}
+
+/// <summary>
+/// Gets the default tuning
+/// </summary>
+PedalDetectorParams CPedalDetector::DefaultParams()
+{
+    PedalDetectorParams params;
+    params.liftHeight = 0.05f;
+    params.landHeight = 0.02f;
+    params.minDownSpeed = 0.3f;
+    params.fullDownSpeed = 1.5f;
+    params.restRiseSpeed = 0.005f;
+    params.lateUs = 100000;
+    params.resetUs = 500000;
+    return params;
+}
+
+/// <summary>
+/// Forgets both feet; the hi-hat is closed
+/// </summary>
+void CPedalDetector::Reset()
+{
+    memset(m_feet, 0, sizeof(m_feet));
+}
+
+/// <summary>
+/// Takes the feet of one frame. Constant time, no allocation.
+/// </summary>
+/// <param name="left">left foot, plays the hi-hat pedal</param>
+/// <param name="right">right foot, plays the kick</param>
+/// <param name="timeUs">capture time of the frame</param>
+/// <param name="pEvents">receives the pedal strokes, at most cPedalMaxEvents</param>
+/// <returns>number of strokes written</returns>
+int CPedalDetector::Update(const DrumFootInput& left, const DrumFootInput& right, int64_t timeUs, DrumPedalEvent* pEvents)
+{
+    int count = 0;
+
+    // Kick: a tap lifts the foot, the stroke lands when it is back down
+    Foot& kick = m_feet[1];
+    if (UpdateFoot(kick, right, timeUs))
+    {
+        if (!kick.up && kick.height > m_params.liftHeight)
+        {
+            kick.up = true;
+            kick.peakDownSpeed = 0.0f;
+        }
+        else if (kick.up && kick.height < m_params.landHeight)
+        {
+            kick.up = false;
+            if (!kick.late && kick.peakDownSpeed >= m_params.minDownSpeed)
+            {
+                DrumPedalEvent& event = pEvents[count++];
+                event.piece = DRUM_PIECE_KICK;
+                event.hitVelocity = HitVelocity(kick.peakDownSpeed);
+                event.sounds = true;
+                event.chokes = false;
+            }
+        }
+    }
+
+    // Hi-hat: the pedal stays open while the foot is up and closes with a chick when it comes down
+    Foot& hihat = m_feet[0];
+    if (UpdateFoot(hihat, left, timeUs))
+    {
+        if (!hihat.up && hihat.height > m_params.liftHeight)
+        {
+            hihat.up = true;
+            hihat.peakDownSpeed = 0.0f;
+        }
+        else if (hihat.up && hihat.height < m_params.landHeight)
+        {
+            hihat.up = false;
+
+            // Closed is closed, however it got there; only a real stroke is heard
+            DrumPedalEvent& event = pEvents[count++];
+            event.piece = DRUM_PIECE_HIHAT_PEDAL;
+            event.hitVelocity = HitVelocity(hihat.peakDownSpeed);
+            event.sounds = !hihat.late && hihat.peakDownSpeed >= m_params.minDownSpeed;
+            event.chokes = true;
+        }
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Takes one foot sample
+/// </summary>
+/// <returns>false if the foot has nothing new to say on this frame</returns>
+bool CPedalDetector::UpdateFoot(Foot& foot, const DrumFootInput& input, int64_t timeUs)
+{
+    if (input.footTracked && input.ankleTracked)
+    {
+        float offset = input.ankle.y - input.foot.y;
+        foot.ankleOffset = foot.hasAnkleOffset ? foot.ankleOffset + (offset - foot.ankleOffset) * g_AnkleOffsetRate : offset;
+        foot.hasAnkleOffset = true;
+    }
+
+    // An ankle never seen together with its foot cannot stand in for it
+    if (!input.footTracked && !(input.ankleTracked && foot.hasAnkleOffset))
+    {
+        if (foot.valid && timeUs - foot.timeUs > m_params.resetUs)
+        {
+            foot.valid = false;
+            foot.up = false;
+        }
+        return false;
+    }
+
+    float y = input.footTracked ? input.foot.y : input.ankle.y - foot.ankleOffset;
+    if (!foot.valid || timeUs - foot.timeUs > m_params.resetUs)
+    {
+        foot.valid = true;
+        foot.rest = y;
+        foot.height = 0.0f;
+        foot.y = y;
+        foot.timeUs = timeUs;
+        foot.peakDownSpeed = 0.0f;
+        foot.late = false;
+        foot.up = false;
+        return false;
+    }
+
+    // Repeated or out of order timestamps carry no motion information
+    if (timeUs <= foot.timeUs)
+    {
+        return false;
+    }
+
+    float dt = (timeUs - foot.timeUs) * 1e-6f;
+    float downSpeed = (foot.y - y) / dt;
+    foot.peakDownSpeed = (downSpeed > foot.peakDownSpeed) ? downSpeed : foot.peakDownSpeed;
+    foot.late = (timeUs - foot.timeUs > m_params.lateUs);
+
+    // The rest height drops with the foot at once, but a foot held up only slowly becomes the new rest
+    float rise = m_params.restRiseSpeed * dt;
+    foot.rest = (y < foot.rest) ? y : ((y - foot.rest > rise) ? foot.rest + rise : y);
+    foot.height = y - foot.rest;
+    foot.y = y;
+    foot.timeUs = timeUs;
+    return true;
+}
+
+/// <summary>
+/// Maps a descent speed to a hit velocity
+/// </summary>
+float CPedalDetector::HitVelocity(float downSpeed) const
+{
+    float range = m_params.fullDownSpeed - m_params.minDownSpeed;
+    float hitVelocity = (range > 0.0f) ? (downSpeed - m_params.minDownSpeed) / range : 1.0f;
+    return (hitVelocity < 0.0f) ? 0.0f : ((hitVelocity > 1.0f) ? 1.0f : hitVelocity);
+}
@@ -0,0 +1,130 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="PedalDetector.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumKit.h"
+#include "SkeletonFrame.h"
+
+static const int cPedalMaxEvents = 4;
+
+/// <summary>
+/// Tuning of the pedal detector. Heights are in meters above where the foot rests,
+/// speeds in meters per second.
+/// </summary>
+struct PedalDetectorParams
+{
+    float                   liftHeight;         // a foot this high arms the kick or opens the hi-hat
+    float                   landHeight;         // a foot this low has come down again
+    float                   minDownSpeed;       // a kick must come down at least this fast; slower hi-hat closes are silent
+    float                   fullDownSpeed;      // downward speed that maps to full hit velocity
+    float                   restRiseSpeed;      // how fast the rest height follows a foot that stays up
+    int64_t                 lateUs;             // a foot back after a longer gap changes state without a sound
+    int64_t                 resetUs;            // a foot gone for longer starts over, with the hi-hat closed
+};
+
+/// <summary>
+/// One pedal stroke
+/// </summary>
+struct DrumPedalEvent
+{
+    DrumPiece               piece;              // DRUM_PIECE_KICK or DRUM_PIECE_HIHAT_PEDAL
+    float                   hitVelocity;        // 0..1
+    bool                    sounds;             // false for a hi-hat closed too slowly or across a tracking gap
+    bool                    chokes;             // closing the hi-hat silences the open hi-hat
+};
+
+/// <summary>
+/// Hands the pedal detector one foot of a skeleton
+/// </summary>
+struct DrumFootInput
+{
+    SkeletonPoint           foot;
+    SkeletonPoint           ankle;
+    bool                    footTracked;
+    bool                    ankleTracked;
+};
+
+/// <summary>
+/// Finds pedal strokes in the feet of one skeleton: the right foot taps the kick,
+/// the left foot opens and closes the hi-hat. A foot is measured by its height
+/// above where it rests, which follows the foot down at once and up only slowly,
+/// so neither the floor nor the sensor height needs to be known. The ankle stands
+/// in for a foot the sensor has lost. Tracking gaps, such as seated mode losing
+/// the legs, never sound a pedal.
+/// </summary>
+class CPedalDetector
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CPedalDetector();
+
+    /// <summary>
+    /// Gets the default tuning
+    /// </summary>
+    static PedalDetectorParams DefaultParams();
+
+    /// <summary>
+    /// Changes the tuning
+    /// </summary>
+    /// <param name="params">new tuning</param>
+    void                    SetParams(const PedalDetectorParams& params) { m_params = params; }
+
+    /// <summary>
+    /// Forgets both feet; the hi-hat is closed
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Takes the feet of one frame. Constant time, no allocation.
+    /// </summary>
+    /// <param name="left">left foot, plays the hi-hat pedal</param>
+    /// <param name="right">right foot, plays the kick</param>
+    /// <param name="timeUs">capture time of the frame</param>
+    /// <param name="pEvents">receives the pedal strokes, at most cPedalMaxEvents</param>
+    /// <returns>number of strokes written</returns>
+    int                     Update(const DrumFootInput& left, const DrumFootInput& right, int64_t timeUs, DrumPedalEvent* pEvents);
+
+    /// <summary>
+    /// Gets whether the hi-hat pedal is up, so the hi-hat rings open
+    /// </summary>
+    bool                    IsHihatOpen() const { return m_feet[0].up; }
+
+private:
+    /// <summary>
+    /// Height of one foot above where it rests
+    /// </summary>
+    struct Foot
+    {
+        bool                valid;              // rest height known
+        float               rest;               // skeleton space y the foot rests at
+        float               height;
+        float               ankleOffset;        // ankle above foot, for when only the ankle is tracked
+        bool                hasAnkleOffset;
+        float               y;
+        int64_t             timeUs;             // latest tracked sample
+        float               peakDownSpeed;      // fastest descent since the foot last rose
+        bool                late;               // the latest sample came after a gap
+        bool                up;                 // kick armed, hi-hat open
+    };
+
+    PedalDetectorParams     m_params;
+    Foot                    m_feet[2];          // left, right
+
+    /// <summary>
+    /// Takes one foot sample
+    /// </summary>
+    /// <returns>false if the foot has nothing new to say on this frame</returns>
+    bool                    UpdateFoot(Foot& foot, const DrumFootInput& input, int64_t timeUs);
+
+    /// <summary>
+    /// Maps a descent speed to a hit velocity
+    /// </summary>
+    float                   HitVelocity(float downSpeed) const;
+};
@@ -8,21 +8,16 @@
 #include <strsafe.h>
 #include "SkeletonBasics.h"
 #include "resource.h"
+#include "DrumTrace.h"
 #include <iostream>
 #include <Windows.h>
 #include <sstream>
-#include <mmsystem.h>
-#pragma comment(lib, "winmm.lib")
-
-static float crash_left_xmin = -200.00,crash_left_xmax = -60.00,crash_left_ymin = 40.00,crash_left_ymax = 100.00;
-static float high_hat_xmin = -30.00 ,high_hat_xmax = 60.00,high_hat_ymin = 50.00 ,high_hat_ymax = 110.00;
-static float ride_xmin = 148.00 ,ride_xmax = 300.00,ride_ymin = 20.00 ,ride_ymax = 150.00;
-static float snare_xmin = -40.00 ,snare_xmax = 60.00,snare_ymin = 130.00, snare_ymax = 200.00;
-static float lowtom_xmin = -180.00 ,lowtom_xmax = 00.00,lowtom_ymin = 90.00, lowtom_ymax = 170.00;
-static float hitom_xmin = 20.00 ,hitom_xmax = 180.00,hitom_ymin = 90.00, hitom_ymax = 170.00;
-static float left_x_old = 0.00, left_y_old = 0.00, right_x_old = 0.00, right_y_old = 0.00;
-static BOOL left_x_pos = false,left_y_pos = false,right_x_pos = false,right_y_pos = false;
+#include <shellapi.h>
 
+static_assert(NUI_SKELETON_COUNT == cSkeletonCount, "SkeletonFrame must mirror NUI_SKELETON_FRAME");
+static_assert(NUI_SKELETON_POSITION_COUNT == cSkeletonJointCount, "SkeletonData must mirror NUI_SKELETON_DATA");
+
+// Formats and allocates, so only the reports made once in a while use it; the hot path traces with DRUM_TRACE
 #define DBOUT( s )          \
 {                              \
 	                            \
@@ -31,9 +26,53 @@ static BOOL left_x_pos = false,left_y_pos = false,right_x_pos = false,right_y_po
 	OutputDebugStringW( os_.str().c_str() ); \
 }
 
-static const float g_JointThickness = 3.0f;
-static const float g_TrackedBoneThickness = 6.0f;
-static const float g_InferredBoneThickness = 1.0f;
+// Folder holding the kit samples, loaded into memory once at startup
+static const char g_SampleDirectory[] = "C:\\Users\\Nirav\\Desktop\\";
+
+// Delay between a hand moving and its skeleton frame arriving, taken off predicted hit times
+static const int64_t g_SensorLatencyUs = 33333;
+
+// Without new snapshots the render thread still redraws this often, so the window recovers from being covered
+static const DWORD g_RenderIdleMs = 100;
+
+// Posted to the window when another thread has set the status text
+static const UINT WM_APP_STATUS = WM_APP + 1;
+
+/// <summary>
+/// Copies an SDK frame into the sensor independent layout used by the detector and recordings
+/// </summary>
+/// <param name="source">frame from NuiSkeletonGetNextFrame</param>
+/// <param name="pFrame">receives the copy</param>
+static void CopySkeletonFrame(const NUI_SKELETON_FRAME & source, SkeletonFrame * pFrame)
+{
+    pFrame->timestampMs = source.liTimeStamp.QuadPart;
+    pFrame->frameNumber = source.dwFrameNumber;
+    pFrame->flags = source.dwFlags;
+    pFrame->floorClipPlane[0] = source.vFloorClipPlane.x;
+    pFrame->floorClipPlane[1] = source.vFloorClipPlane.y;
+    pFrame->floorClipPlane[2] = source.vFloorClipPlane.z;
+    pFrame->floorClipPlane[3] = source.vFloorClipPlane.w;
+
+    for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+    {
+        const NUI_SKELETON_DATA & skel = source.SkeletonData[i];
+        SkeletonData & data = pFrame->skeletons[i];
+
+        data.trackingState = skel.eTrackingState;
+        data.trackingId = skel.dwTrackingID;
+        data.position.x = skel.Position.x;
+        data.position.y = skel.Position.y;
+        data.position.z = skel.Position.z;
+
+        for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+        {
+            data.joints[j].x = skel.SkeletonPositions[j].x;
+            data.joints[j].y = skel.SkeletonPositions[j].y;
+            data.joints[j].z = skel.SkeletonPositions[j].z;
+            data.jointStates[j] = static_cast<uint8_t>(skel.eSkeletonPositionTrackingState[j]);
+        }
+    }
+}
 
 /// <summary>
 /// Entry point for the application
@@ -46,6 +85,81 @@ static const float g_InferredBoneThickness = 1.0f;
 int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
 {
     CSkeletonBasics application;
+
+    // /record <file> saves the live skeleton stream, /replay <file> [/fast] plays one back instead of the sensor,
+    // /latency <file> writes the stage latencies there on exit, /renderdelay <ms> stalls every drawn frame,
+    // /midi <file> writes the notes to a Standard MIDI File, /midiport <name> plays them on a MIDI port,
+    // /calibrate fits the zones to the reach of every drummer who steps in, /trace <file> dumps the trace rings on exit,
+    // /smoothing <none|sdk|adaptive> picks how sensor frames are smoothed (the checkbox switches sdk and adaptive),
+    // /sensors <n> fuses the skeletons of up to n Kinects facing the kit (with /record, each one's frames also go to <file>.sensor<i>)
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (NULL != argv)
+    {
+        bool realTime = true;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (0 == _wcsicmp(argv[i], L"/fast"))
+            {
+                realTime = false;
+            }
+            else if (0 == _wcsicmp(argv[i], L"/calibrate"))
+            {
+                application.SetCalibration(true);
+            }
+            else if (0 == _wcsicmp(argv[i], L"/smoothing") && i + 1 < argc)
+            {
+                ++i;
+                if (0 == _wcsicmp(argv[i], L"none"))
+                {
+                    application.SetSmoothing(SKELETON_SMOOTHING_NONE);
+                }
+                else if (0 == _wcsicmp(argv[i], L"adaptive"))
+                {
+                    application.SetSmoothing(SKELETON_SMOOTHING_ADAPTIVE);
+                }
+            }
+            else if (0 == _wcsicmp(argv[i], L"/sensors") && i + 1 < argc)
+            {
+                application.SetMaxSensors(_wtoi(argv[++i]));
+            }
+        }
+
+        for (int i = 1; i + 1 < argc; ++i)
+        {
+            if (0 == _wcsicmp(argv[i], L"/record"))
+            {
+                application.StartRecording(argv[++i]);
+            }
+            else if (0 == _wcsicmp(argv[i], L"/replay"))
+            {
+                application.StartReplay(argv[++i], realTime);
+            }
+            else if (0 == _wcsicmp(argv[i], L"/latency"))
+            {
+                application.SetLatencyLog(argv[++i]);
+            }
+            else if (0 == _wcsicmp(argv[i], L"/trace"))
+            {
+                application.SetTraceLog(argv[++i]);
+            }
+            else if (0 == _wcsicmp(argv[i], L"/midi"))
+            {
+                application.StartMidi(argv[++i], false);
+            }
+            else if (0 == _wcsicmp(argv[i], L"/midiport"))
+            {
+                application.StartMidi(argv[++i], true);
+            }
+            else if (0 == _wcsicmp(argv[i], L"/renderdelay"))
+            {
+                application.SetRenderDelay(static_cast<DWORD>(_wtoi(argv[++i])));
+            }
+        }
+
+        LocalFree(argv);
+    }
+
     application.Run(hInstance, nCmdShow);
 }
 
@@ -54,17 +168,40 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 /// </summary>
 CSkeletonBasics::CSkeletonBasics() :
     m_pD2DFactory(NULL),
-    m_hNextSkeletonEvent(INVALID_HANDLE_VALUE),
     m_pSkeletonStreamHandle(INVALID_HANDLE_VALUE),
     m_bSeatedMode(false),
     m_pRenderTarget(NULL),
-    m_pBrushJointTracked(NULL),
-    m_pBrushJointInferred(NULL),
-    m_pBrushBoneTracked(NULL),
-    m_pBrushBoneInferred(NULL),
-    m_pNuiSensor(NULL)
+    m_sensorCount(0),
+    m_maxSensors(1),
+    m_frameTimer(-1),
+    m_pAudioOutput(NULL),
+    m_bMidi(false),
+    m_bReplayRealTime(true),
+    m_bReplayReported(false),
+    m_smoothing(SKELETON_SMOOTHING_SDK),
+    m_frameTimeUs(0),
+    m_arrivalUs(0),
+    m_renderDelayMs(0),
+    m_bStopping(false),
+    m_hStopEvent(NULL),
+    m_hSnapshotEvent(NULL),
+    m_uiThreadId(0)
 {
-    ZeroMemory(m_Points,sizeof(m_Points));
+    ZeroMemory(m_pBrushes,sizeof(m_pBrushes));
+    ZeroMemory(&m_Frame,sizeof(m_Frame));
+    m_szLatencyLog[0] = L'\0';
+    m_szTraceLog[0] = '\0';
+    m_szQueuedStatus[0] = L'\0';
+
+    for (int i = 0; i < cSkeletonFusionMaxSensors; ++i)
+    {
+        m_Sensors[i].pNuiSensor = NULL;
+        m_Sensors[i].hNextSkeletonEvent = INVALID_HANDLE_VALUE;
+        m_Sensors[i].filterSmoothing = SKELETON_SMOOTHING_SDK;
+    }
+
+    // Frames wait in the fusion for the other sensors; that wait is a stage of its own
+    m_Fusion.SetLatencyTracer(&m_Latency);
 }
 
 /// <summary>
@@ -72,14 +209,50 @@ CSkeletonBasics::CSkeletonBasics() :
 /// </summary>
 CSkeletonBasics::~CSkeletonBasics()
 {
-    if (m_pNuiSensor)
+    // Nothing may touch the sensor, the players or Direct2D once this returns
+    StopThreads();
+
+    for (int i = 0; i < m_sensorCount; ++i)
     {
-        m_pNuiSensor->NuiShutdown();
+        m_Sensors[i].pNuiSensor->NuiShutdown();
+
+        if (m_Sensors[i].hNextSkeletonEvent && (m_Sensors[i].hNextSkeletonEvent != INVALID_HANDLE_VALUE))
+        {
+            CloseHandle(m_Sensors[i].hNextSkeletonEvent);
+        }
     }
 
-    if (m_hNextSkeletonEvent && (m_hNextSkeletonEvent != INVALID_HANDLE_VALUE))
+    m_Engine.Stop();
+
+    // Held back notes go out before the file or port closes
+    m_Midi.Stop();
+    m_MidiFile.Close();
+    m_MidiPort.Close();
+
+    // stop audio before the mixer goes away
+    if (m_pAudioOutput)
     {
-        CloseHandle(m_hNextSkeletonEvent);
+        m_pAudioOutput->Stop();
+        delete m_pAudioOutput;
+        m_pAudioOutput = NULL;
+    }
+
+    // Nothing records any more, so the latency numbers are final
+    ReportLatency();
+    if (L'\0' != m_szLatencyLog[0])
+    {
+        FILE* pFile = NULL;
+        if (0 == _wfopen_s(&pFile, m_szLatencyLog, L"w"))
+        {
+            m_Latency.Print(pFile);
+            fclose(pFile);
+        }
+    }
+
+    // The threads are gone, so the rings hold everything they traced
+    if ('\0' != m_szTraceLog[0])
+    {
+        DrumTraceDump(m_szTraceLog);
     }
 
     // clean up Direct2D objects
@@ -88,7 +261,10 @@ CSkeletonBasics::~CSkeletonBasics()
     // clean up Direct2D
     SafeRelease(m_pD2DFactory);
 
-    SafeRelease(m_pNuiSensor);
+    for (int i = 0; i < m_sensorCount; ++i)
+    {
+        SafeRelease(m_Sensors[i].pNuiSensor);
+    }
 }
 
 /// <summary>
@@ -101,6 +277,8 @@ int CSkeletonBasics::Run(HINSTANCE hInstance, int nCmdShow)
     MSG       msg = {0};
     WNDCLASS  wc  = {0};
 
+    m_uiThreadId = GetCurrentThreadId();
+
     // Dialog custom window class
     wc.style         = CS_HREDRAW | CS_VREDRAW;
     wc.cbWndExtra    = DLGWINDOWEXTRA;
@@ -126,58 +304,117 @@ int CSkeletonBasics::Run(HINSTANCE hInstance, int nCmdShow)
     // Show window
     ShowWindow(hWndApp, nCmdShow);
 
-    const int eventCount = 1;
-    HANDLE hEvents[eventCount];
-
-    // Main message loop
-    while (WM_QUIT != msg.message)
+    // Frames are detected and drawn on their own threads, this one only handles the window
+    while (GetMessageW(&msg, NULL, 0, 0) > 0)
     {
-        hEvents[0] = m_hNextSkeletonEvent;
-
-        // Check to see if we have either a message (by passing in QS_ALLEVENTS)
-        // Or a Kinect event (hEvents)
-        // Update() will check for Kinect events individually, in case more than one are signalled
-        DWORD dwEvent = MsgWaitForMultipleObjects(eventCount, hEvents, FALSE, INFINITE, QS_ALLINPUT);
-
-        // Check if this is an event we're waiting on and not a timeout or message
-        if (WAIT_OBJECT_0 == dwEvent)
+        // F2 shows the stage latencies so far
+        if (WM_KEYDOWN == msg.message && VK_F2 == msg.wParam)
         {
-            Update();
+            ReportLatency();
+            continue;
         }
 
-        if (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE))
+        // If a dialog message will be taken care of by the dialog proc
+        if ((hWndApp != NULL) && IsDialogMessageW(hWndApp, &msg))
         {
-            // If a dialog message will be taken care of by the dialog proc
-            if ((hWndApp != NULL) && IsDialogMessageW(hWndApp, &msg))
-            {
-                continue;
-            }
-
-            TranslateMessage(&msg);
-            DispatchMessageW(&msg);
+            continue;
         }
+
+        TranslateMessage(&msg);
+        DispatchMessageW(&msg);
     }
 
     return static_cast<int>(msg.wParam);
 }
 
 /// <summary>
-/// Main processing function
+/// Main processing function, run by the detection thread's reactor whenever a frame may be ready
 /// </summary>
 void CSkeletonBasics::Update()
 {
-    if (NULL == m_pNuiSensor)
+    if (m_Replayer.IsOpen())
+    {
+        // Recorded frames go through the same path as live ones
+        m_arrivalUs = DrumGetTimeMicroseconds();
+        const SkeletonFrame* pFrame = m_Replayer.Next(m_arrivalUs);
+        if (NULL != pFrame)
+        {
+            ProcessSkeletonFrame(*pFrame);
+        }
+
+        // Wake up in time for the next recorded frame
+        int64_t nowUs = DrumGetTimeMicroseconds();
+        int64_t waitUs = m_Replayer.TimeUntilNextUs(nowUs);
+        if (waitUs >= 0)
+        {
+            m_Reactor.SetTimer(m_frameTimer, nowUs + waitUs);
+        }
+        else if (!m_bReplayReported)
+        {
+            m_Reactor.Post(DRUM_REACTOR_UI, OnReplayFinished, this);
+            m_bReplayReported = true;
+        }
+
+        return;
+    }
+
+    if (0 == m_sensorCount)
+    {
+        return;
+    }
+
+    if (m_sensorCount > 1)
     {
+        FuseSkeletons();
+
+        // A frame a sensor is late for goes out without it once it has waited long enough
+        int64_t nowUs = DrumGetTimeMicroseconds();
+        int64_t waitUs = m_Fusion.TimeUntilDueUs(nowUs);
+        if (waitUs >= 0)
+        {
+            m_Reactor.SetTimer(m_frameTimer, nowUs + waitUs);
+        }
         return;
     }
 
-    // Wait for 0ms, just quickly test if it is time to process a skeleton
-    if ( WAIT_OBJECT_0 == WaitForSingleObject(m_hNextSkeletonEvent, 0) )
+    // The reactor only gets here once the sensor has signalled a frame
+    m_arrivalUs = DrumGetTimeMicroseconds();
+    ProcessSkeleton();
+}
+
+/// <summary>
+/// Runs Update for the reactor
+/// </summary>
+/// <param name="pContext">the application</param>
+void CSkeletonBasics::OnFrameReady(void* pContext)
+{
+    static_cast<CSkeletonBasics*>(pContext)->Update();
+}
+
+/// <summary>
+/// Applies the seated mode the window's thread chose to every sensor, between frames
+/// </summary>
+/// <param name="pContext">the application</param>
+void CSkeletonBasics::OnSeatedModeChanged(void* pContext)
+{
+    CSkeletonBasics* pThis = static_cast<CSkeletonBasics*>(pContext);
+    for (int i = 0; i < pThis->m_sensorCount; ++i)
     {
-        ProcessSkeleton();
+        // Set near mode for every sensor based on our internal state
+        KinectSensor& kinect = pThis->m_Sensors[i];
+        kinect.pNuiSensor->NuiSkeletonTrackingEnable(kinect.hNextSkeletonEvent, pThis->m_bSeatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
     }
 }
 
+/// <summary>
+/// Shows the prediction error of the whole recording once it has played
+/// </summary>
+/// <param name="pContext">the application</param>
+void CSkeletonBasics::OnReplayFinished(void* pContext)
+{
+    static_cast<CSkeletonBasics*>(pContext)->ReportPredictionError();
+}
+
 /// <summary>
 /// Handles window messages, passes most to the class instance to handle
 /// </summary>
@@ -225,19 +462,53 @@ LRESULT CALLBACK CSkeletonBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam
             // Bind application window handle
             m_hWnd = hWnd;
 
+            CheckDlgButton(hWnd, IDC_CHECK_ADAPTIVE_SMOOTHING, (SKELETON_SMOOTHING_ADAPTIVE == m_smoothing) ? BST_CHECKED : BST_UNCHECKED);
+
             // Init Direct2D
             D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED, &m_pD2DFactory);
 
+            // Load the kit and open the audio device
+            CreateAudio();
+
+            // Tracked skeletons beyond the first are detected on their own threads
+            unsigned int cores = std::thread::hardware_concurrency();
+            m_Engine.SetLatencyTracer(&m_Latency);
+            m_Engine.Start((cores > 1) ? NUI_SKELETON_MAX_TRACKED_COUNT - 1 : 0);
+
             // Look for a connected Kinect, and create it if found
-            CreateFirstConnected();
+            if (m_Replayer.IsOpen())
+            {
+                m_Replayer.Start(DrumGetTimeMicroseconds(), m_bReplayRealTime);
+                SetStatusMessage(L"Replaying recorded skeleton stream");
+            }
+            else
+            {
+                CreateConnected();
+            }
+
+            StartThreads();
         }
         break;
 
         // If the titlebar X is clicked, destroy app
     case WM_CLOSE:
+        StopThreads();
         DestroyWindow(hWnd);
         break;
 
+        // Status text from the detection or render thread
+    case WM_APP_STATUS:
+        {
+            WCHAR szMessage[cStatusMessageMaxLen];
+            {
+                std::lock_guard<std::mutex> lock(m_StatusLock);
+                StringCchCopyW(szMessage, _countof(szMessage), m_szQueuedStatus);
+            }
+
+            SetStatusMessage(szMessage);
+        }
+        break;
+
     case WM_DESTROY:
         // Quit the main message pump
         PostQuitMessage(0);
@@ -248,14 +519,17 @@ LRESULT CALLBACK CSkeletonBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam
         // If it was for the near mode control and a clicked event, change near mode
         if (IDC_CHECK_SEATED == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
         {
-            // Toggle out internal state for near mode
+            // Toggle out internal state for near mode. Seated mode stops tracking the legs;
+            // the pedals go quiet and the hi-hat closes until the feet come back.
+            // The sensors are switched on the detection thread, so never in the middle of fetching a frame.
             m_bSeatedMode = !m_bSeatedMode;
-
-            if (NULL != m_pNuiSensor)
-            {
-                // Set near mode for sensor based on our internal state
-                m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, m_bSeatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
-            }
+            m_Reactor.Post(DRUM_REACTOR_CONFIG, OnSeatedModeChanged, this);
+        }
+        else if (IDC_CHECK_ADAPTIVE_SMOOTHING == LOWORD(wParam) && BN_CLICKED == HIWORD(wParam))
+        {
+            // Switch between the SDK's smoothing and our own filter; the detection thread picks it up on its next frame
+            bool adaptive = (BST_CHECKED == IsDlgButtonChecked(hWnd, IDC_CHECK_ADAPTIVE_SMOOTHING));
+            m_smoothing = adaptive ? SKELETON_SMOOTHING_ADAPTIVE : SKELETON_SMOOTHING_SDK;
         }
         break;
     }
@@ -264,10 +538,202 @@ LRESULT CALLBACK CSkeletonBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam
 }
 
 /// <summary>
-/// Create the first connected Kinect found 
+/// Starts the detection and render threads, and a capture thread per Kinect if there are several
 /// </summary>
-/// <returns>indicates success or failure</returns>
-HRESULT CSkeletonBasics::CreateFirstConnected()
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::StartThreads()
+{
+    m_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    m_hSnapshotEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (NULL == m_hStopEvent || NULL == m_hSnapshotEvent)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = m_Reactor.Initialize();
+    if (SUCCEEDED(hr))
+    {
+        hr = m_CapturedEvent.Create();
+    }
+
+    // Frames come from the sensor's event, from the capture threads, or on the recording's clock;
+    // either way detecting them goes ahead of everything else the detection thread does
+    if (SUCCEEDED(hr) && m_Replayer.IsOpen())
+    {
+        hr = m_Reactor.AddTimer(DRUM_REACTOR_SENSOR, OnFrameReady, this, &m_frameTimer);
+        m_Reactor.SetTimer(m_frameTimer, DrumGetTimeMicroseconds());
+    }
+    else if (SUCCEEDED(hr) && m_sensorCount > 1)
+    {
+        hr = m_Reactor.AddEvent(&m_CapturedEvent, DRUM_REACTOR_SENSOR, OnFrameReady, this);
+        if (SUCCEEDED(hr))
+        {
+            hr = m_Reactor.AddTimer(DRUM_REACTOR_SENSOR, OnFrameReady, this, &m_frameTimer);
+        }
+    }
+    else if (SUCCEEDED(hr) && 1 == m_sensorCount)
+    {
+        hr = m_Reactor.AddHandle(m_Sensors[0].hNextSkeletonEvent, DRUM_REACTOR_SENSOR, OnFrameReady, this);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_bStopping = false;
+    m_DetectionThread = std::thread(&CSkeletonBasics::DetectionThread, this);
+    m_RenderThread = std::thread(&CSkeletonBasics::RenderThread, this);
+
+    // One Kinect is waited for by the detection thread itself
+    for (int i = 0; m_sensorCount > 1 && i < m_sensorCount; ++i)
+    {
+        m_Sensors[i].captureThread = std::thread(&CSkeletonBasics::CaptureThread, this, i);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Stops and joins every thread StartThreads started
+/// </summary>
+void CSkeletonBasics::StopThreads()
+{
+    m_bStopping = true;
+    m_Reactor.Stop();
+    if (NULL != m_hStopEvent)
+    {
+        SetEvent(m_hStopEvent);
+    }
+
+    if (NULL != m_hSnapshotEvent)
+    {
+        SetEvent(m_hSnapshotEvent);
+    }
+
+    if (m_DetectionThread.joinable())
+    {
+        m_DetectionThread.join();
+    }
+
+    if (m_RenderThread.joinable())
+    {
+        m_RenderThread.join();
+    }
+
+    for (int i = 0; i < m_sensorCount; ++i)
+    {
+        if (m_Sensors[i].captureThread.joinable())
+        {
+            m_Sensors[i].captureThread.join();
+        }
+    }
+
+    if (NULL != m_hStopEvent)
+    {
+        CloseHandle(m_hStopEvent);
+        m_hStopEvent = NULL;
+    }
+
+    if (NULL != m_hSnapshotEvent)
+    {
+        CloseHandle(m_hSnapshotEvent);
+        m_hSnapshotEvent = NULL;
+    }
+
+    m_Reactor.Close();
+    m_CapturedEvent.Close();
+}
+
+/// <summary>
+/// Waits for the frames of one of several Kinects and hands them to the detection thread until stopped
+/// </summary>
+/// <param name="sensor">index into m_Sensors</param>
+void CSkeletonBasics::CaptureThread(int sensor)
+{
+    CDrumTraceThreadScope trace;
+
+    // Frames are timed when they are signalled, so this must not wait behind anything either
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+    KinectSensor& kinect = m_Sensors[sensor];
+    HANDLE hEvents[2] = { m_hStopEvent, kinect.hNextSkeletonEvent };
+    CapturedSkeletonFrame captured;
+
+    while (!m_bStopping)
+    {
+        DWORD dwEvent = WaitForMultipleObjects(2, hEvents, FALSE, INFINITE);
+        if (WAIT_OBJECT_0 + 1 != dwEvent)
+        {
+            break;
+        }
+
+        captured.arrivalUs = DrumGetTimeMicroseconds();
+        if (FAILED(FetchSkeleton(sensor, captured.arrivalUs, &captured.frame)))
+        {
+            continue;
+        }
+
+        // The detection thread drains the queue on every wake; should it ever fall behind, the newest frame is dropped
+        kinect.frames.Push(captured);
+        m_CapturedEvent.Signal();
+    }
+}
+
+/// <summary>
+/// Waits for skeleton frames and detects hits on them until stopped
+/// </summary>
+void CSkeletonBasics::DetectionThread()
+{
+    CDrumTraceThreadScope trace;
+
+    // Hits must not wait behind drawing or anything else the process does
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+    // Frames first, then settings the window's thread changed, then UI work a batch at a time
+    m_Reactor.Run();
+}
+
+/// <summary>
+/// Draws the newest snapshot until stopped
+/// </summary>
+void CSkeletonBasics::RenderThread()
+{
+    CDrumTraceThreadScope trace;
+
+    bool haveSnapshot = false;
+    while (!m_bStopping)
+    {
+        // Presenting waits for the display, so this runs at display rate at most
+        WaitForSingleObject(m_hSnapshotEvent, g_RenderIdleMs);
+        if (m_bStopping)
+        {
+            break;
+        }
+
+        // Snapshots published while the last one was drawn are skipped, only the newest counts
+        haveSnapshot = m_Snapshots.Acquire() || haveSnapshot;
+        if (!haveSnapshot)
+        {
+            continue;
+        }
+
+        DrawSnapshot(m_Snapshots.ReadBuffer());
+
+        if (m_renderDelayMs > 0)
+        {
+            Sleep(m_renderDelayMs);
+        }
+    }
+
+    DiscardDirect2DResources();
+}
+
+/// <summary>
+/// Create the connected Kinects found, up to m_maxSensors
+/// </summary>
+/// <returns>S_OK if at least one was created, otherwise failure code</returns>
+HRESULT CSkeletonBasics::CreateConnected()
 {
     INuiSensor * pNuiSensor;
 
@@ -279,7 +745,7 @@ HRESULT CSkeletonBasics::CreateFirstConnected()
     }
 
     // Look at each Kinect sensor
-    for (int i = 0; i < iSensorCount; ++i)
+    for (int i = 0; i < iSensorCount && m_sensorCount < m_maxSensors; ++i)
     {
         // Create the sensor so we can check status, if we can't create it, move on to the next
         hr = NuiCreateSensorByIndex(i, &pNuiSensor);
@@ -292,379 +758,486 @@ HRESULT CSkeletonBasics::CreateFirstConnected()
         hr = pNuiSensor->NuiStatus();
         if (S_OK == hr)
         {
-            m_pNuiSensor = pNuiSensor;
-            break;
+            // Initialize the Kinect and specify that we'll be using skeleton
+            hr = pNuiSensor->NuiInitialize(NUI_INITIALIZE_FLAG_USES_SKELETON);
         }
 
-        // This sensor wasn't OK, so release it since we're not using it
-        pNuiSensor->Release();
-    }
-
-    if (NULL != m_pNuiSensor)
-    {
-        // Initialize the Kinect and specify that we'll be using skeleton
-        hr = m_pNuiSensor->NuiInitialize(NUI_INITIALIZE_FLAG_USES_SKELETON); 
-        if (SUCCEEDED(hr))
+        if (S_OK == hr)
         {
             // Create an event that will be signaled when skeleton data is available
-            m_hNextSkeletonEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+            KinectSensor& kinect = m_Sensors[m_sensorCount];
+            kinect.hNextSkeletonEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
 
             // Open a skeleton stream to receive skeleton data
-            hr = m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, 0); 
+            hr = pNuiSensor->NuiSkeletonTrackingEnable(kinect.hNextSkeletonEvent, 0);
+            if (SUCCEEDED(hr))
+            {
+                kinect.pNuiSensor = pNuiSensor;
+                ++m_sensorCount;
+                continue;
+            }
+
+            CloseHandle(kinect.hNextSkeletonEvent);
+            kinect.hNextSkeletonEvent = INVALID_HANDLE_VALUE;
+            pNuiSensor->NuiShutdown();
         }
+
+        // This sensor wasn't OK, so release it since we're not using it
+        pNuiSensor->Release();
     }
 
-    if (NULL == m_pNuiSensor || FAILED(hr))
+    if (0 == m_sensorCount)
     {
         SetStatusMessage(L"No ready Kinect found!");
         return E_FAIL;
     }
 
+    // The first Kinect paces the fused stream; the others are placed once they track a drummer with it
+    m_Fusion.Initialize(m_sensorCount);
+    if (m_sensorCount > 1)
+    {
+        WCHAR szMessage[cStatusMessageMaxLen];
+        StringCchPrintfW(szMessage, _countof(szMessage), L"Fusing %d Kinects; step in where all of them see you", m_sensorCount);
+        SetStatusMessage(szMessage);
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Use up to this many Kinects at once, fusing their skeletons; call before the window is created
+/// </summary>
+/// <param name="count">1 to cSkeletonFusionMaxSensors</param>
+void CSkeletonBasics::SetMaxSensors(int count)
+{
+    m_maxSensors = (count < 1) ? 1 : (count > cSkeletonFusionMaxSensors) ? cSkeletonFusionMaxSensors : count;
+}
+
+/// <summary>
+/// Record every skeleton frame to a file
+/// </summary>
+/// <param name="szPath">recording to create</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::StartRecording(const WCHAR* szPath)
+{
+    char szFile[MAX_PATH];
+    if (0 == WideCharToMultiByte(CP_ACP, 0, szPath, -1, szFile, _countof(szFile), NULL, NULL))
+    {
+        return E_INVALIDARG;
+    }
+
+    // Frames are recorded after smoothing, exactly as the detector sees them
+    uint32_t flags = (SKELETON_SMOOTHING_NONE != m_smoothing) ? cSkeletonStreamFlagSmoothed : 0;
+
+    // With several Kinects each one's frames are kept as well, so DrumHeadless can fuse them again
+    for (int i = 0; m_maxSensors > 1 && i < m_maxSensors; ++i)
+    {
+        char szSensorFile[MAX_PATH];
+        if (SUCCEEDED(StringCchPrintfA(szSensorFile, _countof(szSensorFile), "%s.sensor%d", szFile, i)))
+        {
+            m_Sensors[i].recorder.Open(szSensorFile, flags);
+        }
+    }
+
+    return m_Recorder.Open(szFile, flags);
+}
+
+/// <summary>
+/// Play back a recording instead of using the sensor
+/// </summary>
+/// <param name="szPath">recording to replay</param>
+/// <param name="realTime">pace frames as recorded instead of as fast as possible</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::StartReplay(const WCHAR* szPath, bool realTime)
+{
+    char szFile[MAX_PATH];
+    if (0 == WideCharToMultiByte(CP_ACP, 0, szPath, -1, szFile, _countof(szFile), NULL, NULL))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_bReplayRealTime = realTime;
+    return m_Replayer.Open(szFile);
+}
+
+/// <summary>
+/// Send every stroke as a General MIDI drum note, besides playing the samples
+/// </summary>
+/// <param name="szName">Standard MIDI File to create, or MIDI port to open</param>
+/// <param name="port">szName is a MIDI port instead of a file</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::StartMidi(const WCHAR* szName, bool port)
+{
+    char szTarget[MAX_PATH];
+    if (0 == WideCharToMultiByte(CP_ACP, 0, szName, -1, szTarget, _countof(szTarget), NULL, NULL))
+    {
+        return E_INVALIDARG;
+    }
+
+    IMidiOutput* pOutput = &m_MidiFile;
+    HRESULT hr = port ? m_MidiPort.Open(szTarget) : m_MidiFile.Open(szTarget);
+    if (port)
+    {
+        pOutput = &m_MidiPort;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_Midi.Start(pOutput, g_SensorLatencyUs);
+    }
+
+    m_bMidi = SUCCEEDED(hr);
     return hr;
 }
 
 /// <summary>
-/// Handle new skeleton data
+/// Write the stage latencies to a file on exit
 /// </summary>
-void CSkeletonBasics::ProcessSkeleton()
+/// <param name="szPath">file to write</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::SetLatencyLog(const WCHAR* szPath)
 {
-    NUI_SKELETON_FRAME skeletonFrame = {0};
+    return StringCchCopyW(m_szLatencyLog, _countof(m_szLatencyLog), szPath);
+}
 
-    HRESULT hr = m_pNuiSensor->NuiSkeletonGetNextFrame(0, &skeletonFrame);
-    if ( FAILED(hr) )
+/// <summary>
+/// Dump the trace rings to a file on exit, for DrumTraceDecode
+/// </summary>
+/// <param name="szPath">file to write</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::SetTraceLog(const WCHAR* szPath)
+{
+    if (0 == WideCharToMultiByte(CP_ACP, 0, szPath, -1, m_szTraceLog, _countof(m_szTraceLog), NULL, NULL))
     {
-        return;
+        m_szTraceLog[0] = '\0';
+        return E_INVALIDARG;
     }
 
-    // smooth out the skeleton data
-    m_pNuiSensor->NuiTransformSmooth(&skeletonFrame, NULL);
+    return S_OK;
+}
 
-    // Endure Direct2D is ready to draw
-    hr = EnsureDirect2DResources( );
-    if ( FAILED(hr) )
+/// <summary>
+/// Shows p50, p99 and max of every pipeline stage
+/// </summary>
+void CSkeletonBasics::ReportLatency()
+{
+    LatencySummary summary;
+    for (int i = 0; i < LATENCY_STAGE_COUNT; ++i)
     {
-        return;
+        LatencyStage stage = static_cast<LatencyStage>(i);
+        m_Latency.GetSummary(stage, &summary);
+        DBOUT(CLatencyTracer::StageName(stage) << ": " << summary.count << " samples, p50 " << summary.p50Us
+            << "us, p99 " << summary.p99Us << "us, max " << summary.maxUs << "us\n");
     }
 
-    m_pRenderTarget->BeginDraw();
-    m_pRenderTarget->Clear( );
+    m_Latency.GetSummary(LATENCY_STAGE_END_TO_END, &summary);
+    WCHAR szMessage[cStatusMessageMaxLen];
+    StringCchPrintfW(szMessage, _countof(szMessage), L"Frame to sound: p50 %.1f ms, p99 %.1f ms, max %.1f ms",
+        summary.p50Us / 1000.0, summary.p99Us / 1000.0, summary.maxUs / 1000.0);
+    SetStatusMessage(szMessage);
+}
 
-    RECT rct;
-    GetClientRect( GetDlgItem( m_hWnd, IDC_VIDEOVIEW ), &rct);
-    int width = rct.right;
-    int height = rct.bottom;
+/// <summary>
+/// Load the kit samples into the mixer and start audio output
+/// </summary>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::CreateAudio()
+{
+    HRESULT hr = m_Mixer.Initialize(CDrumMixer::cDefaultSampleRate, CDrumMixer::cDefaultBlockFrames, CDrumMixer::cDefaultVoiceCount);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
 
-    for (int i = 0 ; i < NUI_SKELETON_COUNT; ++i)
+    for (int i = 0; i < DRUM_PIECE_COUNT; ++i)
     {
-        NUI_SKELETON_TRACKING_STATE trackingState = skeletonFrame.SkeletonData[i].eTrackingState;
+        char szPath[MAX_PATH];
+        StringCchPrintfA(szPath, _countof(szPath), "%s%s", g_SampleDirectory, DrumPieceSampleFile(static_cast<DrumPiece>(i)));
 
-        if (NUI_SKELETON_TRACKED == trackingState)
+        // A missing sample only silences that piece
+        if (FAILED(m_Mixer.LoadSample(i, szPath)))
         {
-            // We're tracking the skeleton, draw it
-            DrawSkeleton(skeletonFrame.SkeletonData[i], width, height);
+            SetStatusMessage(L"Couldn't load all drum samples!");
         }
-        else if (NUI_SKELETON_POSITION_ONLY == trackingState)
+    }
+
+    m_pAudioOutput = new CWaveOutAudioOutput();
+    m_Mixer.SetLatencyTracer(&m_Latency);
+    hr = m_pAudioOutput->Start(&m_Mixer);
+    if (FAILED(hr))
+    {
+        SetStatusMessage(L"Couldn't open the audio device!");
+        delete m_pAudioOutput;
+        m_pAudioOutput = NULL;
+    }
+
+    return hr;
+}
+
+/// <summary>
+/// Plays, schedules, cancels or chokes a kit piece sample for the engine, and its MIDI note
+/// </summary>
+/// <param name="trigger">what the engine detected or predicted</param>
+void CSkeletonBasics::Trigger(const DrumHitTrigger& trigger)
+{
+    if (m_bMidi)
+    {
+        m_Midi.Trigger(trigger);
+    }
+
+    switch (trigger.type)
+    {
+    case DRUM_TRIGGER_PLAY:
+        {
+            m_Mixer.Trigger(trigger.sampleId, CStrikeDetector::HitGain(trigger.hitVelocity), m_arrivalUs);
+
+            // Pedals have no zone to light up
+            if (trigger.zone >= 0)
+            {
+                DrumSnapshotHit hit = { trigger.timeUs, trigger.trackingId, trigger.zone, trigger.hitVelocity };
+                m_HitHistory.Add(hit);
+            }
+        }
+        break;
+
+    case DRUM_TRIGGER_SCHEDULE:
         {
-            // we've only received the center point of the skeleton, draw that
-            D2D1_ELLIPSE ellipse = D2D1::Ellipse(
-                SkeletonToScreen(skeletonFrame.SkeletonData[i].Position, width, height),
-                g_JointThickness,
-                g_JointThickness
-                );
+            // Move the predicted crossing from the frame clock to the output clock
+            int64_t startUs = DrumGetTimeMicroseconds() + trigger.leadUs - g_SensorLatencyUs;
+            m_Mixer.Schedule(trigger.sampleId, CStrikeDetector::HitGain(trigger.hitVelocity), startUs, trigger.ticket);
 
-            m_pRenderTarget->DrawEllipse(ellipse, m_pBrushJointTracked);
+            DrumSnapshotHit hit = { m_frameTimeUs, trigger.trackingId, trigger.zone, trigger.hitVelocity };
+            m_HitHistory.Add(hit);
         }
+        break;
+
+    case DRUM_TRIGGER_CANCEL:
+        m_Mixer.Cancel(trigger.ticket);
+        break;
+
+    case DRUM_TRIGGER_CHOKE:
+        m_Mixer.Choke(trigger.sampleId);
+        break;
     }
+}
 
-    hr = m_pRenderTarget->EndDraw();
+/// <summary>
+/// Shows how far predicted hit times were from the measured ones
+/// </summary>
+void CSkeletonBasics::ReportPredictionError()
+{
+    HitPredictorStats stats;
+    m_Engine.GetPredictorStats(&stats);
+
+    double meanMs = stats.errorCount ? stats.errorSumUs / (1000.0 * stats.errorCount) : 0.0;
+    double meanAbsMs = stats.errorCount ? stats.errorAbsSumUs / (1000.0 * stats.errorCount) : 0.0;
+
+    WCHAR szMessage[cStatusMessageMaxLen];
+    StringCchPrintfW(szMessage, _countof(szMessage),
+        L"Replay done: %llu predicted, %llu confirmed, %llu cancelled, %llu missed, error %.1f ms (mean |error| %.1f ms, max %.1f ms)",
+        stats.predicted, stats.confirmed, stats.cancelled, stats.missed, meanMs, meanAbsMs, stats.errorAbsMaxUs / 1000.0);
+    SetStatusMessage(szMessage);
+    DBOUT(szMessage << "\n");
+}
 
-    // Device lost, need to recreate the render target
-    // We'll dispose it now and retry drawing
-    if (D2DERR_RECREATE_TARGET == hr)
+/// <summary>
+/// Handle new skeleton data
+/// </summary>
+void CSkeletonBasics::ProcessSkeleton()
+{
+    if (FAILED(FetchSkeleton(0, m_arrivalUs, &m_Frame)))
     {
-        hr = S_OK;
-        DiscardDirect2DResources();
+        return;
     }
+
+    if (m_Recorder.IsOpen())
+    {
+        m_Recorder.Write(m_Frame);
+    }
+
+    ProcessSkeletonFrame(m_Frame);
 }
 
 /// <summary>
-/// Draws a skeleton
-/// </summary>
-/// <param name="skel">skeleton to draw</param>
-/// <param name="windowWidth">width (in pixels) of output buffer</param>
-/// <param name="windowHeight">height (in pixels) of output buffer</param>
-void CSkeletonBasics::DrawSkeleton(const NUI_SKELETON_DATA & skel, int windowWidth, int windowHeight)
-{      
-    int i;
-	LONG x,y;
-		
-    for (i = 0; i < NUI_SKELETON_POSITION_COUNT; ++i)
-    {
-
-        m_Points[i] = SkeletonToScreen(skel.SkeletonPositions[i], windowWidth, windowHeight);
-		NuiTransformSkeletonToDepthImage(skel.SkeletonPositions[i], &x, &y, &depth[i]);
-
-   }
-	
-    /* Calculating the relative depth of the left and right hand ahead of shoulder */
-    USHORT rel_right_depth = depth[2] - depth[11];
-	USHORT rel_left_depth = depth[2] - depth[7];
-
-	if (rel_right_depth > 5000)
-		rel_right_depth = 0;
-	
-    if (rel_left_depth > 5000)
-		rel_left_depth = 0;
-
-	/* Shoulder = depth[2], Left hand = depth[7], right hand = depth[11] */
-	float rel_left_x,rel_left_y,rel_right_x,rel_right_y;
-
-    /* Checking if the motion of the left hand is downward and to the right */
-	if((m_Points[7].x - left_x_old) > 0)
-		left_x_pos = true;
-	else
-		left_x_pos = false;
-
-	if((m_Points[7].y - left_y_old) > 0)
-		left_y_pos = true;
-	else
-		left_y_pos = false;
-
-    /* Checking if the motion of the right hand is downward and to the left */
-	if((m_Points[11].x - right_x_old) > 0)
-		right_x_pos = true;
-	else
-		right_x_pos = false;
-
-	if((m_Points[11].y - right_y_old) > 0)
-		right_y_pos = true;
-	else
-		right_y_pos = false;
-
-	left_x_old = m_Points[7].x;
-	left_y_old = m_Points[7].y;
-	right_x_old = m_Points[11].x;
-	right_y_old = m_Points[11].y;
-
-
-    /* The relative movement taking place between shoulder and left hand*/
-	rel_left_x = m_Points[7].x - m_Points[2].x;
-	rel_left_y = m_Points[7].y - m_Points[2].y;
-
-    /* The relative movement taking place between shoulder and right hand*/
-	rel_right_x = m_Points[11].x - m_Points[2].x;
-	rel_right_y = m_Points[11].y - m_Points[2].y;
-
-	DBOUT("LEFT (" << rel_left_x << "," << rel_left_y << ")\n");
-	DBOUT("RIGHT (" << rel_right_x << "," << rel_right_y << ")\n");
-	
-    if (rel_left_depth > 2800 )
-	{
-		if ((rel_left_x < lowtom_xmax && rel_left_x > lowtom_xmin) && (rel_left_y < lowtom_ymax 
-			&& rel_left_y > lowtom_ymin) && left_y_pos)
-			mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\lowTom-small.WAV"), NULL, 0, NULL);
-
-		if ((rel_left_x < hitom_xmax && rel_left_x > hitom_xmin) && (rel_left_y < hitom_ymax 
-			&& rel_left_y > hitom_ymin) && left_y_pos)
-			mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\highTom-small.WAV"), NULL, 0, NULL);
-	}
-
-	if (rel_right_depth > 2800 )
-	{
-		if ((rel_right_x < lowtom_xmax && rel_right_x > lowtom_xmin) && (rel_right_y < lowtom_ymax 
-			&& rel_right_y > lowtom_ymin) && right_y_pos)
-			mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\lowTom-small.WAV"), NULL, 0, NULL);
-
-		if ((rel_right_x < hitom_xmax && rel_right_x > hitom_xmin) && (rel_right_y < hitom_ymax 
-			&& rel_right_y > hitom_ymin) && right_y_pos)
-			mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\highTom-small.WAV"), NULL, 0, NULL);
-	}
-
-
-	if ((rel_left_x < snare_xmax && rel_left_x > snare_xmin) && (rel_left_y < snare_ymax && rel_left_y > snare_ymin) && 
-        left_y_pos && rel_left_depth <= 2500)
-	{
-		DBOUT("Snare played \n");
-		//PlaySound(TEXT("C:\\Users\\Nirav\\Desktop\\snareDrum.WAV"), NULL, SND_ASYNC);
-		mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\snareDrum.WAV"), NULL, 0, NULL);
-		
-	}
-
-	if ((rel_right_x < ride_xmax && rel_right_x > ride_xmin) && (rel_right_y < ride_ymax && rel_right_y > ride_ymin) 
-		&& right_x_pos && rel_right_depth <=2500)
-	{
-		DBOUT("Ride played \n");
-		mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\ride-small.WAV"), NULL, 0, NULL);
-	}
-
-	if ((rel_right_x < high_hat_xmax && rel_right_x > high_hat_xmin) && (rel_right_y < high_hat_ymax && rel_right_y > high_hat_ymin)
-		&& right_y_pos && rel_right_depth <= 2500)
-	{
-		DBOUT("High Hat played \n");
-		DBOUT("("<< rel_right_x << ","<< rel_right_y<<") \n");
-		//PlaySound(TEXT("C:\\Users\\Nirav\\Desktop\\hihatDrum.WAV"), NULL, SND_ASYNC);
-		mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\hihatDrum.WAV"), NULL, 0, NULL);
-	}
-	
-	if ((rel_right_x < crash_left_xmax && rel_right_x > crash_left_xmin) && 
-		(rel_right_y < crash_left_ymax && rel_right_y > crash_left_ymin) && right_y_pos && rel_right_depth <= 2500)
-	{
-		DBOUT("Crash Left played \n");
-		//PlaySound(TEXT("C:\\Users\\Nirav\\Desktop\\leftCrashDrum-small.WAV"), NULL, SND_ASYNC);
-		mciSendString(TEXT("play C:\\Users\\Nirav\\Desktop\\leftCrashDrum-small.WAV"), NULL, 0, NULL);
-	}
-
-	/* Draw Crash */
-	D2D1_RECT_F crash_shape;
-	crash_shape.left = m_Points[2].x + crash_left_xmin;
-	crash_shape.right = m_Points[2].x + crash_left_xmax;
-	crash_shape.top = m_Points[2].y + crash_left_ymin;
-	crash_shape.bottom = m_Points[2].y + crash_left_ymax;
-	m_pRenderTarget->DrawRectangle(crash_shape, m_pShape, g_TrackedBoneThickness - 5.0);
-
-	/* Draw Hihat */
-	D2D1_RECT_F hihat_shape;
-	hihat_shape.left = m_Points[2].x + high_hat_xmin;
-	hihat_shape.right = m_Points[2].x + high_hat_xmax;
-	hihat_shape.top = m_Points[2].y + high_hat_ymin;
-	hihat_shape.bottom = m_Points[2].y + high_hat_ymax;
-	m_pRenderTarget->DrawRectangle(hihat_shape, m_pShape, g_TrackedBoneThickness - 5.0);
-
-	/* Draw Snare */
-	D2D1_RECT_F snare_shape;
-	snare_shape.left = m_Points[2].x + snare_xmin;
-	snare_shape.right = m_Points[2].x + snare_xmax;
-	snare_shape.top = m_Points[2].y + snare_ymin;
-	snare_shape.bottom = m_Points[2].y + snare_ymax;
-	m_pRenderTarget->DrawRectangle(snare_shape, m_pShape, g_TrackedBoneThickness - 5.0);
-
-	/* Draw Ride */
-	D2D1_RECT_F ride_shape;
-	ride_shape.left = m_Points[2].x + ride_xmin;
-	ride_shape.right = m_Points[2].x + ride_xmax;
-	ride_shape.top = m_Points[2].y + ride_ymin;
-	ride_shape.bottom = m_Points[2].y + ride_ymax;
-	m_pRenderTarget->DrawRectangle(ride_shape, m_pShape, g_TrackedBoneThickness - 5.0);
-
-	/* Draw HiTom */
-	D2D1_RECT_F hitom_shape;
-	hitom_shape.left = m_Points[2].x + hitom_xmin;
-	hitom_shape.right = m_Points[2].x + hitom_xmax;
-	hitom_shape.top = m_Points[2].y + hitom_ymin;
-	hitom_shape.bottom = m_Points[2].y + hitom_ymax;
-	m_pRenderTarget->DrawRectangle(hitom_shape, m_pBrushJointInferred, g_TrackedBoneThickness - 5.0);
-
-	/* Draw LowTom */
-	D2D1_RECT_F lowtom_shape;
-	lowtom_shape.left = m_Points[2].x + lowtom_xmin;
-	lowtom_shape.right = m_Points[2].x + lowtom_xmax;
-	lowtom_shape.top = m_Points[2].y + lowtom_ymin;
-	lowtom_shape.bottom = m_Points[2].y + lowtom_ymax;
-	m_pRenderTarget->DrawRectangle(lowtom_shape, m_pBrushJointInferred, g_TrackedBoneThickness - 5.0);
-
-
-    // Render Torso
-    DrawBone(skel, NUI_SKELETON_POSITION_HEAD, NUI_SKELETON_POSITION_SHOULDER_CENTER);
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_CENTER, NUI_SKELETON_POSITION_SHOULDER_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_CENTER, NUI_SKELETON_POSITION_SHOULDER_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_CENTER, NUI_SKELETON_POSITION_SPINE);
-    DrawBone(skel, NUI_SKELETON_POSITION_SPINE, NUI_SKELETON_POSITION_HIP_CENTER);
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_CENTER, NUI_SKELETON_POSITION_HIP_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_CENTER, NUI_SKELETON_POSITION_HIP_RIGHT);
-
-    // Left Arm
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_LEFT, NUI_SKELETON_POSITION_ELBOW_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ELBOW_LEFT, NUI_SKELETON_POSITION_WRIST_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_WRIST_LEFT, NUI_SKELETON_POSITION_HAND_LEFT);
-
-    // Right Arm
-    DrawBone(skel, NUI_SKELETON_POSITION_SHOULDER_RIGHT, NUI_SKELETON_POSITION_ELBOW_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ELBOW_RIGHT, NUI_SKELETON_POSITION_WRIST_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_WRIST_RIGHT, NUI_SKELETON_POSITION_HAND_RIGHT);
-
-    // Left Leg
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_LEFT, NUI_SKELETON_POSITION_KNEE_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_KNEE_LEFT, NUI_SKELETON_POSITION_ANKLE_LEFT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ANKLE_LEFT, NUI_SKELETON_POSITION_FOOT_LEFT);
-
-    // Right Leg
-    DrawBone(skel, NUI_SKELETON_POSITION_HIP_RIGHT, NUI_SKELETON_POSITION_KNEE_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_KNEE_RIGHT, NUI_SKELETON_POSITION_ANKLE_RIGHT);
-    DrawBone(skel, NUI_SKELETON_POSITION_ANKLE_RIGHT, NUI_SKELETON_POSITION_FOOT_RIGHT);
-
-    // Draw the joints in a different color
-    for (i = 0; i < NUI_SKELETON_POSITION_COUNT; ++i)
-    {
-        D2D1_ELLIPSE ellipse = D2D1::Ellipse( m_Points[i], g_JointThickness, g_JointThickness );
-
-        if ( skel.eSkeletonPositionTrackingState[i] == NUI_SKELETON_POSITION_INFERRED )
-        {
-            m_pRenderTarget->DrawEllipse(ellipse, m_pBrushJointInferred);
-        }
-        else if ( skel.eSkeletonPositionTrackingState[i] == NUI_SKELETON_POSITION_TRACKED )
-        {
-            m_pRenderTarget->DrawEllipse(ellipse, m_pBrushJointTracked);
-        }
-    }
+/// Fetches and smooths the next frame of a Kinect
+/// </summary>
+/// <param name="sensor">index into m_Sensors</param>
+/// <param name="arrivalUs">time the frame was signalled</param>
+/// <param name="pFrame">receives the frame</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonBasics::FetchSkeleton(int sensor, int64_t arrivalUs, SkeletonFrame* pFrame)
+{
+    KinectSensor& kinect = m_Sensors[sensor];
+    NUI_SKELETON_FRAME skeletonFrame = {0};
+
+    HRESULT hr = kinect.pNuiSensor->NuiSkeletonGetNextFrame(0, &skeletonFrame);
+    if ( FAILED(hr) )
+    {
+        return hr;
+    }
+
+    int64_t fetchedUs = DrumGetTimeMicroseconds();
+    m_Latency.Record(LATENCY_STAGE_FETCH, fetchedUs - arrivalUs);
+
+    // smooth out the skeleton data, either by the SDK or by our own filter on the copy
+    int smoothing = m_smoothing;
+    if (SKELETON_SMOOTHING_SDK == smoothing)
+    {
+        kinect.pNuiSensor->NuiTransformSmooth(&skeletonFrame, NULL);
+    }
+
+    CopySkeletonFrame(skeletonFrame, pFrame);
+
+    if (SKELETON_SMOOTHING_ADAPTIVE == smoothing)
+    {
+        // Switched back on, the filter must not pick up where it left off
+        if (SKELETON_SMOOTHING_ADAPTIVE != kinect.filterSmoothing)
+        {
+            kinect.skeletonFilter.Reset();
+        }
+
+        kinect.skeletonFilter.Filter(pFrame, pFrame->timestampMs * 1000);
+    }
+    kinect.filterSmoothing = smoothing;
+    m_Latency.Record(LATENCY_STAGE_SMOOTHING, DrumGetTimeMicroseconds() - fetchedUs);
+    return S_OK;
 }
 
 /// <summary>
-/// Draws a bone line between two joints
+/// Hands the frames the capture threads took to the fusion, and detects hits on every fused frame that is due
 /// </summary>
-/// <param name="skel">skeleton to draw bones from</param>
-/// <param name="joint0">joint to start drawing from</param>
-/// <param name="joint1">joint to end drawing at</param>
-void CSkeletonBasics::DrawBone(const NUI_SKELETON_DATA & skel, NUI_SKELETON_POSITION_INDEX joint0, NUI_SKELETON_POSITION_INDEX joint1)
+void CSkeletonBasics::FuseSkeletons()
 {
-    NUI_SKELETON_POSITION_TRACKING_STATE joint0State = skel.eSkeletonPositionTrackingState[joint0];
-    NUI_SKELETON_POSITION_TRACKING_STATE joint1State = skel.eSkeletonPositionTrackingState[joint1];
-
-	
+    CapturedSkeletonFrame captured;
+    for (int i = 0; i < m_sensorCount; ++i)
+    {
+        KinectSensor& kinect = m_Sensors[i];
+        while (kinect.frames.Pop(captured))
+        {
+            int64_t timeUs = captured.frame.timestampMs * 1000;
+            m_Fusion.Push(i, captured.frame, timeUs, captured.arrivalUs);
 
+            // Each sensor's own frames are recorded on the fused clock, so the recordings replay together
+            if (kinect.recorder.IsOpen())
+            {
+                captured.frame.timestampMs = (timeUs + m_Fusion.ClockOffsetUs(i)) / 1000;
+                kinect.recorder.Write(captured.frame);
+            }
+        }
+    }
 
-    // If we can't find either of these joints, exit
-    if (joint0State == NUI_SKELETON_POSITION_NOT_TRACKED || joint1State == NUI_SKELETON_POSITION_NOT_TRACKED)
+    // Fused frames carry the time sensor 0's frame arrived, so the sensor stage and the mixer see it as theirs
+    int64_t timeUs = 0;
+    while (S_OK == m_Fusion.Pop(DrumGetTimeMicroseconds(), &m_Frame, &timeUs, &m_arrivalUs))
     {
-        return;
+        if (m_Recorder.IsOpen())
+        {
+            m_Recorder.Write(m_Frame);
+        }
+
+        ProcessSkeletonFrame(m_Frame);
     }
+}
+
+/// <summary>
+/// Detect hits on one frame of skeleton data and publish it for drawing
+/// </summary>
+/// <param name="frame">frame from the sensor or a recording</param>
+void CSkeletonBasics::ProcessSkeletonFrame(const SkeletonFrame& frame)
+{
+    m_frameTimeUs = frame.timestampMs * 1000;
+    m_Latency.RecordSensor(m_frameTimeUs, m_arrivalUs);
 
-    // Don't draw if both points are inferred
-    if (joint0State == NUI_SKELETON_POSITION_INFERRED && joint1State == NUI_SKELETON_POSITION_INFERRED)
+    // Every tracked skeleton is its own drummer; what they play comes back through Trigger.
+    // Zones are in skeleton space, so detection does not care about the window at all.
+    m_Engine.ProcessFrame(frame, m_frameTimeUs, this);
+
+    // The render thread draws whenever it gets to it; detection never waits for it
+    FillDrumSnapshot(frame, m_Engine.Players(), m_HitHistory, m_frameTimeUs, &m_Snapshots.WriteBuffer());
+    m_Snapshots.Publish();
+    SetEvent(m_hSnapshotEvent);
+}
+
+/// <summary>
+/// Draws one snapshot
+/// </summary>
+/// <param name="snapshot">snapshot published by detection</param>
+void CSkeletonBasics::DrawSnapshot(const DrumSnapshot& snapshot)
+{
+    int64_t startUs = DrumGetTimeMicroseconds();
+
+    // Endure Direct2D is ready to draw
+    HRESULT hr = EnsureDirect2DResources( );
+    if ( FAILED(hr) )
     {
         return;
     }
 
-    // We assume all drawn bones are inferred unless BOTH joints are tracked
-    if (joint0State == NUI_SKELETON_POSITION_TRACKED && joint1State == NUI_SKELETON_POSITION_TRACKED)
+    // Follow the window size; the snapshot is projected for whatever size it has now
+    RECT rct;
+    GetClientRect( GetDlgItem( m_hWnd, IDC_VIDEOVIEW ), &rct);
+    int width = rct.right;
+    int height = rct.bottom;
+
+    D2D1_SIZE_U size = m_pRenderTarget->GetPixelSize();
+    if (size.width != static_cast<UINT32>(width) || size.height != static_cast<UINT32>(height))
     {
-        m_pRenderTarget->DrawLine(m_Points[joint0], m_Points[joint1], m_pBrushBoneTracked, g_TrackedBoneThickness);
+        m_pRenderTarget->Resize(D2D1::SizeU(width, height));
     }
-    else
+
+    // Skeletons, zones and lit zones are recorded first, then drawn one brush at a time
+    RecordDrumSnapshot(snapshot, width, height, &m_DrawList);
+
+    m_pRenderTarget->BeginDraw();
+    m_pRenderTarget->Clear( );
+    DrawList(m_DrawList);
+    hr = m_pRenderTarget->EndDraw();
+    m_Latency.Record(LATENCY_STAGE_RENDER, DrumGetTimeMicroseconds() - startUs);
+
+    // Device lost, need to recreate the render target
+    // We'll dispose it now and retry drawing
+    if (D2DERR_RECREATE_TARGET == hr)
     {
-        m_pRenderTarget->DrawLine(m_Points[joint0], m_Points[joint1], m_pBrushBoneInferred, g_InferredBoneThickness);
+        hr = S_OK;
+        DiscardDirect2DResources();
     }
 }
 
 /// <summary>
-/// Converts a skeleton point to screen space
+/// Draws a recorded frame batch by batch, setting each brush once per batch
 /// </summary>
-/// <param name="skeletonPoint">skeleton point to tranform</param>
-/// <param name="width">width (in pixels) of output buffer</param>
-/// <param name="height">height (in pixels) of output buffer</param>
-/// <returns>point in screen-space</returns>
-D2D1_POINT_2F CSkeletonBasics::SkeletonToScreen(Vector4 skeletonPoint, int width, int height)
+/// <param name="list">closed draw list of the frame</param>
+void CSkeletonBasics::DrawList(const CDrumDrawList & list)
 {
-    LONG x, y;
-    USHORT depth;
+    const DrumDrawCommand* pCommands = list.Commands();
+    for (int b = 0; b < list.BatchCount(); ++b)
+    {
+        const DrumDrawBatch & batch = list.Batch(b);
+        ID2D1SolidColorBrush* pBrush = m_pBrushes[batch.brush];
+
+        for (int i = batch.first; i < batch.first + batch.count; ++i)
+        {
+            const DrumDrawCommand & command = pCommands[i];
+            switch (command.op)
+            {
+            case DRUM_DRAW_LINE:
+                m_pRenderTarget->DrawLine(D2D1::Point2F(command.x0, command.y0), D2D1::Point2F(command.x1, command.y1), pBrush, command.width);
+                break;
 
-    // Calculate the skeleton's position on the screen
-    // NuiTransformSkeletonToDepthImage returns coordinates in NUI_IMAGE_RESOLUTION_320x240 space
-    NuiTransformSkeletonToDepthImage(skeletonPoint, &x, &y, &depth);
+            case DRUM_DRAW_ELLIPSE:
+                m_pRenderTarget->DrawEllipse(D2D1::Ellipse(D2D1::Point2F(command.x0, command.y0), command.x1, command.y1), pBrush, command.width);
+                break;
 
-    float screenPointX = static_cast<float>(x * width) / cScreenWidth;
-    float screenPointY = static_cast<float>(y * height) / cScreenHeight;
+            case DRUM_DRAW_RECT:
+                m_pRenderTarget->DrawRectangle(D2D1::RectF(command.x0, command.y0, command.x1, command.y1), pBrush, command.width);
+                break;
 
-    return D2D1::Point2F(screenPointX, screenPointY);
+            case DRUM_DRAW_FILL_RECT:
+                m_pRenderTarget->FillRectangle(D2D1::RectF(command.x0, command.y0, command.x1, command.y1), pBrush);
+                break;
+            }
+        }
+    }
 }
 
 /// <summary>
@@ -700,13 +1273,12 @@ HRESULT CSkeletonBasics::EnsureDirect2DResources()
             return hr;
         }
 
-        //light green
-        m_pRenderTarget->CreateSolidColorBrush(D2D1::ColorF(0.27f, 0.75f, 0.27f), &m_pBrushJointTracked);
-
-        m_pRenderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::Yellow, 1.0f), &m_pBrushJointInferred);
-        m_pRenderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::Green, 1.0f), &m_pBrushBoneTracked);
-        m_pRenderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::Gray, 1.0f), &m_pBrushBoneInferred);
-		m_pRenderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::Red, 1.0f), &m_pShape);
+        // The software rasterizer draws with the same colors
+        for (int i = 0; i < DRUM_BRUSH_COUNT; ++i)
+        {
+            const DrumBrushColor & color = cDrumBrushColors[i];
+            m_pRenderTarget->CreateSolidColorBrush(D2D1::ColorF(color.r, color.g, color.b, 1.0f), &m_pBrushes[i]);
+        }
     }
 
     return hr;
@@ -719,10 +1291,10 @@ void CSkeletonBasics::DiscardDirect2DResources( )
 {
     SafeRelease(m_pRenderTarget);
 
-    SafeRelease(m_pBrushJointTracked);
-    SafeRelease(m_pBrushJointInferred);
-    SafeRelease(m_pBrushBoneTracked);
-    SafeRelease(m_pBrushBoneInferred);
+    for (int i = 0; i < DRUM_BRUSH_COUNT; ++i)
+    {
+        SafeRelease(m_pBrushes[i]);
+    }
 }
 
 /// <summary>
@@ -731,5 +1303,14 @@ void CSkeletonBasics::DiscardDirect2DResources( )
 /// <param name="szMessage">message to display</param>
 void CSkeletonBasics::SetStatusMessage(WCHAR * szMessage)
 {
+    // Only the window's thread may send to the window, or closing it could deadlock on a join
+    if (GetCurrentThreadId() != m_uiThreadId)
+    {
+        std::lock_guard<std::mutex> lock(m_StatusLock);
+        StringCchCopyW(m_szQueuedStatus, _countof(m_szQueuedStatus), szMessage);
+        PostMessageW(m_hWnd, WM_APP_STATUS, 0, 0);
+        return;
+    }
+
     SendDlgItemMessageW(m_hWnd, IDC_STATUS, WM_SETTEXT, 0, (LPARAM)szMessage);
 }
\ No newline at end of file
@@ -8,12 +8,36 @@
 
 #include "resource.h"
 #include "NuiApi.h"
+#include "DrumDrawList.h"
+#include "DrumEngine.h"
+#include "DrumKit.h"
+#include "DrumReactor.h"
+#include "DrumMixer.h"
+#include "DrumSnapshot.h"
+#include "LatencyTracer.h"
+#include "MidiOutput.h"
+#include "AudioOutput.h"
+#include "BoundedQueue.h"
+#include "SkeletonFilter.h"
+#include "SkeletonFrame.h"
+#include "SkeletonFusion.h"
+#include "SkeletonProjection.h"
+#include "SkeletonStream.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
 
-class CSkeletonBasics
+// How skeleton frames from the sensor are smoothed before detection
+enum SkeletonSmoothing
 {
-    static const int        cScreenWidth  = 320;
-    static const int        cScreenHeight = 240;
+    SKELETON_SMOOTHING_NONE = 0,        // raw joints
+    SKELETON_SMOOTHING_SDK,             // NuiTransformSmooth with its default parameters
+    SKELETON_SMOOTHING_ADAPTIVE         // CSkeletonFilter
+};
 
+class CSkeletonBasics : public IDrumTriggerSink
+{
     static const int        cStatusMessageMaxLen = MAX_PATH*2;
 
 public:
@@ -54,41 +78,240 @@ public:
     /// <param name="nCmdShow"></param>
     int                     Run(HINSTANCE hInstance, int nCmdShow);
 
+    /// <summary>
+    /// Record every skeleton frame to a file
+    /// </summary>
+    /// <param name="szPath">recording to create</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 StartRecording(const WCHAR* szPath);
+
+    /// <summary>
+    /// Play back a recording instead of using the sensor
+    /// </summary>
+    /// <param name="szPath">recording to replay</param>
+    /// <param name="realTime">pace frames as recorded instead of as fast as possible</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 StartReplay(const WCHAR* szPath, bool realTime);
+
+    /// <summary>
+    /// Send every stroke as a General MIDI drum note, besides playing the samples
+    /// </summary>
+    /// <param name="szName">Standard MIDI File to create, or MIDI port to open</param>
+    /// <param name="port">szName is a MIDI port instead of a file</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 StartMidi(const WCHAR* szName, bool port);
+
+    /// <summary>
+    /// Write the stage latencies to a file on exit
+    /// </summary>
+    /// <param name="szPath">file to write</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 SetLatencyLog(const WCHAR* szPath);
+
+    /// <summary>
+    /// Dump the trace rings to a file on exit, for DrumTraceDecode
+    /// </summary>
+    /// <param name="szPath">file to write</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 SetTraceLog(const WCHAR* szPath);
+
+    /// <summary>
+    /// Stall the render thread after every frame it draws, to check that drawing never delays hits
+    /// </summary>
+    /// <param name="delayMs">milliseconds to stall, 0 for none</param>
+    void                    SetRenderDelay(DWORD delayMs) { m_renderDelayMs = delayMs; }
+
+    /// <summary>
+    /// Fit the zones to the reach of every drummer from a warm-up of strokes, then keep following them
+    /// </summary>
+    /// <param name="enable">true to calibrate</param>
+    void                    SetCalibration(bool enable) { m_Engine.SetCalibration(enable); }
+
+    /// <summary>
+    /// Choose how sensor frames are smoothed; takes effect from the next frame
+    /// </summary>
+    /// <param name="smoothing">SkeletonSmoothing</param>
+    void                    SetSmoothing(int smoothing) { m_smoothing = smoothing; }
+
+    /// <summary>
+    /// Use up to this many Kinects at once, fusing their skeletons; call before the window is created
+    /// </summary>
+    /// <param name="count">1 to cSkeletonFusionMaxSensors</param>
+    void                    SetMaxSensors(int count);
+
+    /// <summary>
+    /// Plays, schedules or cancels a kit piece sample for the engine, and its MIDI note
+    /// </summary>
+    /// <param name="trigger">what the engine detected or predicted</param>
+    virtual void            Trigger(const DrumHitTrigger& trigger);
+
 private:
+    /// <summary>
+    /// Frame a capture thread hands to the detection thread
+    /// </summary>
+    struct CapturedSkeletonFrame
+    {
+        SkeletonFrame       frame;
+        int64_t             arrivalUs;
+    };
+
+    /// <summary>
+    /// One Kinect, with its smoothing, and with several of them the thread that waits for its frames
+    /// </summary>
+    struct KinectSensor
+    {
+        INuiSensor*         pNuiSensor;
+        HANDLE              hNextSkeletonEvent;
+        int                 filterSmoothing;    // smoothing of the previous frame
+        CSkeletonFilter     skeletonFilter;
+        std::thread         captureThread;
+        CBoundedQueue<CapturedSkeletonFrame, 8> frames;     // captured, not yet fused
+        CSkeletonRecorder   recorder;           // this sensor's frames alone, on the fused clock
+    };
+
     HWND                    m_hWnd;
 
-    bool                    m_bSeatedMode;
+    std::atomic<bool>       m_bSeatedMode;
+
+    // Open Kinects; the first one paces the fused stream and sets its skeleton space
+    KinectSensor            m_Sensors[cSkeletonFusionMaxSensors];
+    int                     m_sensorCount;
+    int                     m_maxSensors;
 
-    // Current Kinect
-    INuiSensor*             m_pNuiSensor;
+    // With several Kinects, their frames are fused on the detection thread
+    CSkeletonFusion         m_Fusion;
+    CDrumReactorEvent       m_CapturedEvent;
 
     // Skeletal drawing
     ID2D1HwndRenderTarget*   m_pRenderTarget;
-    ID2D1SolidColorBrush*    m_pBrushJointTracked;
-    ID2D1SolidColorBrush*    m_pBrushJointInferred;
-    ID2D1SolidColorBrush*    m_pBrushBoneTracked;
-    ID2D1SolidColorBrush*    m_pBrushBoneInferred;
-	ID2D1SolidColorBrush*    m_pShape;
-    D2D1_POINT_2F            m_Points[NUI_SKELETON_POSITION_COUNT];
-	USHORT					 depth[NUI_SKELETON_POSITION_COUNT];
+    ID2D1SolidColorBrush*    m_pBrushes[DRUM_BRUSH_COUNT];
+    CDrumDrawList            m_DrawList;         // frame being drawn, projected for the window
+    DWORD                    m_renderDelayMs;
 
 
     // Direct2D
     ID2D1Factory*           m_pD2DFactory;
     
     HANDLE                  m_pSkeletonStreamHandle;
-    HANDLE                  m_hNextSkeletonEvent;
-    
+
+    // One drummer per tracked skeleton
+    CDrumEngine             m_Engine;
+    int64_t                 m_frameTimeUs;
+
+    // Drum audio
+    CDrumMixer              m_Mixer;
+    IAudioOutput*           m_pAudioOutput;
+
+    // MIDI notes to a file or a port, sent from the sink's own thread
+    CMidiTriggerSink        m_Midi;
+    CMidiFileOutput         m_MidiFile;
+    CMidiPortOutput         m_MidiPort;
+    bool                    m_bMidi;
+
+    // Joint smoothing, chosen on the window's thread and applied where each sensor's frames are fetched
+    std::atomic<int>        m_smoothing;
+
+    // Skeleton recording and replay
+    SkeletonFrame           m_Frame;
+    CSkeletonRecorder       m_Recorder;
+    CSkeletonReplayer       m_Replayer;
+    bool                    m_bReplayRealTime;
+    bool                    m_bReplayReported;
+
+    // Stage latencies
+    CLatencyTracer          m_Latency;
+    int64_t                 m_arrivalUs;
+    WCHAR                   m_szLatencyLog[MAX_PATH];
+    char                    m_szTraceLog[MAX_PATH];
+
+    // Detection runs on its own thread, in a reactor that puts frames ahead of any other work,
+    // and hands every frame to the render thread as a snapshot
+    CDrumReactor            m_Reactor;
+    int                     m_frameTimer;       // next recorded frame, or the wait of a fused one running out
+    std::thread             m_DetectionThread;
+    std::thread             m_RenderThread;
+    std::atomic<bool>       m_bStopping;
+    HANDLE                  m_hStopEvent;
+    HANDLE                  m_hSnapshotEvent;
+    CTripleBuffer<DrumSnapshot> m_Snapshots;
+    CDrumHitHistory         m_HitHistory;
+
+    // Status text set from other threads, shown by the window's thread
+    DWORD                   m_uiThreadId;
+    std::mutex              m_StatusLock;
+    WCHAR                   m_szQueuedStatus[cStatusMessageMaxLen];
+
+    /// <summary>
+    /// Starts the detection and render threads, and a capture thread per Kinect if there are several
+    /// </summary>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 StartThreads();
+
+    /// <summary>
+    /// Stops and joins every thread StartThreads started
+    /// </summary>
+    void                    StopThreads();
+
+    /// <summary>
+    /// Waits for the frames of one of several Kinects and hands them to the detection thread until stopped
+    /// </summary>
+    /// <param name="sensor">index into m_Sensors</param>
+    void                    CaptureThread(int sensor);
+
+    /// <summary>
+    /// Waits for skeleton frames and detects hits on them until stopped
+    /// </summary>
+    void                    DetectionThread();
+
+    /// <summary>
+    /// Runs Update for the reactor
+    /// </summary>
+    /// <param name="pContext">the application</param>
+    static void             OnFrameReady(void* pContext);
+
+    /// <summary>
+    /// Applies the seated mode the window's thread chose to every sensor, between frames
+    /// </summary>
+    /// <param name="pContext">the application</param>
+    static void             OnSeatedModeChanged(void* pContext);
+
+    /// <summary>
+    /// Shows the prediction error of the whole recording once it has played
+    /// </summary>
+    /// <param name="pContext">the application</param>
+    static void             OnReplayFinished(void* pContext);
+
+    /// <summary>
+    /// Draws the newest snapshot until stopped
+    /// </summary>
+    void                    RenderThread();
+
     /// <summary>
-    /// Main processing function
+    /// Main processing function, run by the detection thread's reactor whenever a frame may be ready
     /// </summary>
     void                    Update();
 
     /// <summary>
-    /// Create the first connected Kinect found 
+    /// Create the connected Kinects found, up to m_maxSensors
+    /// </summary>
+    /// <returns>S_OK if at least one was created, otherwise failure code</returns>
+    HRESULT                 CreateConnected();
+
+    /// <summary>
+    /// Load the kit samples into the mixer and start audio output
     /// </summary>
     /// <returns>S_OK on success, otherwise failure code</returns>
-    HRESULT                 CreateFirstConnected();
+    HRESULT                 CreateAudio();
+
+    /// <summary>
+    /// Shows how far predicted hit times were from the measured ones
+    /// </summary>
+    void                    ReportPredictionError();
+
+    /// <summary>
+    /// Shows p50, p99 and max of every pipeline stage
+    /// </summary>
+    void                    ReportLatency();
 
     /// <summary>
     /// Handle new skeleton data
@@ -96,40 +319,47 @@ private:
     void                    ProcessSkeleton();
 
     /// <summary>
-    /// Ensure necessary Direct2d resources are created
+    /// Fetches and smooths the next frame of a Kinect
     /// </summary>
-    /// <returns>S_OK if successful, otherwise an error code</returns>
-    HRESULT                 EnsureDirect2DResources( );
+    /// <param name="sensor">index into m_Sensors</param>
+    /// <param name="arrivalUs">time the frame was signalled</param>
+    /// <param name="pFrame">receives the frame</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 FetchSkeleton(int sensor, int64_t arrivalUs, SkeletonFrame* pFrame);
 
     /// <summary>
-    /// Dispose Direct2d resources 
+    /// Hands the frames the capture threads took to the fusion, and detects hits on every fused frame that is due
     /// </summary>
-    void                    DiscardDirect2DResources( );
+    void                    FuseSkeletons();
 
     /// <summary>
-    /// Draws a bone line between two joints
+    /// Detect hits on one frame of skeleton data and publish it for drawing
     /// </summary>
-    /// <param name="skel">skeleton to draw bones from</param>
-    /// <param name="joint0">joint to start drawing from</param>
-    /// <param name="joint1">joint to end drawing at</param>
-    void                    DrawBone(const NUI_SKELETON_DATA & skel, NUI_SKELETON_POSITION_INDEX bone0, NUI_SKELETON_POSITION_INDEX bone1);
+    /// <param name="frame">frame from the sensor or a recording</param>
+    void                    ProcessSkeletonFrame(const SkeletonFrame& frame);
 
     /// <summary>
-    /// Draws a skeleton
+    /// Draws one snapshot
     /// </summary>
-    /// <param name="skel">skeleton to draw</param>
-    /// <param name="windowWidth">width (in pixels) of output buffer</param>
-    /// <param name="windowHeight">height (in pixels) of output buffer</param>
-    void                    DrawSkeleton(const NUI_SKELETON_DATA & skel, int windowWidth, int windowHeight);
+    /// <param name="snapshot">snapshot published by detection</param>
+    void                    DrawSnapshot(const DrumSnapshot& snapshot);
+
+    /// <summary>
+    /// Ensure necessary Direct2d resources are created
+    /// </summary>
+    /// <returns>S_OK if successful, otherwise an error code</returns>
+    HRESULT                 EnsureDirect2DResources( );
+
+    /// <summary>
+    /// Dispose Direct2d resources 
+    /// </summary>
+    void                    DiscardDirect2DResources( );
 
     /// <summary>
-    /// Converts a skeleton point to screen space
+    /// Draws a recorded frame batch by batch, setting each brush once per batch
     /// </summary>
-    /// <param name="skeletonPoint">skeleton point to tranform</param>
-    /// <param name="width">width (in pixels) of output buffer</param>
-    /// <param name="height">height (in pixels) of output buffer</param>
-    /// <returns>point in screen-space</returns>
-    D2D1_POINT_2F           SkeletonToScreen(Vector4 skeletonPoint, int width, int height);
+    /// <param name="list">closed draw list of the frame</param>
+    void                    DrawList(const CDrumDrawList & list);
 
 
     /// <summary>
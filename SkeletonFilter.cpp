@@ -0,0 +1,218 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonFilter.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonFilter.h"
+#include <string.h>
+
+#ifdef DRUM_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+static const float cTwoPi = 6.28318531f;
+
+/// <summary>
+/// Tells whether a joint strikes, and gets the faster hand settings
+/// </summary>
+static bool IsStrikingJoint(int joint)
+{
+    switch (joint)
+    {
+    case SKELETON_JOINT_WRIST_LEFT:
+    case SKELETON_JOINT_HAND_LEFT:
+    case SKELETON_JOINT_WRIST_RIGHT:
+    case SKELETON_JOINT_HAND_RIGHT:
+    case SKELETON_JOINT_ANKLE_LEFT:
+    case SKELETON_JOINT_FOOT_LEFT:
+    case SKELETON_JOINT_ANKLE_RIGHT:
+    case SKELETON_JOINT_FOOT_RIGHT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// <summary>
+/// Gets how far a low pass with the given cutoff moves toward a new sample
+/// </summary>
+static inline float SmoothingFactor(float cutoff, float dt)
+{
+    float r = cTwoPi * cutoff * dt;
+    return r / (r + 1.0f);
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonFilter::CSkeletonFilter()
+{
+    SetParams(DefaultParams());
+    Reset();
+}
+
+/// <summary>
+/// Gets the settings tuned on generated drummers with sensor-like noise
+/// </summary>
+SkeletonFilterParams CSkeletonFilter::DefaultParams()
+{
+    SkeletonFilterParams params;
+    params.handMinCutoff = 2.0f;
+    params.handBeta = 20.0f;
+    params.bodyMinCutoff = 0.5f;
+    params.bodyBeta = 2.0f;
+    params.speedCutoff = 1.0f;
+    return params;
+}
+
+/// <summary>
+/// Changes the settings, keeping what the filter has seen so far
+/// </summary>
+/// <param name="params">new settings</param>
+/// <returns>S_OK on success, E_INVALIDARG for cutoffs that are not positive or negative betas</returns>
+HRESULT CSkeletonFilter::SetParams(const SkeletonFilterParams& params)
+{
+    if (!(params.handMinCutoff > 0.0f) || !(params.bodyMinCutoff > 0.0f) || !(params.speedCutoff > 0.0f) ||
+        !(params.handBeta >= 0.0f) || !(params.bodyBeta >= 0.0f))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_params = params;
+    for (int j = 0; j < cSkeletonJointCount; ++j)
+    {
+        bool striking = IsStrikingJoint(j);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            m_minCutoff[3 * j + axis] = striking ? params.handMinCutoff : params.bodyMinCutoff;
+            m_beta[3 * j + axis] = striking ? params.handBeta : params.bodyBeta;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Forgets every skeleton, so the next frame passes unfiltered
+/// </summary>
+void CSkeletonFilter::Reset()
+{
+    memset(m_position, 0, sizeof(m_position));
+    memset(m_speed, 0, sizeof(m_speed));
+    memset(m_trackingIds, 0, sizeof(m_trackingIds));
+    memset(m_bPrimed, 0, sizeof(m_bPrimed));
+    m_lastTimeUs = 0;
+    m_bHasTime = false;
+}
+
+/// <summary>
+/// Smooths the joints of every tracked skeleton of a frame, in one pass over all of them.
+/// A skeleton seen for the first time, and a joint that was not tracked, start from where they are.
+/// </summary>
+/// <param name="pFrame">frame to smooth in place</param>
+/// <param name="timeUs">capture time of the frame</param>
+void CSkeletonFilter::Filter(SkeletonFrame* pFrame, int64_t timeUs)
+{
+    // Every skeleton of a frame was captured at once, so one time step serves them all
+    int64_t stepUs = timeUs - m_lastTimeUs;
+    if (!m_bHasTime || stepUs <= 0 || stepUs > cSkeletonFilterMaxGapUs)
+    {
+        memset(m_bPrimed, 0, sizeof(m_bPrimed));
+        stepUs = 1;
+    }
+    m_lastTimeUs = timeUs;
+    m_bHasTime = true;
+
+    float dt = stepUs / 1000000.0f;
+    float invDt = 1.0f / dt;
+    float speedFactor = SmoothingFactor(m_params.speedCutoff, dt);
+
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        SkeletonData& skel = pFrame->skeletons[s];
+        if (SKELETON_TRACKED != skel.trackingState)
+        {
+            m_bPrimed[s] = false;
+            continue;
+        }
+
+        // The joints are laid out as x, y, z one after another
+        float* pJoints = &skel.joints[0].x;
+        float* pPosition = m_position[s];
+        float* pSpeed = m_speed[s];
+
+        if (!m_bPrimed[s] || skel.trackingId != m_trackingIds[s])
+        {
+            memcpy(pPosition, pJoints, sizeof(m_position[s]));
+            memset(pSpeed, 0, sizeof(m_speed[s]));
+            m_trackingIds[s] = skel.trackingId;
+            m_bPrimed[s] = true;
+            continue;
+        }
+
+        // Coordinates of joints the sensor lost start over from where they come back
+        uint32_t restart[cSkeletonFilterLanes];
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            uint32_t mask = (SKELETON_JOINT_NOT_TRACKED == skel.jointStates[j]) ? 0xFFFFFFFFu : 0;
+            restart[3 * j] = mask;
+            restart[3 * j + 1] = mask;
+            restart[3 * j + 2] = mask;
+        }
+
+#ifdef DRUM_HAVE_SSE2
+        const __m128 step = _mm_set1_ps(cTwoPi * dt);
+        const __m128 inverseStep = _mm_set1_ps(invDt);
+        const __m128 speedGain = _mm_set1_ps(speedFactor);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+
+        for (int l = 0; l < cSkeletonFilterLanes; l += 4)
+        {
+            __m128 raw = _mm_loadu_ps(pJoints + l);
+            __m128 last = _mm_loadu_ps(pPosition + l);
+            __m128 speed = _mm_loadu_ps(pSpeed + l);
+
+            __m128 rawSpeed = _mm_mul_ps(_mm_sub_ps(raw, last), inverseStep);
+            speed = _mm_add_ps(speed, _mm_mul_ps(speedGain, _mm_sub_ps(rawSpeed, speed)));
+
+            // The faster the joint moves, the higher the cutoff and the less it lags
+            __m128 cutoff = _mm_add_ps(_mm_loadu_ps(m_minCutoff + l), _mm_mul_ps(_mm_loadu_ps(m_beta + l), _mm_andnot_ps(sign, speed)));
+            __m128 r = _mm_mul_ps(step, cutoff);
+            __m128 gain = _mm_div_ps(r, _mm_add_ps(r, one));
+            __m128 filtered = _mm_add_ps(last, _mm_mul_ps(gain, _mm_sub_ps(raw, last)));
+
+            __m128 lost = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(restart + l)));
+            filtered = _mm_or_ps(_mm_and_ps(lost, raw), _mm_andnot_ps(lost, filtered));
+            speed = _mm_andnot_ps(lost, speed);
+
+            _mm_storeu_ps(pPosition + l, filtered);
+            _mm_storeu_ps(pSpeed + l, speed);
+            _mm_storeu_ps(pJoints + l, filtered);
+        }
+#else
+        for (int l = 0; l < cSkeletonFilterLanes; ++l)
+        {
+            float raw = pJoints[l];
+            float last = pPosition[l];
+            if (0 != restart[l])
+            {
+                pPosition[l] = raw;
+                pSpeed[l] = 0.0f;
+                continue;
+            }
+
+            float rawSpeed = (raw - last) * invDt;
+            float speed = pSpeed[l] + speedFactor * (rawSpeed - pSpeed[l]);
+            float cutoff = m_minCutoff[l] + m_beta[l] * ((speed < 0.0f) ? -speed : speed);
+            float r = cTwoPi * dt * cutoff;
+            float filtered = last + r / (r + 1.0f) * (raw - last);
+
+            pPosition[l] = filtered;
+            pSpeed[l] = speed;
+            pJoints[l] = filtered;
+        }
+#endif
+    }
+}
@@ -0,0 +1,93 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonFilter.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Adaptive joint smoothing, in place of NuiTransformSmooth with its default
+// parameters. Every joint coordinate goes through a One-Euro filter: a low pass
+// whose cutoff rises with the speed of the joint, so a joint held still is
+// smoothed hard while a stroke passes with little lag. Hands and feet, which
+// strike, get their own settings; the rest of the body, which zones are measured
+// from, is smoothed harder.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "SkeletonFrame.h"
+
+// Longest gap between frames the filter bridges; after a longer one it starts over
+static const int64_t cSkeletonFilterMaxGapUs = 500000;
+
+// Coordinates of one skeleton, three per joint, in the order of SkeletonData::joints
+static const int     cSkeletonFilterLanes = 3 * cSkeletonJointCount;
+
+/// <summary>
+/// Settings of the joint filter
+/// </summary>
+struct SkeletonFilterParams
+{
+    float                   handMinCutoff;      // Hz, cutoff of wrists, hands, ankles and feet held still
+    float                   handBeta;           // Hz the cutoff rises by per m/s of speed
+    float                   bodyMinCutoff;      // Hz, cutoff of every other joint held still
+    float                   bodyBeta;
+    float                   speedCutoff;        // Hz, cutoff of the speed estimate
+};
+
+/// <summary>
+/// One-Euro filter over every joint of every skeleton in a frame
+/// </summary>
+class CSkeletonFilter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonFilter();
+
+    /// <summary>
+    /// Gets the settings tuned on generated drummers with sensor-like noise
+    /// </summary>
+    static SkeletonFilterParams DefaultParams();
+
+    /// <summary>
+    /// Changes the settings, keeping what the filter has seen so far
+    /// </summary>
+    /// <param name="params">new settings</param>
+    /// <returns>S_OK on success, E_INVALIDARG for cutoffs that are not positive or negative betas</returns>
+    HRESULT                 SetParams(const SkeletonFilterParams& params);
+
+    /// <summary>
+    /// Gets the current settings
+    /// </summary>
+    const SkeletonFilterParams& Params() const { return m_params; }
+
+    /// <summary>
+    /// Forgets every skeleton, so the next frame passes unfiltered
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Smooths the joints of every tracked skeleton of a frame, in one pass over all of them.
+    /// A skeleton seen for the first time, and a joint that was not tracked, start from where they are.
+    /// </summary>
+    /// <param name="pFrame">frame to smooth in place</param>
+    /// <param name="timeUs">capture time of the frame</param>
+    void                    Filter(SkeletonFrame* pFrame, int64_t timeUs);
+
+private:
+    SkeletonFilterParams    m_params;
+
+    // Settings spread out to one value per coordinate
+    float                   m_minCutoff[cSkeletonFilterLanes];
+    float                   m_beta[cSkeletonFilterLanes];
+
+    // Filtered coordinates and speeds of every skeleton slot
+    float                   m_position[cSkeletonCount][cSkeletonFilterLanes];
+    float                   m_speed[cSkeletonCount][cSkeletonFilterLanes];
+    uint32_t                m_trackingIds[cSkeletonCount];
+    bool                    m_bPrimed[cSkeletonCount];          // false for slots with nothing to go on
+
+    int64_t                 m_lastTimeUs;
+    bool                    m_bHasTime;
+};
@@ -0,0 +1,93 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonFrame.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Sensor independent copy of NUI_SKELETON_FRAME. The layout is fixed so frames
+// can be written to disk and mapped back in without any conversion.
+
+#pragma once
+
+#include <stdint.h>
+
+static const int cSkeletonCount      = 6;   // NUI_SKELETON_COUNT
+static const int cSkeletonJointCount = 20;  // NUI_SKELETON_POSITION_COUNT
+
+// Joint indices, same values as NUI_SKELETON_POSITION_INDEX
+enum SkeletonJoint
+{
+    SKELETON_JOINT_HIP_CENTER = 0,
+    SKELETON_JOINT_SPINE,
+    SKELETON_JOINT_SHOULDER_CENTER,
+    SKELETON_JOINT_HEAD,
+    SKELETON_JOINT_SHOULDER_LEFT,
+    SKELETON_JOINT_ELBOW_LEFT,
+    SKELETON_JOINT_WRIST_LEFT,
+    SKELETON_JOINT_HAND_LEFT,
+    SKELETON_JOINT_SHOULDER_RIGHT,
+    SKELETON_JOINT_ELBOW_RIGHT,
+    SKELETON_JOINT_WRIST_RIGHT,
+    SKELETON_JOINT_HAND_RIGHT,
+    SKELETON_JOINT_HIP_LEFT,
+    SKELETON_JOINT_KNEE_LEFT,
+    SKELETON_JOINT_ANKLE_LEFT,
+    SKELETON_JOINT_FOOT_LEFT,
+    SKELETON_JOINT_HIP_RIGHT,
+    SKELETON_JOINT_KNEE_RIGHT,
+    SKELETON_JOINT_ANKLE_RIGHT,
+    SKELETON_JOINT_FOOT_RIGHT
+};
+
+// Same values as NUI_SKELETON_POSITION_TRACKING_STATE
+enum SkeletonJointState
+{
+    SKELETON_JOINT_NOT_TRACKED = 0,
+    SKELETON_JOINT_INFERRED,
+    SKELETON_JOINT_TRACKED
+};
+
+// Same values as NUI_SKELETON_TRACKING_STATE
+enum SkeletonTrackingState
+{
+    SKELETON_NOT_TRACKED = 0,
+    SKELETON_POSITION_ONLY,
+    SKELETON_TRACKED
+};
+
+/// <summary>
+/// Point in skeleton space, in meters from the sensor
+/// </summary>
+struct SkeletonPoint
+{
+    float                   x;
+    float                   y;
+    float                   z;
+};
+
+/// <summary>
+/// One tracked body
+/// </summary>
+struct SkeletonData
+{
+    uint32_t                trackingState;
+    uint32_t                trackingId;
+    SkeletonPoint           position;
+    SkeletonPoint           joints[cSkeletonJointCount];
+    uint8_t                 jointStates[cSkeletonJointCount];
+};
+
+/// <summary>
+/// All bodies seen by the sensor at one instant
+/// </summary>
+struct SkeletonFrame
+{
+    int64_t                 timestampMs;
+    uint32_t                frameNumber;
+    uint32_t                flags;
+    float                   floorClipPlane[4];
+    SkeletonData            skeletons[cSkeletonCount];
+};
+
+static_assert(sizeof(SkeletonData) == 280, "SkeletonData layout is part of the recording format");
+static_assert(sizeof(SkeletonFrame) == 1712, "SkeletonFrame layout is part of the recording format");
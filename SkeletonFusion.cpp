@@ -0,0 +1,724 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonFusion.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonFusion.h"
+#include <math.h>
+#include <string.h>
+
+// Power iterations that find the rotation of a pose fit; a drummer's joints spread
+// wide enough in two directions that far fewer would do
+static const int g_RegisterIterations = 200;
+
+static const SkeletonSensorPose g_IdentityPose = { { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f } };
+
+/// <summary>
+/// Moves a point from a sensor's skeleton space into sensor 0's
+/// </summary>
+static SkeletonPoint TransformPoint(const SkeletonSensorPose& pose, const SkeletonPoint& point)
+{
+    const float* r = pose.rotation;
+    SkeletonPoint moved;
+    moved.x = r[0] * point.x + r[1] * point.y + r[2] * point.z + pose.translation[0];
+    moved.y = r[3] * point.x + r[4] * point.y + r[5] * point.z + pose.translation[1];
+    moved.z = r[6] * point.x + r[7] * point.y + r[8] * point.z + pose.translation[2];
+    return moved;
+}
+
+/// <summary>
+/// Moves every tracked skeleton of a frame from a sensor's skeleton space into sensor 0's
+/// </summary>
+static void TransformFrame(const SkeletonSensorPose& pose, SkeletonFrame* pFrame)
+{
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        SkeletonData& skel = pFrame->skeletons[s];
+        if (SKELETON_NOT_TRACKED == skel.trackingState)
+        {
+            continue;
+        }
+
+        skel.position = TransformPoint(pose, skel.position);
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            skel.joints[j] = TransformPoint(pose, skel.joints[j]);
+        }
+    }
+}
+
+/// <summary>
+/// Finds the tracked skeleton with a tracking id
+/// </summary>
+/// <returns>skeleton index, -1 if none</returns>
+static int FindSkeleton(const SkeletonFrame& frame, uint32_t trackingId)
+{
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        if (SKELETON_TRACKED == frame.skeletons[s].trackingState && trackingId == frame.skeletons[s].trackingId)
+        {
+            return s;
+        }
+    }
+
+    return -1;
+}
+
+/// <summary>
+/// Counts the tracked skeletons of a frame
+/// </summary>
+/// <param name="frame">frame to look at</param>
+/// <param name="pFirst">receives the index of the first one</param>
+/// <returns>number of tracked skeletons</returns>
+static int CountTracked(const SkeletonFrame& frame, int* pFirst)
+{
+    int count = 0;
+    for (int s = cSkeletonCount; s-- > 0;)
+    {
+        if (SKELETON_TRACKED == frame.skeletons[s].trackingState)
+        {
+            *pFirst = s;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Gets the point two sensors' views of one drummer are matched by
+/// </summary>
+static const SkeletonPoint& MatchPoint(const SkeletonData& skel)
+{
+    return (SKELETON_JOINT_NOT_TRACKED != skel.jointStates[SKELETON_JOINT_SHOULDER_CENTER]) ?
+        skel.joints[SKELETON_JOINT_SHOULDER_CENTER] : skel.position;
+}
+
+/// <summary>
+/// Fits the rotation and translation that best map a sensor's joints onto sensor 0's
+/// (Horn's closed form, with the rotation as the leading eigenvector of a 4x4 matrix)
+/// </summary>
+/// <param name="sums">joint pairs as sums</param>
+/// <param name="pPose">receives the pose</param>
+/// <param name="pRms">receives the root mean square distance left between the pairs</param>
+/// <returns>false with too few pairs to fit</returns>
+static bool FitPose(double count, const double* sumSensor, const double* sumReference, const double* sumCross,
+                    double sumSquares, SkeletonSensorPose* pPose, float* pRms)
+{
+    if (count < 3.0)
+    {
+        return false;
+    }
+
+    double p[3];
+    double q[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        p[a] = sumSensor[a] / count;
+        q[a] = sumReference[a] / count;
+    }
+
+    // Covariance of the centered pairs, sensor by reference
+    double S[3][3];
+    for (int a = 0; a < 3; ++a)
+    {
+        for (int b = 0; b < 3; ++b)
+        {
+            S[a][b] = sumCross[3 * a + b] - count * p[a] * q[b];
+        }
+    }
+    double spread = sumSquares - count * (p[0] * p[0] + p[1] * p[1] + p[2] * p[2] + q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+
+    double N[4][4];
+    N[0][0] = S[0][0] + S[1][1] + S[2][2];
+    N[0][1] = S[1][2] - S[2][1];
+    N[0][2] = S[2][0] - S[0][2];
+    N[0][3] = S[0][1] - S[1][0];
+    N[1][1] = S[0][0] - S[1][1] - S[2][2];
+    N[1][2] = S[0][1] + S[1][0];
+    N[1][3] = S[2][0] + S[0][2];
+    N[2][2] = -S[0][0] + S[1][1] - S[2][2];
+    N[2][3] = S[1][2] + S[2][1];
+    N[3][3] = -S[0][0] - S[1][1] + S[2][2];
+
+    double norm = 0.0;
+    for (int a = 0; a < 4; ++a)
+    {
+        for (int b = a; b < 4; ++b)
+        {
+            N[b][a] = N[a][b];
+            norm += ((a == b) ? 1.0 : 2.0) * N[a][b] * N[a][b];
+        }
+    }
+
+    // Shifted by its norm every eigenvalue is positive, so the largest one wins the power iteration
+    norm = sqrt(norm);
+    for (int a = 0; a < 4; ++a)
+    {
+        N[a][a] += norm;
+    }
+
+    double v[4] = { 1.0, 0.3, 0.2, 0.1 };
+    for (int i = 0; i < g_RegisterIterations; ++i)
+    {
+        double w[4];
+        double length = 0.0;
+        for (int a = 0; a < 4; ++a)
+        {
+            w[a] = N[a][0] * v[0] + N[a][1] * v[1] + N[a][2] * v[2] + N[a][3] * v[3];
+            length += w[a] * w[a];
+        }
+
+        length = sqrt(length);
+        if (!(length > 0.0))
+        {
+            return false;
+        }
+
+        for (int a = 0; a < 4; ++a)
+        {
+            v[a] = w[a] / length;
+        }
+    }
+
+    double qw = v[0], qx = v[1], qy = v[2], qz = v[3];
+    double R[3][3] =
+    {
+        { 1.0 - 2.0 * (qy * qy + qz * qz), 2.0 * (qx * qy - qw * qz), 2.0 * (qx * qz + qw * qy) },
+        { 2.0 * (qx * qy + qw * qz), 1.0 - 2.0 * (qx * qx + qz * qz), 2.0 * (qy * qz - qw * qx) },
+        { 2.0 * (qx * qz - qw * qy), 2.0 * (qy * qz + qw * qx), 1.0 - 2.0 * (qx * qx + qy * qy) },
+    };
+
+    // What is left over after the fit: sum of |q - R p|^2 over the centered pairs
+    double aligned = 0.0;
+    for (int a = 0; a < 3; ++a)
+    {
+        pPose->translation[a] = static_cast<float>(q[a] - (R[a][0] * p[0] + R[a][1] * p[1] + R[a][2] * p[2]));
+        for (int b = 0; b < 3; ++b)
+        {
+            pPose->rotation[3 * a + b] = static_cast<float>(R[a][b]);
+            aligned += R[a][b] * S[b][a];
+        }
+    }
+
+    double residual = spread - 2.0 * aligned;
+    *pRms = static_cast<float>(sqrt((residual > 0.0) ? residual / count : 0.0));
+    return true;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonFusion::CSkeletonFusion() :
+    m_params(DefaultParams()),
+    m_pTracer(NULL)
+{
+    Initialize(1);
+}
+
+/// <summary>
+/// Gets the default settings
+/// </summary>
+SkeletonFusionParams CSkeletonFusion::DefaultParams()
+{
+    SkeletonFusionParams params;
+    params.trackedWeight = 1.0f;
+    params.inferredWeight = 0.1f;
+    params.matchDistance = 0.4f;
+    params.maxWaitUs = 50000;
+    return params;
+}
+
+/// <summary>
+/// Forgets every frame, clock offset and pose, and sets the number of sensors
+/// </summary>
+/// <param name="sensorCount">1 to cSkeletonFusionMaxSensors</param>
+/// <returns>S_OK on success, E_INVALIDARG for a count out of range</returns>
+HRESULT CSkeletonFusion::Initialize(int sensorCount)
+{
+    if (sensorCount < 1 || sensorCount > cSkeletonFusionMaxSensors)
+    {
+        return E_INVALIDARG;
+    }
+
+    memset(m_sensors, 0, sizeof(m_sensors));
+    for (int i = 0; i < cSkeletonFusionMaxSensors; ++i)
+    {
+        m_sensors[i].pose = g_IdentityPose;
+    }
+
+    // Sensor 0 defines the space everything is fused in
+    m_sensors[0].bRegistered = true;
+
+    memset(m_bHaveSample, 0, sizeof(m_bHaveSample));
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_sensorCount = sensorCount;
+    m_lastFusedUs = 0;
+    m_bFused = false;
+    return S_OK;
+}
+
+/// <summary>
+/// Changes the settings
+/// </summary>
+/// <param name="params">new settings</param>
+/// <returns>S_OK on success, E_INVALIDARG for negative weights, no tracked weight or a negative wait</returns>
+HRESULT CSkeletonFusion::SetParams(const SkeletonFusionParams& params)
+{
+    if (!(params.trackedWeight > 0.0f) || !(params.inferredWeight >= 0.0f) || !(params.matchDistance > 0.0f) ||
+        params.maxWaitUs < 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_params = params;
+    return S_OK;
+}
+
+/// <summary>
+/// Sets the time to add to a sensor's frame times to bring them onto the fused clock,
+/// instead of learning it from when frames arrive
+/// </summary>
+/// <param name="sensor">sensor index</param>
+/// <param name="offsetUs">microseconds to add</param>
+/// <returns>S_OK on success, E_INVALIDARG for a sensor out of range</returns>
+HRESULT CSkeletonFusion::SetClockOffset(int sensor, int64_t offsetUs)
+{
+    if (sensor < 0 || sensor >= m_sensorCount)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_sensors[sensor].clockOffsetUs = offsetUs;
+    m_sensors[sensor].bFixedOffset = true;
+    return S_OK;
+}
+
+/// <summary>
+/// Sets where a sensor stands, instead of learning it
+/// </summary>
+/// <param name="sensor">sensor index, 1 or more; sensor 0 defines the space</param>
+/// <param name="pose">map from the sensor's skeleton space into sensor 0's</param>
+/// <returns>S_OK on success, E_INVALIDARG for a sensor out of range</returns>
+HRESULT CSkeletonFusion::SetSensorPose(int sensor, const SkeletonSensorPose& pose)
+{
+    if (sensor < 1 || sensor >= m_sensorCount)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_sensors[sensor].pose = pose;
+    m_sensors[sensor].bRegistered = true;
+    return S_OK;
+}
+
+/// <summary>
+/// Takes one frame of a sensor
+/// </summary>
+/// <param name="sensor">sensor index</param>
+/// <param name="frame">frame, copied</param>
+/// <param name="timeUs">capture time on the sensor's clock</param>
+/// <param name="arrivalUs">time the frame arrived, on the clock nowUs of Pop is read from</param>
+/// <returns>S_OK, S_FALSE if the frame came too late to be used, E_INVALIDARG for a sensor out of range</returns>
+HRESULT CSkeletonFusion::Push(int sensor, const SkeletonFrame& frame, int64_t timeUs, int64_t arrivalUs)
+{
+    if (sensor < 0 || sensor >= m_sensorCount)
+    {
+        return E_INVALIDARG;
+    }
+
+    Sensor& source = m_sensors[sensor];
+
+    // The sensor clocks are unrelated to ours; the quickest frame seen tells them apart best
+    int64_t offsetUs = arrivalUs - timeUs;
+    if (!source.bFixedOffset && (!source.bHeard || offsetUs < source.clockOffsetUs))
+    {
+        source.clockOffsetUs = offsetUs;
+    }
+    source.bHeard = true;
+    source.lastArrivalUs = arrivalUs;
+
+    // The fused stream never goes back in time
+    if (0 == sensor && m_bFused && timeUs + source.clockOffsetUs <= m_lastFusedUs)
+    {
+        ++m_stats.late;
+        return S_FALSE;
+    }
+
+    int at = source.count;
+    while (at > 0 && source.entries[at - 1].timeUs > timeUs)
+    {
+        --at;
+    }
+
+    if (cSkeletonFusionDepth == source.count)
+    {
+        // Full: the oldest frame makes room, unless the new one is older still
+        ++m_stats.overflowed;
+        if (0 == at)
+        {
+            return S_FALSE;
+        }
+
+        memmove(&source.entries[0], &source.entries[1], (at - 1) * sizeof(Entry));
+        --at;
+    }
+    else
+    {
+        memmove(&source.entries[at + 1], &source.entries[at], (source.count - at) * sizeof(Entry));
+        ++source.count;
+    }
+
+    Entry& entry = source.entries[at];
+    entry.frame = frame;
+    entry.timeUs = timeUs;
+    entry.arrivalUs = arrivalUs;
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the next fused frame once every live sensor has caught up with it or it has
+/// waited maxWaitUs
+/// </summary>
+/// <param name="nowUs">current time</param>
+/// <param name="pFrame">receives the fused frame, in sensor 0's space</param>
+/// <param name="pTimeUs">receives its capture time on the fused clock</param>
+/// <param name="pArrivalUs">receives when sensor 0's frame arrived</param>
+/// <returns>S_OK with a frame, S_FALSE if none is due yet</returns>
+HRESULT CSkeletonFusion::Pop(int64_t nowUs, SkeletonFrame* pFrame, int64_t* pTimeUs, int64_t* pArrivalUs)
+{
+    Sensor& reference = m_sensors[0];
+    if (0 == reference.count)
+    {
+        return S_FALSE;
+    }
+
+    const Entry& next = reference.entries[0];
+    int64_t timeUs = next.timeUs + reference.clockOffsetUs;
+
+    // Sensors never heard from or gone silent are not waited for
+    bool complete = true;
+    for (int i = 1; i < m_sensorCount; ++i)
+    {
+        const Sensor& sensor = m_sensors[i];
+        if (!sensor.bHeard || nowUs - sensor.lastArrivalUs > cSkeletonFusionMaxSilenceUs)
+        {
+            continue;
+        }
+
+        if (0 == sensor.count || sensor.entries[sensor.count - 1].timeUs + sensor.clockOffsetUs < timeUs)
+        {
+            complete = false;
+        }
+    }
+
+    if (!complete && nowUs - next.arrivalUs < m_params.maxWaitUs)
+    {
+        return S_FALSE;
+    }
+
+    *pFrame = next.frame;
+    pFrame->timestampMs = timeUs / 1000;
+    *pTimeUs = timeUs;
+    *pArrivalUs = next.arrivalUs;
+    if (NULL != m_pTracer)
+    {
+        m_pTracer->Record(LATENCY_STAGE_FUSION, nowUs - next.arrivalUs);
+    }
+
+    // The other sensors at this instant, in sensor 0's space once it is known where they stand
+    for (int i = 1; i < m_sensorCount; ++i)
+    {
+        m_bHaveSample[i] = Sample(i, timeUs, &m_samples[i]);
+        if (m_bHaveSample[i] && !m_sensors[i].bRegistered)
+        {
+            Register(i, *pFrame, m_samples[i]);
+            m_bHaveSample[i] = false;
+        }
+        else if (m_bHaveSample[i])
+        {
+            TransformFrame(m_sensors[i].pose, &m_samples[i]);
+        }
+    }
+
+    Fuse(pFrame);
+
+    // Only the latest frame before this instant can still be needed, to interpolate from
+    for (int i = 1; i < m_sensorCount; ++i)
+    {
+        Sensor& sensor = m_sensors[i];
+        int stale = 0;
+        while (stale + 1 < sensor.count && sensor.entries[stale + 1].timeUs + sensor.clockOffsetUs <= timeUs)
+        {
+            ++stale;
+        }
+
+        memmove(&sensor.entries[0], &sensor.entries[stale], (sensor.count - stale) * sizeof(Entry));
+        sensor.count -= stale;
+    }
+
+    memmove(&reference.entries[0], &reference.entries[1], (reference.count - 1) * sizeof(Entry));
+    --reference.count;
+
+    m_lastFusedUs = timeUs;
+    m_bFused = true;
+    ++m_stats.fused;
+    ++m_stats.contributed[0];
+    m_stats.incomplete += complete ? 0 : 1;
+    return S_OK;
+}
+
+/// <summary>
+/// Gets how long until the oldest waiting frame goes out whatever has arrived
+/// </summary>
+/// <param name="nowUs">current time</param>
+/// <returns>microseconds, 0 if it is due, negative if no frame is waiting</returns>
+int64_t CSkeletonFusion::TimeUntilDueUs(int64_t nowUs) const
+{
+    if (0 == m_sensors[0].count)
+    {
+        return -1;
+    }
+
+    int64_t waitUs = m_sensors[0].entries[0].arrivalUs + m_params.maxWaitUs - nowUs;
+    return (waitUs > 0) ? waitUs : 0;
+}
+
+/// <summary>
+/// Gets a sensor's frames at an instant, interpolated between the frames either side
+/// </summary>
+/// <returns>false if the sensor has no frame near enough</returns>
+bool CSkeletonFusion::Sample(int sensor, int64_t timeUs, SkeletonFrame* pSample) const
+{
+    const Sensor& source = m_sensors[sensor];
+    int after = 0;
+    while (after < source.count && source.entries[after].timeUs + source.clockOffsetUs < timeUs)
+    {
+        ++after;
+    }
+
+    const Entry* pBefore = (after > 0) ? &source.entries[after - 1] : NULL;
+    const Entry* pAfter = (after < source.count) ? &source.entries[after] : NULL;
+    int64_t beforeUs = (NULL != pBefore) ? timeUs - (pBefore->timeUs + source.clockOffsetUs) : 0;
+    int64_t afterUs = (NULL != pAfter) ? pAfter->timeUs + source.clockOffsetUs - timeUs : 0;
+
+    // Too far apart to bridge, the nearer one may still do
+    if (NULL != pBefore && NULL != pAfter && beforeUs + afterUs > cSkeletonFusionMaxBridgeUs)
+    {
+        if (beforeUs <= afterUs)
+        {
+            pAfter = NULL;
+        }
+        else
+        {
+            pBefore = NULL;
+        }
+    }
+
+    if (NULL == pBefore || NULL == pAfter)
+    {
+        const Entry* pNearest = (NULL != pBefore) ? pBefore : pAfter;
+        if (NULL == pNearest || ((NULL != pBefore) ? beforeUs : afterUs) > cSkeletonFusionMaxHoldUs)
+        {
+            return false;
+        }
+
+        *pSample = pNearest->frame;
+        return true;
+    }
+
+    // Drummers in both frames are moved to the instant, the rest are taken from the nearer frame
+    float u = static_cast<float>(beforeUs) / static_cast<float>(beforeUs + afterUs);
+    *pSample = (u <= 0.5f) ? pBefore->frame : pAfter->frame;
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        SkeletonData& skel = pSample->skeletons[s];
+        if (SKELETON_TRACKED != skel.trackingState)
+        {
+            continue;
+        }
+
+        int a = FindSkeleton(pBefore->frame, skel.trackingId);
+        int b = FindSkeleton(pAfter->frame, skel.trackingId);
+        if (a < 0 || b < 0)
+        {
+            continue;
+        }
+
+        const SkeletonData& from = pBefore->frame.skeletons[a];
+        const SkeletonData& to = pAfter->frame.skeletons[b];
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            skel.joints[j].x = from.joints[j].x + u * (to.joints[j].x - from.joints[j].x);
+            skel.joints[j].y = from.joints[j].y + u * (to.joints[j].y - from.joints[j].y);
+            skel.joints[j].z = from.joints[j].z + u * (to.joints[j].z - from.joints[j].z);
+            skel.jointStates[j] = (from.jointStates[j] < to.jointStates[j]) ? from.jointStates[j] : to.jointStates[j];
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Adds the joints of the one drummer sensor 0 and a sensor both track to the sensor's
+/// pose fit, and fits the pose once there are enough
+/// </summary>
+void CSkeletonFusion::Register(int sensor, const SkeletonFrame& reference, const SkeletonFrame& sample)
+{
+    // With more than one drummer in view it is not known who is who yet
+    int referenceSlot = 0;
+    int sampleSlot = 0;
+    if (1 != CountTracked(reference, &referenceSlot) || 1 != CountTracked(sample, &sampleSlot))
+    {
+        return;
+    }
+
+    Correspondence& pairs = m_sensors[sensor].correspondence;
+    const SkeletonData& target = reference.skeletons[referenceSlot];
+    const SkeletonData& seen = sample.skeletons[sampleSlot];
+    for (int j = 0; j < cSkeletonJointCount; ++j)
+    {
+        if (SKELETON_JOINT_TRACKED != target.jointStates[j] || SKELETON_JOINT_TRACKED != seen.jointStates[j])
+        {
+            continue;
+        }
+
+        double p[3] = { seen.joints[j].x, seen.joints[j].y, seen.joints[j].z };
+        double q[3] = { target.joints[j].x, target.joints[j].y, target.joints[j].z };
+        pairs.count += 1.0;
+        for (int a = 0; a < 3; ++a)
+        {
+            pairs.sumSensor[a] += p[a];
+            pairs.sumReference[a] += q[a];
+            pairs.sumSquares += p[a] * p[a] + q[a] * q[a];
+            for (int b = 0; b < 3; ++b)
+            {
+                pairs.sumCross[3 * a + b] += p[a] * q[b];
+            }
+        }
+    }
+
+    if (++pairs.frames < cSkeletonFusionRegisterFrames)
+    {
+        return;
+    }
+
+    // A poor fit means the two sensors were not looking at the same drummer; start over
+    SkeletonSensorPose pose;
+    float rms = 0.0f;
+    if (FitPose(pairs.count, pairs.sumSensor, pairs.sumReference, pairs.sumCross, pairs.sumSquares, &pose, &rms) &&
+        rms <= cSkeletonFusionRegisterMaxRms)
+    {
+        m_sensors[sensor].pose = pose;
+        m_sensors[sensor].bRegistered = true;
+    }
+
+    memset(&pairs, 0, sizeof(pairs));
+}
+
+/// <summary>
+/// Averages the joints of the other sensors' samples into sensor 0's frame
+/// </summary>
+void CSkeletonFusion::Fuse(SkeletonFrame* pFrame)
+{
+    bool claimed[cSkeletonFusionMaxSensors][cSkeletonCount];
+    bool contributed[cSkeletonFusionMaxSensors];
+    memset(claimed, 0, sizeof(claimed));
+    memset(contributed, 0, sizeof(contributed));
+
+    float matchSquared = m_params.matchDistance * m_params.matchDistance;
+    for (int s = 0; s < cSkeletonCount; ++s)
+    {
+        SkeletonData& skel = pFrame->skeletons[s];
+        if (SKELETON_TRACKED != skel.trackingState)
+        {
+            continue;
+        }
+
+        float sum[cSkeletonJointCount][3];
+        float weight[cSkeletonJointCount];
+        uint8_t state[cSkeletonJointCount];
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            state[j] = skel.jointStates[j];
+            weight[j] = (SKELETON_JOINT_TRACKED == state[j]) ? m_params.trackedWeight :
+                        (SKELETON_JOINT_INFERRED == state[j]) ? m_params.inferredWeight : 0.0f;
+            sum[j][0] = weight[j] * skel.joints[j].x;
+            sum[j][1] = weight[j] * skel.joints[j].y;
+            sum[j][2] = weight[j] * skel.joints[j].z;
+        }
+
+        const SkeletonPoint& anchor = MatchPoint(skel);
+        for (int i = 1; i < m_sensorCount; ++i)
+        {
+            if (!m_bHaveSample[i])
+            {
+                continue;
+            }
+
+            // The same drummer as seen by this sensor: the nearest one not already taken
+            int best = -1;
+            float bestSquared = matchSquared;
+            for (int k = 0; k < cSkeletonCount; ++k)
+            {
+                const SkeletonData& other = m_samples[i].skeletons[k];
+                if (SKELETON_TRACKED != other.trackingState || claimed[i][k])
+                {
+                    continue;
+                }
+
+                const SkeletonPoint& point = MatchPoint(other);
+                float dx = point.x - anchor.x;
+                float dy = point.y - anchor.y;
+                float dz = point.z - anchor.z;
+                float squared = dx * dx + dy * dy + dz * dz;
+                if (squared < bestSquared)
+                {
+                    best = k;
+                    bestSquared = squared;
+                }
+            }
+
+            if (best < 0)
+            {
+                continue;
+            }
+
+            claimed[i][best] = true;
+            contributed[i] = true;
+            const SkeletonData& other = m_samples[i].skeletons[best];
+            for (int j = 0; j < cSkeletonJointCount; ++j)
+            {
+                float w = (SKELETON_JOINT_TRACKED == other.jointStates[j]) ? m_params.trackedWeight :
+                          (SKELETON_JOINT_INFERRED == other.jointStates[j]) ? m_params.inferredWeight : 0.0f;
+                weight[j] += w;
+                sum[j][0] += w * other.joints[j].x;
+                sum[j][1] += w * other.joints[j].y;
+                sum[j][2] += w * other.joints[j].z;
+                state[j] = (other.jointStates[j] > state[j]) ? other.jointStates[j] : state[j];
+            }
+        }
+
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            if (weight[j] > 0.0f)
+            {
+                skel.joints[j].x = sum[j][0] / weight[j];
+                skel.joints[j].y = sum[j][1] / weight[j];
+                skel.joints[j].z = sum[j][2] / weight[j];
+            }
+
+            if (SKELETON_JOINT_TRACKED == state[j] && SKELETON_JOINT_TRACKED != skel.jointStates[j])
+            {
+                ++m_stats.recoveredJoints;
+            }
+            skel.jointStates[j] = state[j];
+        }
+    }
+
+    for (int i = 1; i < m_sensorCount; ++i)
+    {
+        m_stats.contributed[i] += contributed[i] ? 1 : 0;
+    }
+}
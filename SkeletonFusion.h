@@ -0,0 +1,246 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonFusion.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Fusion of the skeleton streams of several sensors into one. Each sensor has its
+// own clock and takes its frames at its own instants. Frames are moved onto one
+// clock, held in a short reorder buffer until every sensor has been heard from past
+// the same instant, and the other sensors' skeletons are interpolated to that
+// instant. Every joint is then averaged over the sensors that see it, weighted by
+// how sure each sensor is of it, so a hand one sensor only infers behind a cymbal
+// is taken from a sensor that tracks it. Sensor 0 paces the fused stream and sets
+// the space it is in; where the others stand is learned from a drummer they track
+// together, unless it is given.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "LatencyTracer.h"
+#include "SkeletonFrame.h"
+
+static const int     cSkeletonFusionMaxSensors = 4;
+static const int     cSkeletonFusionDepth = 8;                  // frames held per sensor
+
+// A sensor silent for longer no longer holds the fused stream back
+static const int64_t cSkeletonFusionMaxSilenceUs = 200000;
+
+// Furthest a sensor's frame may lie from a fused instant and still be used as it is,
+// and the longest gap between two of its frames that is interpolated across
+static const int64_t cSkeletonFusionMaxHoldUs = 40000;
+static const int64_t cSkeletonFusionMaxBridgeUs = 100000;
+
+// Frames of a drummer both sensors track that a sensor's pose is fitted from,
+// and how far the fitted joints may lie from sensor 0's on average
+static const int     cSkeletonFusionRegisterFrames = 60;
+static const float   cSkeletonFusionRegisterMaxRms = 0.05f;
+
+/// <summary>
+/// Where a sensor stands: maps points of its skeleton space into sensor 0's
+/// </summary>
+struct SkeletonSensorPose
+{
+    float                   rotation[9];        // row major
+    float                   translation[3];     // meters
+};
+
+/// <summary>
+/// Settings of the fusion
+/// </summary>
+struct SkeletonFusionParams
+{
+    float                   trackedWeight;      // weight of a joint a sensor tracks
+    float                   inferredWeight;     // weight of a joint a sensor only infers
+    float                   matchDistance;      // meters two sensors' shoulder centers of one drummer may lie apart
+    int64_t                 maxWaitUs;          // longest a frame of sensor 0 waits for the others
+};
+
+/// <summary>
+/// What the fusion has done so far
+/// </summary>
+struct SkeletonFusionStats
+{
+    uint64_t                fused;              // frames out
+    uint64_t                incomplete;         // frames out before every live sensor had caught up
+    uint64_t                late;               // frames of sensor 0 older than a frame already out, dropped
+    uint64_t                overflowed;         // frames pushed out of a full reorder buffer
+    uint64_t                recoveredJoints;    // joints sensor 0 lost or inferred that another sensor tracked
+    uint64_t                contributed[cSkeletonFusionMaxSensors];     // frames each sensor had a part in
+};
+
+/// <summary>
+/// Aligns and fuses the skeleton streams of up to cSkeletonFusionMaxSensors sensors.
+/// Not thread safe: push and pop from one thread.
+/// </summary>
+class CSkeletonFusion
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonFusion();
+
+    /// <summary>
+    /// Gets the default settings
+    /// </summary>
+    static SkeletonFusionParams DefaultParams();
+
+    /// <summary>
+    /// Forgets every frame, clock offset and pose, and sets the number of sensors
+    /// </summary>
+    /// <param name="sensorCount">1 to cSkeletonFusionMaxSensors</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a count out of range</returns>
+    HRESULT                 Initialize(int sensorCount);
+
+    /// <summary>
+    /// Changes the settings
+    /// </summary>
+    /// <param name="params">new settings</param>
+    /// <returns>S_OK on success, E_INVALIDARG for negative weights, no tracked weight or a negative wait</returns>
+    HRESULT                 SetParams(const SkeletonFusionParams& params);
+
+    /// <summary>
+    /// Sets the time to add to a sensor's frame times to bring them onto the fused clock,
+    /// instead of learning it from when frames arrive
+    /// </summary>
+    /// <param name="sensor">sensor index</param>
+    /// <param name="offsetUs">microseconds to add</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a sensor out of range</returns>
+    HRESULT                 SetClockOffset(int sensor, int64_t offsetUs);
+
+    /// <summary>
+    /// Sets where a sensor stands, instead of learning it
+    /// </summary>
+    /// <param name="sensor">sensor index, 1 or more; sensor 0 defines the space</param>
+    /// <param name="pose">map from the sensor's skeleton space into sensor 0's</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a sensor out of range</returns>
+    HRESULT                 SetSensorPose(int sensor, const SkeletonSensorPose& pose);
+
+    /// <summary>
+    /// Takes one frame of a sensor
+    /// </summary>
+    /// <param name="sensor">sensor index</param>
+    /// <param name="frame">frame, copied</param>
+    /// <param name="timeUs">capture time on the sensor's clock</param>
+    /// <param name="arrivalUs">time the frame arrived, on the clock nowUs of Pop is read from</param>
+    /// <returns>S_OK, S_FALSE if the frame came too late to be used, E_INVALIDARG for a sensor out of range</returns>
+    HRESULT                 Push(int sensor, const SkeletonFrame& frame, int64_t timeUs, int64_t arrivalUs);
+
+    /// <summary>
+    /// Gets the next fused frame once every live sensor has caught up with it or it has
+    /// waited maxWaitUs
+    /// </summary>
+    /// <param name="nowUs">current time</param>
+    /// <param name="pFrame">receives the fused frame, in sensor 0's space</param>
+    /// <param name="pTimeUs">receives its capture time on the fused clock</param>
+    /// <param name="pArrivalUs">receives when sensor 0's frame arrived</param>
+    /// <returns>S_OK with a frame, S_FALSE if none is due yet</returns>
+    HRESULT                 Pop(int64_t nowUs, SkeletonFrame* pFrame, int64_t* pTimeUs, int64_t* pArrivalUs);
+
+    /// <summary>
+    /// Gets how long until the oldest waiting frame goes out whatever has arrived
+    /// </summary>
+    /// <param name="nowUs">current time</param>
+    /// <returns>microseconds, 0 if it is due, negative if no frame is waiting</returns>
+    int64_t                 TimeUntilDueUs(int64_t nowUs) const;
+
+    /// <summary>
+    /// Times how long frames of sensor 0 wait in the reorder buffer
+    /// </summary>
+    /// <param name="pTracer">tracer to record LATENCY_STAGE_FUSION in, NULL for none</param>
+    void                    SetLatencyTracer(CLatencyTracer* pTracer) { m_pTracer = pTracer; }
+
+    /// <summary>
+    /// Gets the offset a sensor's frame times are moved onto the fused clock by
+    /// </summary>
+    int64_t                 ClockOffsetUs(int sensor) const { return m_sensors[sensor].clockOffsetUs; }
+
+    /// <summary>
+    /// Checks whether it is known where a sensor stands, so its joints are fused
+    /// </summary>
+    bool                    IsRegistered(int sensor) const { return m_sensors[sensor].bRegistered; }
+
+    /// <summary>
+    /// Gets where a sensor stands
+    /// </summary>
+    const SkeletonSensorPose& SensorPose(int sensor) const { return m_sensors[sensor].pose; }
+
+    /// <summary>
+    /// Gets the number of sensors
+    /// </summary>
+    int                     SensorCount() const { return m_sensorCount; }
+
+    /// <summary>
+    /// Reads what the fusion has done so far
+    /// </summary>
+    /// <param name="pStats">receives the counts</param>
+    void                    GetStats(SkeletonFusionStats* pStats) const { *pStats = m_stats; }
+
+private:
+    /// <summary>
+    /// Frame waiting in a reorder buffer
+    /// </summary>
+    struct Entry
+    {
+        SkeletonFrame       frame;
+        int64_t             timeUs;             // on the sensor's clock
+        int64_t             arrivalUs;
+    };
+
+    /// <summary>
+    /// Joint pairs a sensor's pose is fitted from, as sums
+    /// </summary>
+    struct Correspondence
+    {
+        double              count;
+        double              sumSensor[3];
+        double              sumReference[3];
+        double              sumCross[9];        // sensor x reference
+        double              sumSquares;         // of both
+        int                 frames;
+    };
+
+    /// <summary>
+    /// One sensor's frames, clock and pose
+    /// </summary>
+    struct Sensor
+    {
+        Entry               entries[cSkeletonFusionDepth];     // oldest first
+        int                 count;
+        int64_t             clockOffsetUs;
+        bool                bFixedOffset;
+        bool                bHeard;
+        int64_t             lastArrivalUs;
+        SkeletonSensorPose  pose;
+        bool                bRegistered;
+        Correspondence      correspondence;
+    };
+
+    SkeletonFusionParams    m_params;
+    int                     m_sensorCount;
+    Sensor                  m_sensors[cSkeletonFusionMaxSensors];
+    SkeletonFrame           m_samples[cSkeletonFusionMaxSensors];  // other sensors at the fused instant
+    bool                    m_bHaveSample[cSkeletonFusionMaxSensors];
+    int64_t                 m_lastFusedUs;
+    bool                    m_bFused;
+    SkeletonFusionStats     m_stats;
+    CLatencyTracer*         m_pTracer;
+
+    /// <summary>
+    /// Gets a sensor's frames at an instant, interpolated between the frames either side
+    /// </summary>
+    /// <returns>false if the sensor has no frame near enough</returns>
+    bool                    Sample(int sensor, int64_t timeUs, SkeletonFrame* pSample) const;
+
+    /// <summary>
+    /// Adds the joints of the one drummer sensor 0 and a sensor both track to the sensor's
+    /// pose fit, and fits the pose once there are enough
+    /// </summary>
+    void                    Register(int sensor, const SkeletonFrame& reference, const SkeletonFrame& sample);
+
+    /// <summary>
+    /// Averages the joints of the other sensors' samples into sensor 0's frame
+    /// </summary>
+    void                    Fuse(SkeletonFrame* pFrame);
+};
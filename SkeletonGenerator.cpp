@@ -0,0 +1,323 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonGenerator.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonGenerator.h"
+#include <math.h>
+#include <string.h>
+
+static const float g_Pi = 3.14159265f;
+
+// Body layout in meters. Drummers stand side by side, every other one a step back.
+static const float g_DrummerSpacing  = 0.9f;
+static const float g_DrummerDistance = 2.2f;
+static const float g_DrummerStagger  = 0.25f;
+static const float g_ShoulderHeight  = 0.5f;
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonGenerator::CSkeletonGenerator() :
+    m_params(DefaultParams()),
+    m_timeUs(0),
+    m_frameNumber(0),
+    m_random(1)
+{
+    m_targetCount[0] = 0;
+    m_targetCount[1] = 0;
+    memset(m_hands, 0, sizeof(m_hands));
+}
+
+/// <summary>
+/// Gets the default performance: one drummer at 120 strokes per minute
+/// </summary>
+SkeletonGeneratorParams CSkeletonGenerator::DefaultParams()
+{
+    SkeletonGeneratorParams params;
+    params.skeletonCount = 1;
+    params.tempoBpm = 120.0f;
+    params.noise = 0.0f;
+    params.strokeHeight = 0.3f;
+    params.reach = 1.0f;
+    params.frameUs = 33333;
+    params.seed = 1;
+    return params;
+}
+
+/// <summary>
+/// Lays out the performance. Only zones struck downwards are played.
+/// </summary>
+/// <param name="params">shape of the performance</param>
+/// <param name="zones">zones every drummer plays</param>
+/// <returns>S_OK on success, E_INVALIDARG if the parameters or zones leave nothing to play</returns>
+HRESULT CSkeletonGenerator::Initialize(const SkeletonGeneratorParams& params, const CDrumZoneTable& zones)
+{
+    if (params.skeletonCount < 1 || params.skeletonCount > cSkeletonCount ||
+        params.tempoBpm <= 0.0f || params.frameUs <= 0 || params.reach <= 0.0f)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_params = params;
+    m_timeUs = 0;
+    m_frameNumber = 0;
+    m_random = (0 != params.seed) ? params.seed : 1;
+
+    for (int hand = 0; hand < 2; ++hand)
+    {
+        m_targetCount[hand] = 0;
+        for (int i = 0; i < zones.Count() && m_targetCount[hand] < cMaxTargets; ++i)
+        {
+            if (FindTarget(zones, i, hand, &m_targets[hand][m_targetCount[hand]]))
+            {
+                ++m_targetCount[hand];
+            }
+        }
+
+        if (0 == m_targetCount[hand])
+        {
+            return E_INVALIDARG;
+        }
+    }
+
+    // Hands alternate on the beat; drummers are spread over the beat so they do not play in unison
+    int64_t beatUs = static_cast<int64_t>(60000000.0f / params.tempoBpm);
+    for (int s = 0; s < params.skeletonCount; ++s)
+    {
+        for (int hand = 0; hand < 2; ++hand)
+        {
+            HandState& state = m_hands[s][hand];
+            state.toUs = 500000 + beatUs * s / params.skeletonCount - beatUs * (1 - hand);
+            state.toZone = -1;
+            NextStroke(s, hand);
+            state.from = state.to;
+        }
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Generates the next frame
+/// </summary>
+/// <param name="pFrame">receives the frame</param>
+/// <param name="pHits">receives the strokes that landed since the previous frame</param>
+/// <param name="maxHits">capacity of pHits</param>
+/// <returns>number of strokes written</returns>
+int CSkeletonGenerator::NextFrame(SkeletonFrame* pFrame, SyntheticHit* pHits, int maxHits)
+{
+    m_timeUs += m_params.frameUs;
+
+    memset(pFrame, 0, sizeof(*pFrame));
+    pFrame->timestampMs = m_timeUs / 1000;
+    pFrame->frameNumber = ++m_frameNumber;
+    pFrame->floorClipPlane[1] = 1.0f;
+    pFrame->floorClipPlane[3] = 0.8f;
+
+    int hitCount = 0;
+    for (int s = 0; s < m_params.skeletonCount; ++s)
+    {
+        SkeletonData& skel = pFrame->skeletons[s];
+        skel.trackingState = SKELETON_TRACKED;
+        skel.trackingId = static_cast<uint32_t>(s + 1);
+
+        SkeletonPoint* joints = skel.joints;
+        SkeletonPoint shoulder = Shoulder(s);
+        SkeletonPoint hip = { shoulder.x, shoulder.y - g_ShoulderHeight, shoulder.z };
+
+        joints[SKELETON_JOINT_HIP_CENTER] = hip;
+        joints[SKELETON_JOINT_SPINE] = hip;
+        joints[SKELETON_JOINT_SPINE].y += 0.2f;
+        joints[SKELETON_JOINT_SHOULDER_CENTER] = shoulder;
+        joints[SKELETON_JOINT_HEAD] = shoulder;
+        joints[SKELETON_JOINT_HEAD].y += 0.2f;
+
+        for (int side = 0; side < 2; ++side)
+        {
+            float sign = (0 == side) ? -1.0f : 1.0f;
+            int offset = (0 == side) ? 0 : (SKELETON_JOINT_SHOULDER_RIGHT - SKELETON_JOINT_SHOULDER_LEFT);
+            int legOffset = (0 == side) ? 0 : (SKELETON_JOINT_HIP_RIGHT - SKELETON_JOINT_HIP_LEFT);
+
+            SkeletonPoint hipSide = { hip.x + 0.1f * sign, hip.y - 0.05f, hip.z };
+            joints[SKELETON_JOINT_HIP_LEFT + legOffset] = hipSide;
+            joints[SKELETON_JOINT_KNEE_LEFT + legOffset] = hipSide;
+            joints[SKELETON_JOINT_KNEE_LEFT + legOffset].y -= 0.45f;
+            joints[SKELETON_JOINT_ANKLE_LEFT + legOffset] = hipSide;
+            joints[SKELETON_JOINT_ANKLE_LEFT + legOffset].y -= 0.85f;
+            joints[SKELETON_JOINT_FOOT_LEFT + legOffset] = joints[SKELETON_JOINT_ANKLE_LEFT + legOffset];
+            joints[SKELETON_JOINT_FOOT_LEFT + legOffset].y -= 0.05f;
+            joints[SKELETON_JOINT_FOOT_LEFT + legOffset].z -= 0.08f;
+
+            // Strokes that landed since the last frame are the ground truth
+            HandState& state = m_hands[s][side];
+            while (state.toUs <= m_timeUs)
+            {
+                if (hitCount < maxHits)
+                {
+                    SyntheticHit& hit = pHits[hitCount++];
+                    hit.timeUs = state.toUs;
+                    hit.trackingId = skel.trackingId;
+                    hit.hand = (0 == side) ? DRUM_HAND_LEFT : DRUM_HAND_RIGHT;
+                    hit.zone = state.toZone;
+                }
+
+                NextStroke(s, side);
+            }
+
+            // Glide between strike points while lifting and dropping the hand, so speed
+            // peaks downwards at the strike and reverses right after it
+            float u = static_cast<float>(m_timeUs - state.fromUs) / static_cast<float>(state.toUs - state.fromUs);
+            float glide = u * u * (3.0f - 2.0f * u);
+            SkeletonPoint hand;
+            hand.x = state.from.x + (state.to.x - state.from.x) * glide;
+            hand.y = state.from.y + (state.to.y - state.from.y) * glide + m_params.strokeHeight * sinf(g_Pi * u);
+            hand.z = state.from.z + (state.to.z - state.from.z) * glide;
+
+            SkeletonPoint shoulderSide = { shoulder.x + 0.18f * sign, shoulder.y - 0.03f, shoulder.z };
+            SkeletonPoint elbow = { (shoulderSide.x + hand.x) * 0.5f, (shoulderSide.y + hand.y) * 0.5f - 0.12f, (shoulderSide.z + hand.z) * 0.5f + 0.05f };
+            SkeletonPoint wrist = { hand.x + (elbow.x - hand.x) * 0.1f, hand.y + (elbow.y - hand.y) * 0.1f, hand.z + (elbow.z - hand.z) * 0.1f };
+
+            joints[SKELETON_JOINT_SHOULDER_LEFT + offset] = shoulderSide;
+            joints[SKELETON_JOINT_ELBOW_LEFT + offset] = elbow;
+            joints[SKELETON_JOINT_WRIST_LEFT + offset] = wrist;
+            joints[SKELETON_JOINT_HAND_LEFT + offset] = hand;
+        }
+
+        for (int j = 0; j < cSkeletonJointCount; ++j)
+        {
+            if (m_params.noise > 0.0f)
+            {
+                joints[j].x += Random(-m_params.noise, m_params.noise);
+                joints[j].y += Random(-m_params.noise, m_params.noise);
+                joints[j].z += Random(-m_params.noise, m_params.noise);
+            }
+
+            skel.jointStates[j] = SKELETON_JOINT_TRACKED;
+        }
+
+        skel.position = joints[SKELETON_JOINT_HIP_CENTER];
+    }
+
+    return hitCount;
+}
+
+/// <summary>
+/// Next value of the generator's own random sequence, in lo..hi
+/// </summary>
+float CSkeletonGenerator::Random(float lo, float hi)
+{
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return lo + (hi - lo) * ((m_random & 0xFFFFFF) / 16777216.0f);
+}
+
+/// <summary>
+/// Position of a drummer's shoulder center
+/// </summary>
+SkeletonPoint CSkeletonGenerator::Shoulder(int skeleton) const
+{
+    SkeletonPoint shoulder;
+    shoulder.x = (skeleton - (m_params.skeletonCount - 1) * 0.5f) * g_DrummerSpacing;
+    shoulder.y = g_ShoulderHeight;
+    shoulder.z = g_DrummerDistance + ((skeleton & 1) ? g_DrummerStagger : 0.0f);
+    return shoulder;
+}
+
+/// <summary>
+/// Converts a zone space point to skeleton space for a drummer
+/// </summary>
+SkeletonPoint CSkeletonGenerator::ToSkeleton(int skeleton, const Target& target) const
+{
+    // Zone space is skeleton space around the shoulder, with y and depth turned around
+    SkeletonPoint shoulder = Shoulder(skeleton);
+
+    SkeletonPoint point;
+    point.x = shoulder.x + target.x * m_params.reach;
+    point.y = shoulder.y - target.y * m_params.reach;
+    point.z = shoulder.z - target.depth * m_params.reach;
+    return point;
+}
+
+/// <summary>
+/// Picks the next zone a hand strikes and when
+/// </summary>
+void CSkeletonGenerator::NextStroke(int skeleton, int hand)
+{
+    HandState& state = m_hands[skeleton][hand];
+    int64_t strokeUs = static_cast<int64_t>(2 * 60000000.0f / m_params.tempoBpm);
+
+    int pick = static_cast<int>(Random(0.0f, static_cast<float>(m_targetCount[hand])));
+    const Target& target = m_targets[hand][(pick < m_targetCount[hand]) ? pick : 0];
+
+    state.from = state.to;
+    state.fromUs = state.toUs;
+    state.toUs += strokeUs;
+    state.to = ToSkeleton(skeleton, target);
+    state.toZone = target.zone;
+}
+
+/// <summary>
+/// Finds a point only the given zone contains for the hand, robust to the hand rebounding
+/// </summary>
+bool CSkeletonGenerator::FindTarget(const CDrumZoneTable& zones, int zone, int hand, Target* pTarget) const
+{
+    static const float fractions[] = { 0.5f, 0.4f, 0.6f, 0.3f, 0.7f, 0.2f, 0.8f };
+    static const int fractionCount = sizeof(fractions) / sizeof(fractions[0]);
+
+    DrumZone bounds = zones.GetZone(zone);
+    uint32_t handBit = (0 == hand) ? DRUM_HAND_LEFT : DRUM_HAND_RIGHT;
+    if (0 == (bounds.hands & handBit) || DRUM_MOTION_DOWN != (bounds.motion | DRUM_MOTION_DOWN))
+    {
+        return false;
+    }
+
+    float depth = DrumZoneStrikeDepth(bounds);
+
+    // Strokes are detected a frame or two after landing, with the hand already on its way up
+    float rebound = (bounds.yMax - bounds.yMin) * 0.3f;
+
+    DrumHandInput away = { 1.0e6f, 1.0e6f, 0.0f, DRUM_MOTION_DOWN };
+    for (int fy = 0; fy < fractionCount; ++fy)
+    {
+        for (int fx = 0; fx < fractionCount; ++fx)
+        {
+            DrumHandInput probe;
+            probe.x = bounds.xMin + (bounds.xMax - bounds.xMin) * fractions[fx];
+            probe.y = bounds.yMin + (bounds.yMax - bounds.yMin) * fractions[fy];
+            probe.depth = depth;
+            probe.motion = DRUM_MOTION_DOWN;
+
+            bool unique = true;
+            for (int r = 0; r < 2 && unique; ++r)
+            {
+                DrumHandInput test = probe;
+                test.y -= rebound * r;
+
+                DrumZoneHits hits;
+                zones.HitTestScalar((0 == hand) ? test : away, (0 == hand) ? away : test, &hits);
+
+                DrumZoneMask mask = (0 == hand) ? hits.left : hits.right;
+                unique = mask.Test(zone);
+                mask.Clear(zone);
+                for (int w = 0; w < cDrumZoneMaskWords; ++w)
+                {
+                    unique = unique && (0 == mask.bits[w]);
+                }
+            }
+
+            if (unique)
+            {
+                pTarget->zone = zone;
+                pTarget->x = probe.x;
+                pTarget->y = probe.y;
+                pTarget->depth = depth;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
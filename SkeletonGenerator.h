@@ -0,0 +1,138 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonGenerator.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumZones.h"
+#include "SkeletonFrame.h"
+
+/// <summary>
+/// Shape of the generated performance
+/// </summary>
+struct SkeletonGeneratorParams
+{
+    int                     skeletonCount;      // drummers in front of the sensor, up to cSkeletonCount
+    float                   tempoBpm;           // strokes per minute of each drummer, hands alternate
+    float                   noise;              // meters, uniform jitter added to every joint on every frame
+    float                   strokeHeight;       // meters a hand lifts between two strokes
+    float                   reach;              // drummer's reach against the one the zones are laid out for; strike points scale about the shoulder
+    int64_t                 frameUs;            // sensor frame interval
+    uint32_t                seed;
+};
+
+/// <summary>
+/// Stroke that landed, the ground truth detection is scored against
+/// </summary>
+struct SyntheticHit
+{
+    int64_t                 timeUs;             // instant the hand reached the zone, between frames
+    uint32_t                trackingId;
+    DrumHand                hand;
+    int                     zone;
+};
+
+/// <summary>
+/// Makes up skeleton frames of people drumming, for benchmarks and replays without a sensor.
+/// Each drummer stands still with both hands swinging down from the shoulder onto zones of
+/// the kit, alternating hands on the beat. Strike points are zone space points moved to the
+/// drummer's shoulder, so every stroke lands inside a known zone at a known time.
+/// </summary>
+class CSkeletonGenerator
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonGenerator();
+
+    /// <summary>
+    /// Gets the default performance: one drummer at 120 strokes per minute
+    /// </summary>
+    static SkeletonGeneratorParams DefaultParams();
+
+    /// <summary>
+    /// Lays out the performance. Only zones struck downwards are played.
+    /// </summary>
+    /// <param name="params">shape of the performance</param>
+    /// <param name="zones">zones every drummer plays</param>
+    /// <returns>S_OK on success, E_INVALIDARG if the parameters or zones leave nothing to play</returns>
+    HRESULT                 Initialize(const SkeletonGeneratorParams& params, const CDrumZoneTable& zones);
+
+    /// <summary>
+    /// Generates the next frame
+    /// </summary>
+    /// <param name="pFrame">receives the frame</param>
+    /// <param name="pHits">receives the strokes that landed since the previous frame</param>
+    /// <param name="maxHits">capacity of pHits</param>
+    /// <returns>number of strokes written</returns>
+    int                     NextFrame(SkeletonFrame* pFrame, SyntheticHit* pHits, int maxHits);
+
+    /// <summary>
+    /// Gets the capture time of the latest frame
+    /// </summary>
+    int64_t                 TimeUs() const { return m_timeUs; }
+
+private:
+    static const int        cMaxTargets = 16;
+
+    /// <summary>
+    /// Place a hand strikes, in zone space
+    /// </summary>
+    struct Target
+    {
+        int                 zone;
+        float               x;
+        float               y;
+        float               depth;
+    };
+
+    /// <summary>
+    /// Stroke a hand is moving through
+    /// </summary>
+    struct HandState
+    {
+        int64_t             fromUs;             // previous strike
+        int64_t             toUs;               // next strike
+        SkeletonPoint       from;               // skeleton space strike points
+        SkeletonPoint       to;
+        int                 toZone;
+    };
+
+    SkeletonGeneratorParams m_params;
+    int64_t                 m_timeUs;
+    uint32_t                m_frameNumber;
+    uint32_t                m_random;
+
+    Target                  m_targets[2][cMaxTargets];
+    int                     m_targetCount[2];
+    HandState               m_hands[cSkeletonCount][2];
+
+    /// <summary>
+    /// Next value of the generator's own random sequence, in lo..hi
+    /// </summary>
+    float                   Random(float lo, float hi);
+
+    /// <summary>
+    /// Position of a drummer's shoulder center
+    /// </summary>
+    SkeletonPoint           Shoulder(int skeleton) const;
+
+    /// <summary>
+    /// Converts a zone space point to skeleton space for a drummer
+    /// </summary>
+    SkeletonPoint           ToSkeleton(int skeleton, const Target& target) const;
+
+    /// <summary>
+    /// Picks the next zone a hand strikes and when
+    /// </summary>
+    void                    NextStroke(int skeleton, int hand);
+
+    /// <summary>
+    /// Finds a point only the given zone contains for the hand, robust to the hand rebounding
+    /// </summary>
+    bool                    FindTarget(const CDrumZoneTable& zones, int zone, int hand, Target* pTarget) const;
+};
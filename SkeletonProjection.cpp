@@ -0,0 +1,148 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonProjection.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonProjection.h"
+#include <float.h>
+
+#ifdef DRUM_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+/// <summary>
+/// Projects a skeleton point into the 320x240 depth image. Gives the same result as
+/// NuiTransformSkeletonToDepthImage, so detection does not need the sensor runtime.
+/// </summary>
+/// <param name="point">point in skeleton space</param>
+/// <param name="pDepth">receives the depth image point, all zero for points at or behind the sensor</param>
+void SkeletonToDepthImage(const SkeletonPoint& point, DepthImagePoint* pDepth)
+{
+    if (point.z > FLT_EPSILON)
+    {
+        // Same operations in the same order as the SDK header, so rounding matches
+        pDepth->x = static_cast<int32_t>(cDepthImageWidth / 2 + point.x * (cDepthImageWidth / 320.0f) * cDepthImageFocalLength / point.z + 0.5f);
+        pDepth->y = static_cast<int32_t>(cDepthImageHeight / 2 - point.y * (cDepthImageHeight / 240.0f) * cDepthImageFocalLength / point.z + 0.5f);
+        pDepth->depth = static_cast<uint16_t>(static_cast<uint16_t>(point.z * 1000) << 3);
+    }
+    else
+    {
+        pDepth->x = 0;
+        pDepth->y = 0;
+        pDepth->depth = 0;
+    }
+}
+
+#ifdef DRUM_HAVE_SSE2
+
+/// <summary>
+/// Projects four points given as separate x, y and z lanes
+/// </summary>
+static inline void ProjectFour(__m128 x, __m128 y, __m128 z, __m128 width, __m128 height,
+                               __m128* pScreenX, __m128* pScreenY, __m128i* pDepth)
+{
+    const __m128 focal = _mm_set1_ps(cDepthImageFocalLength);
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    // Points at or behind the sensor project to zero
+    __m128 valid = _mm_cmpgt_ps(z, _mm_set1_ps(FLT_EPSILON));
+
+    // Divide rather than multiply by a reciprocal, so the rounding is the scalar one
+    __m128 imageX = _mm_add_ps(_mm_add_ps(_mm_set1_ps(cDepthImageWidth / 2.0f), _mm_div_ps(_mm_mul_ps(x, focal), z)), half);
+    __m128 imageY = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(cDepthImageHeight / 2.0f), _mm_div_ps(_mm_mul_ps(y, focal), z)), half);
+    __m128i pixelX = _mm_and_si128(_mm_cvttps_epi32(imageX), _mm_castps_si128(valid));
+    __m128i pixelY = _mm_and_si128(_mm_cvttps_epi32(imageY), _mm_castps_si128(valid));
+
+    // Pixel times screen size is exact in float, as is the integer product the scalar code converts
+    *pScreenX = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(pixelX), width), _mm_set1_ps(static_cast<float>(cDepthImageWidth)));
+    *pScreenY = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(pixelY), height), _mm_set1_ps(static_cast<float>(cDepthImageHeight)));
+
+    __m128i millimeters = _mm_cvttps_epi32(_mm_mul_ps(z, _mm_set1_ps(1000.0f)));
+    millimeters = _mm_and_si128(millimeters, _mm_set1_epi32(0xFFFF));
+    *pDepth = _mm_and_si128(_mm_and_si128(_mm_slli_epi32(millimeters, 3), _mm_set1_epi32(0xFFFF)), _mm_castps_si128(valid));
+}
+
+/// <summary>
+/// Projects the joints of one skeleton onto the screen, four joints at a time.
+/// Matches SkeletonToDepthImage scaled to the screen exactly.
+/// </summary>
+/// <param name="skel">skeleton to project</param>
+/// <param name="windowWidth">width (in pixels) of the screen</param>
+/// <param name="windowHeight">height (in pixels) of the screen</param>
+/// <param name="pProjected">receives the projected joints</param>
+void ProjectSkeleton(const SkeletonData& skel, int windowWidth, int windowHeight, ProjectedSkeleton* pProjected)
+{
+    const __m128 width = _mm_set1_ps(static_cast<float>(windowWidth));
+    const __m128 height = _mm_set1_ps(static_cast<float>(windowHeight));
+
+    __m128 screenX, screenY;
+    __m128i depth;
+    int32_t depths[4];
+
+    // Joints are packed x y z, so four of them are three loads that get deinterleaved
+    static_assert(cSkeletonJointCount % 4 == 0, "joints are projected four at a time");
+    static_assert(sizeof(SkeletonPoint) == 3 * sizeof(float), "joints must be packed");
+    const float* pJoint = &skel.joints[0].x;
+    for (int j = 0; j < cSkeletonJointCount; j += 4, pJoint += 12)
+    {
+        __m128 a = _mm_loadu_ps(pJoint);                // x0 y0 z0 x1
+        __m128 b = _mm_loadu_ps(pJoint + 4);            // y1 z1 x2 y2
+        __m128 c = _mm_loadu_ps(pJoint + 8);            // z2 x3 y3 z3
+
+        __m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+        ProjectFour(x, y, z, width, height, &screenX, &screenY, &depth);
+
+        _mm_storeu_ps(&pProjected->x[j], screenX);
+        _mm_storeu_ps(&pProjected->y[j], screenY);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(depths), depth);
+        pProjected->depth[j] = static_cast<uint16_t>(depths[0]);
+        pProjected->depth[j + 1] = static_cast<uint16_t>(depths[1]);
+        pProjected->depth[j + 2] = static_cast<uint16_t>(depths[2]);
+        pProjected->depth[j + 3] = static_cast<uint16_t>(depths[3]);
+    }
+}
+
+#else
+
+/// <summary>
+/// Projects the joints of one skeleton onto the screen, one joint at a time
+/// </summary>
+/// <param name="skel">skeleton to project</param>
+/// <param name="windowWidth">width (in pixels) of the screen</param>
+/// <param name="windowHeight">height (in pixels) of the screen</param>
+/// <param name="pProjected">receives the projected joints</param>
+void ProjectSkeleton(const SkeletonData& skel, int windowWidth, int windowHeight, ProjectedSkeleton* pProjected)
+{
+    for (int joint = 0; joint < cSkeletonJointCount; ++joint)
+    {
+        DepthImagePoint point;
+        SkeletonToDepthImage(skel.joints[joint], &point);
+        pProjected->x[joint] = static_cast<float>(point.x * windowWidth) / cDepthImageWidth;
+        pProjected->y[joint] = static_cast<float>(point.y * windowHeight) / cDepthImageHeight;
+        pProjected->depth[joint] = point.depth;
+    }
+}
+
+#endif
+
+/// <summary>
+/// Projects every tracked skeleton of a frame in one pass
+/// </summary>
+/// <param name="frame">frame to project</param>
+/// <param name="windowWidth">width (in pixels) of the screen</param>
+/// <param name="windowHeight">height (in pixels) of the screen</param>
+/// <param name="pProjected">receives one entry per skeleton slot, untracked slots are left as they are</param>
+void ProjectSkeletons(const SkeletonFrame& frame, int windowWidth, int windowHeight, ProjectedSkeleton* pProjected)
+{
+    for (int i = 0; i < cSkeletonCount; ++i)
+    {
+        if (SKELETON_TRACKED == frame.skeletons[i].trackingState)
+        {
+            ProjectSkeleton(frame.skeletons[i], windowWidth, windowHeight, &pProjected[i]);
+        }
+    }
+}
@@ -0,0 +1,64 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonProjection.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "SkeletonFrame.h"
+
+// Depth image the sensor projects skeletons into, NUI_IMAGE_RESOLUTION_320x240
+static const int   cDepthImageWidth  = 320;
+static const int   cDepthImageHeight = 240;
+
+// NUI_CAMERA_SKELETON_TO_DEPTH_IMAGE_MULTIPLIER_320x240, pixels per meter at one meter
+static const float cDepthImageFocalLength = 285.63f;
+
+/// <summary>
+/// Skeleton point projected into the depth image
+/// </summary>
+struct DepthImagePoint
+{
+    int32_t                 x;
+    int32_t                 y;
+    uint16_t                depth;              // millimeters shifted left by 3, as in depth frames
+};
+
+/// <summary>
+/// Joints of one skeleton on the screen, one array per field
+/// </summary>
+struct ProjectedSkeleton
+{
+    float                   x[cSkeletonJointCount];         // screen pixels
+    float                   y[cSkeletonJointCount];
+    uint16_t                depth[cSkeletonJointCount];     // depth image units
+};
+
+/// <summary>
+/// Projects a skeleton point into the 320x240 depth image. Gives the same result as
+/// NuiTransformSkeletonToDepthImage, so detection does not need the sensor runtime.
+/// </summary>
+/// <param name="point">point in skeleton space</param>
+/// <param name="pDepth">receives the depth image point, all zero for points at or behind the sensor</param>
+void SkeletonToDepthImage(const SkeletonPoint& point, DepthImagePoint* pDepth);
+
+/// <summary>
+/// Projects the joints of one skeleton onto the screen, four joints at a time.
+/// Matches SkeletonToDepthImage scaled to the screen exactly.
+/// </summary>
+/// <param name="skel">skeleton to project</param>
+/// <param name="windowWidth">width (in pixels) of the screen</param>
+/// <param name="windowHeight">height (in pixels) of the screen</param>
+/// <param name="pProjected">receives the projected joints</param>
+void ProjectSkeleton(const SkeletonData& skel, int windowWidth, int windowHeight, ProjectedSkeleton* pProjected);
+
+/// <summary>
+/// Projects every tracked skeleton of a frame in one pass
+/// </summary>
+/// <param name="frame">frame to project</param>
+/// <param name="windowWidth">width (in pixels) of the screen</param>
+/// <param name="windowHeight">height (in pixels) of the screen</param>
+/// <param name="pProjected">receives one entry per skeleton slot, untracked slots are left as they are</param>
+void ProjectSkeletons(const SkeletonFrame& frame, int windowWidth, int windowHeight, ProjectedSkeleton* pProjected);
@@ -0,0 +1,214 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonSources.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonSources.h"
+#include <string.h>
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonReplaySource::CSkeletonReplaySource() :
+    m_nextFrame(0)
+{
+}
+
+/// <summary>
+/// Maps a recording
+/// </summary>
+/// <param name="szPath">recording to open</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonReplaySource::Open(const char* szPath)
+{
+    m_nextFrame = 0;
+    return m_replayer.Open(szPath);
+}
+
+/// <summary>
+/// Gets the next recorded frame
+/// </summary>
+/// <param name="ppFrame">receives the frame, inside the mapping</param>
+/// <param name="pTimeUs">receives the recorded capture time</param>
+/// <returns>S_OK with a frame, S_FALSE once every frame has been read</returns>
+HRESULT CSkeletonReplaySource::Read(const SkeletonFrame** ppFrame, int64_t* pTimeUs)
+{
+    if (!m_replayer.IsOpen())
+    {
+        return E_FAIL;
+    }
+
+    if (m_nextFrame >= m_replayer.FrameCount())
+    {
+        return S_FALSE;
+    }
+
+    const SkeletonFrame* pFrame = m_replayer.Frame(m_nextFrame++);
+    *ppFrame = pFrame;
+    *pTimeUs = pFrame->timestampMs * 1000;
+    return S_OK;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonGeneratorSource::CSkeletonGeneratorSource() :
+    m_frameCount(0),
+    m_nextFrame(0),
+    m_strokeCount(0)
+{
+    memset(&m_frame, 0, sizeof(m_frame));
+}
+
+/// <summary>
+/// Lays out the performance
+/// </summary>
+/// <param name="params">shape of the performance</param>
+/// <param name="zones">zones every drummer plays</param>
+/// <param name="frameCount">frames to generate before the source ends</param>
+/// <returns>S_OK on success, E_INVALIDARG if the parameters or zones leave nothing to play</returns>
+HRESULT CSkeletonGeneratorSource::Initialize(const SkeletonGeneratorParams& params, const CDrumZoneTable& zones, uint64_t frameCount)
+{
+    m_frameCount = frameCount;
+    m_nextFrame = 0;
+    m_strokeCount = 0;
+    return m_generator.Initialize(params, zones);
+}
+
+/// <summary>
+/// Generates the next frame
+/// </summary>
+/// <param name="ppFrame">receives the frame, valid until the next call</param>
+/// <param name="pTimeUs">receives the capture time</param>
+/// <returns>S_OK with a frame, S_FALSE once frameCount frames have been generated</returns>
+HRESULT CSkeletonGeneratorSource::Read(const SkeletonFrame** ppFrame, int64_t* pTimeUs)
+{
+    if (m_nextFrame >= m_frameCount)
+    {
+        return S_FALSE;
+    }
+
+    // At most a stroke per hand per frame, with room for a generous frame interval
+    SyntheticHit hits[2 * cSkeletonCount * 4];
+    m_strokeCount += m_generator.NextFrame(&m_frame, hits, 2 * cSkeletonCount * 4);
+    ++m_nextFrame;
+
+    *ppFrame = &m_frame;
+    *pTimeUs = m_generator.TimeUs();
+    return S_OK;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonFusionSource::CSkeletonFusionSource() :
+    m_sourceCount(0),
+    m_nowUs(0),
+    m_maxWaitUs(0)
+{
+    memset(m_pSources, 0, sizeof(m_pSources));
+    memset(m_clockOffsetsUs, 0, sizeof(m_clockOffsetsUs));
+    memset(m_pPending, 0, sizeof(m_pPending));
+    memset(m_pendingUs, 0, sizeof(m_pendingUs));
+    memset(m_bEnded, 0, sizeof(m_bEnded));
+    memset(&m_frame, 0, sizeof(m_frame));
+}
+
+/// <summary>
+/// Takes the sources to fuse, the first one pacing the fused stream
+/// </summary>
+/// <param name="ppSources">sources, which must outlive this one</param>
+/// <param name="pClockOffsetsUs">microseconds to add to each source's capture times to bring them onto the first one's clock</param>
+/// <param name="sourceCount">1 to cSkeletonFusionMaxSensors</param>
+/// <returns>S_OK on success, E_INVALIDARG for a count out of range</returns>
+HRESULT CSkeletonFusionSource::Initialize(ISkeletonFrameSource* const* ppSources, const int64_t* pClockOffsetsUs, int sourceCount)
+{
+    HRESULT hr = m_fusion.Initialize(sourceCount);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_sourceCount = sourceCount;
+    for (int i = 0; i < sourceCount; ++i)
+    {
+        m_pSources[i] = ppSources[i];
+        m_clockOffsetsUs[i] = pClockOffsetsUs[i];
+        m_pPending[i] = NULL;
+        m_bEnded[i] = false;
+
+        // The offsets are known, so the fusion need not learn them from arrival times
+        m_fusion.SetClockOffset(i, pClockOffsetsUs[i]);
+    }
+
+    m_nowUs = 0;
+    m_maxWaitUs = 0;
+    return S_OK;
+}
+
+/// <summary>
+/// Gets the next fused frame
+/// </summary>
+/// <param name="ppFrame">receives the frame, valid until the next call</param>
+/// <param name="pTimeUs">receives the capture time on the fused clock</param>
+/// <returns>S_OK with a frame, S_FALSE once every source has ended and every frame is out</returns>
+HRESULT CSkeletonFusionSource::Read(const SkeletonFrame** ppFrame, int64_t* pTimeUs)
+{
+    if (0 == m_sourceCount)
+    {
+        return E_FAIL;
+    }
+
+    for (;;)
+    {
+        int64_t arrivalUs = 0;
+        if (S_OK == m_fusion.Pop(m_nowUs, &m_frame, pTimeUs, &arrivalUs))
+        {
+            m_maxWaitUs = (m_nowUs - arrivalUs > m_maxWaitUs) ? m_nowUs - arrivalUs : m_maxWaitUs;
+            *ppFrame = &m_frame;
+            return S_OK;
+        }
+
+        // Every source that has not ended keeps one frame read ahead
+        int next = -1;
+        for (int i = 0; i < m_sourceCount; ++i)
+        {
+            if (NULL == m_pPending[i] && !m_bEnded[i])
+            {
+                int64_t timeUs = 0;
+                HRESULT hr = m_pSources[i]->Read(&m_pPending[i], &timeUs);
+                if (FAILED(hr))
+                {
+                    return hr;
+                }
+
+                m_bEnded[i] = (S_OK != hr);
+                m_pPending[i] = m_bEnded[i] ? NULL : m_pPending[i];
+                m_pendingUs[i] = timeUs + m_clockOffsetsUs[i];
+            }
+
+            if (NULL != m_pPending[i] && (next < 0 || m_pendingUs[i] < m_pendingUs[next]))
+            {
+                next = i;
+            }
+        }
+
+        // Time runs on to whichever comes first: the next frame, or the wait of a held one running out
+        int64_t dueUs = m_fusion.TimeUntilDueUs(m_nowUs);
+        if (dueUs >= 0 && (next < 0 || m_nowUs + dueUs <= m_pendingUs[next]))
+        {
+            m_nowUs += dueUs;
+            continue;
+        }
+
+        if (next < 0)
+        {
+            return S_FALSE;
+        }
+
+        m_nowUs = (m_pendingUs[next] > m_nowUs) ? m_pendingUs[next] : m_nowUs;
+        m_fusion.Push(next, *m_pPending[next], m_pendingUs[next] - m_clockOffsetsUs[next], m_pendingUs[next]);
+        m_pPending[next] = NULL;
+    }
+}
@@ -0,0 +1,146 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonSources.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Frame sources that need no sensor: recordings and generated performances, and
+// the fusion of several recordings as if they came from sensors running together.
+
+#pragma once
+
+#include "DrumEngine.h"
+#include "SkeletonFusion.h"
+#include "SkeletonGenerator.h"
+#include "SkeletonStream.h"
+
+/// <summary>
+/// Reads the frames of a recording, in order, once
+/// </summary>
+class CSkeletonReplaySource : public ISkeletonFrameSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonReplaySource();
+
+    /// <summary>
+    /// Maps a recording
+    /// </summary>
+    /// <param name="szPath">recording to open</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// <summary>
+    /// Gets the next recorded frame
+    /// </summary>
+    /// <param name="ppFrame">receives the frame, inside the mapping</param>
+    /// <param name="pTimeUs">receives the recorded capture time</param>
+    /// <returns>S_OK with a frame, S_FALSE once every frame has been read</returns>
+    virtual HRESULT         Read(const SkeletonFrame** ppFrame, int64_t* pTimeUs);
+
+    /// <summary>
+    /// Gets the recording
+    /// </summary>
+    const CSkeletonReplayer& Replayer() const { return m_replayer; }
+
+private:
+    CSkeletonReplayer       m_replayer;
+    uint64_t                m_nextFrame;
+};
+
+/// <summary>
+/// Generates a performance of a given length
+/// </summary>
+class CSkeletonGeneratorSource : public ISkeletonFrameSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonGeneratorSource();
+
+    /// <summary>
+    /// Lays out the performance
+    /// </summary>
+    /// <param name="params">shape of the performance</param>
+    /// <param name="zones">zones every drummer plays</param>
+    /// <param name="frameCount">frames to generate before the source ends</param>
+    /// <returns>S_OK on success, E_INVALIDARG if the parameters or zones leave nothing to play</returns>
+    HRESULT                 Initialize(const SkeletonGeneratorParams& params, const CDrumZoneTable& zones, uint64_t frameCount);
+
+    /// <summary>
+    /// Generates the next frame
+    /// </summary>
+    /// <param name="ppFrame">receives the frame, valid until the next call</param>
+    /// <param name="pTimeUs">receives the capture time</param>
+    /// <returns>S_OK with a frame, S_FALSE once frameCount frames have been generated</returns>
+    virtual HRESULT         Read(const SkeletonFrame** ppFrame, int64_t* pTimeUs);
+
+    /// <summary>
+    /// Gets the number of strokes that have landed so far, what a perfect detector would have played
+    /// </summary>
+    uint64_t                StrokeCount() const { return m_strokeCount; }
+
+private:
+    CSkeletonGenerator      m_generator;
+    SkeletonFrame           m_frame;
+    uint64_t                m_frameCount;
+    uint64_t                m_nextFrame;
+    uint64_t                m_strokeCount;
+};
+
+/// <summary>
+/// Fuses the frames of several sources, as if each was a sensor whose frames arrive the
+/// moment they are captured. Frames are taken from the sources in the order of their
+/// capture times on the fused clock, and fused frames go out when CSkeletonFusion would
+/// let them go.
+/// </summary>
+class CSkeletonFusionSource : public ISkeletonFrameSource
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonFusionSource();
+
+    /// <summary>
+    /// Takes the sources to fuse, the first one pacing the fused stream
+    /// </summary>
+    /// <param name="ppSources">sources, which must outlive this one</param>
+    /// <param name="pClockOffsetsUs">microseconds to add to each source's capture times to bring them onto the first one's clock</param>
+    /// <param name="sourceCount">1 to cSkeletonFusionMaxSensors</param>
+    /// <returns>S_OK on success, E_INVALIDARG for a count out of range</returns>
+    HRESULT                 Initialize(ISkeletonFrameSource* const* ppSources, const int64_t* pClockOffsetsUs, int sourceCount);
+
+    /// <summary>
+    /// Gets the next fused frame
+    /// </summary>
+    /// <param name="ppFrame">receives the frame, valid until the next call</param>
+    /// <param name="pTimeUs">receives the capture time on the fused clock</param>
+    /// <returns>S_OK with a frame, S_FALSE once every source has ended and every frame is out</returns>
+    virtual HRESULT         Read(const SkeletonFrame** ppFrame, int64_t* pTimeUs);
+
+    /// <summary>
+    /// Gets the fusion, to read its stats or give it a latency tracer
+    /// </summary>
+    CSkeletonFusion&        Fusion() { return m_fusion; }
+
+    /// <summary>
+    /// Gets the longest a fused frame waited for the other sources so far
+    /// </summary>
+    int64_t                 MaxWaitUs() const { return m_maxWaitUs; }
+
+private:
+    ISkeletonFrameSource*   m_pSources[cSkeletonFusionMaxSensors];
+    int64_t                 m_clockOffsetsUs[cSkeletonFusionMaxSensors];
+    const SkeletonFrame*    m_pPending[cSkeletonFusionMaxSensors];     // read, not yet pushed
+    int64_t                 m_pendingUs[cSkeletonFusionMaxSensors];
+    bool                    m_bEnded[cSkeletonFusionMaxSensors];
+    int                     m_sourceCount;
+    CSkeletonFusion         m_fusion;
+    SkeletonFrame           m_frame;
+    int64_t                 m_nowUs;                                    // simulated clock, on the fused clock
+    int64_t                 m_maxWaitUs;
+};
@@ -0,0 +1,313 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonStream.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "SkeletonStream.h"
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char g_SkeletonStreamMagic[8] = { 'K', 'D', 'R', 'U', 'M', 'S', 'K', 'L' };
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonRecorder::CSkeletonRecorder() :
+    m_pFile(NULL)
+{
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CSkeletonRecorder::~CSkeletonRecorder()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates the recording file
+/// </summary>
+/// <param name="szPath">file to create</param>
+/// <param name="flags">cSkeletonStreamFlag values describing the frames</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonRecorder::Open(const char* szPath, uint32_t flags)
+{
+    Close();
+
+    m_pFile = fopen(szPath, "wb");
+    if (NULL == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    // Frames are about 1.7KB, let stdio batch a few dozen per write
+    setvbuf(m_pFile, NULL, _IOFBF, 64 * 1024);
+
+    memcpy(m_header.magic, g_SkeletonStreamMagic, sizeof(m_header.magic));
+    m_header.version = cSkeletonStreamVersion;
+    m_header.headerBytes = sizeof(SkeletonStreamHeader);
+    m_header.frameBytes = sizeof(SkeletonFrame);
+    m_header.flags = flags;
+    m_header.frameCount = 0;
+
+    if (fwrite(&m_header, sizeof(m_header), 1, m_pFile) != 1)
+    {
+        fclose(m_pFile);
+        m_pFile = NULL;
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Appends one frame
+/// </summary>
+/// <param name="frame">frame to record</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CSkeletonRecorder::Write(const SkeletonFrame& frame)
+{
+    if (NULL == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    if (fwrite(&frame, sizeof(frame), 1, m_pFile) != 1)
+    {
+        return E_FAIL;
+    }
+
+    ++m_header.frameCount;
+    return S_OK;
+}
+
+/// <summary>
+/// Writes the final frame count and closes the file
+/// </summary>
+void CSkeletonRecorder::Close()
+{
+    if (NULL == m_pFile)
+    {
+        return;
+    }
+
+    fseek(m_pFile, 0, SEEK_SET);
+    fwrite(&m_header, sizeof(m_header), 1, m_pFile);
+    fclose(m_pFile);
+    m_pFile = NULL;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CSkeletonReplayer::CSkeletonReplayer() :
+    m_pView(NULL),
+    m_viewBytes(0),
+#ifdef _WIN32
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_hMapping(NULL),
+#endif
+    m_pFrames(NULL),
+    m_frameCount(0),
+    m_flags(0),
+    m_nextFrame(0),
+    m_bRealTime(false),
+    m_startUs(0),
+    m_firstTimestampMs(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CSkeletonReplayer::~CSkeletonReplayer()
+{
+    Close();
+}
+
+/// <summary>
+/// Maps a recording and validates its header
+/// </summary>
+/// <param name="szPath">recording to open</param>
+/// <returns>S_OK on success, E_FAIL if it cannot be mapped, its header is wrong, or it was never closed or cut short</returns>
+HRESULT CSkeletonReplayer::Open(const char* szPath)
+{
+    Close();
+
+#ifdef _WIN32
+    m_hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile)
+    {
+        return E_FAIL;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_hFile, &size) || 0 == size.QuadPart)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (NULL == m_hMapping)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    m_pView = MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+    m_viewBytes = static_cast<uint64_t>(size.QuadPart);
+#else
+    int fd = open(szPath, O_RDONLY);
+    if (fd < 0)
+    {
+        return E_FAIL;
+    }
+
+    struct stat info;
+    if (0 != fstat(fd, &info) || 0 == info.st_size)
+    {
+        close(fd);
+        return E_FAIL;
+    }
+
+    void* pView = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED != pView)
+    {
+        madvise(pView, info.st_size, MADV_SEQUENTIAL);
+        m_pView = pView;
+        m_viewBytes = static_cast<uint64_t>(info.st_size);
+    }
+#endif
+
+    if (NULL == m_pView || m_viewBytes < sizeof(SkeletonStreamHeader))
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    const SkeletonStreamHeader* pHeader = static_cast<const SkeletonStreamHeader*>(m_pView);
+    if (0 != memcmp(pHeader->magic, g_SkeletonStreamMagic, sizeof(pHeader->magic)) ||
+        cSkeletonStreamVersion != pHeader->version ||
+        sizeof(SkeletonFrame) != pHeader->frameBytes ||
+        pHeader->headerBytes < sizeof(SkeletonStreamHeader) ||
+        0 != pHeader->headerBytes % 8 ||
+        pHeader->headerBytes > m_viewBytes)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    // A recording that was never closed still has a zero count, and one cut short holds fewer
+    // frames than it counts; neither can be told apart from a damaged file, so both are refused
+    uint64_t framesInFile = (m_viewBytes - pHeader->headerBytes) / pHeader->frameBytes;
+    if ((0 == pHeader->frameCount && framesInFile > 0) || pHeader->frameCount > framesInFile)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    m_frameCount = pHeader->frameCount;
+
+    m_flags = pHeader->flags;
+    m_pFrames = reinterpret_cast<const SkeletonFrame*>(static_cast<const char*>(m_pView) + pHeader->headerBytes);
+
+    Start(0, false);
+    return S_OK;
+}
+
+/// <summary>
+/// Unmaps the recording
+/// </summary>
+void CSkeletonReplayer::Close()
+{
+#ifdef _WIN32
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+
+    if (INVALID_HANDLE_VALUE != m_hFile)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_pView)
+    {
+        munmap(const_cast<void*>(m_pView), m_viewBytes);
+    }
+#endif
+
+    m_pView = NULL;
+    m_viewBytes = 0;
+    m_pFrames = NULL;
+    m_frameCount = 0;
+    m_flags = 0;
+    m_nextFrame = 0;
+}
+
+/// <summary>
+/// Rewinds to the first frame and sets the pacing
+/// </summary>
+/// <param name="nowUs">current time, the first frame is due immediately</param>
+/// <param name="realTime">pace frames by their timestamps instead of as fast as possible</param>
+void CSkeletonReplayer::Start(int64_t nowUs, bool realTime)
+{
+    m_nextFrame = 0;
+    m_bRealTime = realTime;
+    m_startUs = nowUs;
+    m_firstTimestampMs = (m_frameCount > 0) ? m_pFrames[0].timestampMs : 0;
+}
+
+/// <summary>
+/// Gets how long until the next frame is due
+/// </summary>
+/// <param name="nowUs">current time</param>
+/// <returns>microseconds to wait, 0 if a frame is due, negative if the recording has ended</returns>
+int64_t CSkeletonReplayer::TimeUntilNextUs(int64_t nowUs) const
+{
+    if (m_nextFrame >= m_frameCount)
+    {
+        return -1;
+    }
+
+    if (!m_bRealTime)
+    {
+        return 0;
+    }
+
+    int64_t dueUs = m_startUs + (m_pFrames[m_nextFrame].timestampMs - m_firstTimestampMs) * 1000;
+    return (dueUs > nowUs) ? dueUs - nowUs : 0;
+}
+
+/// <summary>
+/// Gets the next frame if it is due
+/// </summary>
+/// <param name="nowUs">current time</param>
+/// <returns>frame inside the mapping, or NULL if none is due or the recording has ended</returns>
+const SkeletonFrame* CSkeletonReplayer::Next(int64_t nowUs)
+{
+    if (0 != TimeUntilNextUs(nowUs))
+    {
+        return NULL;
+    }
+
+    return &m_pFrames[m_nextFrame++];
+}
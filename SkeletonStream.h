@@ -0,0 +1,170 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="SkeletonStream.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Recording and replay of skeleton frames. A recording is a small header
+// followed by raw SkeletonFrame records, little endian.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "SkeletonFrame.h"
+#include <stdio.h>
+
+static const uint32_t cSkeletonStreamVersion = 1;
+
+// Set when frames were smoothed before they were recorded
+static const uint32_t cSkeletonStreamFlagSmoothed = 0x1;
+
+/// <summary>
+/// File header of a skeleton recording
+/// </summary>
+struct SkeletonStreamHeader
+{
+    char                    magic[8];
+    uint32_t                version;
+    uint32_t                headerBytes;
+    uint32_t                frameBytes;
+    uint32_t                flags;
+    uint64_t                frameCount;
+};
+
+static_assert(sizeof(SkeletonStreamHeader) == 32, "SkeletonStreamHeader layout is part of the recording format");
+
+/// <summary>
+/// Appends skeleton frames to a recording
+/// </summary>
+class CSkeletonRecorder
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonRecorder();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CSkeletonRecorder();
+
+    /// <summary>
+    /// Creates the recording file
+    /// </summary>
+    /// <param name="szPath">file to create</param>
+    /// <param name="flags">cSkeletonStreamFlag values describing the frames</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szPath, uint32_t flags);
+
+    /// <summary>
+    /// Appends one frame
+    /// </summary>
+    /// <param name="frame">frame to record</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Write(const SkeletonFrame& frame);
+
+    /// <summary>
+    /// Writes the final frame count and closes the file
+    /// </summary>
+    void                    Close();
+
+    /// <summary>
+    /// Checks whether a recording is in progress
+    /// </summary>
+    bool                    IsOpen() const { return NULL != m_pFile; }
+
+private:
+    FILE*                   m_pFile;
+    SkeletonStreamHeader    m_header;
+};
+
+/// <summary>
+/// Memory maps a recording and hands out frames in place, either paced by the
+/// original timestamps or as fast as they are asked for.
+/// </summary>
+class CSkeletonReplayer
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CSkeletonReplayer();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CSkeletonReplayer();
+
+    /// <summary>
+    /// Maps a recording and validates its header
+    /// </summary>
+    /// <param name="szPath">recording to open</param>
+    /// <returns>S_OK on success, E_FAIL if it cannot be mapped, its header is wrong, or it was never closed or cut short</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// <summary>
+    /// Unmaps the recording
+    /// </summary>
+    void                    Close();
+
+    /// <summary>
+    /// Rewinds to the first frame and sets the pacing
+    /// </summary>
+    /// <param name="nowUs">current time, the first frame is due immediately</param>
+    /// <param name="realTime">pace frames by their timestamps instead of as fast as possible</param>
+    void                    Start(int64_t nowUs, bool realTime);
+
+    /// <summary>
+    /// Gets the next frame if it is due
+    /// </summary>
+    /// <param name="nowUs">current time</param>
+    /// <returns>frame inside the mapping, or NULL if none is due or the recording has ended</returns>
+    const SkeletonFrame*    Next(int64_t nowUs);
+
+    /// <summary>
+    /// Gets how long until the next frame is due
+    /// </summary>
+    /// <param name="nowUs">current time</param>
+    /// <returns>microseconds to wait, 0 if a frame is due, negative if the recording has ended</returns>
+    int64_t                 TimeUntilNextUs(int64_t nowUs) const;
+
+    /// <summary>
+    /// Gets a frame by index
+    /// </summary>
+    /// <param name="index">frame index</param>
+    /// <returns>frame inside the mapping</returns>
+    const SkeletonFrame*    Frame(uint64_t index) const { return m_pFrames + index; }
+
+    /// <summary>
+    /// Gets the number of frames in the recording
+    /// </summary>
+    uint64_t                FrameCount() const { return m_frameCount; }
+
+    /// <summary>
+    /// Gets the cSkeletonStreamFlag values of the recording
+    /// </summary>
+    uint32_t                Flags() const { return m_flags; }
+
+    /// <summary>
+    /// Checks whether a recording is mapped
+    /// </summary>
+    bool                    IsOpen() const { return NULL != m_pFrames; }
+
+private:
+    const void*             m_pView;
+    uint64_t                m_viewBytes;
+#ifdef _WIN32
+    HANDLE                  m_hFile;
+    HANDLE                  m_hMapping;
+#endif
+
+    const SkeletonFrame*    m_pFrames;
+    uint64_t                m_frameCount;
+    uint32_t                m_flags;
+
+    uint64_t                m_nextFrame;
+    bool                    m_bRealTime;
+    int64_t                 m_startUs;
+    int64_t                 m_firstTimestampMs;
+};
@@ -0,0 +1,253 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="StrikeDetector.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "StrikeDetector.h"
+#include <math.h>
+#include <string.h>
+
+// Softest hits still need to be audible
+static const float g_MinHitGain = 0.2f;
+
+// Golden section steps of the landing time search; they narrow two frames to under a microsecond
+static const int   g_StrikeFitIterations = 24;
+static const double g_GoldenRatio = 0.6180339887498949;
+
+/// <summary>
+/// Least squares fit of a bouncing stroke, height = c + a s + b s^2 with s = |t - landing|,
+/// to height samples
+/// </summary>
+/// <param name="t">sample times in milliseconds</param>
+/// <param name="y">sample heights</param>
+/// <param name="count">number of samples</param>
+/// <param name="landing">time of the bounce in milliseconds</param>
+/// <returns>sum of squared residuals, HUGE_VAL if the samples do not pin the fit down</returns>
+static double StrikeFitResidual(const double* t, const double* y, int count, double landing)
+{
+    double s[cStrikeFitSamples];
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0, s4 = 0.0;
+    double y0 = 0.0, y1 = 0.0, y2 = 0.0;
+    for (int i = 0; i < count; ++i)
+    {
+        s[i] = fabs(t[i] - landing);
+        double sq = s[i] * s[i];
+        s0 += 1.0;
+        s1 += s[i];
+        s2 += sq;
+        s3 += sq * s[i];
+        s4 += sq * sq;
+        y0 += y[i];
+        y1 += y[i] * s[i];
+        y2 += y[i] * sq;
+    }
+
+    // Normal equations by Cramer's rule
+    double det = s0 * (s2 * s4 - s3 * s3) - s1 * (s1 * s4 - s3 * s2) + s2 * (s1 * s3 - s2 * s2);
+    if (!(det > 1e-9))
+    {
+        return HUGE_VAL;
+    }
+
+    double c = (y0 * (s2 * s4 - s3 * s3) - s1 * (y1 * s4 - s3 * y2) + s2 * (y1 * s3 - s2 * y2)) / det;
+    double a = (s0 * (y1 * s4 - y2 * s3) - y0 * (s1 * s4 - s3 * s2) + s2 * (s1 * y2 - y1 * s2)) / det;
+    double b = (s0 * (s2 * y2 - s3 * y1) - s1 * (s1 * y2 - s2 * y1) + y0 * (s1 * s3 - s2 * s2)) / det;
+
+    double residual = 0.0;
+    for (int i = 0; i < count; ++i)
+    {
+        double e = y[i] - (c + a * s[i] + b * s[i] * s[i]);
+        residual += e * e;
+    }
+
+    return residual;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CStrikeDetector::CStrikeDetector() :
+    m_params(DefaultParams())
+{
+    Reset();
+}
+
+/// <summary>
+/// Gets the default tuning
+/// </summary>
+StrikeDetectorParams CStrikeDetector::DefaultParams()
+{
+    StrikeDetectorParams params;
+    params.minStrikeSpeed = 0.6f;
+    params.fullStrikeSpeed = 3.0f;
+    params.releaseRatio = 0.7f;
+    params.motionDeadband = 0.1f;
+    return params;
+}
+
+/// <summary>
+/// Forgets the trajectory, e.g. when the hand stops being tracked
+/// </summary>
+void CStrikeDetector::Reset()
+{
+    memset(m_history, 0, sizeof(m_history));
+    memset(&m_motion, 0, sizeof(m_motion));
+    m_head = 0;
+    m_count = 0;
+}
+
+/// <summary>
+/// Adds a position sample and updates the kinematics. Constant time, no allocation.
+/// </summary>
+/// <param name="position">hand position in skeleton space</param>
+/// <param name="timeUs">time the position was captured</param>
+/// <returns>kinematics after this sample</returns>
+const HandMotion& CStrikeDetector::Update(const SkeletonPoint& position, int64_t timeUs)
+{
+    // Repeated or out of order timestamps carry no motion information
+    if (m_count > 0 && timeUs <= History(0).timeUs)
+    {
+        m_motion.struck = false;
+        return m_motion;
+    }
+
+    m_head = (m_head + 1) % cHistoryLength;
+    m_history[m_head].position = position;
+    m_history[m_head].timeUs = timeUs;
+    if (m_count < cHistoryLength)
+    {
+        ++m_count;
+    }
+
+    m_motion.struck = false;
+    if (m_count < 3)
+    {
+        return m_motion;
+    }
+
+    // Velocity over two intervals damps single frame noise
+    const HandSample& newest = History(0);
+    const HandSample& oldest = History(2);
+    float dt = (newest.timeUs - oldest.timeUs) * 1e-6f;
+
+    SkeletonPoint velocity;
+    velocity.x = (newest.position.x - oldest.position.x) / dt;
+    velocity.y = (newest.position.y - oldest.position.y) / dt;
+    velocity.z = (newest.position.z - oldest.position.z) / dt;
+
+    float step = (newest.timeUs - History(1).timeUs) * 1e-6f;
+    m_motion.acceleration.x = (velocity.x - m_motion.velocity.x) / step;
+    m_motion.acceleration.y = (velocity.y - m_motion.velocity.y) / step;
+    m_motion.acceleration.z = (velocity.z - m_motion.velocity.z) / step;
+    m_motion.velocity = velocity;
+    m_motion.downSpeed = -velocity.y;
+
+    // Track the peak of the current downward stroke; it lands when the hand brakes or reverses
+    float strokeSpeed = 0.0f;
+    if (m_motion.downSpeed > m_motion.peakDownSpeed)
+    {
+        m_motion.peakDownSpeed = m_motion.downSpeed;
+    }
+    else if (m_motion.peakDownSpeed >= m_params.minStrikeSpeed &&
+             m_motion.downSpeed < m_motion.peakDownSpeed * m_params.releaseRatio)
+    {
+        m_motion.struck = true;
+        strokeSpeed = m_motion.peakDownSpeed;
+        m_motion.peakDownSpeed = 0.0f;
+
+        // Landing is found once per stroke, not per frame
+        int64_t strikeUs = EstimateStrikeTime();
+        m_motion.strikeUs = (strikeUs < timeUs - cStrikeMaxLateUs) ? timeUs - cStrikeMaxLateUs : strikeUs;
+    }
+    else if (m_motion.downSpeed <= 0.0f)
+    {
+        m_motion.peakDownSpeed = 0.0f;
+    }
+
+    if (!m_motion.struck)
+    {
+        strokeSpeed = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y + velocity.z * velocity.z);
+    }
+
+    float range = m_params.fullStrikeSpeed - m_params.minStrikeSpeed;
+    float hitVelocity = (range > 0.0f) ? (strokeSpeed - m_params.minStrikeSpeed) / range : 1.0f;
+    m_motion.hitVelocity = (hitVelocity < 0.0f) ? 0.0f : (hitVelocity > 1.0f ? 1.0f : hitVelocity);
+
+    return m_motion;
+}
+
+/// <summary>
+/// Solves for when the latest stroke landed, far finer than the sample period. Fits the
+/// last cStrikeFitSamples heights with a hand that comes down, meets the surface and
+/// bounces back off it the way it came, and finds the instant of the bounce.
+/// </summary>
+/// <returns>landing time, the time of the lowest sample while there are too few samples to fit</returns>
+int64_t CStrikeDetector::EstimateStrikeTime() const
+{
+    if (0 == m_count)
+    {
+        return 0;
+    }
+
+    int count = (m_count < cStrikeFitSamples) ? m_count : cStrikeFitSamples;
+    int64_t newestUs = History(0).timeUs;
+
+    double t[cStrikeFitSamples];
+    double y[cStrikeFitSamples];
+    int lowest = 0;
+    for (int age = 0; age < count; ++age)
+    {
+        t[age] = (History(age).timeUs - newestUs) / 1000.0;
+        y[age] = History(age).position.y;
+        if (y[age] < y[lowest])
+        {
+            lowest = age;
+        }
+    }
+
+    if (count < cStrikeFitSamples)
+    {
+        return History(lowest).timeUs;
+    }
+
+    // The bounce lies between the samples either side of the lowest, or before it when the newest is lowest
+    double lo = t[(lowest + 1 < count) ? lowest + 1 : lowest];
+    double hi = t[(lowest > 0) ? lowest - 1 : 0];
+    double inner = hi - g_GoldenRatio * (hi - lo);
+    double outer = lo + g_GoldenRatio * (hi - lo);
+    double innerResidual = StrikeFitResidual(t, y, count, inner);
+    double outerResidual = StrikeFitResidual(t, y, count, outer);
+    for (int i = 0; i < g_StrikeFitIterations; ++i)
+    {
+        if (innerResidual < outerResidual)
+        {
+            hi = outer;
+            outer = inner;
+            outerResidual = innerResidual;
+            inner = hi - g_GoldenRatio * (hi - lo);
+            innerResidual = StrikeFitResidual(t, y, count, inner);
+        }
+        else
+        {
+            lo = inner;
+            inner = outer;
+            innerResidual = outerResidual;
+            outer = lo + g_GoldenRatio * (hi - lo);
+            outerResidual = StrikeFitResidual(t, y, count, outer);
+        }
+    }
+
+    double landingMs = (lo + hi) * 0.5;
+    return newestUs + static_cast<int64_t>(floor(landingMs * 1000.0 + 0.5));
+}
+
+/// <summary>
+/// Maps a hit velocity to a sample gain
+/// </summary>
+/// <param name="hitVelocity">0..1 hit velocity</param>
+/// <returns>linear gain</returns>
+float CStrikeDetector::HitGain(float hitVelocity)
+{
+    return g_MinHitGain + (1.0f - g_MinHitGain) * hitVelocity;
+}
@@ -0,0 +1,133 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="StrikeDetector.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "SkeletonFrame.h"
+
+// Samples the landing time of a stroke is fitted to
+static const int     cStrikeFitSamples = 5;
+
+// Furthest a stroke's landing time lies before the sample it is detected on
+static const int64_t cStrikeMaxLateUs = 100000;
+
+/// <summary>
+/// Tuning of the strike detector. Speeds are in meters per second.
+/// </summary>
+struct StrikeDetectorParams
+{
+    float                   minStrikeSpeed;     // downward speed a stroke must reach to count
+    float                   fullStrikeSpeed;    // downward speed that maps to full hit velocity
+    float                   releaseRatio;       // stroke lands once speed falls below this fraction of its peak
+    float                   motionDeadband;     // sideways speed ignored as jitter
+};
+
+/// <summary>
+/// One hand position sample
+/// </summary>
+struct HandSample
+{
+    SkeletonPoint           position;
+    int64_t                 timeUs;
+};
+
+/// <summary>
+/// Kinematics of a hand after the latest sample
+/// </summary>
+struct HandMotion
+{
+    SkeletonPoint           velocity;           // m/s, skeleton space (y is up)
+    SkeletonPoint           acceleration;       // m/s^2
+    float                   downSpeed;          // -velocity.y
+    float                   peakDownSpeed;      // fastest downward speed of the current stroke
+    bool                    struck;             // a stroke landed on this sample
+    int64_t                 strikeUs;           // when struck: time the stroke landed, between samples
+    float                   hitVelocity;        // 0..1, stroke speed when struck, otherwise current speed
+};
+
+/// <summary>
+/// Finds drum strokes in the trajectory of one hand. Keeps a short ring buffer of
+/// timestamped positions, derives velocity and acceleration from it, and reports a
+/// strike when a fast downward movement peaks and starts to reverse.
+/// </summary>
+class CStrikeDetector
+{
+public:
+    static const int        cHistoryLength = 8;
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CStrikeDetector();
+
+    /// <summary>
+    /// Gets the default tuning
+    /// </summary>
+    static StrikeDetectorParams DefaultParams();
+
+    /// <summary>
+    /// Changes the tuning
+    /// </summary>
+    /// <param name="params">new tuning</param>
+    void                    SetParams(const StrikeDetectorParams& params) { m_params = params; }
+
+    /// <summary>
+    /// Gets the tuning
+    /// </summary>
+    const StrikeDetectorParams& Params() const { return m_params; }
+
+    /// <summary>
+    /// Forgets the trajectory, e.g. when the hand stops being tracked
+    /// </summary>
+    void                    Reset();
+
+    /// <summary>
+    /// Adds a position sample and updates the kinematics. Constant time, no allocation.
+    /// </summary>
+    /// <param name="position">hand position in skeleton space</param>
+    /// <param name="timeUs">time the position was captured</param>
+    /// <returns>kinematics after this sample</returns>
+    const HandMotion&       Update(const SkeletonPoint& position, int64_t timeUs);
+
+    /// <summary>
+    /// Gets the kinematics after the latest sample
+    /// </summary>
+    const HandMotion&       Motion() const { return m_motion; }
+
+    /// <summary>
+    /// Solves for when the latest stroke landed, far finer than the sample period. Fits the
+    /// last cStrikeFitSamples heights with a hand that comes down, meets the surface and
+    /// bounces back off it the way it came, and finds the instant of the bounce.
+    /// </summary>
+    /// <returns>landing time, the time of the lowest sample while there are too few samples to fit</returns>
+    int64_t                 EstimateStrikeTime() const;
+
+    /// <summary>
+    /// Gets the number of samples held
+    /// </summary>
+    int                     HistoryCount() const { return m_count; }
+
+    /// <summary>
+    /// Gets a past sample
+    /// </summary>
+    /// <param name="age">0 for the newest sample, up to HistoryCount() - 1</param>
+    const HandSample&       History(int age) const { return m_history[(m_head - age + cHistoryLength) % cHistoryLength]; }
+
+    /// <summary>
+    /// Maps a hit velocity to a sample gain
+    /// </summary>
+    /// <param name="hitVelocity">0..1 hit velocity</param>
+    /// <returns>linear gain</returns>
+    static float            HitGain(float hitVelocity);
+
+private:
+    StrikeDetectorParams    m_params;
+    HandSample              m_history[cHistoryLength];
+    int                     m_head;
+    int                     m_count;
+    HandMotion              m_motion;
+};
@@ -0,0 +1,91 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="TripleBuffer.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/// <summary>
+/// Hands the newest value from one writer thread to one reader thread without either
+/// ever waiting. The writer fills its own slot and swaps it into the middle; the reader
+/// swaps the middle with its own slot when there is something new. Values the reader
+/// was too slow for are dropped, and a slot is never touched by both threads at once.
+/// </summary>
+/// <typeparam name="T">value type, filled in place</typeparam>
+template <typename T>
+class CTripleBuffer
+{
+    static const uint32_t   cIndexMask = 0x3;
+    static const uint32_t   cFresh     = 0x4;       // middle slot holds a value the reader has not taken
+    static const int        cCacheLine = 64;
+
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CTripleBuffer() :
+        m_back(0),
+        m_front(1)
+    {
+        m_middle.store(2, std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// Gets the slot the writer fills. Only the writer thread may call this.
+    /// </summary>
+    T& WriteBuffer()
+    {
+        return m_slots[m_back];
+    }
+
+    /// <summary>
+    /// Makes the filled slot the newest value and gives the writer a free slot to fill next.
+    /// Only the writer thread may call this.
+    /// </summary>
+    void Publish()
+    {
+        m_back = m_middle.exchange(m_back | cFresh, std::memory_order_acq_rel) & cIndexMask;
+    }
+
+    /// <summary>
+    /// Takes the newest value if one was published since the last call. Only the reader thread may call this.
+    /// </summary>
+    /// <returns>true if ReadBuffer now holds a newer value</returns>
+    bool Acquire()
+    {
+        if (0 == (m_middle.load(std::memory_order_relaxed) & cFresh))
+        {
+            return false;
+        }
+
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & cIndexMask;
+        return true;
+    }
+
+    /// <summary>
+    /// Gets the value taken by the last successful Acquire. Only the reader thread may call this.
+    /// </summary>
+    const T& ReadBuffer() const
+    {
+        return m_slots[m_front];
+    }
+
+private:
+    // The writer and the reader each own one slot and one index, on separate cache lines
+    T                       m_slots[3];
+    char                    m_pad0[cCacheLine];
+    uint32_t                m_back;
+    char                    m_pad1[cCacheLine];
+    std::atomic<uint32_t>   m_middle;
+    char                    m_pad2[cCacheLine];
+    uint32_t                m_front;
+    char                    m_pad3[cCacheLine];
+
+    // Not copyable
+    CTripleBuffer(const CTripleBuffer&);
+    CTripleBuffer& operator=(const CTripleBuffer&);
+};
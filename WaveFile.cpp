@@ -0,0 +1,307 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="WaveFile.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "WaveFile.h"
+#include <string.h>
+
+static const uint16_t cWaveFormatPcm        = 0x0001;
+static const uint16_t cWaveFormatFloat      = 0x0003;
+static const uint16_t cWaveFormatExtensible = 0xFFFE;
+
+static uint16_t ReadLE16(const unsigned char* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t ReadLE32(const unsigned char* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void WriteLE16(unsigned char* p, uint16_t v)
+{
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+}
+
+static void WriteLE32(unsigned char* p, uint32_t v)
+{
+    p[0] = static_cast<unsigned char>(v);
+    p[1] = static_cast<unsigned char>(v >> 8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+}
+
+/// <summary>
+/// Decodes one sample of any supported format to [-1, 1]
+/// </summary>
+static float DecodeSample(const unsigned char* p, uint16_t format, uint16_t bits)
+{
+    if (cWaveFormatFloat == format)
+    {
+        float value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    switch (bits)
+    {
+    case 8:
+        return (static_cast<int>(p[0]) - 128) / 128.0f;
+    case 16:
+        return static_cast<int16_t>(ReadLE16(p)) / 32768.0f;
+    case 24:
+        return static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) |
+                                    (static_cast<uint32_t>(p[2]) << 24)) / 2147483648.0f;
+    case 32:
+        return static_cast<int32_t>(ReadLE32(p)) / 2147483648.0f;
+    }
+
+    return 0.0f;
+}
+
+/// <summary>
+/// Loads a RIFF wave file as interleaved stereo float PCM
+/// </summary>
+/// <param name="szPath">file to load</param>
+/// <param name="sampleRate">rate to convert the audio to</param>
+/// <param name="stereo">receives the interleaved left/right samples</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT LoadWaveFile(const char* szPath, int sampleRate, std::vector<float>& stereo)
+{
+    FILE* pFile = fopen(szPath, "rb");
+    if (NULL == pFile)
+    {
+        return E_FAIL;
+    }
+
+    std::vector<unsigned char> bytes;
+    fseek(pFile, 0, SEEK_END);
+    long size = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+    if (size > 12)
+    {
+        bytes.resize(size);
+        if (fread(&bytes[0], 1, size, pFile) != static_cast<size_t>(size))
+        {
+            bytes.clear();
+        }
+    }
+    fclose(pFile);
+
+    if (bytes.size() < 12 || 0 != memcmp(&bytes[0], "RIFF", 4) || 0 != memcmp(&bytes[8], "WAVE", 4))
+    {
+        return E_FAIL;
+    }
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    const unsigned char* pData = NULL;
+    uint32_t dataBytes = 0;
+
+    // Walk the chunk list looking for the format and the audio data
+    size_t offset = 12;
+    while (offset + 8 <= bytes.size())
+    {
+        const unsigned char* pChunk = &bytes[offset];
+        uint32_t chunkBytes = ReadLE32(pChunk + 4);
+        size_t available = bytes.size() - offset - 8;
+        if (chunkBytes > available)
+        {
+            chunkBytes = static_cast<uint32_t>(available);
+        }
+
+        if (0 == memcmp(pChunk, "fmt ", 4) && chunkBytes >= 16)
+        {
+            format = ReadLE16(pChunk + 8);
+            channels = ReadLE16(pChunk + 10);
+            rate = ReadLE32(pChunk + 12);
+            bits = ReadLE16(pChunk + 22);
+
+            // The real format of an extensible header is the first word of the sub format GUID
+            if (cWaveFormatExtensible == format && chunkBytes >= 26)
+            {
+                format = ReadLE16(pChunk + 32);
+            }
+        }
+        else if (0 == memcmp(pChunk, "data", 4))
+        {
+            pData = pChunk + 8;
+            dataBytes = chunkBytes;
+        }
+
+        // Chunks are word aligned
+        offset += 8 + chunkBytes + (chunkBytes & 1);
+    }
+
+    bool supported = (cWaveFormatPcm == format && (8 == bits || 16 == bits || 24 == bits || 32 == bits)) ||
+                     (cWaveFormatFloat == format && 32 == bits);
+    if (!supported || NULL == pData || 0 == channels || 0 == rate || sampleRate <= 0)
+    {
+        return E_FAIL;
+    }
+
+    uint32_t bytesPerSample = bits / 8;
+    uint32_t sourceFrames = dataBytes / (bytesPerSample * channels);
+    if (0 == sourceFrames)
+    {
+        return E_FAIL;
+    }
+
+    // Decode to stereo at the file's own rate first
+    std::vector<float> source(sourceFrames * 2);
+    for (uint32_t i = 0; i < sourceFrames; ++i)
+    {
+        const unsigned char* pFrame = pData + i * bytesPerSample * channels;
+        float left = DecodeSample(pFrame, format, bits);
+        float right = (channels > 1) ? DecodeSample(pFrame + bytesPerSample, format, bits) : left;
+        source[i * 2] = left;
+        source[i * 2 + 1] = right;
+    }
+
+    if (rate == static_cast<uint32_t>(sampleRate))
+    {
+        stereo.swap(source);
+        return S_OK;
+    }
+
+    // Linear resampling is done once here so the mixer never has to
+    double step = static_cast<double>(rate) / sampleRate;
+    uint32_t targetFrames = static_cast<uint32_t>(sourceFrames / step);
+    stereo.resize(targetFrames * 2);
+    for (uint32_t i = 0; i < targetFrames; ++i)
+    {
+        double position = i * step;
+        uint32_t index = static_cast<uint32_t>(position);
+        uint32_t next = (index + 1 < sourceFrames) ? index + 1 : index;
+        float t = static_cast<float>(position - index);
+        stereo[i * 2] = source[index * 2] + (source[next * 2] - source[index * 2]) * t;
+        stereo[i * 2 + 1] = source[index * 2 + 1] + (source[next * 2 + 1] - source[index * 2 + 1]) * t;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CWaveFileWriter::CWaveFileWriter() :
+    m_pFile(NULL),
+    m_dataBytes(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CWaveFileWriter::~CWaveFileWriter()
+{
+    Close();
+}
+
+/// <summary>
+/// Creates the file and writes a placeholder header
+/// </summary>
+/// <param name="szPath">file to create</param>
+/// <param name="sampleRate">sample rate of the audio</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CWaveFileWriter::Open(const char* szPath, int sampleRate)
+{
+    Close();
+
+    m_pFile = fopen(szPath, "wb");
+    if (NULL == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    const uint16_t channels = 2;
+    const uint16_t bits = 16;
+
+    unsigned char header[44];
+    memcpy(header, "RIFF", 4);
+    WriteLE32(header + 4, 36);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    WriteLE32(header + 16, 16);
+    WriteLE16(header + 20, cWaveFormatPcm);
+    WriteLE16(header + 22, channels);
+    WriteLE32(header + 24, static_cast<uint32_t>(sampleRate));
+    WriteLE32(header + 28, static_cast<uint32_t>(sampleRate) * channels * bits / 8);
+    WriteLE16(header + 32, channels * bits / 8);
+    WriteLE16(header + 34, bits);
+    memcpy(header + 36, "data", 4);
+    WriteLE32(header + 40, 0);
+
+    m_dataBytes = 0;
+    if (fwrite(header, 1, sizeof(header), m_pFile) != sizeof(header))
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Appends interleaved stereo frames
+/// </summary>
+/// <param name="pFrames">left/right sample pairs</param>
+/// <param name="frameCount">number of frames</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CWaveFileWriter::Write(const short* pFrames, int frameCount)
+{
+    if (NULL == m_pFile)
+    {
+        return E_FAIL;
+    }
+
+    // Samples are written as little endian regardless of the host
+    unsigned char buffer[1024];
+    int samples = frameCount * 2;
+    while (samples > 0)
+    {
+        int chunk = samples < 512 ? samples : 512;
+        for (int i = 0; i < chunk; ++i)
+        {
+            WriteLE16(buffer + i * 2, static_cast<uint16_t>(pFrames[i]));
+        }
+
+        if (fwrite(buffer, 2, chunk, m_pFile) != static_cast<size_t>(chunk))
+        {
+            return E_FAIL;
+        }
+
+        m_dataBytes += chunk * 2;
+        pFrames += chunk;
+        samples -= chunk;
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Patches the header sizes and closes the file
+/// </summary>
+void CWaveFileWriter::Close()
+{
+    if (NULL == m_pFile)
+    {
+        return;
+    }
+
+    unsigned char size[4];
+    WriteLE32(size, 36 + m_dataBytes);
+    fseek(m_pFile, 4, SEEK_SET);
+    fwrite(size, 1, 4, m_pFile);
+
+    WriteLE32(size, m_dataBytes);
+    fseek(m_pFile, 40, SEEK_SET);
+    fwrite(size, 1, 4, m_pFile);
+
+    fclose(m_pFile);
+    m_pFile = NULL;
+}
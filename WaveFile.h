@@ -0,0 +1,62 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="WaveFile.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include <stdio.h>
+#include <vector>
+
+/// <summary>
+/// Loads a RIFF wave file as interleaved stereo float PCM
+/// </summary>
+/// <param name="szPath">file to load</param>
+/// <param name="sampleRate">rate to convert the audio to</param>
+/// <param name="stereo">receives the interleaved left/right samples</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT LoadWaveFile(const char* szPath, int sampleRate, std::vector<float>& stereo);
+
+/// <summary>
+/// Writes 16 bit stereo PCM to a RIFF wave file
+/// </summary>
+class CWaveFileWriter
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CWaveFileWriter();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CWaveFileWriter();
+
+    /// <summary>
+    /// Creates the file and writes a placeholder header
+    /// </summary>
+    /// <param name="szPath">file to create</param>
+    /// <param name="sampleRate">sample rate of the audio</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Open(const char* szPath, int sampleRate);
+
+    /// <summary>
+    /// Appends interleaved stereo frames
+    /// </summary>
+    /// <param name="pFrames">left/right sample pairs</param>
+    /// <param name="frameCount">number of frames</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Write(const short* pFrames, int frameCount);
+
+    /// <summary>
+    /// Patches the header sizes and closes the file
+    /// </summary>
+    void                    Close();
+
+private:
+    FILE*                   m_pFile;
+    uint32_t                m_dataBytes;
+};
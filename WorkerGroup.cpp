@@ -0,0 +1,188 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="WorkerGroup.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "WorkerGroup.h"
+#include "DrumTrace.h"
+
+/// <summary>
+/// Constructor
+/// </summary>
+CWorkerGroup::CWorkerGroup() :
+    m_function(NULL),
+    m_pContext(NULL),
+    m_count(0),
+    m_generation(0),
+    m_bStop(false),
+    m_next(0),
+    m_remaining(0)
+{
+}
+
+/// <summary>
+/// Destructor
+/// </summary>
+CWorkerGroup::~CWorkerGroup()
+{
+    Stop();
+}
+
+/// <summary>
+/// Creates the worker threads
+/// </summary>
+/// <param name="threadCount">threads besides the caller of Run, 0 to run everything on the caller</param>
+/// <returns>S_OK on success, otherwise failure code</returns>
+HRESULT CWorkerGroup::Start(int threadCount)
+{
+    if (threadCount < 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    Stop();
+    m_bStop = false;
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        m_threads.push_back(std::thread(&CWorkerGroup::WorkerThread, this));
+    }
+
+    return S_OK;
+}
+
+/// <summary>
+/// Joins the worker threads
+/// </summary>
+void CWorkerGroup::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bStop = true;
+    }
+    m_wake.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i].join();
+    }
+
+    m_threads.clear();
+}
+
+/// <summary>
+/// Calls a function for every index in [0, count) across the group and waits for all of them
+/// </summary>
+/// <param name="function">work for one index</param>
+/// <param name="pContext">passed to every call</param>
+/// <param name="count">number of indices</param>
+void CWorkerGroup::Run(WorkFunction function, void* pContext, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    // A single item is not worth waking anybody for
+    if (1 == count || m_threads.empty())
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            function(pContext, i);
+        }
+
+        return;
+    }
+
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_function = function;
+        m_pContext = pContext;
+        m_count = count;
+        generation = ++m_generation;
+        m_remaining.store(count, std::memory_order_relaxed);
+        m_next.store(static_cast<uint64_t>(generation) << 32, std::memory_order_release);
+    }
+    m_wake.notify_all();
+
+    // The caller works too instead of just waiting
+    RunItems(function, pContext, count, generation);
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (0 != m_remaining.load(std::memory_order_acquire))
+    {
+        m_done.wait(lock);
+    }
+}
+
+/// <summary>
+/// Claims and runs indices of one run until none are left or a later run has replaced it
+/// </summary>
+/// <param name="function">work for one index of the run</param>
+/// <param name="pContext">passed to every call of the run</param>
+/// <param name="count">number of indices in the run</param>
+/// <param name="generation">the run's generation</param>
+void CWorkerGroup::RunItems(WorkFunction function, void* pContext, int count, uint32_t generation)
+{
+    for (;;)
+    {
+        // A worker still looking for work when its run ends must not take an index of the next one,
+        // so a claim only succeeds while the counter is tagged with the claimer's run
+        uint64_t claim = m_next.load(std::memory_order_acquire);
+        do
+        {
+            if (static_cast<uint32_t>(claim >> 32) != generation || static_cast<int>(claim & 0xFFFFFFFF) >= count)
+            {
+                return;
+            }
+        }
+        while (!m_next.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+
+        function(pContext, static_cast<int>(claim & 0xFFFFFFFF));
+
+        if (1 == m_remaining.fetch_sub(1, std::memory_order_acq_rel))
+        {
+            // Taking the lock orders this with the waiter's check of m_remaining
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_done.notify_all();
+        }
+    }
+}
+
+/// <summary>
+/// Body of the worker threads
+/// </summary>
+void CWorkerGroup::WorkerThread()
+{
+    CDrumTraceThreadScope trace;
+    uint32_t seen = 0;
+    WorkFunction function;
+    void* pContext;
+    int count;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            while (!m_bStop && m_generation == seen)
+            {
+                m_wake.wait(lock);
+            }
+
+            if (m_bStop)
+            {
+                return;
+            }
+
+            // This run's work as it was published, in case a later run replaces it while this thread works
+            seen = m_generation;
+            function = m_function;
+            pContext = m_pContext;
+            count = m_count;
+        }
+
+        RunItems(function, pContext, count, seen);
+    }
+}
@@ -0,0 +1,91 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="WorkerGroup.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Small fork-join pool. The threads are created once and sleep between runs;
+/// each run hands out item indices to the workers and the calling thread, and
+/// returns when every item is done.
+/// </summary>
+class CWorkerGroup
+{
+public:
+    typedef void (*WorkFunction)(void* pContext, int index);
+
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CWorkerGroup();
+
+    /// <summary>
+    /// Destructor
+    /// </summary>
+    ~CWorkerGroup();
+
+    /// <summary>
+    /// Creates the worker threads
+    /// </summary>
+    /// <param name="threadCount">threads besides the caller of Run, 0 to run everything on the caller</param>
+    /// <returns>S_OK on success, otherwise failure code</returns>
+    HRESULT                 Start(int threadCount);
+
+    /// <summary>
+    /// Joins the worker threads
+    /// </summary>
+    void                    Stop();
+
+    /// <summary>
+    /// Calls a function for every index in [0, count) across the group and waits for all of them
+    /// </summary>
+    /// <param name="function">work for one index</param>
+    /// <param name="pContext">passed to every call</param>
+    /// <param name="count">number of indices</param>
+    void                    Run(WorkFunction function, void* pContext, int count);
+
+    /// <summary>
+    /// Gets the number of worker threads
+    /// </summary>
+    int                     ThreadCount() const { return static_cast<int>(m_threads.size()); }
+
+private:
+    std::vector<std::thread> m_threads;
+    std::mutex              m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    // Current run, published under m_lock
+    WorkFunction            m_function;
+    void*                   m_pContext;
+    int                     m_count;
+    uint32_t                m_generation;
+    bool                    m_bStop;
+
+    // Next index to claim in the low 32 bits, the run it belongs to in the high 32
+    std::atomic<uint64_t>   m_next;
+    std::atomic<int>        m_remaining;
+
+    /// <summary>
+    /// Claims and runs indices of one run until none are left or a later run has replaced it
+    /// </summary>
+    /// <param name="function">work for one index of the run</param>
+    /// <param name="pContext">passed to every call of the run</param>
+    /// <param name="count">number of indices in the run</param>
+    /// <param name="generation">the run's generation</param>
+    void                    RunItems(WorkFunction function, void* pContext, int count, uint32_t generation);
+
+    /// <summary>
+    /// Body of the worker threads
+    /// </summary>
+    void                    WorkerThread();
+};
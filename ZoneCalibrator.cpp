@@ -0,0 +1,219 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="ZoneCalibrator.cpp" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+#include "ZoneCalibrator.h"
+#include <float.h>
+#include <math.h>
+
+/// <summary>
+/// Fits one zone edge, leaving open edges open
+/// </summary>
+static float FitEdge(float edge, float scale, float offset)
+{
+    return (fabsf(edge) >= FLT_MAX) ? edge : offset + scale * edge;
+}
+
+/// <summary>
+/// Lays out fitted copies of zones. Open edges stay open.
+/// </summary>
+/// <param name="pLayout">zones to fit</param>
+/// <param name="count">number of zones</param>
+/// <param name="fit">scale and offsets</param>
+/// <param name="index">whether to build the spatial index of the fitted zones</param>
+/// <param name="pZones">receives the fitted zones</param>
+void FitDrumZones(const DrumZone* pLayout, int count, const DrumZoneFit& fit, bool index, CDrumZoneTable* pZones)
+{
+    pZones->Clear();
+    for (int i = 0; i < count; ++i)
+    {
+        DrumZone zone = pLayout[i];
+        zone.xMin = FitEdge(zone.xMin, fit.scale, fit.x);
+        zone.xMax = FitEdge(zone.xMax, fit.scale, fit.x);
+        zone.yMin = FitEdge(zone.yMin, fit.scale, fit.y);
+        zone.yMax = FitEdge(zone.yMax, fit.scale, fit.y);
+        zone.depthMin = FitEdge(zone.depthMin, fit.scale, fit.depth);
+        zone.depthMax = FitEdge(zone.depthMax, fit.scale, fit.depth);
+        pZones->AddZone(zone);
+    }
+
+    if (index)
+    {
+        pZones->BuildIndex();
+    }
+}
+
+/// <summary>
+/// Constructor
+/// </summary>
+CZoneCalibrator::CZoneCalibrator() :
+    m_bRunning(false),
+    m_bFitted(false),
+    m_strokes(0),
+    m_layoutCount(0),
+    m_bLayoutIndexed(false),
+    m_layoutVariance(0.0f)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        m_layoutMean[axis] = 0.0f;
+        m_moments[axis].Reset();
+    }
+
+    m_applied.scale = 1.0f;
+    m_applied.x = 0.0f;
+    m_applied.y = 0.0f;
+    m_applied.depth = 0.0f;
+}
+
+/// <summary>
+/// Starts a warm-up for a layout. Its strike points, every zone struck downwards
+/// played equally often by each hand allowed on it, are what the strokes are matched with.
+/// </summary>
+/// <param name="layout">zones to fit, copied</param>
+void CZoneCalibrator::Start(const CDrumZoneTable& layout)
+{
+    m_layoutCount = layout.Count();
+    m_bLayoutIndexed = layout.IsIndexed();
+    for (int i = 0; i < m_layoutCount; ++i)
+    {
+        m_layout[i] = layout.GetZone(i);
+    }
+
+    m_bRunning = true;
+    m_bFitted = false;
+    m_strokes = 0;
+
+    m_applied.scale = 1.0f;
+    m_applied.x = 0.0f;
+    m_applied.y = 0.0f;
+    m_applied.depth = 0.0f;
+
+    // Hands alternate, so each hand weighs half whatever number of zones it plays
+    static const uint32_t handBits[2] = { DRUM_HAND_LEFT, DRUM_HAND_RIGHT };
+    double weight = 0.0;
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    double sumSquares[3] = { 0.0, 0.0, 0.0 };
+    for (int h = 0; h < 2; ++h)
+    {
+        int played = 0;
+        for (int i = 0; i < layout.Count(); ++i)
+        {
+            DrumZone zone = layout.GetZone(i);
+            played += (0 != (zone.hands & handBits[h]) && 0 != (zone.motion & DRUM_MOTION_DOWN)) ? 1 : 0;
+        }
+
+        for (int i = 0; i < layout.Count() && played > 0; ++i)
+        {
+            DrumZone zone = layout.GetZone(i);
+            if (0 == (zone.hands & handBits[h]) || 0 == (zone.motion & DRUM_MOTION_DOWN))
+            {
+                continue;
+            }
+
+            const double point[3] = { (zone.xMin + zone.xMax) * 0.5, (zone.yMin + zone.yMax) * 0.5, DrumZoneStrikeDepth(zone) };
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                sum[axis] += point[axis] / played;
+                sumSquares[axis] += point[axis] * point[axis] / played;
+            }
+        }
+
+        weight += (played > 0) ? 1.0 : 0.0;
+    }
+
+    m_layoutVariance = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        double mean = (weight > 0.0) ? sum[axis] / weight : 0.0;
+        double variance = (weight > 0.0) ? sumSquares[axis] / weight - mean * mean : 0.0;
+        m_layoutMean[axis] = static_cast<float>(mean);
+        m_layoutVariance += static_cast<float>((variance > 0.0) ? variance : 0.0);
+        m_moments[axis].Reset();
+    }
+}
+
+/// <summary>
+/// Takes the hands of one frame. Costs two tests on frames without a stroke;
+/// the zones are only laid out again when the fit has moved.
+/// </summary>
+/// <param name="left">left hand in zone space, DRUM_MOTION_DOWN on the frame its stroke lands</param>
+/// <param name="right">right hand</param>
+/// <param name="pZones">zones to lay out again</param>
+/// <returns>true if the zones were laid out again</returns>
+bool CZoneCalibrator::Update(const DrumHandInput& left, const DrumHandInput& right, CDrumZoneTable* pZones)
+{
+    const bool leftStruck = (0 != (left.motion & DRUM_MOTION_DOWN));
+    const bool rightStruck = (0 != (right.motion & DRUM_MOTION_DOWN));
+    if (!m_bRunning || !(leftStruck || rightStruck))
+    {
+        return false;
+    }
+
+    if (leftStruck)
+    {
+        AddStroke(left);
+    }
+
+    if (rightStruck)
+    {
+        AddStroke(right);
+    }
+
+    if (m_strokes < static_cast<uint32_t>(cZoneCalibrationWarmupStrokes))
+    {
+        return false;
+    }
+
+    // Small moves would lay the zones out again on nearly every stroke
+    DrumZoneFit fit = CurrentFit();
+    if (m_bFitted &&
+        fabsf(fit.scale - m_applied.scale) < cZoneCalibrationScaleStep &&
+        fabsf(fit.x - m_applied.x) < cZoneCalibrationOffsetStep &&
+        fabsf(fit.y - m_applied.y) < cZoneCalibrationOffsetStep &&
+        fabsf(fit.depth - m_applied.depth) < cZoneCalibrationOffsetStep)
+    {
+        return false;
+    }
+
+    m_applied = fit;
+    m_bFitted = true;
+    FitDrumZones(m_layout, m_layoutCount, m_applied, m_bLayoutIndexed, pZones);
+    return true;
+}
+
+/// <summary>
+/// Takes one stroke
+/// </summary>
+void CZoneCalibrator::AddStroke(const DrumHandInput& hand)
+{
+    if (!(fabsf(hand.x) < FLT_MAX && fabsf(hand.y) < FLT_MAX && fabsf(hand.depth) < FLT_MAX))
+    {
+        return;
+    }
+
+    m_moments[0].Add(hand.x, cZoneCalibrationMaxWeight);
+    m_moments[1].Add(hand.y, cZoneCalibrationMaxWeight);
+    m_moments[2].Add(hand.depth, cZoneCalibrationMaxWeight);
+    ++m_strokes;
+}
+
+/// <summary>
+/// Fits the layout to the strokes so far
+/// </summary>
+DrumZoneFit CZoneCalibrator::CurrentFit() const
+{
+    // One scale for all three axes, from the overall spread: arms that reach less do so in every direction
+    float variance = m_moments[0].variance + m_moments[1].variance + m_moments[2].variance;
+    float scale = (m_layoutVariance > 0.0f) ? sqrtf(variance / m_layoutVariance) : 1.0f;
+    scale = (scale > cZoneCalibrationMinScale) ? ((scale < cZoneCalibrationMaxScale) ? scale : cZoneCalibrationMaxScale) : cZoneCalibrationMinScale;
+
+    DrumZoneFit fit;
+    fit.scale = scale;
+    fit.x = m_moments[0].mean - scale * m_layoutMean[0];
+    fit.y = m_moments[1].mean - scale * m_layoutMean[1];
+    fit.depth = m_moments[2].mean - scale * m_layoutMean[2];
+    return fit;
+}
@@ -0,0 +1,153 @@
+﻿//------------------------------------------------------------------------------
+// <copyright file="ZoneCalibrator.h" company="Microsoft">
+//     Copyright (c) Microsoft Corporation.  All rights reserved.
+// </copyright>
+//------------------------------------------------------------------------------
+
+// Fits a kit layout to the drummer in front of the sensor. The default zones are
+// laid out for one reach; a player with shorter arms strikes short of the ride
+// and the toms, one with longer arms past them. The calibrator watches where the
+// player's strokes land, keeps the running mean and variance of the strike points
+// without storing any of them, and scales and moves the layout until its own strike
+// points have the same spread and center.
+
+#pragma once
+
+#include "DrumPlatform.h"
+#include "DrumZones.h"
+
+static const int   cZoneCalibrationWarmupStrokes = 24;     // strokes before the layout is first fitted
+static const float cZoneCalibrationMaxWeight     = 256.0f; // strokes; older ones fade out once this many are in
+static const float cZoneCalibrationMinScale      = 0.5f;
+static const float cZoneCalibrationMaxScale      = 2.0f;
+static const float cZoneCalibrationScaleStep     = 0.01f;  // the zones are laid out again once the fit moves this much
+static const float cZoneCalibrationOffsetStep    = 0.005f; // meters
+
+/// <summary>
+/// Mean and variance of a stream of values, updated one value at a time (Welford).
+/// Once the count reaches its limit it stops growing, and the moments become
+/// exponentially weighted, following the values as they drift.
+/// </summary>
+struct RunningMoments
+{
+    float                   count;
+    float                   mean;
+    float                   variance;           // population variance
+
+    void                    Reset() { count = 0.0f; mean = 0.0f; variance = 0.0f; }
+
+    void                    Add(float value, float maxCount)
+    {
+        if (count < maxCount)
+        {
+            count += 1.0f;
+        }
+
+        float delta = value - mean;
+        mean += delta / count;
+        variance += (delta * (value - mean) - variance) / count;
+    }
+};
+
+/// <summary>
+/// How a layout is fitted to a player: every zone edge e along an axis becomes
+/// offset + scale * e. Scaling about the shoulder follows the arm's reach, the
+/// offsets follow where the player holds the sticks.
+/// </summary>
+struct DrumZoneFit
+{
+    float                   scale;
+    float                   x;
+    float                   y;
+    float                   depth;
+};
+
+/// <summary>
+/// Lays out fitted copies of zones. Open edges stay open.
+/// </summary>
+/// <param name="pLayout">zones to fit</param>
+/// <param name="count">number of zones</param>
+/// <param name="fit">scale and offsets</param>
+/// <param name="index">whether to build the spatial index of the fitted zones</param>
+/// <param name="pZones">receives the fitted zones</param>
+void FitDrumZones(const DrumZone* pLayout, int count, const DrumZoneFit& fit, bool index, CDrumZoneTable* pZones);
+
+/// <summary>
+/// Calibrates one player's zones from the strokes the player plays. Warm-up
+/// asks the player to play around the kit; after it, the layout is fitted and
+/// keeps following the player slowly for as long as the calibrator runs.
+/// </summary>
+class CZoneCalibrator
+{
+public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    CZoneCalibrator();
+
+    /// <summary>
+    /// Starts a warm-up for a layout. Its strike points, every zone struck downwards
+    /// played equally often by each hand allowed on it, are what the strokes are matched with.
+    /// </summary>
+    /// <param name="layout">zones to fit, copied</param>
+    void                    Start(const CDrumZoneTable& layout);
+
+    /// <summary>
+    /// Stops following the player; the zones keep their latest fit
+    /// </summary>
+    void                    Stop() { m_bRunning = false; }
+
+    /// <summary>
+    /// Gets whether strokes are taken
+    /// </summary>
+    bool                    IsRunning() const { return m_bRunning; }
+
+    /// <summary>
+    /// Gets whether the warm-up is over and the zones are fitted
+    /// </summary>
+    bool                    IsFitted() const { return m_bFitted; }
+
+    /// <summary>
+    /// Gets the fit the zones are laid out with
+    /// </summary>
+    const DrumZoneFit&      Fit() const { return m_applied; }
+
+    /// <summary>
+    /// Gets the number of strokes taken since the warm-up started
+    /// </summary>
+    uint32_t                Strokes() const { return m_strokes; }
+
+    /// <summary>
+    /// Takes the hands of one frame. Costs two tests on frames without a stroke;
+    /// the zones are only laid out again when the fit has moved.
+    /// </summary>
+    /// <param name="left">left hand in zone space, DRUM_MOTION_DOWN on the frame its stroke lands</param>
+    /// <param name="right">right hand</param>
+    /// <param name="pZones">zones to lay out again</param>
+    /// <returns>true if the zones were laid out again</returns>
+    bool                    Update(const DrumHandInput& left, const DrumHandInput& right, CDrumZoneTable* pZones);
+
+private:
+    bool                    m_bRunning;
+    bool                    m_bFitted;
+    uint32_t                m_strokes;
+
+    DrumZone                m_layout[cDrumZoneMaxCount];    // kept as zones, not a table, to leave out the index
+    int                     m_layoutCount;
+    bool                    m_bLayoutIndexed;
+    float                   m_layoutMean[3];    // x, y and depth of the layout's strike points
+    float                   m_layoutVariance;   // summed over the three axes
+
+    RunningMoments          m_moments[3];       // x, y and depth of the player's strokes
+    DrumZoneFit             m_applied;
+
+    /// <summary>
+    /// Takes one stroke
+    /// </summary>
+    void                    AddStroke(const DrumHandInput& hand);
+
+    /// <summary>
+    /// Fits the layout to the strokes so far
+    /// </summary>
+    DrumZoneFit             CurrentFit() const;
+};